@@ -78,16 +78,22 @@ const uint8_t axpxx_targetVolParams[] = {
 uint16_t _getRegistH8L5(uint8_t regh8, uint8_t regl5)
 {
   uint8_t hv, lv;
-  axpxx_readByte(regh8, 1, &hv);
-  axpxx_readByte(regl5, 1, &lv);
+  i2c_read_op_t ops[] = {
+    {.reg = regh8, .data = &hv, .len = 1},
+    {.reg = regl5, .data = &lv, .len = 1}
+  };
+  axpxx_readBatch(ops, 2);
   return (hv << 5) | (lv & 0x1F);
 }
 
 uint16_t _getRegistResult(uint8_t regh8, uint8_t regl4)
 {
   uint8_t hv, lv;
-  axpxx_readByte(regh8, 1, &hv);
-  axpxx_readByte(regl4, 1, &lv);
+  i2c_read_op_t ops[] = {
+    {.reg = regh8, .data = &hv, .len = 1},
+    {.reg = regl4, .data = &lv, .len = 1}
+  };
+  axpxx_readBatch(ops, 2);
   return (hv << 4) | (lv & 0x0F);
 }
 
@@ -116,39 +122,48 @@ void axpxx_i2c_init()
 void axpxx_readByte(uint8_t reg, uint8_t nbytes, uint8_t *data)
 {
   esp_err_t espErr;
-  i2c_cmd_handle_t cmd;
 
-  cmd = i2c_cmd_link_create();
+  espErr = twatch_i2c_readBytesPrio(I2C_PRI, I2C_XFER_PRIO_NORMAL, AXP202_I2C_ADDRESS, reg, data, nbytes, 10/portTICK_PERIOD_MS);
+  assert(espErr==ESP_OK);
+}
 
-  i2c_master_start(cmd);
-  i2c_master_write_byte(cmd, (AXP202_I2C_ADDRESS << 1) | I2C_MASTER_WRITE, true);
-  i2c_master_write_byte(cmd, reg, true);
-  i2c_master_start(cmd);
-  i2c_master_write_byte(cmd, (AXP202_I2C_ADDRESS << 1) | I2C_MASTER_READ, true);
-  i2c_master_read_byte(cmd, data , I2C_MASTER_NACK);
-  i2c_master_stop(cmd);
+/**
+ * axpxx_readBatchPrio()
+ *
+ * @brief Read several AXP registers in a single I2C transaction, scheduled
+ *        with a given bus priority.
+ * @param p_ops: array of read operations
+ * @param nb_ops: number of read operations
+ * @param priority: I2C transaction priority
+ **/
 
-  //espErr = i2c_master_cmd_begin(AXP202_I2C_NUM, cmd, 10/portTICK_PERIOD_MS);
-  espErr = twatch_i2c_master_cmd_begin(I2C_PRI, cmd, 10/portTICK_PERIOD_MS);
+void axpxx_readBatchPrio(i2c_read_op_t *p_ops, int nb_ops, i2c_xfer_prio_t priority)
+{
+  esp_err_t espErr;
+
+  espErr = twatch_i2c_readBatchPrio(I2C_PRI, priority, AXP202_I2C_ADDRESS, p_ops, nb_ops, 10/portTICK_PERIOD_MS);
   assert(espErr==ESP_OK);
-  i2c_cmd_link_delete(cmd);
+}
+
+/**
+ * axpxx_readBatch()
+ *
+ * @brief Read several AXP registers in a single I2C transaction.
+ * @param p_ops: array of read operations
+ * @param nb_ops: number of read operations
+ **/
+
+void axpxx_readBatch(i2c_read_op_t *p_ops, int nb_ops)
+{
+  axpxx_readBatchPrio(p_ops, nb_ops, I2C_XFER_PRIO_NORMAL);
 }
 
 void axpxx_writeByte(uint8_t reg, uint8_t nbytes, uint8_t *data)
 {
   esp_err_t espErr;
-  i2c_cmd_handle_t cmd;
-  cmd = i2c_cmd_link_create();
-  i2c_master_start(cmd);
-  i2c_master_write_byte(cmd, (AXP202_I2C_ADDRESS << 1) | I2C_MASTER_WRITE, true);
-  i2c_master_write_byte(cmd, reg, true);
-  //  i2c_master_start(cmd);
-  i2c_master_write_byte(cmd, *data, true);
-  i2c_master_stop(cmd);
-  //espErr = i2c_master_cmd_begin(AXP202_I2C_NUM, cmd, 10/portTICK_PERIOD_MS);
-  espErr = twatch_i2c_master_cmd_begin(I2C_PRI, cmd, 10/portTICK_PERIOD_MS);
+
+  espErr = twatch_i2c_writeBytesPrio(I2C_PRI, I2C_XFER_PRIO_NORMAL, AXP202_I2C_ADDRESS, reg, data, nbytes, 10/portTICK_PERIOD_MS);
   assert(espErr==ESP_OK);
-  i2c_cmd_link_delete(cmd);
 }
 
 // Power Output Control register
@@ -436,6 +451,87 @@ float axpxx_getBattDischargeCurrent()
   return _getRegistH8L5(AXP202_BAT_AVERDISCHGCUR_H8, AXP202_BAT_AVERDISCHGCUR_L5) * AXP202_BATT_DISCHARGE_CUR_STEP;
 }
 
+/**
+ * axpxx_getBattStatus()
+ *
+ * @brief Read battery charge status, gauge, voltage and currents in a single
+ *        I2C transaction (AXP202 only).
+ * @param p_status: pointer to a `axp_batt_status_t` structure
+ * @return AXP_PASS on success, AXP_NOT_INIT or AXP_NOT_SUPPORT otherwise
+ **/
+
+int axpxx_getBattStatus(axp_batt_status_t *p_status)
+{
+  uint8_t chg_status, percentage;
+  uint8_t vol[2], chg_cur[2], dischg_cur[2];
+
+  if (!axpxx_init)
+  return AXP_NOT_INIT;
+  if (axpxx_chip_id != AXP202_CHIP_ID)
+  return AXP_NOT_SUPPORT;
+
+  i2c_read_op_t ops[] = {
+    {.reg = AXP202_MODE_CHGSTATUS, .data = &chg_status, .len = 1},
+    {.reg = AXP202_BATT_PERCENTAGE, .data = &percentage, .len = 1},
+    {.reg = AXP202_BAT_AVERVOL_H8, .data = &vol[0], .len = 1},
+    {.reg = AXP202_BAT_AVERVOL_L4, .data = &vol[1], .len = 1},
+    {.reg = AXP202_BAT_AVERCHGCUR_H8, .data = &chg_cur[0], .len = 1},
+    {.reg = AXP202_BAT_AVERCHGCUR_L4, .data = &chg_cur[1], .len = 1},
+    {.reg = AXP202_BAT_AVERDISCHGCUR_H8, .data = &dischg_cur[0], .len = 1},
+    {.reg = AXP202_BAT_AVERDISCHGCUR_L5, .data = &dischg_cur[1], .len = 1}
+  };
+  axpxx_readBatchPrio(ops, sizeof(ops)/sizeof(i2c_read_op_t), I2C_XFER_PRIO_LOW);
+
+  p_status->charging = IS_OPEN(chg_status, 6);
+  p_status->connected = IS_OPEN(chg_status, 5);
+
+  /* Gauge is not valid when bit 7 is set. */
+  if (!p_status->connected || (percentage & BIT_MASK(7)))
+    p_status->percentage = -1;
+  else
+    p_status->percentage = percentage;
+
+  p_status->voltage = ((vol[0] << 4) | (vol[1] & 0x0F)) * AXP202_BATT_VOLTAGE_STEP;
+  p_status->charge_current = ((chg_cur[0] << 4) | (chg_cur[1] & 0x0F)) * AXP202_BATT_CHARGE_CUR_STEP;
+  p_status->discharge_current = ((dischg_cur[0] << 5) | (dischg_cur[1] & 0x1F)) * AXP202_BATT_DISCHARGE_CUR_STEP;
+
+  return AXP_PASS;
+}
+
+/**
+ * axpxx_getCurrents()
+ *
+ * @brief Read battery charge/discharge currents and VBUS current in a
+ *        single I2C transaction (AXP202 only).
+ * @param p_charge: pointer to battery charge current (mA)
+ * @param p_discharge: pointer to battery discharge current (mA)
+ * @param p_vbus: pointer to VBUS current (mA)
+ * @return AXP_PASS on success, AXP_NOT_INIT or AXP_NOT_SUPPORT otherwise
+ **/
+
+int axpxx_getCurrents(float *p_charge, float *p_discharge, float *p_vbus)
+{
+  uint8_t chg_cur[2], dischg_cur[2], vbus_cur[2];
+
+  if (!axpxx_init)
+  return AXP_NOT_INIT;
+  if (axpxx_chip_id != AXP202_CHIP_ID)
+  return AXP_NOT_SUPPORT;
+
+  i2c_read_op_t ops[] = {
+    {.reg = AXP202_VBUS_CUR_H8, .data = vbus_cur, .len = 2},
+    {.reg = AXP202_BAT_AVERCHGCUR_H8, .data = chg_cur, .len = 2},
+    {.reg = AXP202_BAT_AVERDISCHGCUR_H8, .data = dischg_cur, .len = 2}
+  };
+  axpxx_readBatchPrio(ops, sizeof(ops)/sizeof(i2c_read_op_t), I2C_XFER_PRIO_LOW);
+
+  *p_vbus = ((vbus_cur[0] << 4) | (vbus_cur[1] & 0x0F)) * AXP202_VBUS_CUR_STEP;
+  *p_charge = ((chg_cur[0] << 4) | (chg_cur[1] & 0x0F)) * AXP202_BATT_CHARGE_CUR_STEP;
+  *p_discharge = ((dischg_cur[0] << 5) | (dischg_cur[1] & 0x1F)) * AXP202_BATT_DISCHARGE_CUR_STEP;
+
+  return AXP_PASS;
+}
+
 float axpxx_getSysIPSOUTVoltage()
 {
   if (!axpxx_init)
@@ -467,6 +563,37 @@ uint32_t axpxx_getBattDischargeCoulomb()
   return (buffer[0] << 24) + (buffer[1] << 16) + (buffer[2] << 8) + buffer[3];
 }
 
+/**
+ * axpxx_getCoulombCounters()
+ *
+ * @brief Read both coulomb counters and the ADC sampling rate they depend
+ *        on in a single I2C transaction.
+ * @param p_charge: pointer to charge counter value
+ * @param p_discharge: pointer to discharge counter value
+ * @param p_rate: pointer to ADC sampling rate (Hz)
+ * @return AXP_PASS on success, AXP_NOT_INIT otherwise
+ **/
+
+int axpxx_getCoulombCounters(uint32_t *p_charge, uint32_t *p_discharge, int *p_rate)
+{
+  uint8_t counters[8], speed;
+
+  if (!axpxx_init)
+  return AXP_NOT_INIT;
+
+  i2c_read_op_t ops[] = {
+    {.reg = AXP202_BAT_CHGCOULOMB3, .data = counters, .len = 8},
+    {.reg = AXP202_ADC_SPEED, .data = &speed, .len = 1}
+  };
+  axpxx_readBatchPrio(ops, sizeof(ops)/sizeof(i2c_read_op_t), I2C_XFER_PRIO_LOW);
+
+  *p_charge = ((uint32_t)counters[0] << 24) | ((uint32_t)counters[1] << 16) | ((uint32_t)counters[2] << 8) | counters[3];
+  *p_discharge = ((uint32_t)counters[4] << 24) | ((uint32_t)counters[5] << 16) | ((uint32_t)counters[6] << 8) | counters[7];
+  *p_rate = 25 << ((speed & 0xC0) >> 6);
+
+  return AXP_PASS;
+}
+
 float axpxx_getCoulombData()
 {
   if (!axpxx_init)
@@ -642,6 +769,15 @@ int axpxx_adc1Enable(uint16_t params, bool en)
   return AXP_PASS;
 }
 
+uint8_t axpxx_getAdc1Enable()
+{
+  if (!axpxx_init)
+  return AXP_NOT_INIT;
+  uint8_t val;
+  axpxx_readByte(AXP202_ADC_EN1, 1, &val);
+  return val;
+}
+
 int axpxx_adc2Enable(uint16_t params, bool en)
 {
   if (!axpxx_init)
@@ -723,15 +859,29 @@ int axpxx_readIRQ()
   return AXP_NOT_INIT;
   switch (axpxx_chip_id) {
     case AXP192_CHIP_ID:
-    for (int i = 0; i < 4; ++i) {
-      axpxx_readByte(AXP192_INTSTS1 + i, 1, &axpxx_irq[i]);
+    {
+      i2c_read_op_t ops[5];
+      for (int i = 0; i < 4; ++i) {
+        ops[i].reg = AXP192_INTSTS1 + i;
+        ops[i].data = &axpxx_irq[i];
+        ops[i].len = 1;
+      }
+      ops[4].reg = AXP192_INTSTS5;
+      ops[4].data = &axpxx_irq[4];
+      ops[4].len = 1;
+      axpxx_readBatchPrio(ops, 5, I2C_XFER_PRIO_HIGH);
     }
-    axpxx_readByte(AXP192_INTSTS5, 1, &axpxx_irq[4]);
     return AXP_PASS;
 
     case AXP202_CHIP_ID:
-    for (int i = 0; i < 5; ++i) {
-      axpxx_readByte(AXP202_INTSTS1 + i, 1, &axpxx_irq[i]);
+    {
+      i2c_read_op_t ops[5];
+      for (int i = 0; i < 5; ++i) {
+        ops[i].reg = AXP202_INTSTS1 + i;
+        ops[i].data = &axpxx_irq[i];
+        ops[i].len = 1;
+      }
+      axpxx_readBatchPrio(ops, 5, I2C_XFER_PRIO_HIGH);
     }
     return AXP_PASS;
     default:
@@ -760,6 +910,36 @@ void axpxx_clearIRQ()
   memset(axpxx_irq, 0, sizeof(axpxx_irq));
 }
 
+/**
+ * axpxx_ackIRQ()
+ *
+ * @brief Clear only the IRQ status bits returned by the last call to
+ *        axpxx_readIRQ(), so that events raised in between are kept.
+ **/
+
+void axpxx_ackIRQ()
+{
+  uint8_t reg;
+
+  for (int i = 0; i < 5; i++) {
+    if (axpxx_irq[i] == 0)
+      continue;
+
+    switch (axpxx_chip_id) {
+      case AXP192_CHIP_ID:
+      reg = (i < 4) ? (AXP192_INTSTS1 + i) : AXP192_INTSTS5;
+      break;
+      case AXP202_CHIP_ID:
+      reg = AXP202_INTSTS1 + i;
+      break;
+      default:
+      return;
+    }
+    axpxx_writeByte(reg, 1, &axpxx_irq[i]);
+  }
+  memset(axpxx_irq, 0, sizeof(axpxx_irq));
+}
+
 bool axpxx_isAcinOverVoltageIRQ()
 {
   return (bool)(axpxx_irq[0] & BIT_MASK(7));
@@ -838,6 +1018,21 @@ bool axpxx_isPEKLongtPressIRQ()
   return (bool)(axpxx_irq[2] & BIT_MASK(0));
 }
 
+bool axpxx_isChipOverTemperatureIRQ()
+{
+  return (bool)(axpxx_irq[2] & BIT_MASK(7));
+}
+
+bool axpxx_isApsLowVoltageLevel1IRQ()
+{
+  return (bool)(axpxx_irq[3] & BIT_MASK(1));
+}
+
+bool axpxx_isApsLowVoltageLevel2IRQ()
+{
+  return (bool)(axpxx_irq[3] & BIT_MASK(0));
+}
+
 bool axpxx_isTimerTimeoutIRQ()
 {
   return (bool)(axpxx_irq[4] & BIT_MASK(7));
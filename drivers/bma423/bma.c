@@ -26,7 +26,7 @@ uint16_t _bma_write(uint8_t addr, uint8_t reg, uint8_t *data, uint16_t len);
 
 uint16_t _bma_read(uint8_t addr, uint8_t reg, uint8_t *data, uint16_t len)
 {
-  if (twatch_i2c_readBytes(I2C_PRI, addr, reg, data, len, 1000/portTICK_RATE_MS) == ESP_OK)
+  if (twatch_i2c_readBytesPrio(I2C_PRI, I2C_XFER_PRIO_HIGH, addr, reg, data, len, 1000/portTICK_RATE_MS) == ESP_OK)
     return 0;
   else
     return (1<<13);
@@ -44,7 +44,7 @@ uint16_t _bma_read(uint8_t addr, uint8_t reg, uint8_t *data, uint16_t len)
 
 uint16_t _bma_write(uint8_t addr, uint8_t reg, uint8_t *data, uint16_t len)
 {
-  if (twatch_i2c_writeBytes(I2C_PRI, addr, reg, data, len, 1000/portTICK_RATE_MS) == ESP_OK)
+  if (twatch_i2c_writeBytesPrio(I2C_PRI, I2C_XFER_PRIO_NORMAL, addr, reg, data, len, 1000/portTICK_RATE_MS) == ESP_OK)
     return 0;
   else
     return (1<<13);
@@ -78,6 +78,18 @@ esp_err_t bma_init(void)
   _dev.resolution      = 12;
   _dev.feature_len     = BMA423_FEATURE_SIZE;
 
+  /**
+   * BMA423 stays powered in deep sleep and across resets: if its feature
+   * engine is still initialized, keep its configuration and skip the
+   * reset and the config file upload.
+   **/
+
+  if (bma_is_configured())
+  {
+    if (bma423_init(&_dev) == BMA4_OK)
+      return ESP_OK;
+  }
+
   bma_reset();
 
   _bma_delay(20);
@@ -88,6 +100,13 @@ esp_err_t bma_init(void)
       return ESP_FAIL;
   }
 
+  /* Write device feature config file. */
+  if (bma423_write_config_file(&_dev) != BMA4_OK)
+  {
+    ESP_LOGI(TAG, "bma423_init FAIL: cannot write config file");
+    return ESP_FAIL;
+  }
+
   struct bma4_int_pin_config config ;
   config.edge_ctrl = BMA4_LEVEL_TRIGGER;
   config.lvl = BMA4_ACTIVE_HIGH;
@@ -97,17 +116,28 @@ esp_err_t bma_init(void)
   if (BMA4_OK == bma4_set_int_pin_config(&config, BMA4_INTR1_MAP, &_dev))
     return ESP_OK;
 
-  /* Write device feature config file. */
-  if (bma423_write_config_file(&_dev) != BMA4_OK)
-  {
-    ESP_LOGI(TAG, "bma423_init FAIL: cannot write config file");
-  }
-
   /* Failure. */
   return ESP_FAIL;
 }
 
 
+/**
+ * @brief Determine if BMA423 feature engine is initialized (config file
+ *        has been loaded since power-up).
+ * @retval true if initialized, false otherwise
+ **/
+
+bool bma_is_configured(void)
+{
+  uint8_t status;
+
+  if (_bma_read(BMA4_I2C_ADDR_SECONDARY, BMA4_INTERNAL_STAT, &status, 1) != 0)
+    return false;
+
+  return (status == BMA4_ASIC_INITIALIZED);
+}
+
+
 /**
  * @brief resets BMA423.
  **/
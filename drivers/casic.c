@@ -0,0 +1,211 @@
+#include "drivers/casic.h"
+
+
+/**
+ * casic_checksum()
+ *
+ * @brief Compute the checksum of a CASIC frame
+ * @param msg_class: message class
+ * @param msg_id: message ID
+ * @param p_payload: pointer to payload
+ * @param len: payload length
+ * @return checksum
+ **/
+
+uint32_t casic_checksum(uint8_t msg_class, uint8_t msg_id, uint8_t *p_payload, int len)
+{
+  uint32_t checksum = ((uint32_t)msg_id << 24) + ((uint32_t)msg_class << 16) + len;
+  int i;
+
+  /* Payload is summed as 32-bit little-endian words, zero-padded. */
+  for (i=0; i<len; i++)
+    checksum += (uint32_t)p_payload[i] << (8*(i & 3));
+
+  return checksum;
+}
+
+
+/**
+ * casic_parser_init()
+ *
+ * @brief Initialize a CASIC parser
+ * @param p_parser: pointer to a `casic_parser_t` structure
+ * @param pfn_frame_handler: callback called for each valid frame
+ * @param p_user_data: pointer to user data available to callback
+ **/
+
+void casic_parser_init(casic_parser_t *p_parser, FCasicFrameHandler pfn_frame_handler, void *p_user_data)
+{
+  memset(p_parser, 0, sizeof(casic_parser_t));
+  p_parser->pfn_frame_handler = pfn_frame_handler;
+  p_parser->p_user_data = p_user_data;
+  casic_parser_reset(p_parser);
+}
+
+
+/**
+ * casic_parser_reset()
+ *
+ * @brief Reset parser state, any partial frame is discarded.
+ * @param p_parser: pointer to a `casic_parser_t` structure
+ **/
+
+void casic_parser_reset(casic_parser_t *p_parser)
+{
+  p_parser->state = CASIC_WAIT_SYNC1;
+  p_parser->len = 0;
+  p_parser->pos = 0;
+  p_parser->checksum = 0;
+}
+
+
+/**
+ * casic_parser_busy()
+ *
+ * @brief Tell if a frame is being received
+ * @param p_parser: pointer to a `casic_parser_t` structure
+ * @return true if a frame is in progress, false otherwise
+ **/
+
+bool casic_parser_busy(casic_parser_t *p_parser)
+{
+  return (p_parser->state != CASIC_WAIT_SYNC1);
+}
+
+
+/**
+ * casic_parser_push()
+ *
+ * @brief Feed a single byte into the parser.
+ * @param p_parser: pointer to a `casic_parser_t` structure
+ * @param byte: received byte
+ **/
+
+void casic_parser_push(casic_parser_t *p_parser, uint8_t byte)
+{
+  switch (p_parser->state)
+  {
+    case CASIC_WAIT_SYNC1:
+      {
+        if (byte == CASIC_SYNC1)
+          p_parser->state = CASIC_WAIT_SYNC2;
+      }
+      break;
+
+    case CASIC_WAIT_SYNC2:
+      {
+        if (byte == CASIC_SYNC2)
+          p_parser->state = CASIC_LEN_LO;
+        else
+        {
+          p_parser->nb_framing_errors++;
+          casic_parser_reset(p_parser);
+        }
+      }
+      break;
+
+    case CASIC_LEN_LO:
+      {
+        p_parser->len = byte;
+        p_parser->state = CASIC_LEN_HI;
+      }
+      break;
+
+    case CASIC_LEN_HI:
+      {
+        p_parser->len |= (uint16_t)byte << 8;
+        if (p_parser->len > CASIC_MAX_PAYLOAD)
+        {
+          /* Too big for us, drop it. */
+          p_parser->nb_framing_errors++;
+          casic_parser_reset(p_parser);
+        }
+        else
+          p_parser->state = CASIC_CLASS;
+      }
+      break;
+
+    case CASIC_CLASS:
+      {
+        p_parser->msg_class = byte;
+        p_parser->state = CASIC_ID;
+      }
+      break;
+
+    case CASIC_ID:
+      {
+        p_parser->msg_id = byte;
+        p_parser->pos = 0;
+        p_parser->state = (p_parser->len > 0) ? CASIC_PAYLOAD : CASIC_CHECKSUM;
+      }
+      break;
+
+    case CASIC_PAYLOAD:
+      {
+        p_parser->payload[p_parser->pos++] = byte;
+        if (p_parser->pos == p_parser->len)
+        {
+          p_parser->pos = 0;
+          p_parser->state = CASIC_CHECKSUM;
+        }
+      }
+      break;
+
+    case CASIC_CHECKSUM:
+      {
+        p_parser->checksum |= (uint32_t)byte << (8*p_parser->pos++);
+        if (p_parser->pos < CASIC_CHECKSUM_LEN)
+          break;
+
+        if (p_parser->checksum == casic_checksum(p_parser->msg_class, p_parser->msg_id, p_parser->payload, p_parser->len))
+        {
+          p_parser->nb_frames++;
+          if (p_parser->pfn_frame_handler != NULL)
+            p_parser->pfn_frame_handler(p_parser, p_parser->msg_class, p_parser->msg_id, p_parser->payload, p_parser->len);
+        }
+        else
+          p_parser->nb_checksum_errors++;
+
+        casic_parser_reset(p_parser);
+      }
+      break;
+  }
+}
+
+
+/**
+ * casic_build_frame()
+ *
+ * @brief Build a CASIC frame
+ * @param p_frame: pointer to output buffer
+ * @param size: output buffer size
+ * @param msg_class: message class
+ * @param msg_id: message ID
+ * @param p_payload: pointer to payload
+ * @param len: payload length
+ * @return frame length, -1 if output buffer is too small
+ **/
+
+int casic_build_frame(uint8_t *p_frame, int size, uint8_t msg_class, uint8_t msg_id, uint8_t *p_payload, int len)
+{
+  uint32_t checksum;
+
+  if (size < (CASIC_HEADER_LEN + len + CASIC_CHECKSUM_LEN))
+    return -1;
+
+  p_frame[0] = CASIC_SYNC1;
+  p_frame[1] = CASIC_SYNC2;
+  p_frame[2] = len & 0xff;
+  p_frame[3] = (len >> 8) & 0xff;
+  p_frame[4] = msg_class;
+  p_frame[5] = msg_id;
+  memcpy(&p_frame[CASIC_HEADER_LEN], p_payload, len);
+
+  checksum = casic_checksum(msg_class, msg_id, p_payload, len);
+  p_frame[CASIC_HEADER_LEN + len] = checksum & 0xff;
+  p_frame[CASIC_HEADER_LEN + len + 1] = (checksum >> 8) & 0xff;
+  p_frame[CASIC_HEADER_LEN + len + 2] = (checksum >> 16) & 0xff;
+  p_frame[CASIC_HEADER_LEN + len + 3] = (checksum >> 24) & 0xff;
+
+  return CASIC_HEADER_LEN + len + CASIC_CHECKSUM_LEN;
+}
@@ -45,8 +45,9 @@
 
 esp_err_t read_register8(uint8_t reg, uint8_t *p_value)
 {
-  return twatch_i2c_readBytes(
+  return twatch_i2c_readBytesPrio(
     I2C_PRI,
+    I2C_XFER_PRIO_NORMAL,
     DRV2605_ADDR,
     reg,
     p_value,
@@ -67,8 +68,9 @@ esp_err_t read_register8(uint8_t reg, uint8_t *p_value)
 
 esp_err_t write_register8(uint8_t reg, uint8_t value)
 {
-  return twatch_i2c_writeBytes(
+  return twatch_i2c_writeBytesPrio(
     I2C_PRI,
+    I2C_XFER_PRIO_NORMAL,
     DRV2605_ADDR,
     reg,
     &value,
@@ -148,6 +150,40 @@ esp_err_t drv2605_set_waveform(uint8_t slot, uint8_t w)
 }
 
 
+/**
+ * drv2605_set_sequence()
+ * 
+ * @brief Load the whole waveform sequencer in a single I2C transaction.
+ *        Unused slots are filled with DRV2605_WAVESEQ_END.
+ * @param p_slots: pointer to slot values (effects or waits)
+ * @param count: number of slot values (0-8)
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t drv2605_set_sequence(const uint8_t *p_slots, int count)
+{
+  uint8_t slots[DRV2605_WAVESEQ_SLOTS];
+
+  if ((count < 0) || (count > DRV2605_WAVESEQ_SLOTS))
+    return ESP_FAIL;
+
+  memset(slots, DRV2605_WAVESEQ_END, sizeof(slots));
+  if (count > 0)
+    memcpy(slots, p_slots, count);
+
+  /* DRV2605L auto-increments register address on multi-byte writes. */
+  return twatch_i2c_writeBytesPrio(
+    I2C_PRI,
+    I2C_XFER_PRIO_NORMAL,
+    DRV2605_ADDR,
+    DRV2605_REG_WAVESEQ1,
+    slots,
+    DRV2605_WAVESEQ_SLOTS,
+    1000/portTICK_RATE_MS
+  );
+}
+
+
 /**
  * drv2605_select_library()
  * 
@@ -14,6 +14,9 @@ FT6X36_IRQ_HANDLER ft6236_irq_handler = NULL;
  *
  * Called when the screen is touched, and notify a waiting call to
  * ft6x36_read_touch_data() that it should fetch the report.
+ *
+ * IRQ is level-triggered and stays masked until the report has been
+ * read and ft6x36_ack_irq() is called.
  **/
 
 void IRAM_ATTR _touch_interrupt_handler(void *parameter)
@@ -21,11 +24,25 @@ void IRAM_ATTR _touch_interrupt_handler(void *parameter)
   /* Forward to our IRQ Handler. */
   if (ft6236_irq_handler != NULL)
   {
+    gpio_intr_disable(FT6236_IRQ_GPIO);
+
     /* Call our callback with the read touch points. */
     ft6236_irq_handler();
   }
 }
 
+
+/**
+ * ft6x36_ack_irq()
+ *
+ * Unmask touch IRQ once the pending report has been read.
+ **/
+
+void ft6x36_ack_irq(void)
+{
+  gpio_intr_enable(FT6236_IRQ_GPIO);
+}
+
 /**
  * ft6x06_i2c_read8()
  *
@@ -38,55 +55,16 @@ void IRAM_ATTR _touch_interrupt_handler(void *parameter)
  **/
 
 esp_err_t ft6x06_i2c_read8(uint8_t slave_addr, uint8_t register_addr, uint8_t *data_buf) {
-    i2c_cmd_handle_t i2c_cmd = i2c_cmd_link_create();
-
-    i2c_master_start(i2c_cmd);
-    i2c_master_write_byte(i2c_cmd, (slave_addr << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(i2c_cmd, register_addr, I2C_MASTER_ACK);
-
-    i2c_master_start(i2c_cmd);
-    i2c_master_write_byte(i2c_cmd, (slave_addr << 1) | I2C_MASTER_READ, true);
-
-    i2c_master_read_byte(i2c_cmd, data_buf, I2C_MASTER_NACK);
-    i2c_master_stop(i2c_cmd);
-    esp_err_t ret = twatch_i2c_master_cmd_begin(I2C_SEC, i2c_cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(i2c_cmd);
-    return ret;
+    return twatch_i2c_readBytes(I2C_SEC, slave_addr, register_addr, data_buf, 1, 1000 / portTICK_RATE_MS);
 }
 
 esp_err_t ft6x06_i2c_read(uint8_t slave_addr, uint8_t register_addr, uint8_t *data_buf, int length) {
-    i2c_cmd_handle_t i2c_cmd = i2c_cmd_link_create();
-
-    i2c_master_start(i2c_cmd);
-    i2c_master_write_byte(i2c_cmd, (slave_addr << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(i2c_cmd, register_addr, I2C_MASTER_ACK);
-
-    i2c_master_start(i2c_cmd);
-    i2c_master_write_byte(i2c_cmd, (slave_addr << 1) | I2C_MASTER_READ, true);
-
-    if (length > 1)
-    {
-        i2c_master_read(i2c_cmd, data_buf, length-1, I2C_MASTER_ACK);
-    }
-    i2c_master_read_byte(i2c_cmd, data_buf+length-1, I2C_MASTER_NACK);
-    i2c_master_stop(i2c_cmd);
-    esp_err_t ret = twatch_i2c_master_cmd_begin(I2C_SEC, i2c_cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(i2c_cmd);
-    return ret;
+    return twatch_i2c_readBytes(I2C_SEC, slave_addr, register_addr, data_buf, length, 1000 / portTICK_RATE_MS);
 }
 
 
 esp_err_t ft6x06_i2c_write8(uint8_t slave_addr, uint8_t register_addr, uint8_t data_buf) {
-    i2c_cmd_handle_t i2c_cmd = i2c_cmd_link_create();
-
-    i2c_master_start(i2c_cmd);
-    i2c_master_write_byte(i2c_cmd, (slave_addr << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(i2c_cmd, register_addr, I2C_MASTER_ACK);
-    i2c_master_write_byte(i2c_cmd, data_buf, I2C_MASTER_ACK);
-    i2c_master_stop(i2c_cmd);
-    esp_err_t ret = twatch_i2c_master_cmd_begin(I2C_SEC, i2c_cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(i2c_cmd);
-    return ret;
+    return twatch_i2c_writeBytes(I2C_SEC, slave_addr, register_addr, &data_buf, 1, 1000 / portTICK_RATE_MS);
 }
 
 /**
@@ -98,8 +76,8 @@ void ft6x36_init(uint16_t dev_addr, FT6X36_IRQ_HANDLER pfn_handler) {
   gpio_config_t irq_conf;
 
   /* Initialize FT6x36 IRQ pin as input pin. */
-  irq_conf.intr_type = GPIO_INTR_NEGEDGE;
-  irq_conf.pin_bit_mask = (1ULL << 38);
+  irq_conf.intr_type = GPIO_INTR_LOW_LEVEL;
+  irq_conf.pin_bit_mask = (1ULL << FT6236_IRQ_GPIO);
   irq_conf.mode = GPIO_MODE_INPUT;
   irq_conf.pull_down_en = 0;
   irq_conf.pull_up_en = 1;
@@ -108,7 +86,7 @@ void ft6x36_init(uint16_t dev_addr, FT6X36_IRQ_HANDLER pfn_handler) {
   /* Install our user button interrupt handler. */
   if (gpio_install_isr_service(0) != ESP_OK)
     printf("[isr2] Error while installing service\r\n");
-  gpio_isr_handler_add(GPIO_NUM_38, _touch_interrupt_handler, NULL);
+  gpio_isr_handler_add(FT6236_IRQ_GPIO, _touch_interrupt_handler, NULL);
 
   /* Save IRQ Handler. */
   ft6236_irq_handler = pfn_handler;
@@ -155,6 +133,18 @@ bool ft6x36_read(ft6236_touch_t *touch) {
   /* Read report (optimized, report read in one I2C transaction). */
   ft6x06_i2c_read(current_dev_addr, FT6X36_DEV_MODE_REG, report, FT6X36_REPORT_SIZE);
 
+  return ft6x36_parse_report(report, touch);
+}
+
+
+/**
+ * @brief Parse a raw touch report
+ * @param report: FT6X36_REPORT_SIZE bytes read from FT6X36_DEV_MODE_REG
+ * @param touch: pointer to a `ft6236_touch_t` structure to fill
+ * @retval true if report contains a touch or a gesture, false otherwise
+ **/
+
+bool ft6x36_parse_report(uint8_t *report, ft6236_touch_t *touch) {
   /* Copy gesture id. */
   touch->gest_id = report[FT6X36_GEST_ID_REG];
 
@@ -233,6 +223,45 @@ esp_err_t ft6x36_set_active_period(uint8_t period)
   return ft6x06_i2c_write8(current_dev_addr, FT6X36_PERIOD_ACTIVE_REG, period);
 }
 
+
+/**
+ * @brief Set report period used in monitor mode
+ * @param period: monitor period (chip units, higher is slower)
+ * @retval ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t ft6x36_set_monitor_period(uint8_t period)
+{
+  return ft6x06_i2c_write8(current_dev_addr, FT6X36_PERIOD_MONITOR_REG, period);
+}
+
+
+/**
+ * @brief Set the delay without touch before switching to monitor mode
+ * @param seconds: delay in seconds
+ * @retval ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t ft6x36_set_monitor_timeout(uint8_t seconds)
+{
+  return ft6x06_i2c_write8(current_dev_addr, FT6X36_TIME_ENTER_MONITOR_REG, seconds);
+}
+
+
+/**
+ * @brief Put the controller in hibernate mode
+ *
+ * The controller does not report touches anymore and can only be woken up
+ * through a hardware reset.
+ *
+ * @retval ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t ft6x36_hibernate(void)
+{
+  return ft6x06_i2c_write8(current_dev_addr, FT6X36_POWER_MODE_REG, FT6X36_POWER_MODE_HIBERNATE);
+}
+
 esp_err_t ft6x36_set_max_offset_move_lr(uint8_t offset)
 {
   return ft6x06_i2c_write8(current_dev_addr, FT6X36_OFFSET_LEFT_RIGHT_REG, offset);
@@ -1,12 +1,34 @@
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "driver/gpio.h"
 #include "driver/i2c.h"
+#include "esp_timer.h"
 #include "drivers/i2c.h"
 
 static bool i2c_bus_init = false;
 volatile SemaphoreHandle_t i2c_sems[2];
 
+/* Preallocated command links, one per bus (protected by the bus mutex). */
+static uint8_t i2c_link_buffers[2][I2C_LINK_BUFFER_SIZE];
+
+/* Asynchronous transactions: one queue per priority level and per bus. */
+static QueueHandle_t i2c_xfer_queues[2][I2C_XFER_PRIO_MAX];
+static TaskHandle_t i2c_xfer_tasks[2];
+
+static void twatch_i2c_xfer_worker(void *pvParameters);
+
+#ifdef CONFIG_TWATCH_I2C_TELEMETRY
+  /* Bus statistics, only updated while holding the bus mutex. */
+  static i2c_bus_stats_t i2c_stats[2];
+  static int64_t i2c_stats_since[2];
+
+  /* Latency histogram bucket upper bounds (us). */
+  static const uint32_t i2c_stats_buckets[I2C_STATS_LATENCY_BUCKETS-1] = {
+    50, 100, 200, 500, 1000, 2000, 5000
+  };
+#endif
+
 /**
  * twatch_i2c_init()
  *
@@ -51,6 +73,179 @@ void twatch_i2c_init(void)
   assert(res == ESP_OK);
   res = i2c_driver_install(I2C_NUM_1, I2C_MODE_MASTER, 0, 0, 0);
   assert(res == ESP_OK);
+
+  #ifdef CONFIG_TWATCH_I2C_TELEMETRY
+    i2c_stats_since[I2C_PRI] = esp_timer_get_time();
+    i2c_stats_since[I2C_SEC] = i2c_stats_since[I2C_PRI];
+  #endif
+
+  /* Create asynchronous transaction queues and one worker per bus. */
+  for (int bus=I2C_PRI; bus<=I2C_SEC; bus++)
+  {
+    for (int prio=0; prio<I2C_XFER_PRIO_MAX; prio++)
+    {
+      i2c_xfer_queues[bus][prio] = xQueueCreate(I2C_XFER_QUEUE_SIZE, sizeof(i2c_xfer_t *));
+      assert(i2c_xfer_queues[bus][prio] != NULL);
+    }
+
+    xTaskCreate(
+      twatch_i2c_xfer_worker,
+      (bus == I2C_PRI)?"i2c_pri_xfer":"i2c_sec_xfer",
+      I2C_XFER_TASK_STACK,
+      (void *)(intptr_t)bus,
+      I2C_XFER_TASK_PRIORITY,
+      &i2c_xfer_tasks[bus]
+    );
+    assert(i2c_xfer_tasks[bus] != NULL);
+  }
+}
+
+
+#ifdef CONFIG_TWATCH_I2C_TELEMETRY
+
+/**
+ * twatch_i2c_stats_record()
+ *
+ * @brief Account a transaction in bus statistics. Bus mutex must be held.
+ * @param bus: I2C bus
+ * @param addr: device address, I2C_STATS_ADDR_UNKNOWN if unknown
+ * @param nb_bytes: number of payload bytes transferred
+ * @param result: transaction result
+ * @param latency_us: transaction duration in microseconds
+ **/
+
+static void twatch_i2c_stats_record(
+  i2c_bus_t bus,
+  uint8_t addr,
+  uint32_t nb_bytes,
+  esp_err_t result,
+  uint32_t latency_us
+)
+{
+  int i, bucket;
+  i2c_bus_stats_t *p_stats = &i2c_stats[bus];
+  i2c_dev_stats_t *p_dev = NULL;
+
+  /* Find histogram bucket. */
+  for (bucket=0; bucket<(I2C_STATS_LATENCY_BUCKETS-1); bucket++)
+  {
+    if (latency_us < i2c_stats_buckets[bucket])
+      break;
+  }
+
+  /* Bus totals. */
+  p_stats->nb_xfers++;
+  p_stats->busy_us += latency_us;
+  if (result == ESP_OK)
+    p_stats->nb_bytes += nb_bytes;
+  else if (result == ESP_ERR_TIMEOUT)
+    p_stats->nb_timeouts++;
+  else
+    p_stats->nb_errors++;
+
+  /* Find or allocate device entry. */
+  for (i=0; i<p_stats->nb_devices; i++)
+  {
+    if (p_stats->devices[i].addr == addr)
+    {
+      p_dev = &p_stats->devices[i];
+      break;
+    }
+  }
+  if ((p_dev == NULL) && (p_stats->nb_devices < I2C_STATS_MAX_DEVICES))
+  {
+    p_dev = &p_stats->devices[p_stats->nb_devices++];
+    p_dev->addr = addr;
+  }
+
+  /* Device table full, only bus totals are updated. */
+  if (p_dev == NULL)
+    return;
+
+  p_dev->nb_xfers++;
+  p_dev->latency_hist[bucket]++;
+  if (latency_us > p_dev->max_latency_us)
+    p_dev->max_latency_us = latency_us;
+  if (result == ESP_OK)
+    p_dev->nb_bytes += nb_bytes;
+  else if (result == ESP_ERR_TIMEOUT)
+    p_dev->nb_timeouts++;
+  else
+    p_dev->nb_errors++;
+}
+
+#endif
+
+
+/**
+ * twatch_i2c_lock()
+ *
+ * @brief Take bus mutex, and account for the time spent waiting for it.
+ * @param bus: I2C bus
+ * @return true on success, false otherwise
+ **/
+
+static bool twatch_i2c_lock(i2c_bus_t bus)
+{
+  #ifdef CONFIG_TWATCH_I2C_TELEMETRY
+    uint32_t wait_us;
+    int64_t start = esp_timer_get_time();
+  #endif
+
+  if (xSemaphoreTakeRecursive(i2c_sems[bus], portMAX_DELAY) != pdTRUE)
+    return false;
+
+  #ifdef CONFIG_TWATCH_I2C_TELEMETRY
+    wait_us = (uint32_t)(esp_timer_get_time() - start);
+    i2c_stats[bus].lock_wait_us += wait_us;
+    if (wait_us > i2c_stats[bus].max_lock_wait_us)
+      i2c_stats[bus].max_lock_wait_us = wait_us;
+  #endif
+
+  /* Success. */
+  return true;
+}
+
+
+/**
+ * twatch_i2c_exec()
+ *
+ * @brief Execute a prepared command on a bus. Bus mutex must be held.
+ * @param bus: I2C bus
+ * @param addr: device address (telemetry only)
+ * @param cmd: I2C command
+ * @param nb_bytes: number of payload bytes (telemetry only)
+ * @param ticks_to_wait: transaction timeout
+ * @return transaction result
+ **/
+
+static esp_err_t twatch_i2c_exec(
+  i2c_bus_t bus,
+  uint8_t addr,
+  i2c_cmd_handle_t cmd,
+  uint32_t nb_bytes,
+  TickType_t ticks_to_wait
+)
+{
+  esp_err_t result;
+
+  #ifdef CONFIG_TWATCH_I2C_TELEMETRY
+    int64_t start = esp_timer_get_time();
+  #endif
+
+  result = i2c_master_cmd_begin((bus==I2C_PRI)?I2C_NUM_0:I2C_NUM_1, cmd, ticks_to_wait);
+
+  #ifdef CONFIG_TWATCH_I2C_TELEMETRY
+    twatch_i2c_stats_record(
+      bus,
+      addr,
+      nb_bytes,
+      result,
+      (uint32_t)(esp_timer_get_time() - start)
+    );
+  #endif
+
+  return result;
 }
 
 
@@ -68,9 +263,9 @@ esp_err_t twatch_i2c_master_cmd_begin(i2c_bus_t bus, i2c_cmd_handle_t cmd, TickT
   /* Send command to the right I2C bus. */
   if ((bus == I2C_PRI) || (bus == I2C_SEC))
   {
-    if (xSemaphoreTakeRecursive(i2c_sems[bus], portMAX_DELAY) == pdTRUE)
+    if (twatch_i2c_lock(bus))
     {
-      result = i2c_master_cmd_begin((bus==I2C_PRI)?I2C_NUM_0:I2C_NUM_1, cmd, ticks_to_wait);
+      result = twatch_i2c_exec(bus, I2C_STATS_ADDR_UNKNOWN, cmd, 0, ticks_to_wait);
       xSemaphoreGiveRecursive(i2c_sems[bus]);
     }
     else
@@ -83,6 +278,19 @@ esp_err_t twatch_i2c_master_cmd_begin(i2c_bus_t bus, i2c_cmd_handle_t cmd, TickT
     return ESP_FAIL;
 }
 
+/**
+ * twatch_i2c_writeBytes()
+ *
+ * @brief Write bytes to a device register.
+ * @param bus: I2C bus
+ * @param addr: device address
+ * @param reg: register address
+ * @param data: pointer to the bytes to write
+ * @param len: number of bytes to write
+ * @param ticks_to_wait: transaction timeout
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
 esp_err_t twatch_i2c_writeBytes(
   i2c_bus_t bus,
   uint8_t addr,
@@ -92,51 +300,133 @@ esp_err_t twatch_i2c_writeBytes(
   TickType_t ticks_to_wait
 )
 {
-  int i;
   esp_err_t result;
+  i2c_cmd_handle_t i2c_cmd;
 
-  /* Prepare I2C command. */
-  i2c_cmd_handle_t i2c_cmd = i2c_cmd_link_create();
+  if ((bus != I2C_PRI) && (bus != I2C_SEC))
+    return ESP_FAIL;
+
+  if (!twatch_i2c_lock(bus))
+    return ESP_FAIL;
+
+  /* Prepare I2C command in the bus static link buffer. */
+  i2c_cmd = i2c_cmd_link_create_static(i2c_link_buffers[bus], I2C_LINK_BUFFER_SIZE);
+  if (i2c_cmd == NULL)
+  {
+    xSemaphoreGiveRecursive(i2c_sems[bus]);
+    return ESP_FAIL;
+  }
 
   i2c_master_start(i2c_cmd);
   i2c_master_write_byte(i2c_cmd, (addr << 1) | I2C_MASTER_WRITE, true);
   i2c_master_write_byte(i2c_cmd, reg, I2C_MASTER_ACK);
-  for (i=0; i<len; i++)
-    i2c_master_write_byte(i2c_cmd, data[i], I2C_MASTER_ACK);
+  if (len > 0)
+    i2c_master_write(i2c_cmd, data, len, I2C_MASTER_ACK);
   i2c_master_stop(i2c_cmd);
 
   /* Send command to the right I2C bus. */
-  if ((bus == I2C_PRI) || (bus == I2C_SEC))
-  {
-    if (xSemaphoreTakeRecursive(i2c_sems[bus], portMAX_DELAY) == pdTRUE)
-    {
-      result = i2c_master_cmd_begin((bus==I2C_PRI)?I2C_NUM_0:I2C_NUM_1, i2c_cmd, ticks_to_wait);
-      xSemaphoreGiveRecursive(i2c_sems[bus]);
-    }
-    else
-      result = ESP_FAIL;
+  result = twatch_i2c_exec(bus, addr, i2c_cmd, len, ticks_to_wait);
+  i2c_cmd_link_delete_static(i2c_cmd);
+  xSemaphoreGiveRecursive(i2c_sems[bus]);
 
-    #if 0
-    for (int j=0; j<len; j++)
-    {
-      printf("%02x ", data[j]);
-    }
-    printf("\r\n");
-    #endif
+  /* Return result. */
+  return result;
+}
 
-    i2c_cmd_link_delete(i2c_cmd);
 
-    /* Return result. */
-    return result;
+/**
+ * twatch_i2c_readBatch()
+ *
+ * @brief Read several registers of a device in a single transaction.
+ *
+ * Bus is locked once, and every read operation is chained with a repeated
+ * START, followed by a single STOP.
+ *
+ * @param bus: I2C bus
+ * @param addr: device address
+ * @param p_ops: array of read operations
+ * @param nb_ops: number of read operations (up to I2C_BATCH_MAX_OPS)
+ * @param ticks_to_wait: transaction timeout
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_i2c_readBatch(
+  i2c_bus_t bus,
+  uint8_t addr,
+  i2c_read_op_t *p_ops,
+  int nb_ops,
+  TickType_t ticks_to_wait
+)
+{
+  int i;
+  uint32_t nb_bytes = 0;
+  esp_err_t result;
+  i2c_cmd_handle_t i2c_cmd;
+
+  if ((bus != I2C_PRI) && (bus != I2C_SEC))
+    return ESP_FAIL;
+
+  if ((nb_ops <= 0) || (nb_ops > I2C_BATCH_MAX_OPS))
+    return ESP_FAIL;
+
+  for (i=0; i<nb_ops; i++)
+  {
+    if (p_ops[i].len == 0)
+      return ESP_FAIL;
+    nb_bytes += p_ops[i].len;
   }
-  else
+
+  if (!twatch_i2c_lock(bus))
+    return ESP_FAIL;
+
+  /* Prepare I2C command in the bus static link buffer. */
+  i2c_cmd = i2c_cmd_link_create_static(i2c_link_buffers[bus], I2C_LINK_BUFFER_SIZE);
+  if (i2c_cmd == NULL)
   {
-    i2c_cmd_link_delete(i2c_cmd);
+    xSemaphoreGiveRecursive(i2c_sems[bus]);
     return ESP_FAIL;
   }
+
+  for (i=0; i<nb_ops; i++)
+  {
+    i2c_master_start(i2c_cmd);
+    i2c_master_write_byte(i2c_cmd, (addr << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write_byte(i2c_cmd, p_ops[i].reg, I2C_MASTER_ACK);
+
+    i2c_master_start(i2c_cmd);
+    i2c_master_write_byte(i2c_cmd, (addr << 1) | I2C_MASTER_READ, true);
+
+    if (p_ops[i].len > 1)
+    {
+      i2c_master_read(i2c_cmd, p_ops[i].data, p_ops[i].len-1, I2C_MASTER_ACK);
+    }
+    i2c_master_read_byte(i2c_cmd, p_ops[i].data+p_ops[i].len-1, I2C_MASTER_NACK);
+  }
+  i2c_master_stop(i2c_cmd);
+
+  /* Send command to the right I2C bus. */
+  result = twatch_i2c_exec(bus, addr, i2c_cmd, nb_bytes, ticks_to_wait);
+  i2c_cmd_link_delete_static(i2c_cmd);
+  xSemaphoreGiveRecursive(i2c_sems[bus]);
+
+  /* Return result. */
+  return result;
 }
 
 
+/**
+ * twatch_i2c_readBytes()
+ *
+ * @brief Read bytes from a device register.
+ * @param bus: I2C bus
+ * @param addr: device address
+ * @param reg: register address
+ * @param data: pointer to a buffer to store the read bytes
+ * @param len: number of bytes to read
+ * @param ticks_to_wait: transaction timeout
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
 esp_err_t twatch_i2c_readBytes(
   i2c_bus_t bus,
   uint8_t addr,
@@ -146,44 +436,418 @@ esp_err_t twatch_i2c_readBytes(
   TickType_t ticks_to_wait
 )
 {
-  esp_err_t result;
+  i2c_read_op_t op = {
+    .reg = reg,
+    .data = data,
+    .len = len
+  };
 
-  /* Prepare I2C command. */
-  i2c_cmd_handle_t i2c_cmd = i2c_cmd_link_create();
+  return twatch_i2c_readBatch(bus, addr, &op, 1, ticks_to_wait);
+}
 
-  i2c_master_start(i2c_cmd);
-  i2c_master_write_byte(i2c_cmd, (addr << 1) | I2C_MASTER_WRITE, true);
-  i2c_master_write_byte(i2c_cmd, reg, I2C_MASTER_ACK);
 
-  i2c_master_start(i2c_cmd);
-  i2c_master_write_byte(i2c_cmd, (addr << 1) | I2C_MASTER_READ, true);
 
-  if (len > 1)
-  {
-      i2c_master_read(i2c_cmd, data, len-1, I2C_MASTER_ACK);
-  }
-  i2c_master_read_byte(i2c_cmd, data+len-1, I2C_MASTER_NACK);
-  i2c_master_stop(i2c_cmd);
+/**
+ * twatch_i2c_get_stats()
+ *
+ * @brief Get a snapshot of a bus statistics.
+ * @param bus: I2C bus
+ * @param p_stats: pointer to a `i2c_bus_stats_t` structure
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if telemetry is disabled,
+ *         ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_i2c_get_stats(i2c_bus_t bus, i2c_bus_stats_t *p_stats)
+{
+  #ifdef CONFIG_TWATCH_I2C_TELEMETRY
+    if ((bus != I2C_PRI) && (bus != I2C_SEC))
+      return ESP_FAIL;
+
+    if (xSemaphoreTakeRecursive(i2c_sems[bus], portMAX_DELAY) != pdTRUE)
+      return ESP_FAIL;
+
+    memcpy(p_stats, &i2c_stats[bus], sizeof(i2c_bus_stats_t));
+    p_stats->elapsed_us = esp_timer_get_time() - i2c_stats_since[bus];
+    xSemaphoreGiveRecursive(i2c_sems[bus]);
+
+    /* Compute bus occupancy. */
+    if (p_stats->elapsed_us > 0)
+      p_stats->busy_percent = (uint8_t)((p_stats->busy_us * 100) / p_stats->elapsed_us);
+    else
+      p_stats->busy_percent = 0;
+
+    /* Success. */
+    return ESP_OK;
+  #else
+    return ESP_ERR_NOT_SUPPORTED;
+  #endif
+}
+
+
+/**
+ * twatch_i2c_reset_stats()
+ *
+ * @brief Reset a bus statistics and start a new measurement window.
+ * @param bus: I2C bus
+ **/
+
+void twatch_i2c_reset_stats(i2c_bus_t bus)
+{
+  #ifdef CONFIG_TWATCH_I2C_TELEMETRY
+    if ((bus != I2C_PRI) && (bus != I2C_SEC))
+      return;
 
-  /* Send command to the right I2C bus. */
-  if ((bus == I2C_PRI) || (bus == I2C_SEC))
-  {
     if (xSemaphoreTakeRecursive(i2c_sems[bus], portMAX_DELAY) == pdTRUE)
     {
-      result = i2c_master_cmd_begin((bus==I2C_PRI)?I2C_NUM_0:I2C_NUM_1, i2c_cmd, ticks_to_wait);
+      memset(&i2c_stats[bus], 0, sizeof(i2c_bus_stats_t));
+      i2c_stats_since[bus] = esp_timer_get_time();
       xSemaphoreGiveRecursive(i2c_sems[bus]);
     }
-    else
-      result = ESP_FAIL;
+  #endif
+}
 
-    i2c_cmd_link_delete(i2c_cmd);
 
-    /* Return result. */
-    return result;
+
+/**********************************************************************
+ * Asynchronous transactions
+ *
+ * Callers submit a transaction descriptor to a bus queue and get notified
+ * on completion. Each bus has a worker task that executes pending
+ * transactions, always picking the highest priority one first. Workers
+ * take the same bus mutex as synchronous calls, so both can be mixed.
+ **********************************************************************/
+
+/**
+ * twatch_i2c_xfer_dequeue()
+ *
+ * @brief Get the next pending transaction of a bus, highest priority first.
+ * @param bus: I2C bus
+ * @return pointer to a `i2c_xfer_t` structure, NULL if none pending
+ **/
+
+static i2c_xfer_t *twatch_i2c_xfer_dequeue(i2c_bus_t bus)
+{
+  i2c_xfer_t *p_xfer;
+  int prio;
+
+  for (prio=0; prio<I2C_XFER_PRIO_MAX; prio++)
+  {
+    if (xQueueReceive(i2c_xfer_queues[bus][prio], &p_xfer, 0) == pdTRUE)
+      return p_xfer;
   }
-  else
+
+  /* No pending transaction. */
+  return NULL;
+}
+
+
+/**
+ * twatch_i2c_xfer_exec()
+ *
+ * @brief Execute a transaction described by a `i2c_xfer_t` structure.
+ * @param bus: I2C bus
+ * @param p_xfer: pointer to a `i2c_xfer_t` structure
+ * @return transaction result
+ **/
+
+static esp_err_t twatch_i2c_xfer_exec(i2c_bus_t bus, i2c_xfer_t *p_xfer)
+{
+  switch (p_xfer->type)
   {
-    i2c_cmd_link_delete(i2c_cmd);
-    return ESP_FAIL;
+    case I2C_XFER_READ:
+      return twatch_i2c_readBytes(bus, p_xfer->addr, p_xfer->reg, p_xfer->data, p_xfer->len, p_xfer->ticks_to_wait);
+
+    case I2C_XFER_WRITE:
+      return twatch_i2c_writeBytes(bus, p_xfer->addr, p_xfer->reg, p_xfer->data, p_xfer->len, p_xfer->ticks_to_wait);
+
+    case I2C_XFER_READ_BATCH:
+      return twatch_i2c_readBatch(bus, p_xfer->addr, p_xfer->p_ops, p_xfer->nb_ops, p_xfer->ticks_to_wait);
+
+    default:
+      return ESP_FAIL;
+  }
+}
+
+
+/**
+ * twatch_i2c_xfer_worker()
+ *
+ * @brief Bus worker task, executes queued transactions.
+ * @param pvParameters: I2C bus handled by this worker
+ **/
+
+static void twatch_i2c_xfer_worker(void *pvParameters)
+{
+  i2c_bus_t bus = (i2c_bus_t)pvParameters;
+  i2c_xfer_t *p_xfer;
+  TaskHandle_t notify_task;
+
+  for (;;)
+  {
+    p_xfer = twatch_i2c_xfer_dequeue(bus);
+    if (p_xfer == NULL)
+    {
+      /* Nothing to do, wait for a submission. */
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+
+    /* Execute transaction. */
+    p_xfer->result = twatch_i2c_xfer_exec(bus, p_xfer);
+
+    /* Signal completion, descriptor may be released by the callback. */
+    notify_task = p_xfer->notify_task;
+    if (p_xfer->pfn_callback != NULL)
+      p_xfer->pfn_callback(p_xfer);
+    if (notify_task != NULL)
+      xTaskNotifyGive(notify_task);
   }
 }
+
+
+/**
+ * twatch_i2c_submit()
+ *
+ * @brief Queue an asynchronous transaction.
+ * @param bus: I2C bus
+ * @param p_xfer: pointer to a `i2c_xfer_t` structure, must stay valid until completion
+ * @param ticks_to_wait: number of ticks to wait if the queue is full
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_i2c_submit(i2c_bus_t bus, i2c_xfer_t *p_xfer, TickType_t ticks_to_wait)
+{
+  if (((bus != I2C_PRI) && (bus != I2C_SEC)) || (p_xfer->priority >= I2C_XFER_PRIO_MAX))
+    return ESP_FAIL;
+
+  p_xfer->result = ESP_ERR_INVALID_STATE;
+  if (xQueueSend(i2c_xfer_queues[bus][p_xfer->priority], &p_xfer, ticks_to_wait) != pdTRUE)
+    return ESP_FAIL;
+
+  /* Wake up bus worker. */
+  xTaskNotifyGive(i2c_xfer_tasks[bus]);
+
+  /* Success. */
+  return ESP_OK;
+}
+
+
+/**
+ * twatch_i2c_submit_from_isr()
+ *
+ * @brief Queue an asynchronous transaction from an interrupt handler.
+ * @param bus: I2C bus
+ * @param p_xfer: pointer to a `i2c_xfer_t` structure, must stay valid until completion
+ * @param p_task_woken: set to pdTRUE if a context switch is required
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t IRAM_ATTR twatch_i2c_submit_from_isr(i2c_bus_t bus, i2c_xfer_t *p_xfer, BaseType_t *p_task_woken)
+{
+  if (((bus != I2C_PRI) && (bus != I2C_SEC)) || (p_xfer->priority >= I2C_XFER_PRIO_MAX))
+    return ESP_FAIL;
+
+  p_xfer->result = ESP_ERR_INVALID_STATE;
+  if (xQueueSendFromISR(i2c_xfer_queues[bus][p_xfer->priority], &p_xfer, p_task_woken) != pdTRUE)
+    return ESP_FAIL;
+
+  /* Wake up bus worker. */
+  vTaskNotifyGiveFromISR(i2c_xfer_tasks[bus], p_task_woken);
+
+  /* Success. */
+  return ESP_OK;
+}
+
+
+/**
+ * twatch_i2c_transfer()
+ *
+ * @brief Queue a transaction and wait for its completion. Uses the calling
+ *        task notification, `notify_task` is overwritten.
+ * @param bus: I2C bus
+ * @param p_xfer: pointer to a `i2c_xfer_t` structure
+ * @param ticks_to_wait: number of ticks to wait if the queue is full
+ * @return transaction result, ESP_FAIL if it cannot be queued
+ **/
+
+esp_err_t twatch_i2c_transfer(i2c_bus_t bus, i2c_xfer_t *p_xfer, TickType_t ticks_to_wait)
+{
+  p_xfer->notify_task = xTaskGetCurrentTaskHandle();
+
+  if (twatch_i2c_submit(bus, p_xfer, ticks_to_wait) != ESP_OK)
+    return ESP_FAIL;
+
+  /*
+   * Descriptor may live on the caller stack, always wait for completion.
+   * The transaction itself is bounded by its own `ticks_to_wait`.
+   */
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  return p_xfer->result;
+}
+
+
+/**
+ * twatch_i2c_xfer_sync_done()
+ *
+ * @brief Completion callback of blocking transactions, wakes up the caller.
+ * @param p_xfer: pointer to the completed `i2c_xfer_t` structure
+ **/
+
+static void twatch_i2c_xfer_sync_done(i2c_xfer_t *p_xfer)
+{
+  xSemaphoreGive((SemaphoreHandle_t)p_xfer->p_user_data);
+}
+
+
+/**
+ * twatch_i2c_xfer_sync()
+ *
+ * @brief Queue a transaction at its priority and block until it completes.
+ *
+ * Completion is signaled through a semaphore living on the caller stack,
+ * task notifications are left untouched as PMU and GPS tasks rely on them.
+ * Transactions issued from the bus worker itself (completion callbacks) or
+ * before the workers are started are executed right away.
+ *
+ * @param bus: I2C bus
+ * @param p_xfer: pointer to a `i2c_xfer_t` structure
+ * @return transaction result, ESP_FAIL if it cannot be queued
+ **/
+
+static esp_err_t twatch_i2c_xfer_sync(i2c_bus_t bus, i2c_xfer_t *p_xfer)
+{
+  StaticSemaphore_t done_buffer;
+  SemaphoreHandle_t done;
+
+  if ((bus != I2C_PRI) && (bus != I2C_SEC))
+    return ESP_FAIL;
+
+  if ((i2c_xfer_tasks[bus] == NULL) || (xTaskGetCurrentTaskHandle() == i2c_xfer_tasks[bus]))
+    return twatch_i2c_xfer_exec(bus, p_xfer);
+
+  done = xSemaphoreCreateBinaryStatic(&done_buffer);
+  p_xfer->pfn_callback = twatch_i2c_xfer_sync_done;
+  p_xfer->notify_task = NULL;
+  p_xfer->p_user_data = (void *)done;
+
+  if (twatch_i2c_submit(bus, p_xfer, portMAX_DELAY) != ESP_OK)
+    return ESP_FAIL;
+
+  /* Transaction itself is bounded by its own `ticks_to_wait`. */
+  xSemaphoreTake(done, portMAX_DELAY);
+
+  return p_xfer->result;
+}
+
+
+/**
+ * twatch_i2c_readBytesPrio()
+ *
+ * @brief Read bytes from a device register, scheduled with a given priority.
+ * @param bus: I2C bus
+ * @param priority: transaction priority
+ * @param addr: device address
+ * @param reg: register address
+ * @param data: pointer to a buffer to store the read bytes
+ * @param len: number of bytes to read
+ * @param ticks_to_wait: transaction timeout
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_i2c_readBytesPrio(
+  i2c_bus_t bus,
+  i2c_xfer_prio_t priority,
+  uint8_t addr,
+  uint8_t reg,
+  uint8_t *data,
+  uint16_t len,
+  TickType_t ticks_to_wait
+)
+{
+  i2c_xfer_t xfer = {
+    .type = I2C_XFER_READ,
+    .priority = priority,
+    .addr = addr,
+    .reg = reg,
+    .data = data,
+    .len = len,
+    .ticks_to_wait = ticks_to_wait
+  };
+
+  return twatch_i2c_xfer_sync(bus, &xfer);
+}
+
+
+/**
+ * twatch_i2c_writeBytesPrio()
+ *
+ * @brief Write bytes to a device register, scheduled with a given priority.
+ * @param bus: I2C bus
+ * @param priority: transaction priority
+ * @param addr: device address
+ * @param reg: register address
+ * @param data: pointer to the bytes to write
+ * @param len: number of bytes to write
+ * @param ticks_to_wait: transaction timeout
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_i2c_writeBytesPrio(
+  i2c_bus_t bus,
+  i2c_xfer_prio_t priority,
+  uint8_t addr,
+  uint8_t reg,
+  uint8_t *data,
+  uint16_t len,
+  TickType_t ticks_to_wait
+)
+{
+  i2c_xfer_t xfer = {
+    .type = I2C_XFER_WRITE,
+    .priority = priority,
+    .addr = addr,
+    .reg = reg,
+    .data = data,
+    .len = len,
+    .ticks_to_wait = ticks_to_wait
+  };
+
+  return twatch_i2c_xfer_sync(bus, &xfer);
+}
+
+
+/**
+ * twatch_i2c_readBatchPrio()
+ *
+ * @brief Read several registers of a device in a single transaction,
+ *        scheduled with a given priority.
+ * @param bus: I2C bus
+ * @param priority: transaction priority
+ * @param addr: device address
+ * @param p_ops: array of read operations
+ * @param nb_ops: number of read operations (up to I2C_BATCH_MAX_OPS)
+ * @param ticks_to_wait: transaction timeout
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_i2c_readBatchPrio(
+  i2c_bus_t bus,
+  i2c_xfer_prio_t priority,
+  uint8_t addr,
+  i2c_read_op_t *p_ops,
+  int nb_ops,
+  TickType_t ticks_to_wait
+)
+{
+  i2c_xfer_t xfer = {
+    .type = I2C_XFER_READ_BATCH,
+    .priority = priority,
+    .addr = addr,
+    .ticks_to_wait = ticks_to_wait,
+    .p_ops = p_ops,
+    .nb_ops = nb_ops
+  };
+
+  return twatch_i2c_xfer_sync(bus, &xfer);
+}
@@ -0,0 +1,227 @@
+#include "drivers/nmea.h"
+
+/**
+ * hex_to_dec()
+ *
+ * @brief Convert an hexadecimal digit into its value.
+ * @param ascii: hexadecimal digit to convert
+ * @return digit value
+ **/
+
+static int hex_to_dec(uint8_t ascii)
+{
+  if ((ascii >= '0') && (ascii <= '9'))
+    return (ascii - '0');
+  else if ((ascii >= 'A') && (ascii <= 'F'))
+    return (ascii - 'A') + 10;
+  else if ((ascii >= 'a') && (ascii <= 'f'))
+    return (ascii - 'a') + 10;
+  else
+    return -1;
+}
+
+
+/**
+ * nmea_parser_abort()
+ *
+ * @brief Drop the current sentence and wait for the next '$' marker.
+ * @param p_parser: pointer to a `nmea_parser_t` structure
+ **/
+
+static void nmea_parser_abort(nmea_parser_t *p_parser)
+{
+  p_parser->nb_framing_errors++;
+  p_parser->state = NMEA_WAIT_START;
+}
+
+
+/**
+ * nmea_parser_end_field()
+ *
+ * @brief Terminate the current field and hand it to the field handler.
+ * @param p_parser: pointer to a `nmea_parser_t` structure
+ **/
+
+static void nmea_parser_end_field(nmea_parser_t *p_parser)
+{
+  p_parser->field[p_parser->field_len] = '\0';
+  if (p_parser->pfn_field_handler != NULL)
+  {
+    p_parser->pfn_field_handler(
+      p_parser,
+      p_parser->field_index,
+      p_parser->field,
+      p_parser->field_len
+    );
+  }
+
+  /* Next field. */
+  p_parser->field_index++;
+  p_parser->field_len = 0;
+}
+
+
+/**
+ * nmea_parser_init()
+ *
+ * @brief Initialize an NMEA parser
+ * @param p_parser: pointer to a `nmea_parser_t` structure
+ * @param pfn_field_handler: callback called for each field
+ * @param pfn_sentence_handler: callback called at the end of each sentence
+ * @param p_user_data: pointer to user data available to callbacks
+ **/
+
+void nmea_parser_init(nmea_parser_t *p_parser, FNmeaFieldHandler pfn_field_handler, FNmeaSentenceHandler pfn_sentence_handler, void *p_user_data)
+{
+  memset(p_parser, 0, sizeof(nmea_parser_t));
+  p_parser->pfn_field_handler = pfn_field_handler;
+  p_parser->pfn_sentence_handler = pfn_sentence_handler;
+  p_parser->p_user_data = p_user_data;
+  nmea_parser_reset(p_parser);
+}
+
+
+/**
+ * nmea_parser_reset()
+ *
+ * @brief Reset parser state, any partial sentence is discarded.
+ * @param p_parser: pointer to a `nmea_parser_t` structure
+ **/
+
+void nmea_parser_reset(nmea_parser_t *p_parser)
+{
+  p_parser->state = NMEA_WAIT_START;
+  p_parser->parity = 0;
+  p_parser->checksum = 0;
+  p_parser->field_index = 0;
+  p_parser->field_len = 0;
+  p_parser->sentence_len = 0;
+}
+
+
+/**
+ * nmea_parser_push()
+ *
+ * @brief Feed a single byte into the parser. Partial sentences are kept
+ *        in the parser state, so a sentence may be split across any
+ *        number of calls.
+ * @param p_parser: pointer to a `nmea_parser_t` structure
+ * @param byte: received byte
+ **/
+
+void nmea_parser_push(nmea_parser_t *p_parser, uint8_t byte)
+{
+  int value;
+
+  /* A '$' always starts a new sentence. */
+  if (byte == '$')
+  {
+    if (p_parser->state != NMEA_WAIT_START)
+      p_parser->nb_framing_errors++;
+
+    nmea_parser_reset(p_parser);
+    p_parser->state = NMEA_IN_SENTENCE;
+    return;
+  }
+
+  switch (p_parser->state)
+  {
+    case NMEA_WAIT_START:
+      break;
+
+    case NMEA_IN_SENTENCE:
+      {
+        if (++p_parser->sentence_len > NMEA_SENTENCE_MAXLEN)
+        {
+          nmea_parser_abort(p_parser);
+          break;
+        }
+
+        switch (byte)
+        {
+          case '*':
+            {
+              nmea_parser_end_field(p_parser);
+              p_parser->state = NMEA_CHECKSUM_HI;
+            }
+            break;
+
+          case ',':
+            {
+              p_parser->parity ^= byte;
+              nmea_parser_end_field(p_parser);
+            }
+            break;
+
+          default:
+            {
+              /* Sentence cut short or garbage, drop it. */
+              if ((byte < 0x20) || (byte > 0x7e) || (p_parser->field_len >= NMEA_FIELD_MAXLEN))
+              {
+                nmea_parser_abort(p_parser);
+                break;
+              }
+
+              p_parser->parity ^= byte;
+              p_parser->field[p_parser->field_len++] = byte;
+            }
+            break;
+        }
+      }
+      break;
+
+    case NMEA_CHECKSUM_HI:
+      {
+        value = hex_to_dec(byte);
+        if (value < 0)
+        {
+          nmea_parser_abort(p_parser);
+          break;
+        }
+
+        p_parser->checksum = value << 4;
+        p_parser->state = NMEA_CHECKSUM_LO;
+      }
+      break;
+
+    case NMEA_CHECKSUM_LO:
+      {
+        value = hex_to_dec(byte);
+        if (value < 0)
+        {
+          nmea_parser_abort(p_parser);
+          break;
+        }
+
+        p_parser->checksum |= value;
+        if (p_parser->checksum == p_parser->parity)
+          p_parser->nb_sentences++;
+        else
+          p_parser->nb_checksum_errors++;
+
+        if (p_parser->pfn_sentence_handler != NULL)
+          p_parser->pfn_sentence_handler(p_parser, (p_parser->checksum == p_parser->parity));
+
+        p_parser->state = NMEA_WAIT_START;
+      }
+      break;
+  }
+}
+
+
+/**
+ * nmea_parser_feed()
+ *
+ * @brief Feed a block of bytes into the parser.
+ * @param p_parser: pointer to a `nmea_parser_t` structure
+ * @param p_data: pointer to received bytes
+ * @param len: number of bytes
+ **/
+
+void nmea_parser_feed(nmea_parser_t *p_parser, uint8_t *p_data, int len)
+{
+  int i;
+
+  for (i=0; i<len; i++)
+    nmea_parser_push(p_parser, p_data[i]);
+}
@@ -44,12 +44,22 @@ int constrain(int x, int a, int b)
   return x;
 }
 
+/* Set by IRQ handler, cleared by pcf8563_enable_alarm(). */
+static volatile bool g_alarm_pending = false;
+
 /**
  * _pcf8563_interrupt_handler()
+ *
+ * IRQ is level-triggered and stays asserted until the alarm flag is
+ * cleared, keep it masked (and stop waking up from light sleep) until
+ * pcf8563_enable_alarm() is called.
  **/
 
 void IRAM_ATTR _pcf8563_interrupt_handler(void *parameter)
 {
+  gpio_intr_disable(PCF8563_IRQ_GPIO);
+  gpio_wakeup_disable(PCF8563_IRQ_GPIO);
+  g_alarm_pending = true;
 }
 
 /**
@@ -64,8 +74,8 @@ esp_err_t pcf8563_init(void)
   gpio_config_t irq_conf;
 
   /* Initialize PCF8563 IRQ pin as input pin. */
-  irq_conf.intr_type = GPIO_INTR_NEGEDGE;
-  irq_conf.pin_bit_mask = (1ULL << 37);
+  irq_conf.intr_type = GPIO_INTR_LOW_LEVEL;
+  irq_conf.pin_bit_mask = (1ULL << PCF8563_IRQ_GPIO);
   irq_conf.mode = GPIO_MODE_INPUT;
   irq_conf.pull_down_en = 0;
   irq_conf.pull_up_en = 1;
@@ -74,7 +84,7 @@ esp_err_t pcf8563_init(void)
   /* Install our user button interrupt handler. */
   if (gpio_install_isr_service(0) != ESP_OK)
     printf("[isr2] Error while installing service\r\n");
-  gpio_isr_handler_add(GPIO_NUM_37, _pcf8563_interrupt_handler, NULL);
+  gpio_isr_handler_add(PCF8563_IRQ_GPIO, _pcf8563_interrupt_handler, NULL);
 
   /* Enable Twatch i2c bus. */
   twatch_i2c_init();
@@ -89,8 +99,9 @@ esp_err_t pcf8563_init(void)
 
 void pcf8563_read_bytes(uint8_t reg, uint8_t nbytes, uint8_t *data)
 {
-  twatch_i2c_readBytes(
+  twatch_i2c_readBytesPrio(
     I2C_PRI,
+    I2C_XFER_PRIO_NORMAL,
     PCF8563_SLAVE_ADDRESS,
     reg,
     data,
@@ -106,8 +117,9 @@ void pcf8563_read_bytes(uint8_t reg, uint8_t nbytes, uint8_t *data)
 
 void pcf8563_write_bytes(uint8_t reg, uint8_t nbytes, uint8_t *data)
 {
-  twatch_i2c_writeBytes(
+  twatch_i2c_writeBytesPrio(
     I2C_PRI,
+    I2C_XFER_PRIO_NORMAL,
     PCF8563_SLAVE_ADDRESS,
     reg,
     data,
@@ -242,13 +254,51 @@ esp_err_t pcf8563_get_alarm(pcf8563_alarm_t *p_alarm)
 }
 
 
+/**
+ * pcf8563_enable_alarm()
+ *
+ * @brief Clear alarm flag and enable (or disable) alarm interrupt. The
+ *        IRQ line also wakes up the chip from light sleep while enabled.
+ * @param enable: true to enable alarm interrupt, false to disable it
+ **/
+
 void pcf8563_enable_alarm(bool enable)
 {
   uint8_t data;
 
   pcf8563_read_bytes(PCF8563_STAT2_REG, 1, &data);
   data &= ~PCF8563_ALARM_AF;
-  data |= (PCF8563_TIMER_TF | PCF8563_ALARM_AIE);
+  data |= PCF8563_TIMER_TF;
+  if (enable)
+    data |= PCF8563_ALARM_AIE;
+  else
+    data &= ~PCF8563_ALARM_AIE;
   pcf8563_write_bytes(PCF8563_STAT2_REG, 1, &data);
+  g_alarm_pending = false;
+
+  /* Alarm flag cleared, unmask IRQ. */
+  if (enable)
+  {
+    gpio_wakeup_enable(PCF8563_IRQ_GPIO, GPIO_INTR_LOW_LEVEL);
+    gpio_intr_enable(PCF8563_IRQ_GPIO);
+  }
+  else
+  {
+    gpio_intr_disable(PCF8563_IRQ_GPIO);
+    gpio_wakeup_disable(PCF8563_IRQ_GPIO);
+  }
+}
+
+
+/**
+ * pcf8563_is_alarm_pending()
+ *
+ * @brief Determine if alarm went off since last pcf8563_enable_alarm().
+ * @return true if alarm is pending, false otherwise
+ **/
+
+bool pcf8563_is_alarm_pending(void)
+{
+  return g_alarm_pending;
 }
 
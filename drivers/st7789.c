@@ -22,32 +22,49 @@
 #define P2MASK    0xFF00F0FF
 #define P2MASKP   0x00FF0F00
 
+#ifndef CONFIG_TWATCH_SIM
+
 spi_device_handle_t spi;
-ledc_timer_config_t backlight_timer = {
-  .duty_resolution = LEDC_TIMER_13_BIT, // resolution of PWM duty
-  .freq_hz = 5000,                      // frequency of PWM signal
-#if SOC_LEDC_SUPPORT_HS_MODE
-  .speed_mode = LEDC_HIGH_SPEED_MODE,   // timer mode
+
+/**
+ * APB clock is stopped in light sleep: when automatic light sleep is
+ * enabled, backlight PWM runs from the RTC 8 MHz clock (low-speed mode
+ * only), at a lower frequency to keep 13-bit resolution.
+ **/
+
+#if defined(CONFIG_PM_ENABLE) && defined(CONFIG_FREERTOS_USE_TICKLESS_IDLE)
+  #define ST7789_BL_SPEED_MODE  LEDC_LOW_SPEED_MODE
+  #define ST7789_BL_CLK         LEDC_USE_RTC8M_CLK
+  #define ST7789_BL_FREQ        1000
 #else
-  .speed_mode = LEDC_LOW_SPEED_MODE,
+  #if SOC_LEDC_SUPPORT_HS_MODE
+    #define ST7789_BL_SPEED_MODE  LEDC_HIGH_SPEED_MODE
+  #else
+    #define ST7789_BL_SPEED_MODE  LEDC_LOW_SPEED_MODE
+  #endif
+  #define ST7789_BL_CLK         LEDC_AUTO_CLK
+  #define ST7789_BL_FREQ        5000
 #endif
+
+ledc_timer_config_t backlight_timer = {
+  .duty_resolution = LEDC_TIMER_13_BIT, // resolution of PWM duty
+  .freq_hz = ST7789_BL_FREQ,            // frequency of PWM signal
+  .speed_mode = ST7789_BL_SPEED_MODE,   // timer mode
   .timer_num = LEDC_TIMER_0,            // timer index
-  .clk_cfg = LEDC_AUTO_CLK,             // Auto select the source clock
+  .clk_cfg = ST7789_BL_CLK,             // source clock
 };
 
 ledc_channel_config_t backlight_config = {
   .channel    = LEDC_CHANNEL_0,
   .duty       = 0,
   .gpio_num   = ST7789_BL_IO,
-#if SOC_LEDC_SUPPORT_HS_MODE
-  .speed_mode = LEDC_HIGH_SPEED_MODE,
-#else
-  .speed_mode = LEDC_LOW_SPEED_MODE,
-#endif
+  .speed_mode = ST7789_BL_SPEED_MODE,
   .hpoint     = 0,
   .timer_sel  = LEDC_TIMER_0
 };
 
+#endif /* CONFIG_TWATCH_SIM */
+
 RTC_DATA_ATTR static bool g_inv_x = true;
 RTC_DATA_ATTR static bool g_inv_y = true;
 
@@ -79,6 +96,19 @@ static uint16_t COLOR_LUT[64]={
 };
 
 
+/*
+ * Hardware interface (SPI bus, D/C line and backlight PWM). The host
+ * simulator (see sim/) provides its own implementation of these functions
+ * and only reuses the framebuffer and drawing primitives below.
+ */
+
+void st7789_wait(int milliseconds);
+esp_err_t st7789_send_cmd(const uint8_t cmd);
+esp_err_t st7789_send_data(const uint8_t *data, int len);
+esp_err_t st7789_send_data_byte(const uint8_t byte);
+
+#ifndef CONFIG_TWATCH_SIM
+
 typedef struct {
     uint8_t cmd;
     uint8_t data[16];
@@ -281,6 +311,8 @@ int st7789_backlight_get()
   return ledc_get_duty(backlight_config.speed_mode, backlight_config.channel);
 }
 
+#endif /* CONFIG_TWATCH_SIM */
+
 void st7789_set_drawing_window(int x0, int y0, int x1, int y1)
 {
   int x,y;
@@ -376,6 +408,94 @@ void st7789_blank(void)
 }
 
 
+/**
+ * @brief Compress framebuffer into a snapshot buffer.
+ *
+ * Pixels only use 6 bits, leaving room for run-length tokens:
+ *  - 0x00-0x3F: pixel value, becomes the current pixel
+ *  - 0x40-0x7F: repeat current pixel (token & 0x3F) + 1 times
+ *  - 0x80-0xBF: repeat current pixel ((token & 0x3F) + 1) * 64 times
+ *
+ * @param p_dst: pointer to destination buffer
+ * @param max_size: destination buffer size in bytes
+ * @return: compressed size in bytes, -1 if it does not fit in buffer
+ **/
+
+int st7789_compress_fb(uint8_t *p_dst, int max_size)
+{
+  int i, run, count, size = 0;
+  uint8_t pix;
+
+  i = 0;
+  while (i < FB_SIZE)
+  {
+    pix = framebuffer[i++] & 0x3F;
+    for (run=0; (i < FB_SIZE) && ((framebuffer[i] & 0x3F) == pix) && (run < 64*64); run++)
+      i++;
+
+    if (size >= max_size)
+      return -1;
+    p_dst[size++] = pix;
+
+    /* Long runs first, then remaining pixels. */
+    if (run >= 64)
+    {
+      if (size >= max_size)
+        return -1;
+      count = run/64;
+      p_dst[size++] = 0x80 | (count - 1);
+      run -= count*64;
+    }
+    if (run > 0)
+    {
+      if (size >= max_size)
+        return -1;
+      p_dst[size++] = 0x40 | (run - 1);
+    }
+  }
+
+  /* Success. */
+  return size;
+}
+
+
+/**
+ * @brief Restore framebuffer from a snapshot (see st7789_compress_fb()).
+ * @param p_src: pointer to compressed snapshot
+ * @param size: snapshot size in bytes
+ * @return: ESP_OK on success, ESP_FAIL if snapshot is corrupted
+ **/
+
+esp_err_t st7789_decompress_fb(const uint8_t *p_src, int size)
+{
+  int i, run, offset = 0;
+  uint8_t pix = 0;
+
+  for (i=0; i<size; i++)
+  {
+    if (p_src[i] < 0x40)
+    {
+      run = 1;
+      pix = p_src[i];
+    }
+    else if (p_src[i] < 0x80)
+      run = (p_src[i] & 0x3F) + 1;
+    else if (p_src[i] < 0xC0)
+      run = ((p_src[i] & 0x3F) + 1) * 64;
+    else
+      return ESP_FAIL;
+
+    if ((offset + run) > FB_SIZE)
+      return ESP_FAIL;
+    memset(&framebuffer[offset], pix, run);
+    offset += run;
+  }
+
+  /* Snapshot must cover the whole framebuffer. */
+  return (offset == FB_SIZE)?ESP_OK:ESP_FAIL;
+}
+
+
 /**
  * @brief Get color of a given pixel in framebuffer
  * @param x: pixel X coordinate
@@ -1,7 +1,15 @@
 #include "drivers/uart.h"
 
+#define UART_LINE_READ_TIMEOUT   (20/portTICK_RATE_MS)
+
 static QueueHandle_t g_uart_queue;
 
+/* Line mode buffer pool. */
+static twatch_uart_line_t g_line_pool[TWATCH_UART_LINE_POOL];
+static uint32_t g_line_used = 0;
+static bool g_line_mode = false;
+static portMUX_TYPE g_line_mux = portMUX_INITIALIZER_UNLOCKED;
+
 esp_err_t twatch_uart_init(int baudrate)
 {
   uart_config_t uart_config = {
@@ -34,12 +42,171 @@ esp_err_t twatch_uart_transmit(uint8_t *p_buffer, int len)
   return uart_write_bytes(EX_UART_NUM, (const char*)p_buffer, len);
 }
 
-esp_err_t twatch_uart_receive(uint8_t *p_buffer, int len)
+int twatch_uart_receive(uint8_t *p_buffer, int len, TickType_t ticks_to_wait)
+{
+  return uart_read_bytes(EX_UART_NUM, p_buffer, len, ticks_to_wait);
+}
+
+bool twatch_uart_wait_event(uart_event_t *p_uart_event, TickType_t ticks_to_wait)
+{
+  return xQueueReceive(g_uart_queue, (void * )p_uart_event, ticks_to_wait);
+}
+
+esp_err_t twatch_uart_flush(void)
+{
+  return uart_flush_input(EX_UART_NUM);
+}
+
+esp_err_t twatch_uart_set_baudrate(int baudrate)
+{
+  /* Let pending data go out at the current rate. */
+  uart_wait_tx_done(EX_UART_NUM, 100/portTICK_RATE_MS);
+  return uart_set_baudrate(EX_UART_NUM, baudrate);
+}
+
+int twatch_uart_get_buffered_len(void)
 {
-  return uart_read_bytes(EX_UART_NUM, p_buffer, len, portMAX_DELAY);
+  size_t len = 0;
+
+  if (uart_get_buffered_data_len(EX_UART_NUM, &len) != ESP_OK)
+    return 0;
+  return (int)len;
 }
 
-bool twatch_uart_wait_event(uart_event_t *p_uart_event)
+
+/**
+ * twatch_uart_enable_line_mode()
+ *
+ * @brief Enable end-of-line detection, complete lines are then reported
+ *        through UART_PATTERN_DET events.
+ * @param eol: end-of-line character
+ * @return ESP_OK on success, ESP_FAIL otherwise.
+ **/
+
+esp_err_t twatch_uart_enable_line_mode(char eol)
+{
+  if (uart_enable_pattern_det_baud_intr(EX_UART_NUM, eol, 1, 9, 0, 0) != ESP_OK)
+    return ESP_FAIL;
+  uart_pattern_queue_reset(EX_UART_NUM, TWATCH_UART_PATTERN_QUEUE);
+
+  /* Wake up on end-of-line rather than on every idle gap. */
+  uart_set_rx_full_threshold(EX_UART_NUM, TWATCH_UART_RX_FULL_THRESH);
+  uart_set_rx_timeout(EX_UART_NUM, TWATCH_UART_RX_TOUT_LINE);
+  g_line_mode = true;
+
+  /* Success. */
+  return ESP_OK;
+}
+
+
+/**
+ * twatch_uart_disable_line_mode()
+ *
+ * @brief Disable end-of-line detection, back to raw UART_DATA events.
+ * @return ESP_OK on success, ESP_FAIL otherwise.
+ **/
+
+esp_err_t twatch_uart_disable_line_mode(void)
 {
-  return xQueueReceive(g_uart_queue, (void * )p_uart_event, (portTickType)portMAX_DELAY);
-}
\ No newline at end of file
+  g_line_mode = false;
+  uart_set_rx_timeout(EX_UART_NUM, TWATCH_UART_RX_TOUT_RAW);
+  return uart_disable_pattern_det_intr(EX_UART_NUM);
+}
+
+
+/**
+ * twatch_uart_is_line_mode()
+ *
+ * @brief Tell if line mode is enabled.
+ * @return true if enabled, false otherwise.
+ **/
+
+bool twatch_uart_is_line_mode(void)
+{
+  return g_line_mode;
+}
+
+
+/**
+ * twatch_uart_get_line()
+ *
+ * @brief Read the next complete line into a buffer from the pool. The
+ *        buffer must be given back with `twatch_uart_release_line()`.
+ * @return pointer to a `twatch_uart_line_t` structure, NULL if no line is
+ *         pending or no buffer is available.
+ **/
+
+twatch_uart_line_t *twatch_uart_get_line(void)
+{
+  twatch_uart_line_t *p_line = NULL;
+  uint8_t discard[32];
+  int i, pos, len, chunk;
+
+  if (!g_line_mode)
+    return NULL;
+
+  /* Peek first, the line stays queued if the pool is exhausted. */
+  if (uart_pattern_get_pos(EX_UART_NUM) < 0)
+    return NULL;
+
+  portENTER_CRITICAL(&g_line_mux);
+  for (i=0; i<TWATCH_UART_LINE_POOL; i++)
+  {
+    if ((g_line_used & (1 << i)) == 0)
+    {
+      g_line_used |= (1 << i);
+      p_line = &g_line_pool[i];
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&g_line_mux);
+
+  if (p_line == NULL)
+    return NULL;
+
+  /* Read line including its end-of-line character. */
+  pos = uart_pattern_pop_pos(EX_UART_NUM);
+  len = pos + 1;
+  p_line->b_truncated = (len > TWATCH_UART_LINE_MAXLEN);
+  p_line->len = uart_read_bytes(
+    EX_UART_NUM,
+    p_line->data,
+    p_line->b_truncated ? TWATCH_UART_LINE_MAXLEN : len,
+    UART_LINE_READ_TIMEOUT
+  );
+  if (p_line->len < 0)
+    p_line->len = 0;
+
+  /* Skip whatever does not fit. */
+  len -= p_line->len;
+  while (p_line->b_truncated && (len > 0))
+  {
+    chunk = (len > (int)sizeof(discard)) ? (int)sizeof(discard) : len;
+    chunk = uart_read_bytes(EX_UART_NUM, discard, chunk, UART_LINE_READ_TIMEOUT);
+    if (chunk <= 0)
+      break;
+    len -= chunk;
+  }
+
+  return p_line;
+}
+
+
+/**
+ * twatch_uart_release_line()
+ *
+ * @brief Give a line buffer back to the pool.
+ * @param p_line: pointer to a `twatch_uart_line_t` structure
+ **/
+
+void twatch_uart_release_line(twatch_uart_line_t *p_line)
+{
+  int index = p_line - g_line_pool;
+
+  if ((index < 0) || (index >= TWATCH_UART_LINE_POOL))
+    return;
+
+  portENTER_CRITICAL(&g_line_mux);
+  g_line_used &= ~(1 << index);
+  portEXIT_CRITICAL(&g_line_mux);
+}
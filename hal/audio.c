@@ -1,14 +1,293 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/stream_buffer.h"
 #include "driver/i2s.h"
 #include "driver/gpio.h"
 #include "esp_system.h"
 #include "esp_log.h"
 #include "hal/audio.h"
+#include "hal/audio_mixer.h"
 
 volatile int sample_rate = SOUND_DEFAULT_SAMPLE_RATE;
 
+#if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+
+/* Playback pipeline state. */
+static struct {
+  bool b_running;
+  TaskHandle_t task;
+  StreamBufferHandle_t ring;
+  SemaphoreHandle_t producer_lock;
+  int16_t *p_block;
+  int block_frames;
+  int idle_blocks_max;
+
+  /* Feeder state. */
+  bool b_i2s_started;           /* I2S holds an APB_FREQ_MAX lock while started. */
+  bool b_active;
+  bool b_streaming;
+  bool b_starved;
+  int idle_blocks;
+  int starved_blocks;
+  FAudioRender pfn_source;
+  void *p_source;
+
+  /* Buffer played in place. */
+  const uint8_t *p_buffer;
+  size_t buffer_size;
+  size_t buffer_pos;
+
+  /* Requests from producers, protected by g_audio_mux. */
+  FAudioRender pfn_next_source;
+  void *p_next_source;
+  const uint8_t *p_next_buffer;
+  size_t next_buffer_size;
+  bool b_stop;
+
+  twatch_audio_stats_t stats;
+} g_audio;
+
+static portMUX_TYPE g_audio_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+/**
+ * audio_buffer_render()
+ *
+ * @brief Render callback of the buffer played in place.
+ * @param p_source: not used
+ * @param p_block: pointer to block to fill
+ * @param frames: block size in frames
+ * @return number of frames written in block.
+ **/
+
+static int audio_buffer_render(void *p_source, int16_t *p_block, int frames)
+{
+  size_t chunk;
+
+  chunk = g_audio.buffer_size - g_audio.buffer_pos;
+  if (chunk > frames * AUDIO_FRAME_SIZE)
+    chunk = frames * AUDIO_FRAME_SIZE;
+  memcpy(p_block, &g_audio.p_buffer[g_audio.buffer_pos], chunk);
+  g_audio.buffer_pos += chunk;
+
+  return chunk / AUDIO_FRAME_SIZE;
+}
+
+
+/**
+ * audio_render_block()
+ *
+ * @brief Fill a block with pending frames, source (or buffer played in
+ *        place) first then ring buffer.
+ * @param p_block: pointer to block to fill
+ * @param frames: block size in frames
+ * @return number of frames written in block.
+ **/
+
+static int audio_render_block(int16_t *p_block, int frames)
+{
+  uint8_t *p_dest = (uint8_t *)p_block;
+  size_t size = frames * AUDIO_FRAME_SIZE;
+  size_t filled = 0;
+  int rendered;
+
+  /* Apply producers requests. */
+  portENTER_CRITICAL(&g_audio_mux);
+  if (g_audio.b_stop)
+  {
+    g_audio.pfn_source = NULL;
+    g_audio.b_stop = false;
+  }
+  if (g_audio.pfn_next_source != NULL)
+  {
+    g_audio.pfn_source = g_audio.pfn_next_source;
+    g_audio.p_source = g_audio.p_next_source;
+    g_audio.p_buffer = g_audio.p_next_buffer;
+    g_audio.buffer_size = g_audio.next_buffer_size;
+    g_audio.buffer_pos = 0;
+    g_audio.pfn_next_source = NULL;
+  }
+  portEXIT_CRITICAL(&g_audio_mux);
+
+  /* Source renders straight into the block, a short count means it is done. */
+  if (g_audio.pfn_source != NULL)
+  {
+    rendered = g_audio.pfn_source(g_audio.p_source, p_block, frames);
+    if (rendered < frames)
+      g_audio.pfn_source = NULL;
+    filled += rendered * AUDIO_FRAME_SIZE;
+  }
+
+  /* Streamed frames, never wait here: I2S DMA paces the feeder. */
+  if (filled < size)
+    filled += xStreamBufferReceive(g_audio.ring, &p_dest[filled], size - filled, 0);
+
+  return filled / AUDIO_FRAME_SIZE;
+}
+
+
+/**
+ * audio_feeder_task()
+ *
+ * @brief Move frames from producers into I2S DMA buffers, with mixer
+ *        voices on top. Silence is sent when producers fall behind, and
+ *        the task sleeps once nothing has been played for AUDIO_IDLE_MS.
+ * @param parameter: not used
+ **/
+
+static void audio_feeder_task(void *parameter)
+{
+  size_t written, free_space;
+  int frames, voices;
+
+  while (g_audio.b_running)
+  {
+    frames = audio_render_block(g_audio.p_block, g_audio.block_frames);
+
+    /* Pad block with silence. */
+    if (frames < g_audio.block_frames)
+    {
+      memset(
+        &g_audio.p_block[frames * 2],
+        0,
+        (g_audio.block_frames - frames) * AUDIO_FRAME_SIZE
+      );
+    }
+
+    voices = audio_mixer_mix(g_audio.p_block, g_audio.block_frames);
+
+    /* Underruns only concern streamed frames. */
+    if (frames > 0)
+    {
+      /* Producer was late, a gap has been heard. */
+      if (g_audio.b_starved)
+        g_audio.stats.underruns++;
+      g_audio.b_streaming = true;
+      g_audio.b_starved = (frames < g_audio.block_frames);
+      g_audio.starved_blocks = 0;
+
+      free_space = xStreamBufferSpacesAvailable(g_audio.ring);
+      if (free_space < g_audio.stats.ring_min_free)
+        g_audio.stats.ring_min_free = free_space;
+    }
+    else if (g_audio.b_streaming)
+    {
+      /* Stream is late, or over if nothing comes for a while. */
+      g_audio.b_starved = true;
+      if (++g_audio.starved_blocks > g_audio.idle_blocks_max)
+        g_audio.b_streaming = g_audio.b_starved = false;
+    }
+
+    if ((frames > 0) || (voices > 0))
+    {
+      g_audio.b_active = true;
+      g_audio.idle_blocks = 0;
+    }
+    else if (g_audio.b_active)
+    {
+      /* Nothing to play, keep DMA fed with silence for a while. */
+      if (++g_audio.idle_blocks > g_audio.idle_blocks_max)
+      {
+        /* End of playback, not an underrun. */
+        g_audio.b_active = false;
+        g_audio.b_streaming = g_audio.b_starved = false;
+        i2s_zero_dma_buffer(SOUND_DEFAULT_I2S_PORT);
+        continue;
+      }
+    }
+    else
+    {
+      /* Idle, stop I2S so that it releases its PM lock (light sleep). */
+      if (g_audio.b_i2s_started)
+      {
+        i2s_stop(SOUND_DEFAULT_I2S_PORT);
+        g_audio.b_i2s_started = false;
+      }
+
+      /* Wait for a producer. */
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+
+    g_audio.stats.frames_played += (voices > 0) ? g_audio.block_frames : frames;
+    g_audio.stats.frames_silence += (voices > 0) ? 0 : g_audio.block_frames - frames;
+
+    /* Back from idle, restart I2S before feeding it. */
+    if (!g_audio.b_i2s_started)
+    {
+      i2s_start(SOUND_DEFAULT_I2S_PORT);
+      g_audio.b_i2s_started = true;
+    }
+
+    i2s_write(
+      SOUND_DEFAULT_I2S_PORT,
+      g_audio.p_block,
+      g_audio.block_frames * AUDIO_FRAME_SIZE,
+      &written,
+      portMAX_DELAY
+    );
+  }
+
+  /* Tell deinit we are done. */
+  g_audio.task = NULL;
+  vTaskDelete(NULL);
+}
+
+#endif
+
+
+/**
+ * twatch_audio_wake()
+ *
+ * @brief Wake up feeder task if sleeping, for producers that do not go
+ *        through the ring buffer (e.g. mixer voices).
+ **/
+
+void twatch_audio_wake(void)
+{
+  #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+    if (g_audio.task != NULL)
+      xTaskNotifyGive(g_audio.task);
+  #endif
+}
+
+
+/**
+ * twatch_audio_get_sample_rate()
+ *
+ * @brief Get output sample rate.
+ * @return sample rate in Hz.
+ **/
+
+int twatch_audio_get_sample_rate(void)
+{
+  return sample_rate;
+}
+
+
+/**
+ * twatch_audio_get_default_config()
+ *
+ * @brief Fill a playback configuration with default values.
+ * @param p_config: pointer to a `twatch_audio_config_t` structure
+ * @param sample_rate: sample rate in Hz
+ **/
+
+void twatch_audio_get_default_config(twatch_audio_config_t *p_config, int sample_rate)
+{
+  p_config->sample_rate = sample_rate;
+  p_config->dma_buf_count = AUDIO_DEFAULT_DMA_BUF_COUNT;
+  p_config->dma_buf_len = AUDIO_DEFAULT_DMA_BUF_LEN;
+  p_config->ring_size = AUDIO_DEFAULT_RING_SIZE;
+  p_config->task_priority = AUDIO_DEFAULT_TASK_PRIORITY;
+  p_config->task_core = tskNO_AFFINITY;
+}
+
+
 /**
  * sound_init()
  *
@@ -16,6 +295,23 @@ volatile int sample_rate = SOUND_DEFAULT_SAMPLE_RATE;
  **/
 
 esp_err_t twatch_audio_init(int sample_rate)
+{
+  twatch_audio_config_t config;
+
+  twatch_audio_get_default_config(&config, sample_rate);
+  return twatch_audio_init_config(&config);
+}
+
+
+/**
+ * twatch_audio_init_config()
+ *
+ * @brief Initialize audio DAC interface (I2S) and playback pipeline.
+ * @param p_config: pointer to a `twatch_audio_config_t` structure
+ * @return ESP_OK on success, ESP_FAIL otherwise.
+ **/
+
+esp_err_t twatch_audio_init_config(twatch_audio_config_t *p_config)
 {
   #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
     esp_err_t result;
@@ -27,18 +323,22 @@ esp_err_t twatch_audio_init(int sample_rate)
      **/
 
     /* Initialize ESP32 I2S config. */
+    memset(&ss_config, 0, sizeof(i2s_config_t));
     ss_config.mode = I2S_MODE_MASTER | I2S_MODE_TX;
-    ss_config.sample_rate = sample_rate;
+    ss_config.sample_rate = p_config->sample_rate;
     ss_config.bits_per_sample = 16;
     ss_config.channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT;
     ss_config.communication_format = I2S_COMM_FORMAT_STAND_MSB;
 
     /* Use ESP_INTR_FLAG_LEVEL2, as ESP_INTR_FLAG_LEVEL1 is already used. */
     ss_config.intr_alloc_flags = ESP_INTR_FLAG_LEVEL2;
-    ss_config.dma_buf_count = 6;
-    ss_config.dma_buf_len = 60;
+    ss_config.dma_buf_count = p_config->dma_buf_count;
+    ss_config.dma_buf_len = p_config->dma_buf_len;
     ss_config.use_apll = false;
 
+    /* Output silence rather than stale DMA buffers if the feeder is late. */
+    ss_config.tx_desc_auto_clear = true;
+
     /* Initialize ESP32 pin config. */
     ss_pin_config.bck_io_num = 26;
     ss_pin_config.ws_io_num = 25;
@@ -66,6 +366,50 @@ esp_err_t twatch_audio_init(int sample_rate)
       ESP_LOGE("sound_system", "setting i2s pins failed: %d\r\n", result);
       return ESP_FAIL;
     }
+    sample_rate = p_config->sample_rate;
+
+    /**
+     * Initialize the playback pipeline.
+     **/
+
+    memset(&g_audio, 0, sizeof(g_audio));
+    g_audio.block_frames = p_config->dma_buf_len;
+    g_audio.idle_blocks_max = (AUDIO_IDLE_MS * p_config->sample_rate) / (1000 * p_config->dma_buf_len);
+
+    /* Driver starts I2S when installed. */
+    g_audio.b_i2s_started = true;
+
+    /* Ring buffer size must be a whole number of frames, so that partial
+       reads and writes never split a frame. */
+    g_audio.ring = xStreamBufferCreate(p_config->ring_size & ~(AUDIO_FRAME_SIZE - 1), 1);
+    g_audio.producer_lock = xSemaphoreCreateMutex();
+    g_audio.p_block = (int16_t *)malloc(g_audio.block_frames * AUDIO_FRAME_SIZE);
+    if ((g_audio.ring == NULL) || (g_audio.producer_lock == NULL) || (g_audio.p_block == NULL) ||
+        (audio_mixer_setup(g_audio.block_frames) != ESP_OK))
+    {
+      ESP_LOGE("sound_system", "cannot allocate playback buffers\r\n");
+      twatch_audio_deinit();
+      return ESP_FAIL;
+    }
+    g_audio.stats.ring_min_free = xStreamBufferSpacesAvailable(g_audio.ring);
+
+    /* Start feeder task. */
+    g_audio.b_running = true;
+    if (xTaskCreatePinnedToCore(
+      audio_feeder_task,
+      "audio_feeder",
+      2048,
+      NULL,
+      p_config->task_priority,
+      &g_audio.task,
+      p_config->task_core
+    ) != pdPASS)
+    {
+      ESP_LOGE("sound_system", "cannot create feeder task\r\n");
+      g_audio.b_running = false;
+      twatch_audio_deinit();
+      return ESP_FAIL;
+    }
   #endif
 
   /* Success. */
@@ -76,24 +420,264 @@ esp_err_t twatch_audio_init(int sample_rate)
 /**
  * sound_send_samples()
  *
- * Send 2-channel 16-bit samples to audio DAC.
+ * Send 2-channel 16-bit samples to audio DAC, waiting up to `ticks_to_wait`
+ * for room in the playback ring buffer. Returns ESP_ERR_TIMEOUT if only
+ * part of the samples could be queued (see `p_bytes_written`).
  **/
 
 esp_err_t twatch_audio_send_samples(void *samples, size_t samples_size, size_t *p_bytes_written, TickType_t ticks_to_wait)
 {
   #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
-    return i2s_write(
-      SOUND_DEFAULT_I2S_PORT,
+    size_t requested = samples_size & ~(AUDIO_FRAME_SIZE - 1);
+    size_t written = 0;
+    TimeOut_t timeout;
+
+    if (g_audio.ring == NULL)
+      return ESP_FAIL;
+
+    vTaskSetTimeOutState(&timeout);
+    if (xSemaphoreTake(g_audio.producer_lock, ticks_to_wait) != pdTRUE)
+      return ESP_ERR_TIMEOUT;
+
+    /**
+     * Queue what fits, then wake the feeder so it drains the ring while we
+     * wait for room: it sleeps as long as the ring is empty.
+     **/
+
+    written = xStreamBufferSend(g_audio.ring, samples, requested, 0);
+    twatch_audio_wake();
+    while ((written < requested) && (xTaskCheckForTimeOut(&timeout, &ticks_to_wait) == pdFALSE))
+    {
+      written += xStreamBufferSend(
+        g_audio.ring,
+        (uint8_t *)samples + written,
+        requested - written,
+        ticks_to_wait
+      );
+      twatch_audio_wake();
+    }
+    xSemaphoreGive(g_audio.producer_lock);
+
+    if (p_bytes_written != NULL)
+      *p_bytes_written = written;
+
+    return (written < requested) ? ESP_ERR_TIMEOUT : ESP_OK;
+  #else
+    return ESP_FAIL;
+  #endif
+}
+
+
+/**
+ * twatch_audio_queue()
+ *
+ * @brief Queue 2-channel 16-bit samples without blocking.
+ * @param samples: pointer to samples
+ * @param samples_size: size of samples in bytes
+ * @return number of bytes queued, may be less than `samples_size` if the
+ *         ring buffer is full.
+ **/
+
+size_t twatch_audio_queue(void *samples, size_t samples_size)
+{
+  #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+    size_t written;
+
+    if (g_audio.ring == NULL)
+      return 0;
+
+    if (xSemaphoreTake(g_audio.producer_lock, 0) != pdTRUE)
+      return 0;
+    written = xStreamBufferSend(
+      g_audio.ring,
       samples,
-      samples_size,
-      p_bytes_written,
-      ticks_to_wait
+      samples_size & ~(AUDIO_FRAME_SIZE - 1),
+      0
     );
+    xSemaphoreGive(g_audio.producer_lock);
+
+    if (written > 0)
+      twatch_audio_wake();
+    return written;
+  #else
+    return 0;
+  #endif
+}
+
+
+/**
+ * twatch_audio_play_buffer()
+ *
+ * @brief Play a buffer of 2-channel 16-bit samples in place, without
+ *        copying it. Buffer must stay valid until played, any buffer
+ *        being played is replaced. Queued samples play after the buffer.
+ * @param samples: pointer to samples
+ * @param samples_size: size of samples in bytes
+ * @return ESP_OK on success, ESP_FAIL otherwise.
+ **/
+
+esp_err_t twatch_audio_play_buffer(const void *samples, size_t samples_size)
+{
+  #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+    if ((g_audio.task == NULL) || (samples == NULL))
+      return ESP_FAIL;
+
+    portENTER_CRITICAL(&g_audio_mux);
+    g_audio.pfn_next_source = audio_buffer_render;
+    g_audio.p_next_source = NULL;
+    g_audio.p_next_buffer = (const uint8_t *)samples;
+    g_audio.next_buffer_size = samples_size & ~(AUDIO_FRAME_SIZE - 1);
+    portEXIT_CRITICAL(&g_audio_mux);
+    twatch_audio_wake();
+
+    /* Success. */
+    return ESP_OK;
+  #else
+    return ESP_FAIL;
+  #endif
+}
+
+
+/**
+ * twatch_audio_play_source()
+ *
+ * @brief Play frames rendered on the fly by a source, called from the
+ *        feeder task for each block. Any source or buffer being played is
+ *        replaced. Queued samples play after the source.
+ * @param pfn_render: render callback, returns less frames than asked once
+ *                    the source is exhausted
+ * @param p_source: pointer passed to render callback
+ * @return ESP_OK on success, ESP_FAIL otherwise.
+ **/
+
+esp_err_t twatch_audio_play_source(FAudioRender pfn_render, void *p_source)
+{
+  #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+    if ((g_audio.task == NULL) || (pfn_render == NULL))
+      return ESP_FAIL;
+
+    portENTER_CRITICAL(&g_audio_mux);
+    g_audio.pfn_next_source = pfn_render;
+    g_audio.p_next_source = p_source;
+    g_audio.p_next_buffer = NULL;
+    g_audio.next_buffer_size = 0;
+    portEXIT_CRITICAL(&g_audio_mux);
+    twatch_audio_wake();
+
+    /* Success. */
+    return ESP_OK;
+  #else
+    return ESP_FAIL;
+  #endif
+}
+
+
+/**
+ * twatch_audio_stop()
+ *
+ * @brief Stop playback, dropping queued samples.
+ * @return ESP_OK on success, ESP_FAIL otherwise.
+ **/
+
+esp_err_t twatch_audio_stop(void)
+{
+  #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+    if (g_audio.ring == NULL)
+      return ESP_FAIL;
+
+    portENTER_CRITICAL(&g_audio_mux);
+    g_audio.pfn_next_source = NULL;
+    g_audio.b_stop = true;
+    portEXIT_CRITICAL(&g_audio_mux);
+
+    /* Feeder never blocks on the ring, so it can be reset once producers
+       are kept out. */
+    xSemaphoreTake(g_audio.producer_lock, portMAX_DELAY);
+    xStreamBufferReset(g_audio.ring);
+    xSemaphoreGive(g_audio.producer_lock);
+
+    /* Success. */
+    return ESP_OK;
   #else
     return ESP_FAIL;
   #endif
 }
 
+
+/**
+ * twatch_audio_is_playing()
+ *
+ * @brief Tell if samples are being played or pending.
+ * @return true if playing, false otherwise.
+ **/
+
+bool twatch_audio_is_playing(void)
+{
+  #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+    if (g_audio.ring == NULL)
+      return false;
+
+    return (g_audio.pfn_next_source != NULL) || (g_audio.pfn_source != NULL) ||
+      (xStreamBufferBytesAvailable(g_audio.ring) > 0) ||
+      (g_audio.b_active && !g_audio.b_starved);
+  #else
+    return false;
+  #endif
+}
+
+
+/**
+ * twatch_audio_get_free()
+ *
+ * @brief Get free space in playback ring buffer.
+ * @return free space in bytes.
+ **/
+
+size_t twatch_audio_get_free(void)
+{
+  #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+    if (g_audio.ring == NULL)
+      return 0;
+    return xStreamBufferSpacesAvailable(g_audio.ring);
+  #else
+    return 0;
+  #endif
+}
+
+
+/**
+ * twatch_audio_get_stats()
+ *
+ * @brief Get playback statistics.
+ * @param p_stats: pointer to a `twatch_audio_stats_t` structure
+ **/
+
+void twatch_audio_get_stats(twatch_audio_stats_t *p_stats)
+{
+  #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+    memcpy(p_stats, &g_audio.stats, sizeof(twatch_audio_stats_t));
+  #else
+    memset(p_stats, 0, sizeof(twatch_audio_stats_t));
+  #endif
+}
+
+
+/**
+ * twatch_audio_reset_stats()
+ *
+ * @brief Reset playback statistics.
+ **/
+
+void twatch_audio_reset_stats(void)
+{
+  #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+    memset(&g_audio.stats, 0, sizeof(twatch_audio_stats_t));
+    if (g_audio.ring != NULL)
+      g_audio.stats.ring_min_free = xStreamBufferSpacesAvailable(g_audio.ring);
+  #endif
+}
+
+
 /**
  * audio_deinit()
  *
@@ -105,6 +689,23 @@ esp_err_t twatch_audio_deinit(void)
   #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
     esp_err_t result;
 
+    /* Stop feeder task. */
+    if (g_audio.task != NULL)
+    {
+      g_audio.b_running = false;
+      xTaskNotifyGive(g_audio.task);
+      while (g_audio.task != NULL)
+        vTaskDelay(10/portTICK_RATE_MS);
+    }
+
+    if (g_audio.ring != NULL)
+      vStreamBufferDelete(g_audio.ring);
+    if (g_audio.producer_lock != NULL)
+      vSemaphoreDelete(g_audio.producer_lock);
+    free(g_audio.p_block);
+    memset(&g_audio, 0, sizeof(g_audio));
+    audio_mixer_teardown();
+
     result = i2s_driver_uninstall(SOUND_DEFAULT_I2S_PORT);
     if (result != ESP_OK)
     {
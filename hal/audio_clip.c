@@ -0,0 +1,359 @@
+#include <string.h>
+#include "esp_log.h"
+#include "hal/audio_clip.h"
+
+#define TAG "[hal::audio_clip]"
+
+static const int16_t g_ima_steps[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+  19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+  130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+  337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+  876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+  5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t g_ima_index_adjust[16] = {
+  -1, -1, -1, -1, 2, 4, 6, 8,
+  -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+
+/**
+ * read_le16()
+ *
+ * @brief Read a little-endian 16-bit value.
+ * @param p_data: pointer to data
+ * @return value
+ **/
+
+static uint16_t read_le16(const uint8_t *p_data)
+{
+  return p_data[0] | (p_data[1] << 8);
+}
+
+
+/**
+ * read_le32()
+ *
+ * @brief Read a little-endian 32-bit value.
+ * @param p_data: pointer to data
+ * @return value
+ **/
+
+static uint32_t read_le32(const uint8_t *p_data)
+{
+  return p_data[0] | (p_data[1] << 8) | (p_data[2] << 16) | ((uint32_t)p_data[3] << 24);
+}
+
+
+/**
+ * clip_decode_nibble()
+ *
+ * @brief Decode an IMA ADPCM nibble and update channel state.
+ * @param p_clip: pointer to a `twatch_audio_clip_t` structure
+ * @param channel: channel index
+ * @param nibble: 4-bit code
+ * @return decoded sample
+ **/
+
+static int16_t clip_decode_nibble(twatch_audio_clip_t *p_clip, int channel, uint8_t nibble)
+{
+  int step = g_ima_steps[p_clip->index[channel]];
+  int diff, sample, index;
+
+  diff = step >> 3;
+  if (nibble & 1)
+    diff += step >> 2;
+  if (nibble & 2)
+    diff += step >> 1;
+  if (nibble & 4)
+    diff += step;
+  if (nibble & 8)
+    diff = -diff;
+
+  sample = p_clip->predictor[channel] + diff;
+  if (sample > 32767)
+    sample = 32767;
+  else if (sample < -32768)
+    sample = -32768;
+  p_clip->predictor[channel] = sample;
+
+  index = p_clip->index[channel] + g_ima_index_adjust[nibble];
+  if (index < 0)
+    index = 0;
+  else if (index > 88)
+    index = 88;
+  p_clip->index[channel] = index;
+
+  return sample;
+}
+
+
+/**
+ * clip_decode_group()
+ *
+ * @brief Decode the next group of frames, starting a new block if needed.
+ *        A block starts with a header holding its first frame.
+ * @param p_clip: pointer to a `twatch_audio_clip_t` structure
+ * @return true on success, false if no more data.
+ **/
+
+static bool clip_decode_group(twatch_audio_clip_t *p_clip)
+{
+  const uint8_t *p_block;
+  size_t block_end;
+  int c, i;
+  uint8_t byte;
+
+  if ((p_clip->p_read + 4*p_clip->channels) > p_clip->p_block_end)
+  {
+    /* New block. */
+    if ((p_clip->block_offset + 4*p_clip->channels) > p_clip->data_size)
+      return false;
+
+    p_block = &p_clip->p_data[p_clip->block_offset];
+    for (c=0; c<p_clip->channels; c++)
+    {
+      p_clip->predictor[c] = (int16_t)read_le16(&p_block[4*c]);
+      p_clip->index[c] = (p_block[4*c + 2] > 88) ? 88 : p_block[4*c + 2];
+      p_clip->group[0][c] = p_clip->predictor[c];
+    }
+
+    block_end = p_clip->block_offset + p_clip->block_size;
+    if (block_end > p_clip->data_size)
+      block_end = p_clip->data_size;
+    p_clip->p_read = &p_block[4*p_clip->channels];
+    p_clip->p_block_end = &p_clip->p_data[block_end];
+    p_clip->block_offset += p_clip->block_size;
+
+    p_clip->group_len = 1;
+    p_clip->group_pos = 0;
+    return true;
+  }
+
+  /* 4 bytes per channel, 8 samples each. */
+  for (c=0; c<p_clip->channels; c++)
+  {
+    for (i=0; i<4; i++)
+    {
+      byte = p_clip->p_read[4*c + i];
+      p_clip->group[2*i][c] = clip_decode_nibble(p_clip, c, byte & 0x0f);
+      p_clip->group[2*i + 1][c] = clip_decode_nibble(p_clip, c, byte >> 4);
+    }
+  }
+  p_clip->p_read += 4*p_clip->channels;
+
+  p_clip->group_len = AUDIO_CLIP_GROUP_FRAMES;
+  p_clip->group_pos = 0;
+  return true;
+}
+
+
+/**
+ * clip_next_frame()
+ *
+ * @brief Decode next input frame, mono is duplicated on both channels.
+ * @param p_clip: pointer to a `twatch_audio_clip_t` structure
+ * @param p_frame: pointer to a 2-sample array to fill
+ * @return true on success, false at end of clip.
+ **/
+
+static bool clip_next_frame(twatch_audio_clip_t *p_clip, int16_t *p_frame)
+{
+  if (p_clip->frames_decoded >= p_clip->nb_frames)
+    return false;
+
+  if (p_clip->group_pos >= p_clip->group_len)
+  {
+    if (!clip_decode_group(p_clip))
+      return false;
+  }
+
+  p_frame[0] = p_clip->group[p_clip->group_pos][0];
+  p_frame[1] = p_clip->group[p_clip->group_pos][(p_clip->channels > 1) ? 1 : 0];
+  p_clip->group_pos++;
+  p_clip->frames_decoded++;
+
+  return true;
+}
+
+
+/**
+ * twatch_audio_clip_open()
+ *
+ * @brief Open an IMA ADPCM clip, clip data is not copied and must stay
+ *        mapped while the clip is played.
+ * @param p_clip: pointer to a `twatch_audio_clip_t` structure
+ * @param p_data: pointer to clip (header and blocks)
+ * @param size: clip size in bytes
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if clip is not valid.
+ **/
+
+esp_err_t twatch_audio_clip_open(twatch_audio_clip_t *p_clip, const void *p_data, size_t size)
+{
+  const uint8_t *p_header = (const uint8_t *)p_data;
+
+  memset(p_clip, 0, sizeof(twatch_audio_clip_t));
+
+  if ((p_data == NULL) || (size < AUDIO_CLIP_HEADER_SIZE) || (read_le32(p_header) != AUDIO_CLIP_MAGIC))
+  {
+    ESP_LOGE(TAG, "not an IMA ADPCM clip");
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  p_clip->sample_rate = read_le32(&p_header[4]);
+  p_clip->nb_frames = read_le32(&p_header[8]);
+  p_clip->block_size = read_le16(&p_header[12]);
+  p_clip->channels = p_header[14];
+  p_clip->p_data = &p_header[AUDIO_CLIP_HEADER_SIZE];
+  p_clip->data_size = size - AUDIO_CLIP_HEADER_SIZE;
+
+  /* Blocks hold a header and whole groups for each channel. */
+  if ((p_clip->channels < 1) || (p_clip->channels > 2) || (p_clip->sample_rate == 0) ||
+      (p_clip->block_size < 4*p_clip->channels) || ((p_clip->block_size % (4*p_clip->channels)) != 0))
+  {
+    ESP_LOGE(TAG, "unsupported clip format");
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  twatch_audio_clip_rewind(p_clip);
+
+  /* Success. */
+  return ESP_OK;
+}
+
+
+/**
+ * twatch_audio_clip_rewind()
+ *
+ * @brief Restart clip from its first frame.
+ * @param p_clip: pointer to a `twatch_audio_clip_t` structure
+ **/
+
+void twatch_audio_clip_rewind(twatch_audio_clip_t *p_clip)
+{
+  int output_rate = twatch_audio_get_sample_rate();
+
+  p_clip->block_offset = 0;
+  p_clip->p_read = p_clip->p_data;
+  p_clip->p_block_end = p_clip->p_data;
+  p_clip->group_len = 0;
+  p_clip->group_pos = 0;
+  p_clip->frames_decoded = 0;
+  p_clip->b_last_frame = false;
+
+  p_clip->step = (uint32_t)(((uint64_t)p_clip->sample_rate << 16) / output_rate);
+  if (p_clip->step == 0)
+    p_clip->step = 1;
+
+  /* Two frames are loaded before the first output frame. */
+  p_clip->phase = 2 << 16;
+  p_clip->prev[0] = p_clip->prev[1] = 0;
+  p_clip->cur[0] = p_clip->cur[1] = 0;
+}
+
+
+/**
+ * twatch_audio_clip_set_loop()
+ *
+ * @brief Enable or disable clip looping.
+ * @param p_clip: pointer to a `twatch_audio_clip_t` structure
+ * @param b_loop: true to loop, false to play once
+ **/
+
+void twatch_audio_clip_set_loop(twatch_audio_clip_t *p_clip, bool b_loop)
+{
+  p_clip->b_loop = b_loop;
+}
+
+
+/**
+ * twatch_audio_clip_get_duration_ms()
+ *
+ * @brief Get clip duration.
+ * @param p_clip: pointer to a `twatch_audio_clip_t` structure
+ * @return duration in milliseconds
+ **/
+
+uint32_t twatch_audio_clip_get_duration_ms(twatch_audio_clip_t *p_clip)
+{
+  return (uint32_t)(((uint64_t)p_clip->nb_frames * 1000) / p_clip->sample_rate);
+}
+
+
+/**
+ * twatch_audio_clip_render()
+ *
+ * @brief Render clip frames at output rate, can be used as an audio source
+ *        render callback.
+ * @param p_clip: pointer to a `twatch_audio_clip_t` structure
+ * @param p_block: pointer to block of 16-bit stereo frames to fill
+ * @param frames: block size in frames
+ * @return number of frames written, less than `frames` at end of clip.
+ **/
+
+int twatch_audio_clip_render(void *p_clip, int16_t *p_block, int frames)
+{
+  twatch_audio_clip_t *p = (twatch_audio_clip_t *)p_clip;
+  int i;
+
+  for (i=0; i<frames; i++)
+  {
+    /* Move forward in input. */
+    while (p->phase >= (1 << 16))
+    {
+      p->prev[0] = p->cur[0];
+      p->prev[1] = p->cur[1];
+      if (!clip_next_frame(p, p->cur))
+      {
+        /* Hold last frame once so that it gets played too. */
+        if (!p->b_loop && !p->b_last_frame)
+        {
+          p->b_last_frame = true;
+          p->phase -= (1 << 16);
+          continue;
+        }
+
+        if (!p->b_loop || (p->frames_decoded == 0))
+          return i;
+
+        /* Loop, keep resampler history for a seamless join. */
+        p->block_offset = 0;
+        p->p_read = p->p_block_end = p->p_data;
+        p->group_len = p->group_pos = 0;
+        p->frames_decoded = 0;
+        if (!clip_next_frame(p, p->cur))
+          return i;
+      }
+      p->phase -= (1 << 16);
+    }
+
+    /* Linear interpolation between previous and current frames, 15-bit
+       phase keeps the product within 32 bits. */
+    p_block[2*i] = p->prev[0] + (((p->cur[0] - p->prev[0]) * (int32_t)(p->phase >> 1)) >> 15);
+    p_block[2*i + 1] = p->prev[1] + (((p->cur[1] - p->prev[1]) * (int32_t)(p->phase >> 1)) >> 15);
+    p->phase += p->step;
+  }
+
+  return frames;
+}
+
+
+/**
+ * twatch_audio_clip_play()
+ *
+ * @brief Play clip from its beginning through the audio feeder task.
+ * @param p_clip: pointer to a `twatch_audio_clip_t` structure, must stay
+ *                valid while playing
+ * @return ESP_OK on success, ESP_FAIL otherwise.
+ **/
+
+esp_err_t twatch_audio_clip_play(twatch_audio_clip_t *p_clip)
+{
+  twatch_audio_clip_rewind(p_clip);
+  return twatch_audio_play_source(twatch_audio_clip_render, p_clip);
+}
@@ -0,0 +1,557 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "hal/audio_mixer.h"
+
+#define TAG "[hal::audio_mixer]"
+
+/* Handles are made of a voice index and a generation counter, so that a
+   stale handle never controls a voice that has been reused. */
+#define VOICE_HANDLE(index, gen)  (((gen) << 8) | (index))
+#define VOICE_INDEX(handle)       ((handle) & 0xff)
+#define VOICE_GEN(handle)         (((handle) >> 8) & 0x7fff)
+
+typedef enum {
+  VOICE_PCM,
+  VOICE_CLIP,
+  VOICE_SOURCE
+} voice_type_t;
+
+typedef struct {
+  bool b_active;
+  voice_type_t type;
+  int priority;
+  uint32_t start_order;
+  uint16_t generation;
+
+  /* Gain per channel, AUDIO_MIXER_UNITY being 1.0. */
+  int32_t gain_l;
+  int32_t gain_r;
+
+  /* Voice sources. */
+  const int16_t *p_pcm;
+  size_t pcm_frames;
+  size_t pcm_pos;
+  bool b_loop;
+  twatch_audio_clip_t clip;
+  FAudioRender pfn_render;
+  void *p_source;
+} mixer_voice_t;
+
+static mixer_voice_t g_voices[AUDIO_MIXER_VOICES];
+static SemaphoreHandle_t g_mixer_lock = NULL;
+static int32_t *g_acc = NULL;
+static int16_t *g_scratch = NULL;
+static int g_block_frames = 0;
+static uint32_t g_start_order = 0;
+static twatch_audio_mixer_stats_t g_stats;
+
+
+/**
+ * mixer_pcm_render()
+ *
+ * @brief Render callback of PCM voices, played in place.
+ * @param p_source: pointer to a `mixer_voice_t` structure
+ * @param p_block: pointer to block to fill
+ * @param frames: block size in frames
+ * @return number of frames written in block.
+ **/
+
+static int mixer_pcm_render(void *p_source, int16_t *p_block, int frames)
+{
+  mixer_voice_t *p_voice = (mixer_voice_t *)p_source;
+  int filled = 0;
+  size_t chunk;
+
+  while (filled < frames)
+  {
+    if (p_voice->pcm_pos >= p_voice->pcm_frames)
+    {
+      if (!p_voice->b_loop)
+        break;
+      p_voice->pcm_pos = 0;
+    }
+
+    chunk = p_voice->pcm_frames - p_voice->pcm_pos;
+    if (chunk > (frames - filled))
+      chunk = frames - filled;
+    memcpy(&p_block[2*filled], &p_voice->p_pcm[2*p_voice->pcm_pos], chunk * AUDIO_FRAME_SIZE);
+    p_voice->pcm_pos += chunk;
+    filled += chunk;
+  }
+
+  return filled;
+}
+
+
+/**
+ * mixer_set_gain()
+ *
+ * @brief Compute per-channel gains from gain and balance.
+ * @param p_voice: pointer to a `mixer_voice_t` structure
+ * @param gain: gain, AUDIO_MIXER_UNITY being 1.0
+ * @param pan: balance, from AUDIO_MIXER_PAN_LEFT to AUDIO_MIXER_PAN_RIGHT
+ **/
+
+static void mixer_set_gain(mixer_voice_t *p_voice, int gain, int pan)
+{
+  if (gain < 0)
+    gain = 0;
+  if (pan < AUDIO_MIXER_PAN_LEFT)
+    pan = AUDIO_MIXER_PAN_LEFT;
+  else if (pan > AUDIO_MIXER_PAN_RIGHT)
+    pan = AUDIO_MIXER_PAN_RIGHT;
+
+  p_voice->gain_l = (pan > 0) ? (gain * (AUDIO_MIXER_PAN_RIGHT - pan)) / AUDIO_MIXER_PAN_RIGHT : gain;
+  p_voice->gain_r = (pan < 0) ? (gain * (AUDIO_MIXER_PAN_RIGHT + pan)) / AUDIO_MIXER_PAN_RIGHT : gain;
+}
+
+
+/**
+ * mixer_get_voice()
+ *
+ * @brief Find the voice matching a handle, mixer lock must be held.
+ * @param voice: voice handle
+ * @return pointer to a `mixer_voice_t` structure, NULL if handle is stale.
+ **/
+
+static mixer_voice_t *mixer_get_voice(twatch_audio_voice_t voice)
+{
+  mixer_voice_t *p_voice;
+
+  if ((voice < 0) || (VOICE_INDEX(voice) >= AUDIO_MIXER_VOICES))
+    return NULL;
+
+  p_voice = &g_voices[VOICE_INDEX(voice)];
+  if (!p_voice->b_active || (p_voice->generation != VOICE_GEN(voice)))
+    return NULL;
+
+  return p_voice;
+}
+
+
+/**
+ * mixer_alloc_voice()
+ *
+ * @brief Allocate a voice, stealing the oldest voice with the lowest
+ *        priority if none is free. Mixer lock must be held.
+ * @param priority: priority of the new voice
+ * @return voice index, -1 if every voice has a higher priority.
+ **/
+
+static int mixer_alloc_voice(int priority)
+{
+  int i, victim = -1;
+
+  for (i=0; i<AUDIO_MIXER_VOICES; i++)
+  {
+    if (!g_voices[i].b_active)
+      return i;
+
+    if (g_voices[i].priority > priority)
+      continue;
+
+    if ((victim < 0) ||
+        (g_voices[i].priority < g_voices[victim].priority) ||
+        ((g_voices[i].priority == g_voices[victim].priority) &&
+         ((int32_t)(g_voices[i].start_order - g_voices[victim].start_order) < 0)))
+      victim = i;
+  }
+
+  if (victim >= 0)
+    g_stats.nb_stolen++;
+  return victim;
+}
+
+
+/**
+ * mixer_start_voice()
+ *
+ * @brief Allocate and start a voice.
+ * @param p_template: voice settings (type and source)
+ * @param gain: voice gain
+ * @param pan: voice balance
+ * @param priority: voice priority
+ * @return voice handle, -1 on error.
+ **/
+
+static twatch_audio_voice_t mixer_start_voice(mixer_voice_t *p_template, int gain, int pan, int priority)
+{
+  mixer_voice_t *p_voice;
+  uint16_t generation;
+  int index;
+
+  if (g_mixer_lock == NULL)
+    return -1;
+
+  xSemaphoreTake(g_mixer_lock, portMAX_DELAY);
+  index = mixer_alloc_voice(priority);
+  if (index < 0)
+  {
+    xSemaphoreGive(g_mixer_lock);
+    ESP_LOGW(TAG, "no voice available");
+    return -1;
+  }
+
+  p_voice = &g_voices[index];
+  generation = (p_voice->generation + 1) & 0x7fff;
+  memcpy(p_voice, p_template, sizeof(mixer_voice_t));
+  p_voice->generation = generation;
+  p_voice->priority = priority;
+  p_voice->start_order = g_start_order++;
+  mixer_set_gain(p_voice, gain, pan);
+
+  /* Built-in sources render from the voice itself. */
+  if (p_voice->type == VOICE_PCM)
+  {
+    p_voice->pfn_render = mixer_pcm_render;
+    p_voice->p_source = p_voice;
+  }
+  else if (p_voice->type == VOICE_CLIP)
+  {
+    p_voice->pfn_render = twatch_audio_clip_render;
+    p_voice->p_source = &p_voice->clip;
+  }
+  p_voice->b_active = true;
+  xSemaphoreGive(g_mixer_lock);
+
+  /* Make sure the feeder is running. */
+  twatch_audio_wake();
+
+  return VOICE_HANDLE(index, generation);
+}
+
+
+/**
+ * audio_mixer_setup()
+ *
+ * @brief Allocate mixing buffers, called by audio initialization.
+ * @param block_frames: feeder block size in frames
+ * @return ESP_OK on success, ESP_FAIL otherwise.
+ **/
+
+esp_err_t audio_mixer_setup(int block_frames)
+{
+  audio_mixer_teardown();
+
+  g_mixer_lock = xSemaphoreCreateMutex();
+  g_acc = (int32_t *)malloc(block_frames * 2 * sizeof(int32_t));
+  g_scratch = (int16_t *)malloc(block_frames * AUDIO_FRAME_SIZE);
+  if ((g_mixer_lock == NULL) || (g_acc == NULL) || (g_scratch == NULL))
+  {
+    audio_mixer_teardown();
+    return ESP_FAIL;
+  }
+
+  g_block_frames = block_frames;
+  memset(g_voices, 0, sizeof(g_voices));
+  twatch_audio_mixer_reset_stats();
+
+  /* Success. */
+  return ESP_OK;
+}
+
+
+/**
+ * audio_mixer_teardown()
+ *
+ * @brief Release mixing buffers.
+ **/
+
+void audio_mixer_teardown(void)
+{
+  if (g_mixer_lock != NULL)
+    vSemaphoreDelete(g_mixer_lock);
+  free(g_acc);
+  free(g_scratch);
+  g_mixer_lock = NULL;
+  g_acc = NULL;
+  g_scratch = NULL;
+  g_block_frames = 0;
+}
+
+
+/**
+ * audio_mixer_mix()
+ *
+ * @brief Mix active voices into a block, called by the feeder task. The
+ *        cost is bounded by AUDIO_MIXER_VOICES renders of one block.
+ * @param p_block: pointer to block holding streamed frames (or silence)
+ * @param frames: block size in frames
+ * @return number of voices mixed.
+ **/
+
+int audio_mixer_mix(int16_t *p_block, int frames)
+{
+  mixer_voice_t *p_voice;
+  int64_t start;
+  int32_t sample;
+  int i, v, rendered, nb_voices = 0;
+
+  if ((g_mixer_lock == NULL) || (frames > g_block_frames))
+    return 0;
+
+  xSemaphoreTake(g_mixer_lock, portMAX_DELAY);
+  start = esp_timer_get_time();
+
+  for (v=0; v<AUDIO_MIXER_VOICES; v++)
+  {
+    p_voice = &g_voices[v];
+    if (!p_voice->b_active)
+      continue;
+
+    /* First voice, start from streamed frames. */
+    if (nb_voices++ == 0)
+    {
+      for (i=0; i<2*frames; i++)
+        g_acc[i] = p_block[i];
+    }
+
+    rendered = p_voice->pfn_render(p_voice->p_source, g_scratch, frames);
+    for (i=0; i<rendered; i++)
+    {
+      g_acc[2*i] += (g_scratch[2*i] * p_voice->gain_l) >> 8;
+      g_acc[2*i + 1] += (g_scratch[2*i + 1] * p_voice->gain_r) >> 8;
+    }
+
+    /* One-shot voice is over. */
+    if (rendered < frames)
+      p_voice->b_active = false;
+  }
+
+  if (nb_voices > 0)
+  {
+    /* Saturate back to 16 bits. */
+    for (i=0; i<2*frames; i++)
+    {
+      sample = g_acc[i];
+      if (sample > 32767)
+        sample = 32767;
+      else if (sample < -32768)
+        sample = -32768;
+      p_block[i] = sample;
+    }
+
+    g_stats.nb_blocks++;
+    g_stats.last_block_us = (uint32_t)(esp_timer_get_time() - start);
+    if (g_stats.last_block_us > g_stats.max_block_us)
+      g_stats.max_block_us = g_stats.last_block_us;
+    if (nb_voices > g_stats.max_voices)
+      g_stats.max_voices = nb_voices;
+  }
+  xSemaphoreGive(g_mixer_lock);
+
+  return nb_voices;
+}
+
+
+/**
+ * twatch_audio_mixer_play_pcm()
+ *
+ * @brief Play 16-bit stereo frames in place on a voice.
+ * @param p_frames: pointer to frames, must stay valid while playing
+ * @param nb_frames: number of frames
+ * @param b_loop: true to loop, false to play once
+ * @param gain: voice gain, AUDIO_MIXER_UNITY being 1.0
+ * @param pan: voice balance, from AUDIO_MIXER_PAN_LEFT to AUDIO_MIXER_PAN_RIGHT
+ * @param priority: voice priority, used when stealing voices
+ * @return voice handle, -1 on error.
+ **/
+
+twatch_audio_voice_t twatch_audio_mixer_play_pcm(const int16_t *p_frames, size_t nb_frames, bool b_loop, int gain, int pan, int priority)
+{
+  mixer_voice_t voice;
+
+  if ((p_frames == NULL) || (nb_frames == 0))
+    return -1;
+
+  memset(&voice, 0, sizeof(mixer_voice_t));
+  voice.type = VOICE_PCM;
+  voice.p_pcm = p_frames;
+  voice.pcm_frames = nb_frames;
+  voice.b_loop = b_loop;
+  return mixer_start_voice(&voice, gain, pan, priority);
+}
+
+
+/**
+ * twatch_audio_mixer_play_clip()
+ *
+ * @brief Play an IMA ADPCM clip on a voice.
+ * @param p_clip: pointer to clip data, must stay mapped while playing
+ * @param size: clip size in bytes
+ * @param b_loop: true to loop, false to play once
+ * @param gain: voice gain, AUDIO_MIXER_UNITY being 1.0
+ * @param pan: voice balance, from AUDIO_MIXER_PAN_LEFT to AUDIO_MIXER_PAN_RIGHT
+ * @param priority: voice priority, used when stealing voices
+ * @return voice handle, -1 on error.
+ **/
+
+twatch_audio_voice_t twatch_audio_mixer_play_clip(const void *p_clip, size_t size, bool b_loop, int gain, int pan, int priority)
+{
+  mixer_voice_t voice;
+
+  memset(&voice, 0, sizeof(mixer_voice_t));
+  voice.type = VOICE_CLIP;
+  if (twatch_audio_clip_open(&voice.clip, p_clip, size) != ESP_OK)
+    return -1;
+  twatch_audio_clip_set_loop(&voice.clip, b_loop);
+  return mixer_start_voice(&voice, gain, pan, priority);
+}
+
+
+/**
+ * twatch_audio_mixer_play_source()
+ *
+ * @brief Play frames rendered by a source on a voice.
+ * @param pfn_render: render callback, called from the feeder task
+ * @param p_source: pointer passed to render callback
+ * @param gain: voice gain, AUDIO_MIXER_UNITY being 1.0
+ * @param pan: voice balance, from AUDIO_MIXER_PAN_LEFT to AUDIO_MIXER_PAN_RIGHT
+ * @param priority: voice priority, used when stealing voices
+ * @return voice handle, -1 on error.
+ **/
+
+twatch_audio_voice_t twatch_audio_mixer_play_source(FAudioRender pfn_render, void *p_source, int gain, int pan, int priority)
+{
+  mixer_voice_t voice;
+
+  if (pfn_render == NULL)
+    return -1;
+
+  memset(&voice, 0, sizeof(mixer_voice_t));
+  voice.type = VOICE_SOURCE;
+  voice.pfn_render = pfn_render;
+  voice.p_source = p_source;
+  return mixer_start_voice(&voice, gain, pan, priority);
+}
+
+
+/**
+ * twatch_audio_mixer_stop()
+ *
+ * @brief Stop a voice.
+ * @param voice: voice handle
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if voice is not playing.
+ **/
+
+esp_err_t twatch_audio_mixer_stop(twatch_audio_voice_t voice)
+{
+  mixer_voice_t *p_voice;
+
+  if (g_mixer_lock == NULL)
+    return ESP_FAIL;
+
+  xSemaphoreTake(g_mixer_lock, portMAX_DELAY);
+  p_voice = mixer_get_voice(voice);
+  if (p_voice != NULL)
+    p_voice->b_active = false;
+  xSemaphoreGive(g_mixer_lock);
+
+  return (p_voice != NULL) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+
+/**
+ * twatch_audio_mixer_stop_all()
+ *
+ * @brief Stop every voice.
+ * @return ESP_OK on success, ESP_FAIL otherwise.
+ **/
+
+esp_err_t twatch_audio_mixer_stop_all(void)
+{
+  int i;
+
+  if (g_mixer_lock == NULL)
+    return ESP_FAIL;
+
+  xSemaphoreTake(g_mixer_lock, portMAX_DELAY);
+  for (i=0; i<AUDIO_MIXER_VOICES; i++)
+    g_voices[i].b_active = false;
+  xSemaphoreGive(g_mixer_lock);
+
+  /* Success. */
+  return ESP_OK;
+}
+
+
+/**
+ * twatch_audio_mixer_set_gain()
+ *
+ * @brief Change voice gain and balance while playing.
+ * @param voice: voice handle
+ * @param gain: voice gain, AUDIO_MIXER_UNITY being 1.0
+ * @param pan: voice balance, from AUDIO_MIXER_PAN_LEFT to AUDIO_MIXER_PAN_RIGHT
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if voice is not playing.
+ **/
+
+esp_err_t twatch_audio_mixer_set_gain(twatch_audio_voice_t voice, int gain, int pan)
+{
+  mixer_voice_t *p_voice;
+
+  if (g_mixer_lock == NULL)
+    return ESP_FAIL;
+
+  xSemaphoreTake(g_mixer_lock, portMAX_DELAY);
+  p_voice = mixer_get_voice(voice);
+  if (p_voice != NULL)
+    mixer_set_gain(p_voice, gain, pan);
+  xSemaphoreGive(g_mixer_lock);
+
+  return (p_voice != NULL) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+
+/**
+ * twatch_audio_mixer_is_playing()
+ *
+ * @brief Tell if a voice is still playing.
+ * @param voice: voice handle
+ * @return true if playing, false otherwise.
+ **/
+
+bool twatch_audio_mixer_is_playing(twatch_audio_voice_t voice)
+{
+  bool b_playing;
+
+  if (g_mixer_lock == NULL)
+    return false;
+
+  xSemaphoreTake(g_mixer_lock, portMAX_DELAY);
+  b_playing = (mixer_get_voice(voice) != NULL);
+  xSemaphoreGive(g_mixer_lock);
+
+  return b_playing;
+}
+
+
+/**
+ * twatch_audio_mixer_get_stats()
+ *
+ * @brief Get mixer statistics, compare block times to the block period to
+ *        check the remaining CPU headroom.
+ * @param p_stats: pointer to a `twatch_audio_mixer_stats_t` structure
+ **/
+
+void twatch_audio_mixer_get_stats(twatch_audio_mixer_stats_t *p_stats)
+{
+  memcpy(p_stats, &g_stats, sizeof(twatch_audio_mixer_stats_t));
+  p_stats->block_period_us = (g_block_frames > 0) ?
+    (uint32_t)(((uint64_t)g_block_frames * 1000000) / twatch_audio_get_sample_rate()) : 0;
+}
+
+
+/**
+ * twatch_audio_mixer_reset_stats()
+ *
+ * @brief Reset mixer statistics.
+ **/
+
+void twatch_audio_mixer_reset_stats(void)
+{
+  memset(&g_stats, 0, sizeof(twatch_audio_mixer_stats_t));
+}
@@ -0,0 +1,413 @@
+#include <string.h>
+#include "esp_log.h"
+#include "hal/audio_synth.h"
+
+#define TAG "[hal::audio_synth]"
+
+#define ENV_MAX     (1 << 24)
+
+/* One period of a sine wave. */
+static const int16_t g_sine_table[256] = {
+  0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739,
+  9512, 10278, 11039, 11793, 12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+  18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594, 23170, 23731, 24279, 24811,
+  25329, 25832, 26319, 26790, 27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+  30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521,
+  32609, 32678, 32728, 32757, 32767, 32757, 32728, 32678, 32609, 32521, 32412, 32285,
+  32137, 31971, 31785, 31580, 31356, 31113, 30852, 30571, 30273, 29956, 29621, 29268,
+  28898, 28510, 28105, 27683, 27245, 26790, 26319, 25832, 25329, 24811, 24279, 23731,
+  23170, 22594, 22005, 21403, 20787, 20159, 19519, 18868, 18204, 17530, 16846, 16151,
+  15446, 14732, 14010, 13279, 12539, 11793, 11039, 10278, 9512, 8739, 7962, 7179,
+  6393, 5602, 4808, 4011, 3212, 2410, 1608, 804, 0, -804, -1608, -2410,
+  -3212, -4011, -4808, -5602, -6393, -7179, -7962, -8739, -9512, -10278, -11039, -11793,
+  -12539, -13279, -14010, -14732, -15446, -16151, -16846, -17530, -18204, -18868, -19519, -20159,
+  -20787, -21403, -22005, -22594, -23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790,
+  -27245, -27683, -28105, -28510, -28898, -29268, -29621, -29956, -30273, -30571, -30852, -31113,
+  -31356, -31580, -31785, -31971, -32137, -32285, -32412, -32521, -32609, -32678, -32728, -32757,
+  -32767, -32757, -32728, -32678, -32609, -32521, -32412, -32285, -32137, -31971, -31785, -31580,
+  -31356, -31113, -30852, -30571, -30273, -29956, -29621, -29268, -28898, -28510, -28105, -27683,
+  -27245, -26790, -26319, -25832, -25329, -24811, -24279, -23731, -23170, -22594, -22005, -21403,
+  -20787, -20159, -19519, -18868, -18204, -17530, -16846, -16151, -15446, -14732, -14010, -13279,
+  -12539, -11793, -11039, -10278, -9512, -8739, -7962, -7179, -6393, -5602, -4808, -4011,
+  -3212, -2410, -1608, -804
+};
+
+/* Frequencies of MIDI notes 120 to 131 in mHz, lower octaves are obtained
+   by shifting. */
+static const uint32_t g_note_freqs[12] = {
+  8372018, 8869844, 9397273, 9956063, 10548082, 11175303,
+  11839822, 12543854, 13289750, 14080000, 14917240, 15804266
+};
+
+/* Built-in sounds. */
+const uint8_t twatch_synth_beep[] = {
+  SYNTH_WAVE(SYNTH_SQUARE), SYNTH_TICK(40), SYNTH_VOLUME(96),
+  SYNTH_ENVELOPE(0, 0, 255, 1),
+  SYNTH_NOTE(SYNTH_C6, 2),
+  SYNTH_END
+};
+
+const uint8_t twatch_synth_chime[] = {
+  SYNTH_WAVE(SYNTH_SINE), SYNTH_TICK(100), SYNTH_VOLUME(200),
+  SYNTH_ENVELOPE(1, 20, 80, 15),
+  SYNTH_NOTE(SYNTH_E5, 3), SYNTH_NOTE(SYNTH_C5, 6),
+  SYNTH_END
+};
+
+const uint8_t twatch_synth_alarm[] = {
+  SYNTH_WAVE(SYNTH_TRIANGLE), SYNTH_TICK(60), SYNTH_VOLUME(220),
+  SYNTH_ENVELOPE(0, 0, 255, 2),
+  SYNTH_NOTE(SYNTH_C6, 2), SYNTH_NOTE(SYNTH_REST, 1),
+  SYNTH_NOTE(SYNTH_C6, 2), SYNTH_NOTE(SYNTH_REST, 1),
+  SYNTH_NOTE(SYNTH_C6, 2), SYNTH_NOTE(SYNTH_REST, 10),
+  SYNTH_REPEAT(0),
+  SYNTH_END
+};
+
+
+/**
+ * synth_ms_to_samples()
+ *
+ * @brief Convert a duration into a number of samples.
+ * @param p_synth: pointer to a `twatch_audio_synth_t` structure
+ * @param ms: duration in milliseconds
+ * @return number of samples
+ **/
+
+static uint32_t synth_ms_to_samples(twatch_audio_synth_t *p_synth, uint32_t ms)
+{
+  return (uint32_t)(((uint64_t)ms * p_synth->rate) / 1000);
+}
+
+
+/**
+ * synth_set_env_ramp()
+ *
+ * @brief Set envelope slope to reach a level in a given time.
+ * @param p_synth: pointer to a `twatch_audio_synth_t` structure
+ * @param state: envelope state
+ * @param target: level to reach (Q24)
+ * @param time: ramp duration in 10ms units
+ **/
+
+static void synth_set_env_ramp(twatch_audio_synth_t *p_synth, synth_env_state_t state, int32_t target, uint8_t time)
+{
+  uint32_t samples = synth_ms_to_samples(p_synth, time * 10);
+
+  p_synth->env_state = state;
+  if (samples == 0)
+  {
+    /* Immediate, reached on next sample. */
+    p_synth->level_inc = target - p_synth->level;
+  }
+  else
+  {
+    p_synth->level_inc = (target - p_synth->level) / (int32_t)samples;
+    if (p_synth->level_inc == 0)
+      p_synth->level_inc = (target > p_synth->level) ? 1 : -1;
+  }
+}
+
+
+/**
+ * synth_start_note()
+ *
+ * @brief Start a note, keeping oscillator phase and envelope level to
+ *        avoid clicks.
+ * @param p_synth: pointer to a `twatch_audio_synth_t` structure
+ * @param note: MIDI note, SYNTH_REST for a rest
+ * @param ticks: note duration in ticks
+ **/
+
+static void synth_start_note(twatch_audio_synth_t *p_synth, uint8_t note, uint8_t ticks)
+{
+  uint32_t release_samples;
+  uint32_t freq;
+
+  p_synth->note_samples = synth_ms_to_samples(p_synth, p_synth->tick_ms * ticks);
+  if (p_synth->note_samples == 0)
+    p_synth->note_samples = 1;
+
+  if (note == SYNTH_REST)
+  {
+    /* Let previous note finish its release. */
+    p_synth->gate_samples = 0;
+    return;
+  }
+
+  freq = g_note_freqs[note % 12] >> (10 - (note / 12));
+  p_synth->phase_inc = (uint32_t)(((uint64_t)freq << 32) / ((uint64_t)p_synth->rate * 1000));
+
+  /* Release ends with the note. */
+  release_samples = synth_ms_to_samples(p_synth, p_synth->release * 10);
+  p_synth->gate_samples = (p_synth->note_samples > release_samples) ? p_synth->note_samples - release_samples : 0;
+
+  p_synth->sustain_level = (int32_t)(((int64_t)p_synth->sustain * ENV_MAX) / 255);
+  synth_set_env_ramp(p_synth, SYNTH_ENV_ATTACK, ENV_MAX, p_synth->attack);
+}
+
+
+/**
+ * synth_next_event()
+ *
+ * @brief Run sequence commands up to the next note.
+ * @param p_synth: pointer to a `twatch_audio_synth_t` structure
+ * @return true if a note has been started, false at end of sequence.
+ **/
+
+static bool synth_next_event(twatch_audio_synth_t *p_synth)
+{
+  const uint8_t *p_seq = p_synth->p_sequence;
+  bool b_note_seen = (p_synth->pos > 0);
+  uint8_t cmd;
+
+  if (p_seq == NULL)
+    return false;
+
+  while (1)
+  {
+    cmd = p_seq[p_synth->pos];
+
+    /* Note. */
+    if (cmd < SYNTH_CMD_WAVE)
+    {
+      synth_start_note(p_synth, cmd, p_seq[p_synth->pos + 1]);
+      p_synth->pos += 2;
+      return true;
+    }
+
+    switch (cmd)
+    {
+      case SYNTH_CMD_WAVE:
+        {
+          p_synth->wave = (synth_wave_t)p_seq[p_synth->pos + 1];
+          p_synth->pos += 2;
+        }
+        break;
+
+      case SYNTH_CMD_TICK:
+        {
+          p_synth->tick_ms = p_seq[p_synth->pos + 1];
+          p_synth->pos += 2;
+        }
+        break;
+
+      case SYNTH_CMD_VOLUME:
+        {
+          p_synth->volume = p_seq[p_synth->pos + 1];
+          p_synth->pos += 2;
+        }
+        break;
+
+      case SYNTH_CMD_ENVELOPE:
+        {
+          p_synth->attack = p_seq[p_synth->pos + 1];
+          p_synth->decay = p_seq[p_synth->pos + 2];
+          p_synth->sustain = p_seq[p_synth->pos + 3];
+          p_synth->release = p_seq[p_synth->pos + 4];
+          p_synth->pos += 5;
+        }
+        break;
+
+      case SYNTH_CMD_REPEAT:
+        {
+          if (!p_synth->b_repeat_set)
+          {
+            p_synth->repeat = (p_seq[p_synth->pos + 1] == 0) ? -1 : p_seq[p_synth->pos + 1];
+            p_synth->b_repeat_set = true;
+          }
+
+          /* A sequence without notes would loop forever. */
+          if (b_note_seen && (p_synth->repeat != 0))
+          {
+            if (p_synth->repeat > 0)
+              p_synth->repeat--;
+            p_synth->pos = 0;
+            b_note_seen = false;
+          }
+          else
+          {
+            p_synth->b_repeat_set = false;
+            p_synth->pos += 2;
+          }
+        }
+        break;
+
+      default:
+        return false;
+    }
+  }
+}
+
+
+/**
+ * synth_oscillator()
+ *
+ * @brief Compute oscillator output for the current phase.
+ * @param p_synth: pointer to a `twatch_audio_synth_t` structure
+ * @return sample
+ **/
+
+static int32_t synth_oscillator(twatch_audio_synth_t *p_synth)
+{
+  int32_t value;
+
+  switch (p_synth->wave)
+  {
+    case SYNTH_SQUARE:
+      return (p_synth->phase < 0x80000000) ? 32767 : -32767;
+
+    case SYNTH_TRIANGLE:
+      {
+        value = p_synth->phase >> 15;
+        if (value >= 65536)
+          value = 131071 - value;
+        return value - 32768;
+      }
+
+    default:
+      return g_sine_table[p_synth->phase >> 24];
+  }
+}
+
+
+/**
+ * twatch_audio_synth_init()
+ *
+ * @brief Initialize a synthesizer with default settings (sine wave,
+ *        100ms ticks, short attack and release).
+ * @param p_synth: pointer to a `twatch_audio_synth_t` structure
+ **/
+
+void twatch_audio_synth_init(twatch_audio_synth_t *p_synth)
+{
+  memset(p_synth, 0, sizeof(twatch_audio_synth_t));
+  p_synth->wave = SYNTH_SINE;
+  p_synth->tick_ms = 100;
+  p_synth->volume = 192;
+  p_synth->attack = 1;
+  p_synth->decay = 0;
+  p_synth->sustain = 255;
+  p_synth->release = 2;
+  p_synth->rate = twatch_audio_get_sample_rate();
+}
+
+
+/**
+ * twatch_audio_synth_start()
+ *
+ * @brief Start playing a sequence from its beginning, settings are reset.
+ * @param p_synth: pointer to a `twatch_audio_synth_t` structure
+ * @param p_sequence: pointer to sequence, must stay valid while playing
+ **/
+
+void twatch_audio_synth_start(twatch_audio_synth_t *p_synth, const uint8_t *p_sequence)
+{
+  twatch_audio_synth_init(p_synth);
+  p_synth->p_sequence = p_sequence;
+}
+
+
+/**
+ * twatch_audio_synth_render()
+ *
+ * @brief Render synthesizer output, can be used as an audio source
+ *        render callback.
+ * @param p_synth: pointer to a `twatch_audio_synth_t` structure
+ * @param p_block: pointer to block of 16-bit stereo frames to fill
+ * @param frames: block size in frames
+ * @return number of frames written, less than `frames` at end of sequence.
+ **/
+
+int twatch_audio_synth_render(void *p_synth, int16_t *p_block, int frames)
+{
+  twatch_audio_synth_t *p = (twatch_audio_synth_t *)p_synth;
+  int32_t sample;
+  int i;
+
+  for (i=0; i<frames; i++)
+  {
+    if (p->note_samples == 0)
+    {
+      if (!synth_next_event(p))
+        return i;
+    }
+
+    /* End of gate. */
+    if ((p->gate_samples == 0) && (p->env_state != SYNTH_ENV_IDLE) && (p->env_state != SYNTH_ENV_RELEASE))
+      synth_set_env_ramp(p, SYNTH_ENV_RELEASE, 0, p->release);
+
+    /* Envelope. */
+    switch (p->env_state)
+    {
+      case SYNTH_ENV_ATTACK:
+        {
+          p->level += p->level_inc;
+          if (p->level >= ENV_MAX)
+          {
+            p->level = ENV_MAX;
+            synth_set_env_ramp(p, SYNTH_ENV_DECAY, p->sustain_level, p->decay);
+          }
+        }
+        break;
+
+      case SYNTH_ENV_DECAY:
+        {
+          p->level += p->level_inc;
+          if (p->level <= p->sustain_level)
+          {
+            p->level = p->sustain_level;
+            p->env_state = SYNTH_ENV_SUSTAIN;
+          }
+        }
+        break;
+
+      case SYNTH_ENV_RELEASE:
+        {
+          p->level += p->level_inc;
+          if (p->level <= 0)
+          {
+            p->level = 0;
+            p->env_state = SYNTH_ENV_IDLE;
+          }
+        }
+        break;
+
+      default:
+        break;
+    }
+
+    /* Oscillator scaled by envelope (Q15) and volume. */
+    sample = (synth_oscillator(p) * (p->level >> 9)) >> 15;
+    sample = (sample * p->volume) >> 8;
+    p_block[2*i] = sample;
+    p_block[2*i + 1] = sample;
+
+    p->phase += p->phase_inc;
+    p->note_samples--;
+    if (p->gate_samples > 0)
+      p->gate_samples--;
+  }
+
+  return frames;
+}
+
+
+/**
+ * twatch_audio_synth_play()
+ *
+ * @brief Play a sequence on a mixer voice.
+ * @param p_synth: pointer to a `twatch_audio_synth_t` structure, must stay
+ *                 valid while playing
+ * @param p_sequence: pointer to sequence, must stay valid while playing
+ * @param gain: voice gain, AUDIO_MIXER_UNITY being 1.0
+ * @param pan: voice balance, from AUDIO_MIXER_PAN_LEFT to AUDIO_MIXER_PAN_RIGHT
+ * @param priority: voice priority, used when stealing voices
+ * @return voice handle, -1 on error.
+ **/
+
+twatch_audio_voice_t twatch_audio_synth_play(twatch_audio_synth_t *p_synth, const uint8_t *p_sequence, int gain, int pan, int priority)
+{
+  twatch_audio_synth_start(p_synth, p_sequence);
+  return twatch_audio_mixer_play_source(twatch_audio_synth_render, p_synth, gain, pan, priority);
+}
@@ -0,0 +1,422 @@
+#include "hal/gauge.h"
+#include "hal/pmu.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+#define TAG "[hal::gauge]"
+
+#define GAUGE_MAGIC             0x47415547
+
+/* Below this current (mA), battery is considered at rest. */
+#define GAUGE_REST_MA           15
+
+/**
+ * Time constants (seconds) of the correction toward the OCV estimate.
+ * At rest the voltage is trusted, under load it depends on the internal
+ * resistance estimate and only slowly cancels counter drift.
+ **/
+
+#define GAUGE_REST_TAU_S        60
+#define GAUGE_LOAD_TAU_S        1800
+
+/* Reported level may only move against current by more than this. */
+#define GAUGE_LEVEL_HYSTERESIS  5
+
+/* Current average weight (1/8), average is kept in 1/16 mA. */
+#define GAUGE_AVG_DIV           8
+#define GAUGE_AVG_SCALE         16
+
+/* One coulomb counter unit is 65536 * 0.5 mA / ADC rate, in mA.s. */
+#define GAUGE_COUNT_MAS         32768
+
+/* LiPo open-circuit voltage (mV) from 0% to 100%, in 5% steps. */
+static const uint16_t g_gauge_ocv[] = {
+  3300, 3610, 3690, 3710, 3730, 3750, 3770, 3790, 3800, 3820, 3840,
+  3850, 3870, 3910, 3950, 3980, 4020, 4080, 4110, 4150, 4200
+};
+
+#define GAUGE_OCV_POINTS  (sizeof(g_gauge_ocv)/sizeof(uint16_t))
+
+/* Gauge state, kept across deep sleep. */
+typedef struct {
+  uint32_t magic;
+  int64_t charge_mas;       /* Remaining charge in mA.s. */
+  uint32_t last_charge;     /* Last coulomb counter values. */
+  uint32_t last_discharge;
+  int rate;                 /* ADC rate the counters were sampled at. */
+  int capacity_mah;
+  int resistance_mohm;
+  int avg_current;          /* Averaged current, in 1/GAUGE_AVG_SCALE mA. */
+  int level;
+} gauge_state_t;
+
+RTC_DATA_ATTR static gauge_state_t g_gauge_state;
+
+static struct {
+  SemaphoreHandle_t lock;
+  bool b_enabled;           /* Initialized, gauge is disabled otherwise. */
+  bool b_valid;
+  int64_t last_update_us;
+  twatch_gauge_status_t status;
+} g_gauge;
+
+
+/**
+ * gauge_ocv_to_permille()
+ *
+ * @brief Convert an open-circuit voltage into a state of charge.
+ * @param ocv_mv: open-circuit voltage in millivolts
+ * @return state of charge in permille
+ **/
+
+static int gauge_ocv_to_permille(int ocv_mv)
+{
+  int i;
+
+  if (ocv_mv <= g_gauge_ocv[0])
+    return 0;
+  if (ocv_mv >= g_gauge_ocv[GAUGE_OCV_POINTS - 1])
+    return 1000;
+
+  for (i=1; i<GAUGE_OCV_POINTS; i++)
+  {
+    if (ocv_mv < g_gauge_ocv[i])
+    {
+      return (i - 1) * 50 +
+        ((ocv_mv - g_gauge_ocv[i - 1]) * 50) / (g_gauge_ocv[i] - g_gauge_ocv[i - 1]);
+    }
+  }
+
+  return 1000;
+}
+
+
+/**
+ * gauge_full_mas()
+ *
+ * @brief Get full charge capacity in mA.s.
+ * @return full charge capacity
+ **/
+
+static int64_t gauge_full_mas(void)
+{
+  return (int64_t)g_gauge_state.capacity_mah * 3600;
+}
+
+
+/**
+ * gauge_seed()
+ *
+ * @brief Restart gauge from a voltage-based estimate.
+ * @param soc_permille: estimated state of charge
+ * @param charge: current charge counter value
+ * @param discharge: current discharge counter value
+ * @param rate: current ADC rate
+ **/
+
+static void gauge_seed(int soc_permille, uint32_t charge, uint32_t discharge, int rate)
+{
+  if (g_gauge_state.magic != GAUGE_MAGIC)
+  {
+    g_gauge_state.capacity_mah = GAUGE_DEFAULT_CAPACITY_MAH;
+    g_gauge_state.resistance_mohm = GAUGE_DEFAULT_RESISTANCE_MOHM;
+    g_gauge_state.avg_current = 0;
+  }
+
+  g_gauge_state.charge_mas = (gauge_full_mas() * soc_permille) / 1000;
+  g_gauge_state.last_charge = charge;
+  g_gauge_state.last_discharge = discharge;
+  g_gauge_state.rate = rate;
+  g_gauge_state.level = -1;
+  g_gauge_state.magic = GAUGE_MAGIC;
+}
+
+
+/**
+ * gauge_refresh()
+ *
+ * @brief Read battery status and coulomb counters, and update gauge.
+ *        Must be called with gauge locked.
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+static esp_err_t gauge_refresh(void)
+{
+  axp_batt_status_t batt;
+  uint32_t charge, discharge;
+  int rate, current, avg_current, ocv, soc_ocv, soc, level, tau_s;
+  int64_t now, dt_ms, full, delta;
+
+  if (axpxx_getBattStatus(&batt) != AXP_PASS)
+    return ESP_FAIL;
+  if (axpxx_getCoulombCounters(&charge, &discharge, &rate) != AXP_PASS)
+    return ESP_FAIL;
+  if (!batt.connected)
+    return ESP_FAIL;
+
+  now = esp_timer_get_time();
+  dt_ms = g_gauge.b_valid ? (now - g_gauge.last_update_us) / 1000 : GAUGE_UPDATE_MIN_MS;
+  g_gauge.last_update_us = now;
+
+  /* Load-compensated voltage. */
+  current = (int)batt.charge_current - (int)batt.discharge_current;
+  ocv = (int)batt.voltage - (current * g_gauge_state.resistance_mohm) / 1000;
+  soc_ocv = gauge_ocv_to_permille(ocv);
+
+  if (g_gauge_state.magic != GAUGE_MAGIC)
+  {
+    /* Cold boot, start from voltage. */
+    gauge_seed(soc_ocv, charge, discharge, rate);
+  }
+  else if ((charge < g_gauge_state.last_charge) || (discharge < g_gauge_state.last_discharge))
+  {
+    /* Counters have been reset (battery removed ?), start over. */
+    ESP_LOGW(TAG, "coulomb counters reset, reseeding gauge");
+    gauge_seed(soc_ocv, charge, discharge, rate);
+  }
+  else
+  {
+    /* Integrate charge since last update. */
+    delta = (int64_t)(charge - g_gauge_state.last_charge) -
+            (int64_t)(discharge - g_gauge_state.last_discharge);
+    g_gauge_state.charge_mas += (delta * GAUGE_COUNT_MAS) / g_gauge_state.rate;
+    g_gauge_state.last_charge = charge;
+    g_gauge_state.last_discharge = discharge;
+    g_gauge_state.rate = rate;
+  }
+
+  g_gauge_state.avg_current += (current * GAUGE_AVG_SCALE - g_gauge_state.avg_current) / GAUGE_AVG_DIV;
+  avg_current = g_gauge_state.avg_current / GAUGE_AVG_SCALE;
+  full = gauge_full_mas();
+
+  /**
+   * Pull charge toward the OCV estimate to cancel counter drift. Voltage
+   * is meaningless while charging (constant voltage phase), the end of
+   * charge is handled through PMU_EVENT_CHARGE_DONE.
+   **/
+
+  if (!batt.charging)
+  {
+    tau_s = (abs(current) < GAUGE_REST_MA) ? GAUGE_REST_TAU_S : GAUGE_LOAD_TAU_S;
+    if (dt_ms > tau_s * 1000)
+      dt_ms = tau_s * 1000;
+    g_gauge_state.charge_mas +=
+      (((full * soc_ocv) / 1000 - g_gauge_state.charge_mas) * dt_ms) / (tau_s * 1000);
+  }
+
+  if (g_gauge_state.charge_mas < 0)
+    g_gauge_state.charge_mas = 0;
+  if (g_gauge_state.charge_mas > full)
+    g_gauge_state.charge_mas = full;
+
+  soc = (int)((g_gauge_state.charge_mas * 1000) / full);
+  level = (soc + 5) / 10;
+
+  /* Reported level only follows the current direction, unless way off. */
+  if ((g_gauge_state.level >= 0) && (abs(level - g_gauge_state.level) <= GAUGE_LEVEL_HYSTERESIS))
+  {
+    if ((current < 0) && (level > g_gauge_state.level))
+      level = g_gauge_state.level;
+    if ((current > 0) && (level < g_gauge_state.level))
+      level = g_gauge_state.level;
+  }
+  g_gauge_state.level = level;
+
+  /* Publish status. */
+  g_gauge.status.level = level;
+  g_gauge.status.soc_permille = soc;
+  g_gauge.status.remaining_mah = (int)(g_gauge_state.charge_mas / 3600);
+  g_gauge.status.capacity_mah = g_gauge_state.capacity_mah;
+  g_gauge.status.voltage_mv = (int)batt.voltage;
+  g_gauge.status.ocv_mv = ocv;
+  g_gauge.status.current_ma = current;
+  g_gauge.status.avg_current_ma = avg_current;
+  g_gauge.status.b_charging = batt.charging;
+  if (avg_current < 0)
+    g_gauge.status.time_to_empty_min = (g_gauge.status.remaining_mah * 60) / (-avg_current);
+  else
+    g_gauge.status.time_to_empty_min = -1;
+
+  g_gauge.b_valid = true;
+  return ESP_OK;
+}
+
+
+/**
+ * gauge_pmu_event()
+ *
+ * @brief PMU event callback, end of charge means battery is full.
+ * @param p_event: pointer to a `pmu_event_t` structure
+ * @param p_user_data: not used
+ **/
+
+static void gauge_pmu_event(pmu_event_t *p_event, void *p_user_data)
+{
+  if (!g_gauge.b_enabled || (p_event->type != PMU_EVENT_CHARGE_DONE))
+    return;
+
+  xSemaphoreTake(g_gauge.lock, portMAX_DELAY);
+  if (g_gauge_state.magic == GAUGE_MAGIC)
+  {
+    g_gauge_state.charge_mas = gauge_full_mas();
+    g_gauge_state.level = 100;
+  }
+  xSemaphoreGive(g_gauge.lock);
+}
+
+
+/**
+ * twatch_gauge_init()
+ *
+ * @brief Initialize fuel gauge. State saved before deep sleep is kept,
+ *        charge used while sleeping is read from the coulomb counter.
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_gauge_init(void)
+{
+  g_gauge.b_enabled = false;
+
+  if (g_gauge.lock == NULL)
+  {
+    g_gauge.lock = xSemaphoreCreateMutex();
+    if (g_gauge.lock == NULL)
+      return ESP_FAIL;
+
+    if (twatch_pmu_subscribe(gauge_pmu_event, NULL) != ESP_OK)
+      return ESP_FAIL;
+  }
+
+  /* Make sure battery ADCs and coulomb counter are running. */
+  axpxx_adc1Enable(AXP202_BATT_VOL_ADC1 | AXP202_BATT_CUR_ADC1, true);
+  if ((axpxx_getCoulombRegister() & 0x80) == 0)
+  {
+    if (axpxx_EnableCoulombcounter() != AXP_PASS)
+      return ESP_FAIL;
+  }
+
+  /* First reading may fail (no battery), gauge will retry later. */
+  g_gauge.b_enabled = true;
+  twatch_gauge_update();
+  return ESP_OK;
+}
+
+
+/**
+ * twatch_gauge_update()
+ *
+ * @brief Update gauge from battery measurements.
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_gauge_update(void)
+{
+  esp_err_t result;
+
+  if (!g_gauge.b_enabled)
+    return ESP_FAIL;
+
+  xSemaphoreTake(g_gauge.lock, portMAX_DELAY);
+  result = gauge_refresh();
+  xSemaphoreGive(g_gauge.lock);
+
+  return result;
+}
+
+
+/**
+ * twatch_gauge_get_level()
+ *
+ * @brief Get battery level, updating the gauge if last update is older
+ *        than GAUGE_UPDATE_MIN_MS.
+ * @return level in percent (0-100), -1 on error
+ **/
+
+int twatch_gauge_get_level(void)
+{
+  int level = -1;
+
+  if (!g_gauge.b_enabled)
+    return -1;
+
+  xSemaphoreTake(g_gauge.lock, portMAX_DELAY);
+  if (!g_gauge.b_valid ||
+      ((esp_timer_get_time() - g_gauge.last_update_us) >= (GAUGE_UPDATE_MIN_MS * 1000LL)))
+    gauge_refresh();
+
+  if (g_gauge.b_valid)
+    level = g_gauge.status.level;
+  xSemaphoreGive(g_gauge.lock);
+
+  return level;
+}
+
+
+/**
+ * twatch_gauge_get_status()
+ *
+ * @brief Get gauge status, as of the last update.
+ * @param p_status: pointer to a `twatch_gauge_status_t` structure
+ * @return ESP_OK on success, ESP_FAIL if gauge has never been updated
+ **/
+
+esp_err_t twatch_gauge_get_status(twatch_gauge_status_t *p_status)
+{
+  esp_err_t result = ESP_FAIL;
+
+  if (!g_gauge.b_enabled)
+    return ESP_FAIL;
+
+  xSemaphoreTake(g_gauge.lock, portMAX_DELAY);
+  if (g_gauge.b_valid)
+  {
+    memcpy(p_status, &g_gauge.status, sizeof(twatch_gauge_status_t));
+    result = ESP_OK;
+  }
+  xSemaphoreGive(g_gauge.lock);
+
+  return result;
+}
+
+
+/**
+ * twatch_gauge_set_capacity()
+ *
+ * @brief Set battery full charge capacity, state of charge is kept.
+ *        Must be called after twatch_gauge_init().
+ * @param capacity_mah: capacity in mAh
+ **/
+
+void twatch_gauge_set_capacity(int capacity_mah)
+{
+  if (!g_gauge.b_enabled || (capacity_mah <= 0))
+    return;
+
+  xSemaphoreTake(g_gauge.lock, portMAX_DELAY);
+  if (g_gauge_state.magic == GAUGE_MAGIC)
+  {
+    g_gauge_state.charge_mas = (g_gauge_state.charge_mas * capacity_mah) / g_gauge_state.capacity_mah;
+    g_gauge_state.capacity_mah = capacity_mah;
+  }
+  xSemaphoreGive(g_gauge.lock);
+}
+
+
+/**
+ * twatch_gauge_set_resistance()
+ *
+ * @brief Set battery internal resistance used to compensate voltage for
+ *        the current load. Must be called after twatch_gauge_init().
+ * @param resistance_mohm: resistance in milliohms
+ **/
+
+void twatch_gauge_set_resistance(int resistance_mohm)
+{
+  if (!g_gauge.b_enabled || (resistance_mohm < 0))
+    return;
+
+  xSemaphoreTake(g_gauge.lock, portMAX_DELAY);
+  if (g_gauge_state.magic == GAUGE_MAGIC)
+    g_gauge_state.resistance_mohm = resistance_mohm;
+  xSemaphoreGive(g_gauge.lock);
+}
@@ -1,20 +1,68 @@
 #include <ctype.h>
+#include <math.h>
 
 #include "hal/gps.h"
+#include "hal/gps_sched.h"
+#include "drivers/nmea.h"
+#include "drivers/casic.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_pm.h"
+#include "freertos/event_groups.h"
 
 
 #define GPS_RX_BUFSIZE      1024
-#define NMEA_GNGGA_PREFIX   "GNGGA"
-#define NMEA_GNRMC_PREFIX   "GNRMC"
-#define NMEA_PREFIX_LENGTH  5
+#define GPS_RX_READ_MS      20
 #define TAG "[hal::gps]"
 
+/* Values staged while a sentence is being parsed. */
+#define GPS_UPD_TIME        (1 << 0)
+#define GPS_UPD_LAT         (1 << 1)
+#define GPS_UPD_LNG         (1 << 2)
+#define GPS_UPD_SAT         (1 << 3)
+#define GPS_UPD_HDOP        (1 << 4)
+#define GPS_UPD_ALT         (1 << 5)
+#define GPS_UPD_SPEED       (1 << 6)
+#define GPS_UPD_DATE        (1 << 7)
+#define GPS_UPD_QUALITY     (1 << 8)
+#define GPS_UPD_VALID       (1 << 9)
+#define GPS_UPD_MODE        (1 << 10)
+#define GPS_UPD_PDOP        (1 << 11)
+#define GPS_UPD_VDOP        (1 << 12)
+#define GPS_UPD_COURSE      (1 << 13)
+
+/* GSA lists up to 12 satellites, GSV describes up to 4 per sentence. */
+#define GSA_MAX_ACTIVE      12
+#define GSV_SATS_PER_MSG    4
+#define GSV_FIELDS_PER_SAT  4
+
+/* Scheduler settings, power model is in gps_sched.c. */
+#define GPS_RX_POLL_MS              1000
+
+/* Receiver configuration items set by the application. */
+#define GPS_CFG_BAUDRATE            (1 << 0)
+#define GPS_CFG_RATE                (1 << 1)
+#define GPS_CFG_SENTENCES           (1 << 2)
+#define GPS_CFG_BINARY              (1 << 3)
+
+#define GPS_DEFAULT_BAUDRATE        9600
+#define GPS_CMD_MAXLEN              (NMEA_SENTENCE_MAXLEN + 8)
+
+/* CASIC NAV-PV position validity. */
+#define CASIC_POS_VALID_2D          6
+#define CASIC_POS_VALID_3D          7
+
+/* Event group bit set each time a fix is published. */
+#define GPS_FIX_PUBLISHED   (1 << 0)
+
 //static uint8_t g_gga_test_terms[] =  "064036.289,4836.5375,N,00740.9373,E,1,04,3.2,200.2,M,,,,0000";
 //static uint8_t g_gga_test_terms[] =  "064036.289,,,00740.9373,E,1,04,3.2,200.2,M,,,,0000";
 //static uint8_t g_rmc_test_terms[] = "053740.000,A,2503.6319,N,12136.0099,E,2.69,79.65,100106,,,A";
 
-static uint8_t gps_rx_buffer[GPS_RX_BUFSIZE];
-volatile int gps_rx_buffer_len = 0;
+/* RX ring buffer, written from UART at head and consumed by the parser at tail. */
+static uint8_t gps_rx_ring[GPS_RX_BUFSIZE];
+static int gps_rx_head = 0;
+static int gps_rx_tail = 0;
 
 typedef enum {
   GPS_IDLE,
@@ -22,7 +70,9 @@ typedef enum {
   GPS_READY
 } gps_state_t;
 
+/* Field positions, 0 being the address field. */
 enum gga_term_pos {
+  GGA_ADDR_TERM,
   GGA_TIME_TERM,
   GGA_LAT_TERM,
   GGA_LAT_DIR_TERM,
@@ -36,6 +86,7 @@ enum gga_term_pos {
 };
 
 enum rmc_term_pos {
+  RMC_ADDR_TERM,
   RMC_TIME_TERM,
   RMC_VALID_TERM,
   RMC_LAT_TERM,
@@ -50,97 +101,225 @@ enum rmc_term_pos {
   RMC_POS_MODE_TERM
 };
 
-/* GPS state (FSM). */
-volatile gps_state_t g_gps_state;
-static gps_raw_degrees_t g_lat, g_lng;
-int g_nb_sat = 0;
-int g_hdop;
-int g_alt;
-int g_speed;
-int g_date;
-int g_time;
+enum gsa_term_pos {
+  GSA_ADDR_TERM,
+  GSA_SEL_MODE_TERM,
+  GSA_FIX_MODE_TERM,
+  GSA_FIRST_PRN_TERM,
+  GSA_LAST_PRN_TERM = GSA_FIRST_PRN_TERM + GSA_MAX_ACTIVE - 1,
+  GSA_PDOP_TERM,
+  GSA_HDOP_TERM,
+  GSA_VDOP_TERM,
+  GSA_SYSTEM_ID_TERM
+};
 
-/* Include the following code only for Twatch v2. */
-#ifdef CONFIG_TWATCH_V2
+enum gsv_term_pos {
+  GSV_ADDR_TERM,
+  GSV_NB_MSG_TERM,
+  GSV_MSG_NUM_TERM,
+  GSV_IN_VIEW_TERM,
+  GSV_FIRST_SAT_TERM
+};
+
+enum vtg_term_pos {
+  VTG_ADDR_TERM,
+  VTG_COURSE_TERM,
+  VTG_COURSE_REF_TERM,
+  VTG_COURSE_MAG_TERM,
+  VTG_COURSE_MAG_REF_TERM,
+  VTG_SPEED_KN_TERM,
+  VTG_SPEED_KN_UNIT_TERM,
+  VTG_SPEED_KMH_TERM,
+  VTG_SPEED_KMH_UNIT_TERM,
+  VTG_POS_MODE_TERM
+};
+
+enum gll_term_pos {
+  GLL_ADDR_TERM,
+  GLL_LAT_TERM,
+  GLL_LAT_DIR_TERM,
+  GLL_LNG_TERM,
+  GLL_LNG_DIR_TERM,
+  GLL_TIME_TERM,
+  GLL_VALID_TERM,
+  GLL_POS_MODE_TERM
+};
+
+typedef struct t_gps_pending gps_pending_t;
 
 /**
- * hex_to_dec()
- * 
- * @brief Convert an hexadecimal digit into its value.
- * @param ascii: hexadecimal digit to convert
- * @return digit value
+ * NMEA sentence descriptor: fields are handed to `pfn_parse_field` as they
+ * are received, `pfn_commit` (if any) is called once the sentence has been
+ * validated, after the common fix values have been committed.
  **/
 
-static int hex_to_dec(uint8_t ascii)
-{
-  if ((ascii >= '0') && (ascii <= '9'))
-    return (ascii - '0');
-  else if ((ascii >= 'A') && (ascii <= 'F'))
-    return (ascii - 'A') + 10;
-  else if ((ascii >= 'a') && (ascii <= 'f'))
-    return (ascii - 'a') + 10;
-  else
-    return -1;
-}
+typedef struct {
+  char type[4];
+  void (*pfn_parse_field)(gps_pending_t *p_pending, int field_index, uint8_t *psz_field, int len);
+  void (*pfn_commit)(gps_pending_t *p_pending);
+} nmea_sentence_desc_t;
+
+typedef struct {
+  char id[3];
+  gps_system_t system;
+} nmea_talker_desc_t;
+
+struct t_gps_pending {
+  const nmea_sentence_desc_t *p_desc;
+  gps_system_t system;
+  bool b_valid_data;
+  uint32_t updated;
+  gps_fix_quality_t quality;
+  gps_fix_mode_t mode;
+  gps_raw_degrees_t lat, lng;
+  int nb_sat;
+  int pdop;
+  int hdop;
+  int vdop;
+  int alt;
+  int speed;
+  int course;
+  int date;
+  int time;
+
+  /* GSA active satellites. */
+  uint16_t active_prns[GSA_MAX_ACTIVE];
+  int nb_active;
+
+  /* GSV satellites in view. */
+  int gsv_nb_msg;
+  int gsv_msg_num;
+  gps_satellite_t gsv_sats[GSV_SATS_PER_MSG];
+  int gsv_nb_fields[GSV_SATS_PER_MSG];
+};
 
+/* GPS state (FSM). */
+volatile gps_state_t g_gps_state;
 
 /**
- * hexbyte_to_dec()
- * 
- * @brief Convert 2-digit hexadecimal value to its value
- * @param p_hexbyte: pointer to a 2-digit hex value
- * @return corresponding value as int
+ * Fix publication (seqlock): the GPS task updates `g_fix` then copies it
+ * into `g_fix_shared`, bumping `g_fix_seq` before and after the copy.
+ * Readers retry until they see the same even sequence number on both
+ * sides of their own copy.
  **/
 
-static int hexbyte_to_dec(uint8_t *p_hexbyte)
-{
-  int low = hex_to_dec(*(p_hexbyte + 1));
-  int high = hex_to_dec(*(p_hexbyte));
-  if ((low>=0) && (high >= 0))
-    return (low + high*16);
-  else
-    return -1;
-}
-
+static gps_fix_t g_fix;
+static gps_fix_t g_fix_shared;
+static volatile uint32_t g_fix_seq = 0;
+static EventGroupHandle_t g_fix_events = NULL;
+
+/* Power scheduler state. */
+static struct {
+  gps_sched_config_t config;
+  gps_sched_stats_t stats;
+  TaskHandle_t task;
+  TickType_t power_up_tick;
+  TickType_t next_wake_tick;
+  uint32_t last_ttff_ms;    /* Time to fix since last power-up. */
+  volatile TickType_t last_motion_tick;
+  volatile bool b_motion;
+  bool b_got_fix;
+  bool b_motion_isr;
+  #ifdef CONFIG_PM_ENABLE
+    /* UART drops bytes in light sleep, stay awake while GPS is powered. */
+    esp_pm_lock_handle_t pm_lock;
+  #endif
+} g_sched = {
+  .config = {
+    .mode = GPS_SCHED_OFF,
+    .period_s = GPS_SCHED_DEFAULT_PERIOD_S,
+    .max_period_s = GPS_SCHED_DEFAULT_MAX_PERIOD_S,
+    .fix_timeout_s = GPS_SCHED_DEFAULT_FIX_TIMEOUT_S,
+    .motion_hold_s = GPS_SCHED_DEFAULT_MOTION_HOLD_S
+  },
+  .stats = {
+    .avg_ttff_ms = GPS_DEFAULT_TTFF_MS,
+    .period_s = GPS_SCHED_DEFAULT_PERIOD_S
+  }
+};
+static portMUX_TYPE g_sched_mux = portMUX_INITIALIZER_UNLOCKED;
 
 /**
- * gps_read_data()
- * 
- * @brief Read data sent by GPS into our receive buffer
- * @param p_uart_evt: pointer to a `uart_event_t` structure representing an event
- * @return TWATCH_GPS_ERROR on error, TWATCH_GPS_RX_FULL if FIFO is full, or size of bytes read on success.
+ * Receiver configuration. The module forgets it when powered off, so it is
+ * kept here and applied by the GPS task after each power-up.
  **/
 
-static int gps_read_data(uart_event_t *p_uart_evt)
-{
-  /* Ensure we are reading data from UART. */
-  if (p_uart_evt->type == UART_DATA)
-  {
-    /* Check if GPS rx buffer is full. */
-    if ((gps_rx_buffer_len + p_uart_evt->size) < GPS_RX_BUFSIZE)
-    {
-      /* Read data into our RX buffer. */
-      twatch_uart_receive(&gps_rx_buffer[gps_rx_buffer_len], p_uart_evt->size);
+static struct {
+  uint32_t configured;      /* GPS_CFG_* items set by application. */
+  volatile uint32_t dirty;  /* GPS_CFG_* items not applied yet. */
+  int baudrate;
+  int interval_ms;
+  uint32_t sentences;
+  bool b_binary;
+} g_gps_cfg = {
+  .baudrate = GPS_DEFAULT_BAUDRATE,
+  .interval_ms = 1000
+};
 
-      /* Take into account the newly read data. */
-      gps_rx_buffer_len += p_uart_evt->size;
+/* Sky view, published the same way. */
+static gps_sky_t g_sky;
+static gps_sky_t g_sky_shared;
+static volatile uint32_t g_sky_seq = 0;
 
-      /* Success. */
-      return p_uart_evt->size;
-    }
-    else
-    {
-      /* RX buffer is full. */
-      return TWATCH_GPS_RX_FULL;
-    }
-  }
-  else
-  {
-    /* TODO. */
-    return TWATCH_GPS_ERROR;
-  }
-}
+/* Include the following code only for Twatch v2. */
+#ifdef CONFIG_TWATCH_V2
+
+static nmea_parser_t g_nmea_parser;
+static casic_parser_t g_casic_parser;
+static gps_pending_t g_pending;
+
+/**
+ * Navigation epoch tracking: a receiver sends several messages per epoch,
+ * all carrying the same time of fix (NMEA) or run time (CASIC, which takes
+ * over when binary output is enabled). The fix is published once per
+ * epoch, after the message that ended the previous epoch if it is known,
+ * or else when the next epoch starts.
+ **/
+
+static struct {
+  bool b_dirty;             /* Fix updated since last publication. */
+  bool b_time_known;
+  int time;                 /* Time of fix or run time of current epoch. */
+  uint32_t first_msg;       /* First message that updated the fix. */
+  uint32_t last_msg;        /* Last message that updated the fix. */
+  uint32_t ender_msg;       /* Message ending an epoch, 0 if not known yet. */
+} g_epoch;
+
+/* Message keys, NMEA sentence type and system or CASIC message ID. */
+#define GPS_EPOCH_NMEA_MSG(desc, system)  ((((desc) + 1) << 8) | (system))
+#define GPS_EPOCH_CASIC_MSG(id)           (0x10000 | (id))
+
+/* Satellites used in fix, one PRN bitmap per system. */
+static uint32_t g_used_prns[GPS_SYSTEM_MAX][8];
+
+static void gps_parse_gga_field(gps_pending_t *p_pending, int field_index, uint8_t *psz_field, int len);
+static void gps_parse_rmc_field(gps_pending_t *p_pending, int field_index, uint8_t *psz_field, int len);
+static void gps_parse_gsa_field(gps_pending_t *p_pending, int field_index, uint8_t *psz_field, int len);
+static void gps_parse_gsv_field(gps_pending_t *p_pending, int field_index, uint8_t *psz_field, int len);
+static void gps_parse_vtg_field(gps_pending_t *p_pending, int field_index, uint8_t *psz_field, int len);
+static void gps_parse_gll_field(gps_pending_t *p_pending, int field_index, uint8_t *psz_field, int len);
+static void gps_commit_gsa(gps_pending_t *p_pending);
+static void gps_commit_gsv(gps_pending_t *p_pending);
+
+static const nmea_sentence_desc_t g_nmea_sentences[] = {
+  {"GGA", gps_parse_gga_field, NULL},
+  {"RMC", gps_parse_rmc_field, NULL},
+  {"GSA", gps_parse_gsa_field, gps_commit_gsa},
+  {"GSV", gps_parse_gsv_field, gps_commit_gsv},
+  {"VTG", gps_parse_vtg_field, NULL},
+  {"GLL", gps_parse_gll_field, NULL}
+};
 
+static const nmea_talker_desc_t g_nmea_talkers[] = {
+  {"GP", GPS_SYSTEM_GPS},
+  {"GL", GPS_SYSTEM_GLONASS},
+  {"GA", GPS_SYSTEM_GALILEO},
+  {"GB", GPS_SYSTEM_BEIDOU},
+  {"BD", GPS_SYSTEM_BEIDOU},
+  {"GQ", GPS_SYSTEM_QZSS},
+  {"QZ", GPS_SYSTEM_QZSS},
+  {"GN", GPS_SYSTEM_UNKNOWN}   /* Combined solution. */
+};
 
 /**
  * gps_parse_decimal_2()
@@ -222,630 +401,1966 @@ void gps_parse_degrees(uint8_t *term, gps_raw_degrees_t *p_degrees)
   p_degrees->negative = false;
 }
 
+
 /**
- * gps_parse_gngga_sentence()
- * 
- * @brief Parse a NMEA GNGGA sentence.
- * @param nmea_gga_terms: pointer to a text string containing the terms to parse
+ * gps_parse_address()
+ *
+ * @brief Look up a sentence descriptor from its address field.
+ * @param psz_field: address field (e.g. "GNGGA")
+ * @param len: field length
+ * @param p_system: pointer to the satellite system deduced from talker ID
+ * @return pointer to the sentence descriptor, NULL if not supported
  **/
 
-static void gps_parse_gngga_sentence(uint8_t *nmea_gga_terms)
+static const nmea_sentence_desc_t *gps_parse_address(char *psz_field, int len, gps_system_t *p_system)
 {
-  int term_pos;
-  uint8_t *term_start, *term_end;
-  
-  /* We start with first term. */
-  term_pos = 0;
+  int i;
 
-  /* Parse terms from start. */
-  term_start = nmea_gga_terms;
-  term_end = term_start;
+  /* Address is a 2-char talker ID followed by a 3-char sentence type. */
+  if (len != 5)
+    return NULL;
 
-  /* Loop until null char is met. */
-  while (*term_end != 0)
+  for (i=0; i<(sizeof(g_nmea_talkers)/sizeof(nmea_talker_desc_t)); i++)
   {
-    /* Process character. */
-    switch(*term_end)
-    {
-      case ',':
-        {
-          /* Term separator found, parse term. */
-          *term_end = 0;
+    if ((psz_field[0] == g_nmea_talkers[i].id[0]) && (psz_field[1] == g_nmea_talkers[i].id[1]))
+      break;
+  }
+  if (i == (sizeof(g_nmea_talkers)/sizeof(nmea_talker_desc_t)))
+    return NULL;
+  *p_system = g_nmea_talkers[i].system;
 
-          switch (term_pos)
-          {
-            case GGA_TIME_TERM:
-              {
-                if ((term_end - term_start) > 0)
-                {
-                  /* Parse decimal number as time. */
-                  g_time = gps_parse_decimal_3(term_start);
-                  ESP_LOGI(TAG, "time as int: %u", g_time);
-                }
-              }
-              break;
-
-            case GGA_LAT_TERM:
-              {
-                if ((term_end - term_start) > 0)
-                {
-                  gps_parse_degrees(term_start, &g_lat);
-                  ESP_LOGI(TAG, "lat: %d.%d", g_lat.deg, g_lat.billionths);
-                }
-              }
-              break;
-
-            case GGA_LAT_DIR_TERM:
-              {
-                if (*term_start == 'S')
-                  g_lat.negative = true;
-              }
-              break;
-
-            case GGA_LNG_TERM:
-              {
-                if ((term_end - term_start) > 0)
-                {
-                  gps_parse_degrees(term_start, &g_lng);
-                  ESP_LOGI(TAG, "lng: %d.%d", g_lng.deg, g_lng.billionths);
-                }
-              }
-              break;
-
-            case GGA_LNG_DIR_TERM:
-              {
-                if (*term_start == 'W')
-                  g_lng.negative = true;
-              }
-              break;
-
-            case GGA_SAT_TERM:
-              {
-                /* Parse integer. */
-                g_nb_sat = atol((char *)term_start);
-                ESP_LOGI(TAG, "sat: %d", g_nb_sat);
-              }
-              break;
-
-            case GGA_HDOP_TERM:
-              {
-                g_hdop = gps_parse_decimal_2(term_start);
-                ESP_LOGI(TAG, "hdop: %d", g_hdop);
-              }
-              break;
-
-            case GGA_ALT_TERM:
-              {
-                g_alt = gps_parse_decimal_2(term_start);
-                ESP_LOGI(TAG, "alt: %d", g_alt);
-              }
-
-            /* ... */
-            default:
-              break;
-          }
+  for (i=0; i<(sizeof(g_nmea_sentences)/sizeof(nmea_sentence_desc_t)); i++)
+  {
+    if (!strcmp(&psz_field[2], g_nmea_sentences[i].type))
+      return &g_nmea_sentences[i];
+  }
+
+  return NULL;
+}
+
+
+/**
+ * gps_parse_gga_field()
+ *
+ * @brief Parse a single field of a GGA sentence into the pending values.
+ * @param p_pending: pointer to pending values
+ * @param field_index: field position
+ * @param psz_field: field text
+ * @param len: field length
+ **/
 
-          /* Parse next term. */
-          term_start = term_end + 1;
-          term_end = term_start;
-          term_pos++;
+static void gps_parse_gga_field(gps_pending_t *p_pending, int field_index, uint8_t *psz_field, int len)
+{
+  switch (field_index)
+  {
+    case GGA_TIME_TERM:
+      {
+        if (len > 0)
+        {
+          /* Parse decimal number as time. */
+          p_pending->time = gps_parse_decimal_3(psz_field);
+          p_pending->updated |= GPS_UPD_TIME;
         }
-        break;
+      }
+      break;
 
-      default:
+    case GGA_LAT_TERM:
+      {
+        if (len > 0)
         {
-          term_end++;
+          gps_parse_degrees(psz_field, &p_pending->lat);
+          p_pending->updated |= GPS_UPD_LAT;
         }
-        break;
-    }
+      }
+      break;
+
+    case GGA_LAT_DIR_TERM:
+      {
+        if (*psz_field == 'S')
+          p_pending->lat.negative = true;
+      }
+      break;
+
+    case GGA_LNG_TERM:
+      {
+        if (len > 0)
+        {
+          gps_parse_degrees(psz_field, &p_pending->lng);
+          p_pending->updated |= GPS_UPD_LNG;
+        }
+      }
+      break;
+
+    case GGA_LNG_DIR_TERM:
+      {
+        if (*psz_field == 'W')
+          p_pending->lng.negative = true;
+      }
+      break;
+
+    case GGA_POS_TYPE_TERM:
+      {
+        if (len > 0)
+        {
+          p_pending->quality = (gps_fix_quality_t)atol((char *)psz_field);
+          p_pending->b_valid_data = (p_pending->quality != GPS_FIX_INVALID);
+          p_pending->updated |= GPS_UPD_QUALITY | GPS_UPD_VALID;
+        }
+      }
+      break;
+
+    case GGA_SAT_TERM:
+      {
+        /* Parse integer. */
+        p_pending->nb_sat = atol((char *)psz_field);
+        p_pending->updated |= GPS_UPD_SAT;
+      }
+      break;
+
+    case GGA_HDOP_TERM:
+      {
+        p_pending->hdop = gps_parse_decimal_2(psz_field);
+        p_pending->updated |= GPS_UPD_HDOP;
+      }
+      break;
+
+    case GGA_ALT_TERM:
+      {
+        p_pending->alt = gps_parse_decimal_2(psz_field);
+        p_pending->updated |= GPS_UPD_ALT;
+      }
+      break;
+
+    /* ... */
+    default:
+      break;
   }
 }
 
 
 /**
- * gps_parse_gnrmc_sentence()
- * 
- * @brief Parse a NMEA GNRMC sentence.
- * @param nmea_rmc_terms: pointer to a text string containing the terms to parse
+ * gps_parse_rmc_field()
+ *
+ * @brief Parse a single field of a RMC sentence into the pending values.
+ * @param p_pending: pointer to pending values
+ * @param field_index: field position
+ * @param psz_field: field text
+ * @param len: field length
  **/
 
-static void gps_parse_gnrmc_sentence(uint8_t *nmea_rmc_terms)
+static void gps_parse_rmc_field(gps_pending_t *p_pending, int field_index, uint8_t *psz_field, int len)
 {
-  int term_pos;
-  uint8_t *term_start, *term_end;
-  bool b_valid_data = false;
-  
-  /* We start with first term. */
-  term_pos = 0;
+  /* Position fields are only meaningful if data is marked as valid. */
+  if ((field_index > RMC_VALID_TERM) && !p_pending->b_valid_data)
+    return;
 
-  /* Parse terms from start. */
-  term_start = nmea_rmc_terms;
-  term_end = term_start;
-
-  /* Loop until null char is met. */
-  while (*term_end != 0)
+  switch (field_index)
   {
-    /* Process character. */
-    switch(*term_end)
-    {
-      case ',':
+    case RMC_TIME_TERM:
+      {
+        if (len > 0)
         {
-          /* Term separator found, parse term. */
-          *term_end = 0;
-
-          switch (term_pos)
-          {
-            case RMC_TIME_TERM:
-              {
-                if ((term_end - term_start) > 0)
-                {
-                  /* Parse decimal number as time. */
-                  g_time = gps_parse_decimal_3(term_start);
-                  ESP_LOGI(TAG, "time as int: %u", g_time);
-                }
-              }
-              break;
-
-            case RMC_VALID_TERM:
-              {
-                b_valid_data = (*term_start == 'A');
-              }
-              break;
-
-            case RMC_LAT_TERM:
-              {
-                if (b_valid_data)
-                {
-                  if ((term_end - term_start) > 0) 
-                  {
-                    gps_parse_degrees(term_start, &g_lat);
-                    ESP_LOGI(TAG, "lat: %d.%d", g_lat.deg, g_lat.billionths);
-                  }
-                }
-              }
-              break;
-
-            case RMC_LAT_DIR_TERM:
-              {
-                if (b_valid_data)
-                {
-                  if (*term_start == 'S')
-                    g_lat.negative = true;
-                }
-              }
-              break;
-
-            case RMC_LNG_TERM:
-              {
-                if (b_valid_data)
-                {
-                  if ((term_end - term_start) > 0)
-                  {
-                    gps_parse_degrees(term_start, &g_lng);
-                    ESP_LOGI(TAG, "lng: %d.%d", g_lng.deg, g_lng.billionths);
-                  }
-                }
-              }
-              break;
-
-            case RMC_LNG_DIR_TERM:
-              {
-                if (b_valid_data)
-                {
-                  if (*term_start == 'W')
-                    g_lng.negative = true;
-                }
-              }
-              break;
-
-            case RMC_SPEED_TERM:
-              {
-                if (b_valid_data)
-                {
-                  /* Parse integer. */
-                  g_speed = gps_parse_decimal_2(term_start);
-                  ESP_LOGI(TAG, "speed: %d", g_speed);
-                }
-              }
-              break;
-
-            case RMC_DATE_TERM:
-              {
-                if (b_valid_data)
-                {
-                  g_date = gps_parse_decimal_2(term_start)/100;
-                  ESP_LOGI(TAG, "date: %d", g_date);
-                }
-              }
-              break;
-
-            /* ... */
-            default:
-              break;
-          }
-
-          /* Parse next term. */
-          term_start = term_end + 1;
-          term_end = term_start;
-          term_pos++;
+          /* Parse decimal number as time. */
+          p_pending->time = gps_parse_decimal_3(psz_field);
+          p_pending->updated |= GPS_UPD_TIME;
         }
-        break;
-
-      default:
+      }
+      break;
+
+    case RMC_VALID_TERM:
+      {
+        p_pending->b_valid_data = (*psz_field == 'A');
+        p_pending->updated |= GPS_UPD_VALID;
+      }
+      break;
+
+    case RMC_LAT_TERM:
+      {
+        if (len > 0)
         {
-          term_end++;
+          gps_parse_degrees(psz_field, &p_pending->lat);
+          p_pending->updated |= GPS_UPD_LAT;
         }
-        break;
-    }
+      }
+      break;
+
+    case RMC_LAT_DIR_TERM:
+      {
+        if (*psz_field == 'S')
+          p_pending->lat.negative = true;
+      }
+      break;
+
+    case RMC_LNG_TERM:
+      {
+        if (len > 0)
+        {
+          gps_parse_degrees(psz_field, &p_pending->lng);
+          p_pending->updated |= GPS_UPD_LNG;
+        }
+      }
+      break;
+
+    case RMC_LNG_DIR_TERM:
+      {
+        if (*psz_field == 'W')
+          p_pending->lng.negative = true;
+      }
+      break;
+
+    case RMC_SPEED_TERM:
+      {
+        p_pending->speed = gps_parse_decimal_2(psz_field);
+        p_pending->updated |= GPS_UPD_SPEED;
+      }
+      break;
+
+    case RMC_ROUTE_TERM:
+      {
+        if (len > 0)
+        {
+          p_pending->course = gps_parse_decimal_2(psz_field);
+          p_pending->updated |= GPS_UPD_COURSE;
+        }
+      }
+      break;
+
+    case RMC_DATE_TERM:
+      {
+        p_pending->date = gps_parse_decimal_2(psz_field)/100;
+        p_pending->updated |= GPS_UPD_DATE;
+      }
+      break;
+
+    /* ... */
+    default:
+      break;
   }
 }
 
 
 /**
- * gps_parse_sentence()
- * 
- * @brief Parse a given NMEA sentence
- * @param nmea_sentence: pointer to a NMEA sentence
+ * gps_parse_gsa_field()
+ *
+ * @brief Parse a single field of a GSA sentence into the pending values.
+ * @param p_pending: pointer to pending values
+ * @param field_index: field position
+ * @param psz_field: field text
+ * @param len: field length
  **/
 
-static void gps_parse_sentence(uint8_t *nmea_sentence)
+static void gps_parse_gsa_field(gps_pending_t *p_pending, int field_index, uint8_t *psz_field, int len)
 {
-  if (nmea_sentence[NMEA_PREFIX_LENGTH] == ',')
+  if ((field_index >= GSA_FIRST_PRN_TERM) && (field_index <= GSA_LAST_PRN_TERM))
   {
-    /* Only process GNGGA et GNRMC sentences. */
-    if (!strncmp((char *)nmea_sentence, (char *)NMEA_GNGGA_PREFIX, NMEA_PREFIX_LENGTH))
-    {
-      /* Process GNGGA sentence. */
-      gps_parse_gngga_sentence(&nmea_sentence[NMEA_PREFIX_LENGTH + 1]);
-      //gps_parse_gngga_sentence((uint8_t *)g_gga_test_terms);
-    }
-    else if (!strncmp((char *)nmea_sentence, (char *)NMEA_GNRMC_PREFIX, NMEA_PREFIX_LENGTH))
-    {
-      /* Process GNRMC sentence. */
-      gps_parse_gnrmc_sentence(&nmea_sentence[NMEA_PREFIX_LENGTH + 1]);
-      //gps_parse_gnrmc_sentence(g_rmc_test_terms);
-    }
+    if (len > 0)
+      p_pending->active_prns[p_pending->nb_active++] = atol((char *)psz_field);
+    return;
+  }
+
+  if (len == 0)
+    return;
+
+  switch (field_index)
+  {
+    case GSA_FIX_MODE_TERM:
+      {
+        p_pending->mode = (gps_fix_mode_t)atol((char *)psz_field);
+        p_pending->updated |= GPS_UPD_MODE;
+      }
+      break;
+
+    case GSA_PDOP_TERM:
+      {
+        p_pending->pdop = gps_parse_decimal_2(psz_field);
+        p_pending->updated |= GPS_UPD_PDOP;
+      }
+      break;
+
+    case GSA_HDOP_TERM:
+      {
+        p_pending->hdop = gps_parse_decimal_2(psz_field);
+        p_pending->updated |= GPS_UPD_HDOP;
+      }
+      break;
+
+    case GSA_VDOP_TERM:
+      {
+        p_pending->vdop = gps_parse_decimal_2(psz_field);
+        p_pending->updated |= GPS_UPD_VDOP;
+      }
+      break;
+
+    case GSA_SYSTEM_ID_TERM:
+      {
+        /* NMEA 4.1 system ID, tells which system a GN sentence is about. */
+        p_pending->system = (gps_system_t)atol((char *)psz_field);
+        if (p_pending->system >= GPS_SYSTEM_MAX)
+          p_pending->system = GPS_SYSTEM_UNKNOWN;
+      }
+      break;
+
+    default:
+      break;
   }
 }
 
+
 /**
- * gps_process_rx()
- * 
- * @brief Wait data from GPS module and process it.
- * @param nmea_rmc_terms: pointer to a text string containing the terms to parse
- * @return number of bytes read from GPS.
+ * gps_parse_gsv_field()
+ *
+ * @brief Parse a single field of a GSV sentence into the pending values.
+ * @param p_pending: pointer to pending values
+ * @param field_index: field position
+ * @param psz_field: field text
+ * @param len: field length
  **/
 
-static void gps_process_rx()
+static void gps_parse_gsv_field(gps_pending_t *p_pending, int field_index, uint8_t *psz_field, int len)
 {
-  uart_event_t uart_evt;
-  int nb_rx_bytes;
-  int i;
-  uint8_t parity = 0;
-  int checksum;
+  gps_satellite_t *p_sat;
+  int sat;
 
-  int sentence_start = -1;
-  int sentence_end = -1;
-
-
-  /* Wait for UART event. */
-  if(twatch_uart_wait_event(&uart_evt))
+  switch (field_index)
   {
-    //ESP_LOGI(TAG, "uart[%d] event: %d", EX_UART_NUM, uart_evt.type);
-    switch(uart_evt.type)
-    {
-      case UART_DATA:
+    case GSV_NB_MSG_TERM:
+      p_pending->gsv_nb_msg = atol((char *)psz_field);
+      break;
+
+    case GSV_MSG_NUM_TERM:
+      p_pending->gsv_msg_num = atol((char *)psz_field);
+      break;
+
+    case GSV_IN_VIEW_TERM:
+      break;
+
+    default:
+      {
+        /* Satellite blocks: PRN, elevation, azimuth, SNR. */
+        sat = (field_index - GSV_FIRST_SAT_TERM) / GSV_FIELDS_PER_SAT;
+        if (sat >= GSV_SATS_PER_MSG)
+          break;
+
+        p_sat = &p_pending->gsv_sats[sat];
+        switch ((field_index - GSV_FIRST_SAT_TERM) % GSV_FIELDS_PER_SAT)
         {
-          /* Fetch data. */
-          nb_rx_bytes = gps_read_data(&uart_evt);
-
-          /* Check we managed to read data. */
-          if (nb_rx_bytes > 0)
-          {
-            sentence_start = -1;
-            for (i=0; i<gps_rx_buffer_len; i++)
-            {
-              switch (gps_rx_buffer[i])
-              {
-
-                case '$':
-                  {
-                    if (sentence_start < 0)
-                    {
-                      sentence_start = i;
-                      parity = 0;
-                    }
-                  }
-                  break;
-
-                case '*':
-                  {
-                    if (sentence_start >= 0)
-                    {
-                      if (gps_rx_buffer_len >= (i + 2))
-                      {
-                        sentence_end = i+3;
-                        checksum = hexbyte_to_dec(&gps_rx_buffer[i+1]);
-                        if (checksum >= 0)
-                        {
-                          if (parity == (uint8_t)checksum)
-                          {
-                            /* NMEA sentence is valid, parse. */
-                            gps_rx_buffer[i] = '\0';
-                            //ESP_LOGI(TAG, "received valid sentence: %s", &gps_rx_buffer[sentence_start]);
-                            gps_parse_sentence(&gps_rx_buffer[sentence_start + 1]); /* Skip the '$' marker */
-                          }
-                          else
-                          {
-                            gps_rx_buffer[i] = '\0';
-                            //ESP_LOGI(TAG, "received invalid sentence: %s", &gps_rx_buffer[sentence_start]);
-                          }
-                        }
-                        else
-                        {
-                          //ESP_LOGI(TAG, "checksum error for sentence: %s", gps_rx_buffer);
-                        }
-                      }
-
-                      sentence_start = -1;
-                      parity = 0;
-                    }
-                  }
-                  break;
-
-                case '\n':
-                case '\r':
-                  sentence_start = -1;
-                  parity = 0;
-                  break;
-
-                default:
-                  parity ^= gps_rx_buffer[i];
-                  break;
-              }
-            }
-
-            if (sentence_end >= 0)
-            {
-              /* Chomp. */
-              memcpy(gps_rx_buffer, &gps_rx_buffer[sentence_end], GPS_RX_BUFSIZE - sentence_end);
-              gps_rx_buffer_len -= sentence_end; 
-            }
-            else if (sentence_start >= 0)
-            {
-              /* Chomp. */
-              memcpy(gps_rx_buffer, &gps_rx_buffer[sentence_start], GPS_RX_BUFSIZE - sentence_start);
-              gps_rx_buffer_len -= sentence_start; 
-            }
-          }
+          case 0:
+            p_sat->system = p_pending->system;
+            p_sat->prn = atol((char *)psz_field);
+            break;
+
+          case 1:
+            p_sat->elevation = (len > 0) ? atol((char *)psz_field) : -1;
+            break;
+
+          case 2:
+            p_sat->azimuth = (len > 0) ? atol((char *)psz_field) : -1;
+            break;
+
+          case 3:
+            p_sat->snr = (len > 0) ? atol((char *)psz_field) : -1;
+            break;
         }
-        break;
-
-      default:
-        break;
-    }
+        p_pending->gsv_nb_fields[sat]++;
+      }
+      break;
   }
 }
 
 
 /**
- * twatch_gps_control()
- * 
- * @brief Manage the GPS state machine
- * @param pvParameters: pointer to extra parameters (none used)
+ * gps_parse_vtg_field()
+ *
+ * @brief Parse a single field of a VTG sentence into the pending values.
+ * @param p_pending: pointer to pending values
+ * @param field_index: field position
+ * @param psz_field: field text
+ * @param len: field length
  **/
 
-static void twatch_gps_control(void *pvParameters)
+static void gps_parse_vtg_field(gps_pending_t *p_pending, int field_index, uint8_t *psz_field, int len)
 {
-  for(;;)
+  if (len == 0)
+    return;
+
+  switch (field_index)
   {
+    case VTG_COURSE_TERM:
+      {
+        p_pending->course = gps_parse_decimal_2(psz_field);
+        p_pending->updated |= GPS_UPD_COURSE;
+      }
+      break;
+
+    case VTG_SPEED_KN_TERM:
+      {
+        p_pending->speed = gps_parse_decimal_2(psz_field);
+        p_pending->updated |= GPS_UPD_SPEED;
+      }
+      break;
+
+    case VTG_POS_MODE_TERM:
+      {
+        /* Not valid, discard speed and course. */
+        if (*psz_field == 'N')
+          p_pending->updated = 0;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
 
-    switch(g_gps_state)
-    {
-      case GPS_IDLE:
-        break;
 
-      case GPS_ON:
+/**
+ * gps_parse_gll_field()
+ *
+ * @brief Parse a single field of a GLL sentence into the pending values.
+ * @param p_pending: pointer to pending values
+ * @param field_index: field position
+ * @param psz_field: field text
+ * @param len: field length
+ **/
+
+static void gps_parse_gll_field(gps_pending_t *p_pending, int field_index, uint8_t *psz_field, int len)
+{
+  switch (field_index)
+  {
+    case GLL_LAT_TERM:
+      {
+        if (len > 0)
         {
-          ESP_LOGI(TAG, "Waking up GPS ...");
-          /* Wake-up GPS. */
-          vTaskDelay(60/portTICK_RATE_MS);
-          gpio_set_level(TWATCH_GPS_WAKEUP, 0);
-          vTaskDelay(200/portTICK_RATE_MS);
-          gpio_set_level(TWATCH_GPS_WAKEUP, 1);
-
-          /* GPS should be woken up. */
-          ESP_LOGI(TAG, "GPS has been woken up !");
-          g_gps_state = GPS_READY;
+          gps_parse_degrees(psz_field, &p_pending->lat);
+          p_pending->updated |= GPS_UPD_LAT;
         }
-        break;
-
-      case GPS_READY:
+      }
+      break;
+
+    case GLL_LAT_DIR_TERM:
+      {
+        if (*psz_field == 'S')
+          p_pending->lat.negative = true;
+      }
+      break;
+
+    case GLL_LNG_TERM:
+      {
+        if (len > 0)
         {
-          gps_process_rx();
+          gps_parse_degrees(psz_field, &p_pending->lng);
+          p_pending->updated |= GPS_UPD_LNG;
         }
-        break;
-    }
-
-    vTaskDelay(10);
+      }
+      break;
+
+    case GLL_LNG_DIR_TERM:
+      {
+        if (*psz_field == 'W')
+          p_pending->lng.negative = true;
+      }
+      break;
+
+    case GLL_TIME_TERM:
+      {
+        if (len > 0)
+        {
+          p_pending->time = gps_parse_decimal_3(psz_field);
+          p_pending->updated |= GPS_UPD_TIME;
+        }
+      }
+      break;
+
+    case GLL_VALID_TERM:
+      {
+        /* Position comes before its status, drop it if not valid. */
+        p_pending->b_valid_data = (*psz_field == 'A');
+        if (!p_pending->b_valid_data)
+          p_pending->updated &= ~(GPS_UPD_LAT | GPS_UPD_LNG);
+        p_pending->updated |= GPS_UPD_VALID;
+      }
+      break;
+
+    default:
+      break;
   }
 }
 
-#endif /* CONFIG_TWATCH_V2 */
-
 
 /**
- * twatch_gps_init()
- * 
- * @brief Initialize our GPS module
- * @return ESP_FAIL on failure, ESP_OK on success.
+ * gps_seqlock_write()
+ *
+ * @brief Copy data into a seqlock-protected shared structure
+ * @param p_seq: pointer to the sequence counter
+ * @param p_shared: pointer to the shared structure
+ * @param p_data: pointer to the data to copy
+ * @param size: size of data
  **/
 
-esp_err_t twatch_gps_init(void)
+static void gps_seqlock_write(volatile uint32_t *p_seq, void *p_shared, void *p_data, size_t size)
 {
-  /* Initialize GPS data. */
-  memset(&g_lat, 0, sizeof(gps_raw_degrees_t));
-  memset(&g_lng, 0, sizeof(gps_raw_degrees_t));
-  g_speed = 0;
-  g_date = 0;
-  g_time = 0;
-  g_alt = 0;
-  g_nb_sat = 0;
-  g_hdop = 0;
+  /* Odd sequence number: copy in progress. */
+  (*p_seq)++;
+  __sync_synchronize();
+  memcpy(p_shared, p_data, size);
+  __sync_synchronize();
+  (*p_seq)++;
+}
 
-#ifdef CONFIG_TWATCH_V2
-  /* Initialize UART. */
-  twatch_uart_init(9600);
 
-  /* Initialize wake-up GPIO. */
-  gpio_config_t gps_wake_up;
+/**
+ * gps_publish_sky()
+ *
+ * @brief Flag satellites used in fix and publish the sky view to readers.
+ **/
 
-  /* Configure wake-up GPIO. */
-  gps_wake_up.mode = GPIO_MODE_OUTPUT;
-  gps_wake_up.pin_bit_mask = (1ULL << TWATCH_GPS_WAKEUP);
-  gpio_config(&gps_wake_up);
-  gpio_set_level(TWATCH_GPS_WAKEUP, 1);
+static void gps_publish_sky(void)
+{
+  gps_satellite_t *p_sat;
+  int i;
 
-  /* GPS is idling. */
-  g_gps_state = GPS_IDLE;
+  for (i=0; i<g_sky.nb_sats; i++)
+  {
+    p_sat = &g_sky.sats[i];
+    p_sat->b_used = (p_sat->prn < 256) && (
+      (g_used_prns[p_sat->system][p_sat->prn >> 5] & (1 << (p_sat->prn & 31))) ||
+      (g_used_prns[GPS_SYSTEM_UNKNOWN][p_sat->prn >> 5] & (1 << (p_sat->prn & 31)))
+    );
+  }
 
-  /* Start our GPS controller. */
-  return xTaskCreate(twatch_gps_control, "twatch_gps_control", 10000, NULL, 12, NULL);
-#else
-  return ESP_FAIL;
-#endif
+  g_sky.timestamp_us = esp_timer_get_time();
+  gps_seqlock_write(&g_sky_seq, &g_sky_shared, &g_sky, sizeof(gps_sky_t));
 }
 
 
 /**
- * twatch_gps_on()
- * 
- * @brief Enable GPS
- * @return ESP_FAIL on error, ESP_OK on success.
+ * gps_commit_gsa()
+ *
+ * @brief Record the satellites used in fix by a validated GSA sentence.
+ * @param p_pending: pointer to pending values
  **/
 
-esp_err_t twatch_gps_on(void)
+static void gps_commit_gsa(gps_pending_t *p_pending)
 {
+  int i;
 
-  esp_err_t result = ESP_FAIL;
-
-#ifdef CONFIG_TWATCH_V2
-  if (g_gps_state == GPS_IDLE)
+  memset(g_used_prns[p_pending->system], 0, sizeof(g_used_prns[0]));
+  for (i=0; i<p_pending->nb_active; i++)
   {
-    ESP_LOGI(TAG, "switching on GPS ...");
-
-    /* Power on GPS through LDO4. */
-    result = twatch_pmu_gps_power(true);
-    vTaskDelay(200/portTICK_RATE_MS);
-
-    /* Change current state. */
-    g_gps_state = GPS_ON;
+    if (p_pending->active_prns[i] < 256)
+      g_used_prns[p_pending->system][p_pending->active_prns[i] >> 5] |= (1 << (p_pending->active_prns[i] & 31));
   }
-  else
-    ESP_LOGE(TAG, "GPS is already on !");
-#endif
 
-  return result;
+  gps_publish_sky();
 }
 
 
 /**
- * twatch_gps_on()
- * 
- * @brief Disable GPS
- * @return ESP_FAIL on error, ESP_OK on success.
+ * gps_commit_gsv()
+ *
+ * @brief Add satellites from a validated GSV sentence to the sky view,
+ *        publishing it once the last sentence of a sequence is received.
+ * @param p_pending: pointer to pending values
  **/
 
-esp_err_t twatch_gps_off(void)
+static void gps_commit_gsv(gps_pending_t *p_pending)
 {
-  esp_err_t result = ESP_FAIL;
+  int i, j;
 
-#ifdef CONFIG_TWATCH_V2
-  /* Power off GPS through LDO4. */
-  ESP_LOGI(TAG, "switching off GPS ...");
-  result = twatch_pmu_gps_power(false);
+  /* First sentence of a sequence, forget this system's satellites. */
+  if (p_pending->gsv_msg_num == 1)
+  {
+    for (i=0, j=0; i<g_sky.nb_sats; i++)
+    {
+      if (g_sky.sats[i].system != p_pending->system)
+        g_sky.sats[j++] = g_sky.sats[i];
+    }
+    g_sky.nb_sats = j;
+  }
 
-  /* Mark GPS as powered off. */
-  if (result == ESP_OK)
-    g_gps_state = GPS_IDLE;
-#endif
+  /* Skip incomplete blocks (e.g. a trailing NMEA 4.1 signal ID). */
+  for (i=0; i<GSV_SATS_PER_MSG; i++)
+  {
+    if ((p_pending->gsv_nb_fields[i] == GSV_FIELDS_PER_SAT) && (g_sky.nb_sats < GPS_MAX_SATELLITES))
+      g_sky.sats[g_sky.nb_sats++] = p_pending->gsv_sats[i];
+  }
 
-  /* Return result. */
-  return result;
+  if (p_pending->gsv_msg_num == p_pending->gsv_nb_msg)
+    gps_publish_sky();
 }
 
+
 /**
- * gps_get_lat_lng()
- * 
- * @brief Retrieve GPS latitude/longitude information
- * @param p_lat: pointer to a `gps_raw_degrees_t` structure representing the latitude
- * @param p_lng: pointer to a `gps_raw_degrees_t` structure representing the longitude
+ * gps_on_nmea_field()
+ *
+ * @brief NMEA parser field callback, stages parsed values until the
+ *        sentence checksum is known.
+ * @param p_parser: pointer to the NMEA parser
+ * @param field_index: field position (0 is the address field)
+ * @param psz_field: field text
+ * @param len: field length
  **/
 
-void gps_get_lat_lng(gps_raw_degrees_t *p_lat, gps_raw_degrees_t *p_lng)
+static void gps_on_nmea_field(nmea_parser_t *p_parser, int field_index, char *psz_field, int len)
 {
-  /* Copy without calling memcpy(). */
-  p_lat->deg = g_lat.deg;
-  p_lat->billionths = g_lat.billionths;
-  p_lat->negative = g_lat.negative;
-  p_lng->deg = g_lng.deg;
-  p_lng->billionths = g_lng.billionths;
-  p_lng->negative = g_lng.negative;
-}
+  gps_pending_t *p_pending = (gps_pending_t *)p_parser->p_user_data;
 
-/**
- * gps_get_day()
- * 
- * @brief Get the current day of month
- * @return day in month starting from 1
- **/
+  /* New sentence, forget anything staged by a previous one. */
+  if (field_index == 0)
+  {
+    memset(p_pending, 0, sizeof(gps_pending_t));
+    p_pending->p_desc = gps_parse_address(psz_field, len, &p_pending->system);
+    return;
+  }
 
-int gps_get_day(void)
-{
-  return (g_date/1000000)%100;
+  if (p_pending->p_desc != NULL)
+    p_pending->p_desc->pfn_parse_field(p_pending, field_index, (uint8_t *)psz_field, len);
 }
 
 
 /**
- * gps_get_month()
- * 
- * @brief Get the current month
- * @return month number starting from 1
+ * gps_publish_fix()
+ *
+ * @brief Publish the current fix to readers and wake up any task waiting
+ *        for a new fix.
  **/
 
-int gps_get_month(void)
+static void gps_publish_fix(void)
 {
-  return (g_date/10000)%100;
-}
+  uint32_t ttff_ms;
 
+  g_fix.timestamp_us = esp_timer_get_time();
+  g_fix.seq++;
+  g_epoch.b_dirty = false;
 
-/**
- * gps_get_year()
- * 
- * @brief Get the current year
- * @return current year (2000+)
- **/
+  gps_seqlock_write(&g_fix_seq, &g_fix_shared, &g_fix, sizeof(gps_fix_t));
 
-int gps_get_year(void)
-{
-  return (g_date/100)%100 + 2000;
+  /* First valid fix since power-up, update our average time to fix. */
+  if (g_fix.valid && !g_sched.b_got_fix)
+  {
+    ttff_ms = (xTaskGetTickCount() - g_sched.power_up_tick)*portTICK_PERIOD_MS;
+    g_sched.b_got_fix = true;
+    g_sched.last_ttff_ms = ttff_ms;
+
+    portENTER_CRITICAL(&g_sched_mux);
+    g_sched.stats.avg_ttff_ms = (3*g_sched.stats.avg_ttff_ms + ttff_ms)/4;
+    portEXIT_CRITICAL(&g_sched_mux);
+  }
+
+  /* Wake up every waiting task. */
+  if (g_fix_events != NULL)
+  {
+    xEventGroupSetBits(g_fix_events, GPS_FIX_PUBLISHED);
+    xEventGroupClearBits(g_fix_events, GPS_FIX_PUBLISHED);
+  }
 }
 
 
 /**
- * gps_get_secs()
- * 
- * @brief Get the number of seconds from the last retrieved time value
- * @return seconds (0-59)
+ * gps_epoch_begin()
+ *
+ * @brief Detect the start of a new navigation epoch before a message is
+ *        merged into the fix, publishing what is left of the previous one.
+ *        The last message of the previous epoch becomes the epoch ender.
+ * @param msg: message key (GPS_EPOCH_NMEA_MSG or GPS_EPOCH_CASIC_MSG)
+ * @param b_has_time: true if message carries a time
+ * @param time: time of fix (NMEA) or receiver run time (CASIC)
  **/
 
-int gps_get_secs(void)
+static void gps_epoch_begin(uint32_t msg, bool b_has_time, int time)
 {
-  return (g_time/1000)%100;
-}
+  bool b_new_epoch;
 
-/**
- * gps_get_mins()
+  if (b_has_time)
+    b_new_epoch = g_epoch.b_time_known && (time != g_epoch.time);
+  else
+  {
+    /* No time yet (cold start), the first message coming back starts a new epoch. */
+    b_new_epoch = !g_epoch.b_time_known && g_epoch.b_dirty && (msg == g_epoch.first_msg);
+  }
+
+  if (b_new_epoch)
+  {
+    g_epoch.ender_msg = g_epoch.last_msg;
+    if (g_epoch.b_dirty)
+      gps_publish_fix();
+  }
+
+  if (b_has_time)
+  {
+    g_epoch.b_time_known = true;
+    g_epoch.time = time;
+  }
+
+  if (!g_epoch.b_dirty)
+    g_epoch.first_msg = msg;
+}
+
+
+/**
+ * gps_epoch_commit()
+ *
+ * @brief Record a message that updated the fix, publishing the fix if this
+ *        message ends the epoch.
+ * @param msg: message key (GPS_EPOCH_NMEA_MSG or GPS_EPOCH_CASIC_MSG)
+ **/
+
+static void gps_epoch_commit(uint32_t msg)
+{
+  g_epoch.last_msg = msg;
+  g_epoch.b_dirty = true;
+
+  if (msg == g_epoch.ender_msg)
+    gps_publish_fix();
+}
+
+
+/**
+ * gps_epoch_reset()
+ *
+ * @brief Forget epoch timing, e.g. when the receiver is powered up again.
+ **/
+
+static void gps_epoch_reset(void)
+{
+  memset(&g_epoch, 0, sizeof(g_epoch));
+}
+
+
+/**
+ * gps_on_nmea_sentence()
+ *
+ * @brief NMEA parser sentence callback, commits staged values if the
+ *        sentence checksum is valid.
+ * @param p_parser: pointer to the NMEA parser
+ * @param b_valid: true if checksum matched, false otherwise
+ **/
+
+static void gps_on_nmea_sentence(nmea_parser_t *p_parser, bool b_valid)
+{
+  gps_pending_t *p_pending = (gps_pending_t *)p_parser->p_user_data;
+  uint32_t msg;
+
+  if (!b_valid || (p_pending->p_desc == NULL))
+    return;
+
+  /* First sentence of a new epoch, publish the previous one first. */
+  msg = GPS_EPOCH_NMEA_MSG(p_pending->p_desc - g_nmea_sentences, p_pending->system);
+  if (p_pending->updated != 0)
+    gps_epoch_begin(msg, (p_pending->updated & GPS_UPD_TIME) && !g_gps_cfg.b_binary, p_pending->time);
+
+  if (p_pending->updated & GPS_UPD_TIME)
+    g_fix.time = p_pending->time;
+  if (p_pending->updated & GPS_UPD_LAT)
+    g_fix.lat = p_pending->lat;
+  if (p_pending->updated & GPS_UPD_LNG)
+    g_fix.lng = p_pending->lng;
+  if (p_pending->updated & GPS_UPD_SAT)
+    g_fix.nb_sat = p_pending->nb_sat;
+  if (p_pending->updated & GPS_UPD_HDOP)
+    g_fix.hdop = p_pending->hdop;
+  if (p_pending->updated & GPS_UPD_ALT)
+    g_fix.alt = p_pending->alt;
+  if (p_pending->updated & GPS_UPD_SPEED)
+    g_fix.speed = p_pending->speed;
+  if (p_pending->updated & GPS_UPD_DATE)
+    g_fix.date = p_pending->date;
+  if (p_pending->updated & GPS_UPD_QUALITY)
+    g_fix.quality = p_pending->quality;
+  if (p_pending->updated & GPS_UPD_VALID)
+    g_fix.valid = p_pending->b_valid_data;
+  if (p_pending->updated & GPS_UPD_MODE)
+    g_fix.mode = p_pending->mode;
+  if (p_pending->updated & GPS_UPD_PDOP)
+    g_fix.pdop = p_pending->pdop;
+  if (p_pending->updated & GPS_UPD_VDOP)
+    g_fix.vdop = p_pending->vdop;
+  if (p_pending->updated & GPS_UPD_COURSE)
+    g_fix.course = p_pending->course;
+
+  /* Make the updated fix visible to readers once the epoch is complete. */
+  if (p_pending->updated != 0)
+    gps_epoch_commit(msg);
+
+  /* Sentence-specific processing. */
+  if (p_pending->p_desc->pfn_commit != NULL)
+    p_pending->p_desc->pfn_commit(p_pending);
+}
+
+
+/**
+ * gps_casic_to_degrees()
+ *
+ * @brief Convert a binary position value into raw degrees
+ * @param value: position in degrees
+ * @param p_degrees: pointer to a `gps_raw_degrees_t` structure to fill
+ **/
+
+static void gps_casic_to_degrees(double value, gps_raw_degrees_t *p_degrees)
+{
+  p_degrees->negative = (value < 0);
+  value = fabs(value);
+  p_degrees->deg = (uint16_t)value;
+  p_degrees->billionths = (uint32_t)((value - p_degrees->deg) * 1000000000.0);
+}
+
+
+/**
+ * gps_on_casic_frame()
+ *
+ * @brief CASIC parser callback, updates and publishes the current fix from
+ *        binary navigation messages.
+ * @param p_parser: pointer to the CASIC parser
+ * @param msg_class: message class
+ * @param msg_id: message ID
+ * @param p_payload: pointer to message payload
+ * @param len: payload length
+ **/
+
+static void gps_on_casic_frame(casic_parser_t *p_parser, uint8_t msg_class, uint8_t msg_id, uint8_t *p_payload, int len)
+{
+  double lat, lng;
+  float pdop, height, speed, heading;
+  uint16_t ms, year;
+  uint32_t run_time;
+
+  if ((msg_class != CASIC_CLASS_NAV) || (len < 4))
+    return;
+
+  /* Messages of an epoch share the same run time. */
+  memcpy(&run_time, &p_payload[0], sizeof(uint32_t));
+
+  if ((msg_id == CASIC_ID_NAV_PV) && (len >= 80))
+  {
+    gps_epoch_begin(GPS_EPOCH_CASIC_MSG(msg_id), true, (int)run_time);
+
+    /* Position and velocity, decoded in place (little-endian fields). */
+    memcpy(&pdop, &p_payload[12], sizeof(float));
+    memcpy(&lng, &p_payload[16], sizeof(double));
+    memcpy(&lat, &p_payload[24], sizeof(double));
+    memcpy(&height, &p_payload[32], sizeof(float));
+    memcpy(&speed, &p_payload[64], sizeof(float));     /* speed2D */
+    memcpy(&heading, &p_payload[68], sizeof(float));
+
+    g_fix.valid = (p_payload[4] == CASIC_POS_VALID_2D) || (p_payload[4] == CASIC_POS_VALID_3D);
+    g_fix.mode = (p_payload[4] == CASIC_POS_VALID_3D) ? GPS_MODE_3D : ((p_payload[4] == CASIC_POS_VALID_2D) ? GPS_MODE_2D : GPS_MODE_NO_FIX);
+    g_fix.quality = g_fix.valid ? GPS_FIX_GPS : GPS_FIX_INVALID;
+    g_fix.nb_sat = p_payload[7];
+    g_fix.pdop = (int)(pdop * 100);
+    if (g_fix.valid)
+    {
+      gps_casic_to_degrees(lat, &g_fix.lat);
+      gps_casic_to_degrees(lng, &g_fix.lng);
+      g_fix.alt = (int)(height * 100);
+      g_fix.speed = (int)(speed * 194.3844);   /* m/s to knots x 100 */
+      g_fix.course = (int)(heading * 100);
+    }
+    gps_epoch_commit(GPS_EPOCH_CASIC_MSG(msg_id));
+  }
+  else if ((msg_id == CASIC_ID_NAV_TIMEUTC) && (len >= 24))
+  {
+    gps_epoch_begin(GPS_EPOCH_CASIC_MSG(msg_id), true, (int)run_time);
+    memcpy(&ms, &p_payload[12], sizeof(uint16_t));
+    memcpy(&year, &p_payload[14], sizeof(uint16_t));
+
+    /* Time and date validity flags. */
+    if (p_payload[21] != 0)
+      g_fix.time = ((p_payload[18]*100 + p_payload[19])*100 + p_payload[20])*1000 + ms;
+    if (p_payload[23] != 0)
+      g_fix.date = (p_payload[17]*100 + p_payload[16])*100 + (year % 100);
+    gps_epoch_commit(GPS_EPOCH_CASIC_MSG(msg_id));
+  }
+}
+
+
+/**
+ * gps_rx_feed()
+ *
+ * @brief Dispatch received bytes to the NMEA or CASIC parser. CASIC sync
+ *        byte never appears in NMEA text, so a frame is always spotted.
+ * @param p_data: pointer to received bytes
+ * @param len: number of bytes
+ **/
+
+static void gps_rx_feed(uint8_t *p_data, int len)
+{
+  int i;
+
+  for (i=0; i<len; i++)
+  {
+    if (casic_parser_busy(&g_casic_parser) || (p_data[i] == CASIC_SYNC1))
+      casic_parser_push(&g_casic_parser, p_data[i]);
+    else
+      nmea_parser_push(&g_nmea_parser, p_data[i]);
+  }
+}
+
+
+/**
+ * gps_rx_drain()
+ *
+ * @brief Feed every byte pending in the RX ring buffer to the NMEA parser.
+ **/
+
+static void gps_rx_drain(void)
+{
+  /* Parse up to the end of the buffer if data wraps around. */
+  if (gps_rx_head < gps_rx_tail)
+  {
+    gps_rx_feed(&gps_rx_ring[gps_rx_tail], GPS_RX_BUFSIZE - gps_rx_tail);
+    gps_rx_tail = 0;
+  }
+
+  gps_rx_feed(&gps_rx_ring[gps_rx_tail], gps_rx_head - gps_rx_tail);
+  gps_rx_tail = gps_rx_head;
+}
+
+
+/**
+ * gps_read_data()
+ *
+ * @brief Read data sent by GPS into our RX ring buffer, draining it into
+ *        the parser whenever it runs out of space.
+ * @param size: number of bytes available in UART buffer
+ * @return size of bytes read.
+ **/
+
+static int gps_read_data(int size)
+{
+  int remaining, chunk, nb_read;
+  int total = 0;
+
+  remaining = size;
+  while (remaining > 0)
+  {
+    /* Contiguous free space after head, keeping one slot to tell full from empty. */
+    if (gps_rx_head >= gps_rx_tail)
+      chunk = GPS_RX_BUFSIZE - gps_rx_head - ((gps_rx_tail == 0)?1:0);
+    else
+      chunk = gps_rx_tail - gps_rx_head - 1;
+
+    if (chunk == 0)
+    {
+      /* Ring buffer is full, make room. */
+      gps_rx_drain();
+      continue;
+    }
+
+    if (chunk > remaining)
+      chunk = remaining;
+
+    /* Data is already buffered by the UART driver, do not block. */
+    nb_read = twatch_uart_receive(&gps_rx_ring[gps_rx_head], chunk, GPS_RX_READ_MS/portTICK_RATE_MS);
+    if (nb_read <= 0)
+      break;
+
+    gps_rx_head = (gps_rx_head + nb_read) % GPS_RX_BUFSIZE;
+    remaining -= nb_read;
+    total += nb_read;
+  }
+
+  return total;
+}
+
+
+/**
+ * gps_read_lines()
+ *
+ * @brief Feed every complete line received in line mode to the parsers.
+ *        Lines are read by the UART driver straight into pool buffers.
+ **/
+
+static void gps_read_lines(void)
+{
+  twatch_uart_line_t *p_line;
+
+  while ((p_line = twatch_uart_get_line()) != NULL)
+  {
+    gps_rx_feed(p_line->data, p_line->len);
+    twatch_uart_release_line(p_line);
+  }
+}
+
+
+/**
+ * gps_set_rx_mode()
+ *
+ * @brief Select line-oriented reception when the receiver only sends NMEA
+ *        sentences, raw reception when binary frames are enabled.
+ **/
+
+static void gps_set_rx_mode(void)
+{
+  if (g_gps_cfg.b_binary)
+  {
+    if (twatch_uart_is_line_mode())
+      twatch_uart_disable_line_mode();
+  }
+  else if (!twatch_uart_is_line_mode())
+    twatch_uart_enable_line_mode('\n');
+}
+
+
+/**
+ * gps_process_rx()
+ *
+ * @brief Wait data from GPS module and process it.
+ * @param ticks_to_wait: maximum number of ticks to wait for data
+ **/
+
+static void gps_process_rx(TickType_t ticks_to_wait)
+{
+  uart_event_t uart_evt;
+  int pending;
+
+  /* Wait for UART event. */
+  if(twatch_uart_wait_event(&uart_evt, ticks_to_wait))
+  {
+    switch(uart_evt.type)
+    {
+      case UART_PATTERN_DET:
+        {
+          /* One or more complete sentences. */
+          gps_read_lines();
+        }
+        break;
+
+      case UART_DATA:
+        {
+          if (twatch_uart_is_line_mode())
+          {
+            /* Catch up with lines whose event may have been dropped. */
+            gps_read_lines();
+
+            /* No end-of-line in sight, consume data as a raw stream. */
+            pending = twatch_uart_get_buffered_len();
+            if (pending > TWATCH_UART_LINE_MAXLEN)
+            {
+              if (gps_read_data(pending) > 0)
+                gps_rx_drain();
+            }
+          }
+          else
+          {
+            /* Fetch data and parse it. */
+            if (gps_read_data(uart_evt.size) > 0)
+              gps_rx_drain();
+          }
+        }
+        break;
+
+      case UART_FIFO_OVF:
+      case UART_BUFFER_FULL:
+        {
+          /* Data has been lost, drop whatever sentence was in progress. */
+          ESP_LOGW(TAG, "UART overflow, flushing input");
+          twatch_uart_flush();
+          gps_rx_head = gps_rx_tail = 0;
+          nmea_parser_reset(&g_nmea_parser);
+          casic_parser_reset(&g_casic_parser);
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * _gps_motion_interrupt_handler()
+ *
+ * Interrupt handler for BMA423 INT1, wakes up the GPS task in motion mode.
+ **/
+
+static void IRAM_ATTR _gps_motion_interrupt_handler(void *parameter)
+{
+  BaseType_t b_woken = pdFALSE;
+
+  g_sched.last_motion_tick = xTaskGetTickCountFromISR();
+  g_sched.b_motion = true;
+  if (g_sched.task != NULL)
+    vTaskNotifyGiveFromISR(g_sched.task, &b_woken);
+  if (b_woken)
+    portYIELD_FROM_ISR();
+}
+
+
+/**
+ * gps_apply_config()
+ *
+ * @brief Send pending configuration changes to the GPS module. Baudrate
+ *        is changed last, once every other command has been sent.
+ **/
+
+static void gps_apply_config(void)
+{
+  char command[GPS_CMD_MAXLEN];
+  uint8_t payload[4];
+  uint32_t dirty = g_gps_cfg.dirty;
+  uint32_t mask;
+  int i;
+
+  g_gps_cfg.dirty = 0;
+
+  if (dirty & GPS_CFG_RATE)
+  {
+    snprintf(command, sizeof(command), "PCAS02,%d", g_gps_cfg.interval_ms);
+    twatch_gps_send_command(command);
+  }
+
+  if (dirty & GPS_CFG_SENTENCES)
+  {
+    mask = g_gps_cfg.sentences;
+    snprintf(command, sizeof(command), "PCAS03,%d,%d,%d,%d,%d,%d,%d,0,0,0,,,0,0",
+      (mask & GPS_NMEA_GGA) ? 1 : 0,
+      (mask & GPS_NMEA_GLL) ? 1 : 0,
+      (mask & GPS_NMEA_GSA) ? 1 : 0,
+      (mask & GPS_NMEA_GSV) ? 1 : 0,
+      (mask & GPS_NMEA_RMC) ? 1 : 0,
+      (mask & GPS_NMEA_VTG) ? 1 : 0,
+      (mask & GPS_NMEA_ZDA) ? 1 : 0
+    );
+    twatch_gps_send_command(command);
+  }
+
+  if (dirty & GPS_CFG_BINARY)
+  {
+    /* CFG-MSG: class, id, rate (u16, 0 disables output). */
+    for (i=0; i<2; i++)
+    {
+      payload[0] = CASIC_CLASS_NAV;
+      payload[1] = (i == 0) ? CASIC_ID_NAV_PV : CASIC_ID_NAV_TIMEUTC;
+      payload[2] = g_gps_cfg.b_binary ? 1 : 0;
+      payload[3] = 0;
+      twatch_gps_send_binary(CASIC_CLASS_CFG, CASIC_ID_CFG_MSG, payload, sizeof(payload));
+    }
+
+    /* Binary frames are not line-oriented. */
+    gps_set_rx_mode();
+  }
+
+  if (dirty & GPS_CFG_BAUDRATE)
+  {
+    switch (g_gps_cfg.baudrate)
+    {
+      case 4800: i = 0; break;
+      case 19200: i = 2; break;
+      case 38400: i = 3; break;
+      case 57600: i = 4; break;
+      case 115200: i = 5; break;
+      default: i = 1; break;
+    }
+    snprintf(command, sizeof(command), "PCAS01,%d", i);
+    twatch_gps_send_command(command);
+
+    /* Follow the module, anything received meanwhile is garbage. */
+    twatch_uart_set_baudrate(g_gps_cfg.baudrate);
+    twatch_uart_flush();
+    nmea_parser_reset(&g_nmea_parser);
+    casic_parser_reset(&g_casic_parser);
+  }
+}
+
+
+/**
+ * gps_power_up()
+ *
+ * @brief Power on and wake up GPS module
+ **/
+
+static void gps_power_up(void)
+{
+  ESP_LOGI(TAG, "switching on GPS ...");
+  g_gps_state = GPS_ON;
+
+  #ifdef CONFIG_PM_ENABLE
+    if (g_sched.pm_lock != NULL)
+      esp_pm_lock_acquire(g_sched.pm_lock);
+  #endif
+
+  /* Power on GPS through LDO4. */
+  twatch_pmu_gps_power(true);
+  vTaskDelay(200/portTICK_RATE_MS);
+
+  /* Wake-up GPS. */
+  vTaskDelay(60/portTICK_RATE_MS);
+  gpio_set_level(TWATCH_GPS_WAKEUP, 0);
+  vTaskDelay(200/portTICK_RATE_MS);
+  gpio_set_level(TWATCH_GPS_WAKEUP, 1);
+
+  g_sched.power_up_tick = xTaskGetTickCount();
+  g_sched.b_got_fix = false;
+  gps_epoch_reset();
+
+  portENTER_CRITICAL(&g_sched_mux);
+  g_sched.stats.nb_power_cycles++;
+  portEXIT_CRITICAL(&g_sched_mux);
+
+  /* GPS should be woken up. */
+  ESP_LOGI(TAG, "GPS has been woken up !");
+  g_gps_state = GPS_READY;
+
+  /* Restore receiver configuration. */
+  gps_apply_config();
+}
+
+
+/**
+ * gps_power_down()
+ *
+ * @brief Power off GPS module and drop any partial data.
+ **/
+
+static void gps_power_down(void)
+{
+  uint32_t on_time_s;
+
+  ESP_LOGI(TAG, "switching off GPS ...");
+  twatch_pmu_gps_power(false);
+
+  on_time_s = ((xTaskGetTickCount() - g_sched.power_up_tick)*portTICK_PERIOD_MS)/1000;
+  portENTER_CRITICAL(&g_sched_mux);
+  g_sched.stats.on_time_s += on_time_s;
+  portEXIT_CRITICAL(&g_sched_mux);
+
+  /* Forget about any partial sentence. */
+  twatch_uart_flush();
+  gps_rx_head = gps_rx_tail = 0;
+  nmea_parser_reset(&g_nmea_parser);
+  casic_parser_reset(&g_casic_parser);
+
+  /* Module will be back to its default configuration. */
+  twatch_uart_set_baudrate(GPS_DEFAULT_BAUDRATE);
+  g_gps_cfg.dirty = g_gps_cfg.configured;
+
+  #ifdef CONFIG_PM_ENABLE
+    if (g_sched.pm_lock != NULL)
+      esp_pm_lock_release(g_sched.pm_lock);
+  #endif
+
+  g_gps_state = GPS_IDLE;
+}
+
+
+/**
+ * gps_sched_should_run()
+ *
+ * @brief Decide if GPS must be powered according to the current schedule.
+ *        Periodic fixes are also accounted for here, and the period adapted
+ *        to the last known speed.
+ * @param now: current tick count
+ * @return true if GPS must be on, false otherwise
+ **/
+
+static bool gps_sched_should_run(TickType_t now)
+{
+  gps_sched_config_t config;
+  uint32_t period_s, avg_ttff_ms;
+  TickType_t next_wake_tick;
+
+  portENTER_CRITICAL(&g_sched_mux);
+  config = g_sched.config;
+  period_s = g_sched.stats.period_s;
+  avg_ttff_ms = g_sched.stats.avg_ttff_ms;
+  next_wake_tick = g_sched.next_wake_tick;
+  portEXIT_CRITICAL(&g_sched_mux);
+
+  switch (config.mode)
+  {
+    case GPS_SCHED_CONTINUOUS:
+      return true;
+
+    case GPS_SCHED_PERIODIC:
+      {
+        /* Stay on if reacquiring next fix costs more than the off-time saves. */
+        if (gps_sched_keep_tracking(period_s, g_sched.b_got_fix ? g_sched.last_ttff_ms : avg_ttff_ms))
+          return true;
+
+        if (g_gps_state == GPS_READY)
+        {
+          /* Still acquiring. */
+          if (!g_sched.b_got_fix && ((now - g_sched.power_up_tick) < pdMS_TO_TICKS(config.fix_timeout_s*1000)))
+            return true;
+
+          /* Statistics are read by other tasks, update them atomically. */
+          portENTER_CRITICAL(&g_sched_mux);
+          if (g_sched.b_got_fix)
+          {
+            /* Slow down while stationary, back to base period when moving. */
+            g_sched.stats.nb_fixes++;
+            g_sched.stats.period_s = gps_sched_next_period(&config, g_sched.stats.period_s, g_fix.speed);
+          }
+          else
+            g_sched.stats.nb_timeouts++;
+
+          g_sched.next_wake_tick = g_sched.power_up_tick + pdMS_TO_TICKS(g_sched.stats.period_s*1000);
+          portEXIT_CRITICAL(&g_sched_mux);
+          return false;
+        }
+
+        return ((int32_t)(now - next_wake_tick) >= 0);
+      }
+
+    case GPS_SCHED_MOTION:
+      return g_sched.b_motion && ((now - g_sched.last_motion_tick) < pdMS_TO_TICKS(config.motion_hold_s*1000));
+
+    default:
+      return false;
+  }
+}
+
+
+/**
+ * gps_sched_idle_ticks()
+ *
+ * @brief Compute how long the GPS task may sleep while GPS is off.
+ * @param now: current tick count
+ * @return number of ticks to wait for a notification
+ **/
+
+static TickType_t gps_sched_idle_ticks(TickType_t now)
+{
+  if ((g_sched.config.mode == GPS_SCHED_PERIODIC) && ((int32_t)(g_sched.next_wake_tick - now) > 0))
+    return g_sched.next_wake_tick - now;
+  else if (g_sched.config.mode == GPS_SCHED_PERIODIC)
+    return 0;
+  else
+    return portMAX_DELAY;
+}
+
+
+/**
+ * twatch_gps_control()
+ * 
+ * @brief Manage the GPS state machine
+ * @param pvParameters: pointer to extra parameters (none used)
+ **/
+
+static void twatch_gps_control(void *pvParameters)
+{
+  for(;;)
+  {
+    switch(g_gps_state)
+    {
+      case GPS_IDLE:
+        {
+          /* Sleep until next periodic fix, motion or schedule change. */
+          if (!gps_sched_should_run(xTaskGetTickCount()))
+            ulTaskNotifyTake(pdTRUE, gps_sched_idle_ticks(xTaskGetTickCount()));
+          if (gps_sched_should_run(xTaskGetTickCount()))
+            gps_power_up();
+        }
+        break;
+
+      case GPS_ON:
+        break;
+
+      case GPS_READY:
+        {
+          gps_process_rx(GPS_RX_POLL_MS/portTICK_RATE_MS);
+          if (g_gps_cfg.dirty)
+            gps_apply_config();
+          if (!gps_sched_should_run(xTaskGetTickCount()))
+            gps_power_down();
+        }
+        break;
+    }
+  }
+}
+
+#endif /* CONFIG_TWATCH_V2 */
+
+
+/**
+ * twatch_gps_init()
+ * 
+ * @brief Initialize our GPS module
+ * @return ESP_FAIL on failure, ESP_OK on success.
+ **/
+
+esp_err_t twatch_gps_init(void)
+{
+  /* Initialize GPS data. */
+  memset(&g_fix, 0, sizeof(gps_fix_t));
+  memset(&g_fix_shared, 0, sizeof(gps_fix_t));
+  g_fix_seq = 0;
+  memset(&g_sky, 0, sizeof(gps_sky_t));
+  memset(&g_sky_shared, 0, sizeof(gps_sky_t));
+  g_sky_seq = 0;
+
+#ifdef CONFIG_TWATCH_V2
+  /* Initialize UART, receiver sends NMEA sentences by default. */
+  twatch_uart_init(GPS_DEFAULT_BAUDRATE);
+  gps_set_rx_mode();
+
+  /* Initialize our NMEA parser and RX ring buffer. */
+  gps_rx_head = gps_rx_tail = 0;
+  nmea_parser_init(&g_nmea_parser, gps_on_nmea_field, gps_on_nmea_sentence, &g_pending);
+  casic_parser_init(&g_casic_parser, gps_on_casic_frame, NULL);
+
+  /* Create our fix notification event group. */
+  if (g_fix_events == NULL)
+    g_fix_events = xEventGroupCreate();
+
+  #ifdef CONFIG_PM_ENABLE
+    if ((g_sched.pm_lock == NULL) &&
+        (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "gps", &g_sched.pm_lock) != ESP_OK))
+      g_sched.pm_lock = NULL;
+  #endif
+
+  /* Initialize wake-up GPIO. */
+  gpio_config_t gps_wake_up;
+
+  /* Configure wake-up GPIO. */
+  gps_wake_up.mode = GPIO_MODE_OUTPUT;
+  gps_wake_up.pin_bit_mask = (1ULL << TWATCH_GPS_WAKEUP);
+  gpio_config(&gps_wake_up);
+  gpio_set_level(TWATCH_GPS_WAKEUP, 1);
+
+  /* GPS is idling. */
+  g_gps_state = GPS_IDLE;
+
+  /* Start our GPS controller. */
+  return xTaskCreate(twatch_gps_control, "twatch_gps_control", 10000, NULL, 12, &g_sched.task);
+#else
+  return ESP_FAIL;
+#endif
+}
+
+
+/**
+ * twatch_gps_on()
+ * 
+ * @brief Enable GPS (continuous mode)
+ * @return ESP_FAIL on error, ESP_OK on success.
+ **/
+
+esp_err_t twatch_gps_on(void)
+{
+  gps_sched_config_t config;
+
+  twatch_gps_get_schedule(&config);
+  config.mode = GPS_SCHED_CONTINUOUS;
+  return twatch_gps_set_schedule(&config);
+}
+
+
+/**
+ * twatch_gps_off()
+ * 
+ * @brief Disable GPS
+ * @return ESP_FAIL on error, ESP_OK on success.
+ **/
+
+esp_err_t twatch_gps_off(void)
+{
+  gps_sched_config_t config;
+
+  twatch_gps_get_schedule(&config);
+  config.mode = GPS_SCHED_OFF;
+  return twatch_gps_set_schedule(&config);
+}
+
+
+/**
+ * twatch_gps_set_schedule()
+ *
+ * @brief Set GPS power schedule. In motion mode, the BMA423 must be set up
+ *        by the application to raise INT1 on motion (any-motion, step or
+ *        activity interrupt), or twatch_gps_notify_motion() be called.
+ * @param p_config: pointer to a `gps_sched_config_t` structure
+ * @return ESP_ERR_INVALID_ARG if config is invalid, ESP_FAIL if GPS is not
+ *         supported, ESP_OK on success.
+ **/
+
+esp_err_t twatch_gps_set_schedule(gps_sched_config_t *p_config)
+{
+#ifdef CONFIG_TWATCH_V2
+  gpio_config_t int_conf;
+
+  if ((p_config->mode == GPS_SCHED_PERIODIC) && ((p_config->period_s == 0) || (p_config->max_period_s < p_config->period_s)))
+    return ESP_ERR_INVALID_ARG;
+
+  /* Listen to BMA423 interrupts the first time motion mode is used. */
+  if ((p_config->mode == GPS_SCHED_MOTION) && !g_sched.b_motion_isr)
+  {
+    int_conf.intr_type = GPIO_INTR_POSEDGE;
+    int_conf.pin_bit_mask = (1ULL << TWATCH_BMA423_INT);
+    int_conf.mode = GPIO_MODE_INPUT;
+    int_conf.pull_down_en = 0;
+    int_conf.pull_up_en = 0;
+    gpio_config(&int_conf);
+    gpio_install_isr_service(0);
+    gpio_isr_handler_add(TWATCH_BMA423_INT, _gps_motion_interrupt_handler, NULL);
+    g_sched.b_motion_isr = true;
+  }
+
+  portENTER_CRITICAL(&g_sched_mux);
+  g_sched.config = *p_config;
+  g_sched.stats.period_s = p_config->period_s;
+  g_sched.next_wake_tick = xTaskGetTickCount();
+  portEXIT_CRITICAL(&g_sched_mux);
+
+  /* Let the GPS task apply the new schedule. */
+  if (g_sched.task != NULL)
+    xTaskNotifyGive(g_sched.task);
+
+  /* Success. */
+  return ESP_OK;
+#else
+  return ESP_FAIL;
+#endif
+}
+
+
+/**
+ * twatch_gps_get_schedule()
+ *
+ * @brief Get current GPS power schedule
+ * @param p_config: pointer to a `gps_sched_config_t` structure
+ **/
+
+void twatch_gps_get_schedule(gps_sched_config_t *p_config)
+{
+  portENTER_CRITICAL(&g_sched_mux);
+  *p_config = g_sched.config;
+  portEXIT_CRITICAL(&g_sched_mux);
+}
+
+
+/**
+ * twatch_gps_get_sched_stats()
+ *
+ * @brief Get GPS power scheduler statistics
+ * @param p_stats: pointer to a `gps_sched_stats_t` structure
+ **/
+
+void twatch_gps_get_sched_stats(gps_sched_stats_t *p_stats)
+{
+  portENTER_CRITICAL(&g_sched_mux);
+  *p_stats = g_sched.stats;
+  portEXIT_CRITICAL(&g_sched_mux);
+}
+
+
+/**
+ * gps_estimate_periodic_current()
+ *
+ * @brief Estimate the average GPS current for a given fix period
+ * @param period_s: fix period in seconds
+ * @return average current in mA
+ **/
+
+static float gps_estimate_periodic_current(uint32_t period_s)
+{
+  uint32_t avg_ttff_ms;
+
+  portENTER_CRITICAL(&g_sched_mux);
+  avg_ttff_ms = g_sched.stats.avg_ttff_ms;
+  portEXIT_CRITICAL(&g_sched_mux);
+
+  return gps_sched_periodic_current(period_s, avg_ttff_ms);
+}
+
+
+/**
+ * twatch_gps_estimate_energy()
+ *
+ * @brief Estimate GPS current consumption for a given schedule, based on
+ *        the measured average time to fix.
+ * @param p_config: pointer to a `gps_sched_config_t` structure, NULL for
+ *                  current schedule
+ * @param motion_percent: expected percentage of time spent moving
+ * @param p_energy: pointer to a `gps_energy_t` structure to fill
+ **/
+
+void twatch_gps_estimate_energy(gps_sched_config_t *p_config, int motion_percent, gps_energy_t *p_energy)
+{
+  gps_sched_config_t config;
+
+  if (p_config == NULL)
+    twatch_gps_get_schedule(&config);
+  else
+    config = *p_config;
+
+  switch (config.mode)
+  {
+    case GPS_SCHED_CONTINUOUS:
+      p_energy->moving_current_ma = GPS_CURRENT_TRACKING_MA;
+      p_energy->stationary_current_ma = GPS_CURRENT_TRACKING_MA;
+      break;
+
+    case GPS_SCHED_PERIODIC:
+      p_energy->moving_current_ma = gps_estimate_periodic_current(config.period_s);
+      p_energy->stationary_current_ma = gps_estimate_periodic_current(config.max_period_s);
+      break;
+
+    case GPS_SCHED_MOTION:
+      p_energy->moving_current_ma = GPS_CURRENT_TRACKING_MA;
+      p_energy->stationary_current_ma = 0.0;
+      break;
+
+    default:
+      p_energy->moving_current_ma = 0.0;
+      p_energy->stationary_current_ma = 0.0;
+      break;
+  }
+
+  p_energy->avg_current_ma = (p_energy->moving_current_ma * motion_percent
+    + p_energy->stationary_current_ma * (100 - motion_percent))/100.0;
+}
+
+
+/**
+ * twatch_gps_notify_motion()
+ *
+ * @brief Report user motion to the GPS scheduler (motion mode)
+ **/
+
+void twatch_gps_notify_motion(void)
+{
+  g_sched.last_motion_tick = xTaskGetTickCount();
+  g_sched.b_motion = true;
+  if (g_sched.task != NULL)
+    xTaskNotifyGive(g_sched.task);
+}
+
+
+/**
+ * twatch_gps_send_command()
+ *
+ * @brief Send a text command (e.g. "PCAS10,0") to the GPS module. Leading
+ *        '$', checksum and line ending are added.
+ * @param psz_command: command to send
+ * @return ESP_ERR_INVALID_ARG if command is too long, ESP_FAIL on error,
+ *         ESP_OK on success.
+ **/
+
+esp_err_t twatch_gps_send_command(const char *psz_command)
+{
+#ifdef CONFIG_TWATCH_V2
+  char sentence[GPS_CMD_MAXLEN];
+  uint8_t checksum = 0;
+  int len;
+  const char *p;
+
+  for (p = psz_command; *p != '\0'; p++)
+    checksum ^= (uint8_t)*p;
+
+  len = snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", psz_command, checksum);
+  if ((len < 0) || (len >= sizeof(sentence)))
+    return ESP_ERR_INVALID_ARG;
+
+  return (twatch_uart_transmit((uint8_t *)sentence, len) == len) ? ESP_OK : ESP_FAIL;
+#else
+  return ESP_FAIL;
+#endif
+}
+
+
+/**
+ * twatch_gps_send_binary()
+ *
+ * @brief Send a CASIC binary message to the GPS module
+ * @param msg_class: message class
+ * @param msg_id: message ID
+ * @param p_payload: pointer to message payload
+ * @param len: payload length
+ * @return ESP_ERR_INVALID_ARG if payload is too big, ESP_FAIL on error,
+ *         ESP_OK on success.
+ **/
+
+esp_err_t twatch_gps_send_binary(uint8_t msg_class, uint8_t msg_id, uint8_t *p_payload, int len)
+{
+#ifdef CONFIG_TWATCH_V2
+  uint8_t frame[CASIC_HEADER_LEN + CASIC_MAX_PAYLOAD + CASIC_CHECKSUM_LEN];
+  int frame_len;
+
+  frame_len = casic_build_frame(frame, sizeof(frame), msg_class, msg_id, p_payload, len);
+  if (frame_len < 0)
+    return ESP_ERR_INVALID_ARG;
+
+  return (twatch_uart_transmit(frame, frame_len) == frame_len) ? ESP_OK : ESP_FAIL;
+#else
+  return ESP_FAIL;
+#endif
+}
+
+
+/**
+ * gps_set_config()
+ *
+ * @brief Mark a receiver configuration item as set and have the GPS task
+ *        apply it.
+ * @param item: GPS_CFG_* item
+ * @return ESP_OK on success, ESP_FAIL if GPS is not supported.
+ **/
+
+static esp_err_t gps_set_config(uint32_t item)
+{
+#ifdef CONFIG_TWATCH_V2
+  g_gps_cfg.configured |= item;
+  g_gps_cfg.dirty |= item;
+
+  /* Success. */
+  return ESP_OK;
+#else
+  return ESP_FAIL;
+#endif
+}
+
+
+/**
+ * twatch_gps_set_baudrate()
+ *
+ * @brief Change the GPS module UART baudrate, UART is reconfigured to match.
+ * @param baudrate: 4800, 9600, 19200, 38400, 57600 or 115200
+ * @return ESP_ERR_INVALID_ARG if baudrate is not supported, ESP_OK on success.
+ **/
+
+esp_err_t twatch_gps_set_baudrate(int baudrate)
+{
+  switch (baudrate)
+  {
+    case 4800:
+    case 9600:
+    case 19200:
+    case 38400:
+    case 57600:
+    case 115200:
+      g_gps_cfg.baudrate = baudrate;
+      return gps_set_config(GPS_CFG_BAUDRATE);
+
+    default:
+      return ESP_ERR_INVALID_ARG;
+  }
+}
+
+
+/**
+ * twatch_gps_set_rate()
+ *
+ * @brief Change the GPS module fix interval
+ * @param interval_ms: 1000, 500, 250, 200 or 100 ms
+ * @return ESP_ERR_INVALID_ARG if interval is not supported, ESP_OK on success.
+ **/
+
+esp_err_t twatch_gps_set_rate(int interval_ms)
+{
+  switch (interval_ms)
+  {
+    case 1000:
+    case 500:
+    case 250:
+    case 200:
+    case 100:
+      g_gps_cfg.interval_ms = interval_ms;
+      return gps_set_config(GPS_CFG_RATE);
+
+    default:
+      return ESP_ERR_INVALID_ARG;
+  }
+}
+
+
+/**
+ * twatch_gps_set_sentences()
+ *
+ * @brief Select the NMEA sentences output by the GPS module
+ * @param mask: combination of GPS_NMEA_* flags
+ * @return ESP_OK on success, ESP_FAIL if GPS is not supported.
+ **/
+
+esp_err_t twatch_gps_set_sentences(uint32_t mask)
+{
+  g_gps_cfg.sentences = mask;
+  return gps_set_config(GPS_CFG_SENTENCES);
+}
+
+
+/**
+ * twatch_gps_set_binary_output()
+ *
+ * @brief Enable or disable binary position (NAV-PV) and time (NAV-TIMEUTC)
+ *        messages. Combined with twatch_gps_set_sentences(0), this removes
+ *        NMEA text parsing entirely.
+ * @param b_enable: true to enable binary messages, false to disable
+ * @return ESP_OK on success, ESP_FAIL if GPS is not supported.
+ **/
+
+esp_err_t twatch_gps_set_binary_output(bool b_enable)
+{
+  g_gps_cfg.b_binary = b_enable;
+  return gps_set_config(GPS_CFG_BINARY);
+}
+
+
+/**
+ * gps_seqlock_read()
+ *
+ * @brief Copy a consistent snapshot of a seqlock-protected structure
+ * @param p_seq: pointer to the sequence counter
+ * @param p_data: pointer to the destination buffer
+ * @param p_shared: pointer to the shared structure
+ * @param size: size of data
+ **/
+
+static void gps_seqlock_read(volatile uint32_t *p_seq, void *p_data, void *p_shared, size_t size)
+{
+  uint32_t seq;
+
+  for (;;)
+  {
+    seq = *p_seq;
+    __sync_synchronize();
+    memcpy(p_data, p_shared, size);
+    __sync_synchronize();
+
+    /* Snapshot is consistent if no publication happened meanwhile. */
+    if (((seq & 1) == 0) && (seq == *p_seq))
+      break;
+
+    /* Let the GPS task finish its update if we preempted it. */
+    vTaskDelay(1);
+  }
+}
+
+
+/**
+ * gps_get_fix()
+ *
+ * @brief Retrieve a consistent snapshot of the last published GPS fix
+ * @param p_fix: pointer to a `gps_fix_t` structure that will be filled
+ **/
+
+void gps_get_fix(gps_fix_t *p_fix)
+{
+  gps_seqlock_read(&g_fix_seq, p_fix, &g_fix_shared, sizeof(gps_fix_t));
+}
+
+
+/**
+ * gps_get_sky()
+ *
+ * @brief Retrieve a consistent snapshot of the satellites in view
+ * @param p_sky: pointer to a `gps_sky_t` structure that will be filled
+ **/
+
+void gps_get_sky(gps_sky_t *p_sky)
+{
+  gps_seqlock_read(&g_sky_seq, p_sky, &g_sky_shared, sizeof(gps_sky_t));
+}
+
+
+/**
+ * gps_wait_fix()
+ *
+ * @brief Wait for the next GPS fix to be published
+ * @param p_fix: pointer to a `gps_fix_t` structure that will be filled
+ * @param ticks_to_wait: maximum number of ticks to wait
+ * @return ESP_OK if a new fix has been received, ESP_ERR_TIMEOUT on timeout,
+ *         ESP_ERR_INVALID_STATE if GPS is not available.
+ **/
+
+esp_err_t gps_wait_fix(gps_fix_t *p_fix, TickType_t ticks_to_wait)
+{
+  if (g_fix_events == NULL)
+    return ESP_ERR_INVALID_STATE;
+
+  if (!(xEventGroupWaitBits(g_fix_events, GPS_FIX_PUBLISHED, pdFALSE, pdTRUE, ticks_to_wait) & GPS_FIX_PUBLISHED))
+    return ESP_ERR_TIMEOUT;
+
+  gps_get_fix(p_fix);
+
+  /* Success. */
+  return ESP_OK;
+}
+
+
+/**
+ * gps_get_lat_lng()
+ * 
+ * @brief Retrieve GPS latitude/longitude information
+ * @param p_lat: pointer to a `gps_raw_degrees_t` structure representing the latitude
+ * @param p_lng: pointer to a `gps_raw_degrees_t` structure representing the longitude
+ **/
+
+void gps_get_lat_lng(gps_raw_degrees_t *p_lat, gps_raw_degrees_t *p_lng)
+{
+  gps_fix_t fix;
+
+  /* Both values come from the same fix. */
+  gps_get_fix(&fix);
+  *p_lat = fix.lat;
+  *p_lng = fix.lng;
+}
+
+/**
+ * gps_get_day()
+ * 
+ * @brief Get the current day of month
+ * @return day in month starting from 1
+ **/
+
+int gps_get_day(void)
+{
+  gps_fix_t fix;
+
+  gps_get_fix(&fix);
+  return (fix.date/10000)%100;
+}
+
+
+/**
+ * gps_get_month()
+ * 
+ * @brief Get the current month
+ * @return month number starting from 1
+ **/
+
+int gps_get_month(void)
+{
+  gps_fix_t fix;
+
+  gps_get_fix(&fix);
+  return (fix.date/100)%100;
+}
+
+
+/**
+ * gps_get_year()
+ * 
+ * @brief Get the current year
+ * @return current year (2000+)
+ **/
+
+int gps_get_year(void)
+{
+  gps_fix_t fix;
+
+  gps_get_fix(&fix);
+  return fix.date%100 + 2000;
+}
+
+
+/**
+ * gps_get_secs()
+ * 
+ * @brief Get the number of seconds from the last retrieved time value
+ * @return seconds (0-59)
+ **/
+
+int gps_get_secs(void)
+{
+  gps_fix_t fix;
+
+  gps_get_fix(&fix);
+  return (fix.time/1000)%100;
+}
+
+/**
+ * gps_get_mins()
  * 
  * @brief Get the number of minutes from the last retrieved time value
  * @return seconds (0-59)
@@ -853,7 +2368,10 @@ int gps_get_secs(void)
 
 int gps_get_mins(void)
 {
-  return (g_time/100000)%100;
+  gps_fix_t fix;
+
+  gps_get_fix(&fix);
+  return (fix.time/100000)%100;
 }
 
 
@@ -866,7 +2384,10 @@ int gps_get_mins(void)
 
 int gps_get_hours(void)
 {
-  return (g_time/10000000)%100;
+  gps_fix_t fix;
+
+  gps_get_fix(&fix);
+  return (fix.time/10000000)%100;
 }
 
 
@@ -879,7 +2400,10 @@ int gps_get_hours(void)
 
 float gps_get_speed(void)
 {
-  return (g_speed/100.0)*1.852;
+  gps_fix_t fix;
+
+  gps_get_fix(&fix);
+  return (fix.speed/100.0)*1.852;
 }
 
 
@@ -892,7 +2416,10 @@ float gps_get_speed(void)
 
 int gps_get_satellites(void)
 {
-  return g_nb_sat;
+  gps_fix_t fix;
+
+  gps_get_fix(&fix);
+  return fix.nb_sat;
 }
 
 
@@ -905,7 +2432,10 @@ int gps_get_satellites(void)
 
 float gps_get_hdop(void)
 {
-  return g_hdop/100.0;
+  gps_fix_t fix;
+
+  gps_get_fix(&fix);
+  return fix.hdop/100.0;
 }
 
 
@@ -918,5 +2448,8 @@ float gps_get_hdop(void)
 
 float gps_get_alt(void)
 {
-  return g_alt/100.0;
+  gps_fix_t fix;
+
+  gps_get_fix(&fix);
+  return fix.alt/100.0;
 }
\ No newline at end of file
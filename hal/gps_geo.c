@@ -0,0 +1,426 @@
+#include <math.h>
+#include <string.h>
+
+#include "hal/gps_geo.h"
+
+/* Meridian arc length: 1.11195 cm per 1e-7 degree (mean Earth radius). */
+#define GEO_CM_PER_UNIT_NUM     111195
+#define GEO_CM_PER_UNIT_DEN     100000
+#define GEO_EARTH_RADIUS_CM     637100880.0f
+#define GEO_UNITS_PER_DEGREE    10000000
+#define GEO_UNITS_TO_RAD        (3.14159265358979f / (180.0f * GEO_UNITS_PER_DEGREE))
+
+/* Cached cos(latitude) is refreshed after a 0.01 degree change. */
+#define GEO_COS_REFRESH         100000
+
+/* Stationary periods are accounted in speed window every 5 seconds. */
+#define GEO_IDLE_PUSH_MS        5000
+
+/* cos() of 0 to 90 degrees, 1 degree step, Q15. */
+static const uint16_t g_cos_table[91] = {
+  32768, 32763, 32748, 32723, 32688, 32643, 32588, 32524, 32449, 32365,
+  32270, 32166, 32052, 31928, 31795, 31651, 31499, 31336, 31164, 30983,
+  30792, 30592, 30382, 30163, 29935, 29698, 29452, 29197, 28932, 28660,
+  28378, 28088, 27789, 27482, 27166, 26842, 26510, 26170, 25822, 25466,
+  25102, 24730, 24351, 23965, 23571, 23170, 22763, 22348, 21926, 21498,
+  21063, 20622, 20174, 19720, 19261, 18795, 18324, 17847, 17364, 16877,
+  16384, 15886, 15384, 14876, 14365, 13848, 13328, 12803, 12275, 11743,
+  11207, 10668, 10126, 9580, 9032, 8481, 7927, 7371, 6813, 6252,
+  5690, 5126, 4560, 3993, 3425, 2856, 2286, 1715, 1144, 572,
+  0
+};
+
+
+/**
+ * geo_isqrt()
+ *
+ * @brief Integer square root
+ * @param value: 64-bit value
+ * @return floor(sqrt(value))
+ **/
+
+static uint32_t geo_isqrt(uint64_t value)
+{
+  uint64_t result = 0;
+  uint64_t bit = 1ULL << 62;
+
+  while (bit > value)
+    bit >>= 2;
+
+  while (bit != 0)
+  {
+    if (value >= result + bit)
+    {
+      value -= result + bit;
+      result = (result >> 1) + bit;
+    }
+    else
+      result >>= 1;
+    bit >>= 2;
+  }
+
+  return (uint32_t)result;
+}
+
+
+/**
+ * geo_delta_lng()
+ *
+ * @brief Compute longitude difference the shortest way around, across the
+ *        antimeridian if needed
+ * @param p_from: pointer to origin point
+ * @param p_to: pointer to destination point
+ * @return longitude difference in 1e-7 degrees (-180 to 180 degrees)
+ **/
+
+static int64_t geo_delta_lng(geo_point_t *p_from, geo_point_t *p_to)
+{
+  int64_t dlng = (int64_t)p_to->lng - p_from->lng;
+
+  if (dlng > 180LL*GEO_UNITS_PER_DEGREE)
+    dlng -= 360LL*GEO_UNITS_PER_DEGREE;
+  else if (dlng < -180LL*GEO_UNITS_PER_DEGREE)
+    dlng += 360LL*GEO_UNITS_PER_DEGREE;
+
+  return dlng;
+}
+
+
+/**
+ * geo_cosf_lat()
+ *
+ * @brief Compute cos(latitude) as sin(colatitude), which keeps float
+ *        precision close to the poles
+ * @param lat: latitude in 1e-7 degrees
+ * @return cos(lat)
+ **/
+
+static float geo_cosf_lat(int32_t lat)
+{
+  return sinf((90*GEO_UNITS_PER_DEGREE - abs(lat)) * GEO_UNITS_TO_RAD);
+}
+
+
+/**
+ * geo_delta_cm()
+ *
+ * @brief Compute north/east offsets between two points (equirectangular)
+ * @param p_from: pointer to origin point
+ * @param p_to: pointer to destination point
+ * @param cos_lat: cos(mean latitude), Q15
+ * @param p_dx: pointer to east offset in cm
+ * @param p_dy: pointer to north offset in cm
+ **/
+
+static void geo_delta_cm(geo_point_t *p_from, geo_point_t *p_to, int32_t cos_lat, int64_t *p_dx, int64_t *p_dy)
+{
+  int64_t dlng = geo_delta_lng(p_from, p_to);
+
+  *p_dy = (((int64_t)p_to->lat - p_from->lat) * GEO_CM_PER_UNIT_NUM) / GEO_CM_PER_UNIT_DEN;
+  *p_dx = (((dlng * cos_lat) >> 15) * GEO_CM_PER_UNIT_NUM) / GEO_CM_PER_UNIT_DEN;
+}
+
+
+/**
+ * geo_point_from_raw()
+ *
+ * @brief Build a point from raw GPS degrees
+ * @param p_point: pointer to a `geo_point_t` structure to fill
+ * @param p_lat: pointer to latitude
+ * @param p_lng: pointer to longitude
+ **/
+
+void geo_point_from_raw(geo_point_t *p_point, gps_raw_degrees_t *p_lat, gps_raw_degrees_t *p_lng)
+{
+  p_point->lat = (int32_t)p_lat->deg * GEO_UNITS_PER_DEGREE + (int32_t)(p_lat->billionths / 100);
+  if (p_lat->negative)
+    p_point->lat = -p_point->lat;
+
+  p_point->lng = (int32_t)p_lng->deg * GEO_UNITS_PER_DEGREE + (int32_t)(p_lng->billionths / 100);
+  if (p_lng->negative)
+    p_point->lng = -p_point->lng;
+}
+
+
+/**
+ * geo_point_from_fix()
+ *
+ * @brief Build a point from a GPS fix
+ * @param p_point: pointer to a `geo_point_t` structure to fill
+ * @param p_fix: pointer to a `gps_fix_t` structure
+ **/
+
+void geo_point_from_fix(geo_point_t *p_point, gps_fix_t *p_fix)
+{
+  geo_point_from_raw(p_point, &p_fix->lat, &p_fix->lng);
+}
+
+
+/**
+ * geo_cos_lat()
+ *
+ * @brief Compute cos(latitude) from table with linear interpolation
+ * @param lat: latitude in 1e-7 degrees
+ * @return cos(lat) in Q15
+ **/
+
+int32_t geo_cos_lat(int32_t lat)
+{
+  int32_t deg, frac;
+
+  if (lat < 0)
+    lat = -lat;
+  if (lat >= 90*GEO_UNITS_PER_DEGREE)
+    return 0;
+
+  deg = lat / GEO_UNITS_PER_DEGREE;
+  frac = lat % GEO_UNITS_PER_DEGREE;
+  return g_cos_table[deg] - (int32_t)(((int64_t)(g_cos_table[deg] - g_cos_table[deg + 1]) * frac) / GEO_UNITS_PER_DEGREE);
+}
+
+
+/**
+ * geo_distance_cm()
+ *
+ * @brief Compute distance between two points (equirectangular, integer)
+ * @param p_from: pointer to origin point
+ * @param p_to: pointer to destination point
+ * @return distance in centimeters
+ **/
+
+uint32_t geo_distance_cm(geo_point_t *p_from, geo_point_t *p_to)
+{
+  int64_t dx, dy;
+
+  geo_delta_cm(p_from, p_to, geo_cos_lat((int32_t)(((int64_t)p_from->lat + p_to->lat)/2)), &dx, &dy);
+  return geo_isqrt(dx*dx + dy*dy);
+}
+
+
+/**
+ * geo_haversine_cm()
+ *
+ * @brief Compute great-circle distance between two points (haversine)
+ * @param p_from: pointer to origin point
+ * @param p_to: pointer to destination point
+ * @return distance in centimeters
+ **/
+
+uint32_t geo_haversine_cm(geo_point_t *p_from, geo_point_t *p_to)
+{
+  float dlat = (float)((int64_t)p_to->lat - p_from->lat) * GEO_UNITS_TO_RAD;
+  float dlng = (float)geo_delta_lng(p_from, p_to) * GEO_UNITS_TO_RAD;
+  float a, s_lat, s_lng;
+
+  s_lat = sinf(dlat/2);
+  s_lng = sinf(dlng/2);
+  a = s_lat*s_lat + geo_cosf_lat(p_from->lat)*geo_cosf_lat(p_to->lat)*s_lng*s_lng;
+  if (a > 1.0f)
+    a = 1.0f;
+
+  /* atan2() form stays accurate close to antipodes, unlike asin(). */
+  return (uint32_t)(2.0f * GEO_EARTH_RADIUS_CM * atan2f(sqrtf(a), sqrtf(1.0f - a)));
+}
+
+
+/**
+ * geo_bearing()
+ *
+ * @brief Compute initial bearing from a point to another
+ * @param p_from: pointer to origin point
+ * @param p_to: pointer to destination point
+ * @return bearing in hundredths of degree (0-35999, 0 is north)
+ **/
+
+uint16_t geo_bearing(geo_point_t *p_from, geo_point_t *p_to)
+{
+  float lat1 = p_from->lat * GEO_UNITS_TO_RAD;
+  float lat2 = p_to->lat * GEO_UNITS_TO_RAD;
+  float cos_lat1 = geo_cosf_lat(p_from->lat);
+  float cos_lat2 = geo_cosf_lat(p_to->lat);
+  float dlng = (float)geo_delta_lng(p_from, p_to) * GEO_UNITS_TO_RAD;
+  int32_t bearing;
+
+  bearing = (int32_t)(atan2f(
+    sinf(dlng)*cos_lat2,
+    cos_lat1*sinf(lat2) - sinf(lat1)*cos_lat2*cosf(dlng)
+  ) * (18000.0f / 3.14159265358979f));
+
+  if (bearing < 0)
+    bearing += 36000;
+  return (uint16_t)(bearing % 36000);
+}
+
+
+/**
+ * geo_fence_init()
+ *
+ * @brief Initialize a circular geofence
+ * @param p_fence: pointer to a `geo_fence_t` structure
+ * @param p_center: pointer to fence center
+ * @param radius_m: fence radius in meters
+ **/
+
+void geo_fence_init(geo_fence_t *p_fence, geo_point_t *p_center, uint32_t radius_m)
+{
+  p_fence->center = *p_center;
+  p_fence->radius_cm = radius_m * 100;
+  p_fence->cos_lat = geo_cos_lat(p_center->lat);
+}
+
+
+/**
+ * geo_fence_contains()
+ *
+ * @brief Check if a point lies within a geofence (no square root involved)
+ * @param p_fence: pointer to a `geo_fence_t` structure
+ * @param p_point: pointer to point to check
+ * @return true if point is inside fence, false otherwise
+ **/
+
+bool geo_fence_contains(geo_fence_t *p_fence, geo_point_t *p_point)
+{
+  int64_t dx, dy;
+
+  geo_delta_cm(&p_fence->center, p_point, p_fence->cos_lat, &dx, &dy);
+  return ((uint64_t)(dx*dx + dy*dy) <= (uint64_t)p_fence->radius_cm * p_fence->radius_cm);
+}
+
+
+/**
+ * geo_track_stats_init()
+ *
+ * @brief Initialize track statistics
+ * @param p_stats: pointer to a `geo_track_stats_t` structure
+ * @param min_step_cm: minimal step counted in distance (GPS jitter filter),
+ *                     0 for GEO_DEFAULT_MIN_STEP
+ **/
+
+void geo_track_stats_init(geo_track_stats_t *p_stats, uint32_t min_step_cm)
+{
+  memset(p_stats, 0, sizeof(geo_track_stats_t));
+  p_stats->min_step_cm = (min_step_cm > 0) ? min_step_cm : GEO_DEFAULT_MIN_STEP;
+}
+
+
+/**
+ * geo_track_stats_push()
+ *
+ * @brief Push a segment into the speed window
+ * @param p_stats: pointer to a `geo_track_stats_t` structure
+ * @param distance_cm: segment length
+ * @param time_ms: segment duration
+ **/
+
+static void geo_track_stats_push(geo_track_stats_t *p_stats, uint32_t distance_cm, uint32_t time_ms)
+{
+  p_stats->window_dist_cm[p_stats->window_pos] = distance_cm;
+  p_stats->window_time_ms[p_stats->window_pos] = time_ms;
+  p_stats->window_pos = (p_stats->window_pos + 1) % GEO_SPEED_WINDOW;
+}
+
+
+/**
+ * geo_track_stats_add()
+ *
+ * @brief Add a point to track statistics
+ * @param p_stats: pointer to a `geo_track_stats_t` structure
+ * @param p_point: pointer to new point
+ * @param time_ms: point timestamp in milliseconds
+ **/
+
+void geo_track_stats_add(geo_track_stats_t *p_stats, geo_point_t *p_point, uint32_t time_ms)
+{
+  int64_t dx, dy;
+  uint32_t distance, elapsed;
+
+  if (!p_stats->b_has_last)
+  {
+    p_stats->last = *p_point;
+    p_stats->last_time_ms = time_ms;
+    p_stats->cos_lat = geo_cos_lat(p_point->lat);
+    p_stats->cos_lat_ref = p_point->lat;
+    p_stats->b_has_last = true;
+    return;
+  }
+
+  /* Refresh cached cos(lat) only when latitude changed significantly. */
+  if (abs(p_point->lat - p_stats->cos_lat_ref) > GEO_COS_REFRESH)
+  {
+    p_stats->cos_lat = geo_cos_lat(p_point->lat);
+    p_stats->cos_lat_ref = p_point->lat;
+  }
+
+  geo_delta_cm(&p_stats->last, p_point, p_stats->cos_lat, &dx, &dy);
+  distance = geo_isqrt(dx*dx + dy*dy);
+  elapsed = time_ms - p_stats->last_time_ms;
+
+  if (distance < p_stats->min_step_cm)
+  {
+    /* Stationary, let speed decay. */
+    if (elapsed >= GEO_IDLE_PUSH_MS)
+    {
+      geo_track_stats_push(p_stats, 0, elapsed);
+      p_stats->last_time_ms = time_ms;
+    }
+    return;
+  }
+
+  p_stats->distance_cm += distance;
+  p_stats->moving_time_ms += elapsed;
+  geo_track_stats_push(p_stats, distance, elapsed);
+  p_stats->last = *p_point;
+  p_stats->last_time_ms = time_ms;
+}
+
+
+/**
+ * geo_track_stats_distance_m()
+ *
+ * @brief Get cumulative track distance
+ * @param p_stats: pointer to a `geo_track_stats_t` structure
+ * @return distance in meters
+ **/
+
+uint32_t geo_track_stats_distance_m(geo_track_stats_t *p_stats)
+{
+  return (uint32_t)(p_stats->distance_cm / 100);
+}
+
+
+/**
+ * geo_track_stats_speed()
+ *
+ * @brief Get current speed (moving average over the last segments)
+ * @param p_stats: pointer to a `geo_track_stats_t` structure
+ * @return speed in cm/s
+ **/
+
+uint32_t geo_track_stats_speed(geo_track_stats_t *p_stats)
+{
+  uint64_t distance = 0;
+  uint64_t elapsed = 0;
+  int i;
+
+  for (i=0; i<GEO_SPEED_WINDOW; i++)
+  {
+    distance += p_stats->window_dist_cm[i];
+    elapsed += p_stats->window_time_ms[i];
+  }
+
+  return (elapsed > 0) ? (uint32_t)((distance * 1000) / elapsed) : 0;
+}
+
+
+/**
+ * geo_track_stats_moving_speed()
+ *
+ * @brief Get average speed over time spent moving
+ * @param p_stats: pointer to a `geo_track_stats_t` structure
+ * @return speed in cm/s
+ **/
+
+uint32_t geo_track_stats_moving_speed(geo_track_stats_t *p_stats)
+{
+  return (p_stats->moving_time_ms > 0) ? (uint32_t)((p_stats->distance_cm * 1000) / p_stats->moving_time_ms) : 0;
+}
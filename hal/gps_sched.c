@@ -0,0 +1,72 @@
+#include "hal/gps_sched.h"
+
+/* Time spent after a fix before the receiver is switched off. */
+#define GPS_SCHED_FIX_HOLD_MS   1000
+
+
+/**
+ * gps_sched_keep_tracking()
+ *
+ * @brief Tell if the receiver should stay on until the next periodic fix.
+ *        Tracking current saved while off is weighed against the extra
+ *        current drawn while reacquiring the next fix.
+ * @param period_s: fix period in seconds
+ * @param on_time_ms: time the receiver needs to get a fix after power-up
+ * @return true if GPS should stay on, false if it should be switched off
+ **/
+
+bool gps_sched_keep_tracking(uint32_t period_s, uint32_t on_time_ms)
+{
+  uint64_t off_time_ms;
+
+  /* Next fix would be due before the receiver gets this one. */
+  if (((uint64_t)period_s * 1000) <= on_time_ms)
+    return true;
+  off_time_ms = (uint64_t)period_s * 1000 - on_time_ms;
+
+  return (off_time_ms * GPS_CURRENT_TRACKING_MA) <= (on_time_ms * (GPS_CURRENT_ACQUISITION_MA - GPS_CURRENT_TRACKING_MA));
+}
+
+
+/**
+ * gps_sched_next_period()
+ *
+ * @brief Adapt the periodic fix period to the last known speed: slow down
+ *        while stationary, back to base period when moving.
+ * @param p_config: pointer to the schedule configuration
+ * @param period_s: current period in seconds
+ * @param speed: last known speed in knots x 100
+ * @return next period in seconds
+ **/
+
+uint32_t gps_sched_next_period(gps_sched_config_t *p_config, uint32_t period_s, int speed)
+{
+  if (speed >= GPS_STATIONARY_SPEED)
+    return p_config->period_s;
+
+  return (2*period_s < p_config->max_period_s) ? 2*period_s : p_config->max_period_s;
+}
+
+
+/**
+ * gps_sched_periodic_current()
+ *
+ * @brief Estimate the average GPS current for a given fix period
+ * @param period_s: fix period in seconds
+ * @param ttff_ms: expected time to first fix in milliseconds
+ * @return average current in mA
+ **/
+
+float gps_sched_periodic_current(uint32_t period_s, uint32_t ttff_ms)
+{
+  float on_time_s;
+
+  if (gps_sched_keep_tracking(period_s, ttff_ms))
+    return GPS_CURRENT_TRACKING_MA;
+
+  /* Acquisition until fix, then GPS is switched off. */
+  on_time_s = (ttff_ms + GPS_SCHED_FIX_HOLD_MS)/1000.0;
+  if (on_time_s >= period_s)
+    return GPS_CURRENT_TRACKING_MA;
+  return (on_time_s * GPS_CURRENT_ACQUISITION_MA)/period_s;
+}
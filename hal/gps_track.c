@@ -0,0 +1,582 @@
+#include "hal/gps_track.h"
+
+#define TAG "[hal::gps_track]"
+
+/* Biggest delta record: tag + 3 varints of up to 5 bytes. */
+#define GPS_TRACK_DELTA_MAXLEN      16
+#define GPS_TRACK_KEY_LEN           13
+
+static struct {
+  const esp_partition_t *p_partition;
+  SemaphoreHandle_t lock;
+  bool b_recording;
+  bool b_new_segment;
+  uint32_t offset;                    /* Offset of the next page to write. */
+  uint8_t page[GPS_TRACK_PAGE_SIZE];  /* Page being filled. */
+  int page_len;
+  gps_track_point_t last;
+} g_track;
+
+
+/**
+ * gps_track_to_fixed()
+ *
+ * @brief Convert a raw degrees value into 1e-7 degrees fixed-point
+ * @param p_degrees: pointer to a `gps_raw_degrees_t` structure
+ * @return fixed-point value
+ **/
+
+static int32_t gps_track_to_fixed(gps_raw_degrees_t *p_degrees)
+{
+  int32_t value = (int32_t)p_degrees->deg * 10000000 + (int32_t)(p_degrees->billionths / 100);
+  return p_degrees->negative ? -value : value;
+}
+
+
+/**
+ * gps_track_timestamp()
+ *
+ * @brief Compute a fix timestamp in seconds since 2000-01-01 UTC
+ * @param p_fix: pointer to a `gps_fix_t` structure
+ * @param p_timestamp: pointer to the resulting timestamp
+ * @return true if fix date is set, false otherwise
+ **/
+
+static bool gps_track_timestamp(gps_fix_t *p_fix, uint32_t *p_timestamp)
+{
+  static const uint16_t days_before_month[12] = {
+    0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+  };
+  int day = (p_fix->date/10000)%100;
+  int month = (p_fix->date/100)%100;
+  int year = p_fix->date%100;
+  uint32_t days;
+
+  if ((day < 1) || (month < 1) || (month > 12))
+    return false;
+
+  /* Years 2000-2099 only, every 4th year is a leap year. */
+  days = year*365 + (year + 3)/4 + days_before_month[month - 1] + day - 1;
+  if ((month > 2) && ((year % 4) == 0))
+    days++;
+
+  *p_timestamp = days*86400
+    + ((p_fix->time/10000000)%100)*3600
+    + ((p_fix->time/100000)%100)*60
+    + (p_fix->time/1000)%100;
+
+  /* Success. */
+  return true;
+}
+
+
+/**
+ * gps_track_put_u32()
+ *
+ * @brief Append a little-endian 32-bit value to the current page
+ * @param value: value to append
+ **/
+
+static void gps_track_put_u32(uint32_t value)
+{
+  int i;
+
+  for (i=0; i<4; i++)
+  {
+    g_track.page[g_track.page_len++] = value & 0xff;
+    value >>= 8;
+  }
+}
+
+
+/**
+ * gps_track_put_varint()
+ *
+ * @brief Append an unsigned LEB128 varint to the current page
+ * @param value: value to append
+ **/
+
+static void gps_track_put_varint(uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    g_track.page[g_track.page_len++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  g_track.page[g_track.page_len++] = value;
+}
+
+
+/**
+ * gps_track_flush_page()
+ *
+ * @brief Write the current page to flash, padded with erased bytes.
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if partition is full, or an
+ *         esp_partition error code.
+ **/
+
+static esp_err_t gps_track_flush_page(void)
+{
+  esp_err_t result;
+  uint32_t next_sector;
+
+  if (g_track.page_len == 0)
+    return ESP_OK;
+
+  if (g_track.offset >= g_track.p_partition->size)
+    return ESP_ERR_NO_MEM;
+
+  /**
+   * Erase the next sector before filling the last page of this one, so
+   * that the page following the last written one always reads as erased,
+   * even after a power loss.
+   **/
+
+  next_sector = (g_track.offset / SPI_FLASH_SEC_SIZE + 1) * SPI_FLASH_SEC_SIZE;
+  if (((g_track.offset + GPS_TRACK_PAGE_SIZE) == next_sector) && (next_sector < g_track.p_partition->size))
+  {
+    result = esp_partition_erase_range(g_track.p_partition, next_sector, SPI_FLASH_SEC_SIZE);
+    if (result != ESP_OK)
+      return result;
+  }
+
+  result = esp_partition_write(g_track.p_partition, g_track.offset, g_track.page, GPS_TRACK_PAGE_SIZE);
+  if (result != ESP_OK)
+    return result;
+
+  /* Start a new page. */
+  g_track.offset += GPS_TRACK_PAGE_SIZE;
+  memset(g_track.page, GPS_TRACK_TAG_ERASED, GPS_TRACK_PAGE_SIZE);
+  g_track.page_len = 0;
+
+  /* Success. */
+  return ESP_OK;
+}
+
+
+/**
+ * gps_track_append()
+ *
+ * @brief Encode a point into the current page, flushing it when full.
+ * @param p_point: pointer to a `gps_track_point_t` structure
+ * @return ESP_OK on success, an error code otherwise.
+ **/
+
+static esp_err_t gps_track_append(gps_track_point_t *p_point)
+{
+  esp_err_t result;
+  int32_t dlat, dlng;
+
+  /* Make room for a delta record. */
+  if ((g_track.page_len + GPS_TRACK_DELTA_MAXLEN) > GPS_TRACK_PAGE_SIZE)
+  {
+    result = gps_track_flush_page();
+    if (result != ESP_OK)
+      return result;
+  }
+
+  if (g_track.offset >= g_track.p_partition->size)
+    return ESP_ERR_NO_MEM;
+
+  /* Pages and segments start with an absolute record, so does a clock jump. */
+  if ((g_track.page_len == 0) || p_point->b_new_segment || (p_point->timestamp < g_track.last.timestamp))
+  {
+    g_track.page[g_track.page_len++] = p_point->b_new_segment ? GPS_TRACK_TAG_SEGMENT : GPS_TRACK_TAG_KEY;
+    gps_track_put_u32((uint32_t)p_point->lat);
+    gps_track_put_u32((uint32_t)p_point->lng);
+    gps_track_put_u32(p_point->timestamp);
+  }
+  else
+  {
+    dlat = p_point->lat - g_track.last.lat;
+    dlng = p_point->lng - g_track.last.lng;
+
+    /* Zigzag-encode signed deltas. */
+    g_track.page[g_track.page_len++] = GPS_TRACK_TAG_DELTA;
+    gps_track_put_varint(((uint32_t)dlat << 1) ^ (uint32_t)(dlat >> 31));
+    gps_track_put_varint(((uint32_t)dlng << 1) ^ (uint32_t)(dlng >> 31));
+    gps_track_put_varint(p_point->timestamp - g_track.last.timestamp);
+  }
+
+  g_track.last = *p_point;
+
+  /* Success. */
+  return ESP_OK;
+}
+
+
+#ifdef CONFIG_TWATCH_V2
+
+/**
+ * gps_track_task()
+ *
+ * @brief Record every new GPS fix while recording is enabled
+ * @param pvParameters: pointer to extra parameters (none used)
+ **/
+
+static void gps_track_task(void *pvParameters)
+{
+  gps_fix_t fix;
+
+  for (;;)
+  {
+    /* Block until GPS publishes a fix. */
+    if (gps_wait_fix(&fix, portMAX_DELAY) == ESP_OK)
+    {
+      if (g_track.b_recording)
+        gps_track_add(&fix);
+    }
+    else
+      vTaskDelay(1000/portTICK_RATE_MS);
+  }
+}
+
+#endif /* CONFIG_TWATCH_V2 */
+
+
+/**
+ * gps_track_init()
+ *
+ * @brief Initialize the GPS track recorder
+ * @return ESP_ERR_NOT_FOUND if no track partition exists, ESP_FAIL on
+ *         error, ESP_OK on success.
+ **/
+
+esp_err_t gps_track_init(void)
+{
+  uint8_t tag;
+
+  memset(&g_track, 0, sizeof(g_track));
+  memset(g_track.page, GPS_TRACK_TAG_ERASED, GPS_TRACK_PAGE_SIZE);
+
+  g_track.p_partition = esp_partition_find_first(
+    ESP_PARTITION_TYPE_DATA,
+    GPS_TRACK_PARTITION_SUBTYPE,
+    GPS_TRACK_PARTITION_LABEL
+  );
+  if (g_track.p_partition == NULL)
+  {
+    ESP_LOGE(TAG, "track partition not found");
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  g_track.lock = xSemaphoreCreateMutex();
+  if (g_track.lock == NULL)
+    return ESP_FAIL;
+
+  /* Pages are written in sequence, find the first erased one. */
+  while (g_track.offset < g_track.p_partition->size)
+  {
+    if (esp_partition_read(g_track.p_partition, g_track.offset, &tag, 1) != ESP_OK)
+      return ESP_FAIL;
+    if (tag == GPS_TRACK_TAG_ERASED)
+      break;
+    g_track.offset += GPS_TRACK_PAGE_SIZE;
+  }
+  ESP_LOGI(TAG, "%d bytes of track data", g_track.offset);
+
+#ifdef CONFIG_TWATCH_V2
+  /* Start our recorder. */
+  if (xTaskCreate(gps_track_task, "gps_track_task", 3000, NULL, 5, NULL) != pdPASS)
+    return ESP_FAIL;
+#endif
+
+  /* Success. */
+  return ESP_OK;
+}
+
+
+/**
+ * gps_track_erase()
+ *
+ * @brief Discard all recorded tracks. Only the first sector is erased,
+ *        the following ones are erased as recording reaches them.
+ * @return ESP_OK on success, an error code otherwise.
+ **/
+
+esp_err_t gps_track_erase(void)
+{
+  esp_err_t result;
+
+  if (g_track.p_partition == NULL)
+    return ESP_ERR_INVALID_STATE;
+
+  xSemaphoreTake(g_track.lock, portMAX_DELAY);
+  result = esp_partition_erase_range(g_track.p_partition, 0, SPI_FLASH_SEC_SIZE);
+  if (result == ESP_OK)
+  {
+    g_track.offset = 0;
+    g_track.page_len = 0;
+    memset(g_track.page, GPS_TRACK_TAG_ERASED, GPS_TRACK_PAGE_SIZE);
+    g_track.b_new_segment = true;
+  }
+  xSemaphoreGive(g_track.lock);
+
+  return result;
+}
+
+
+/**
+ * gps_track_start()
+ *
+ * @brief Start recording a new track segment
+ * @return ESP_ERR_NO_MEM if partition is full, ESP_OK on success.
+ **/
+
+esp_err_t gps_track_start(void)
+{
+  esp_err_t result = ESP_OK;
+
+  if (g_track.p_partition == NULL)
+    return ESP_ERR_INVALID_STATE;
+
+  xSemaphoreTake(g_track.lock, portMAX_DELAY);
+  if (g_track.offset >= g_track.p_partition->size)
+    result = ESP_ERR_NO_MEM;
+  else
+  {
+    g_track.b_new_segment = true;
+    g_track.b_recording = true;
+  }
+  xSemaphoreGive(g_track.lock);
+
+  return result;
+}
+
+
+/**
+ * gps_track_stop()
+ *
+ * @brief Stop recording and write pending points to flash
+ * @return ESP_OK on success, an error code otherwise.
+ **/
+
+esp_err_t gps_track_stop(void)
+{
+  esp_err_t result;
+
+  if (g_track.p_partition == NULL)
+    return ESP_ERR_INVALID_STATE;
+
+  xSemaphoreTake(g_track.lock, portMAX_DELAY);
+  g_track.b_recording = false;
+  result = gps_track_flush_page();
+  xSemaphoreGive(g_track.lock);
+
+  return result;
+}
+
+
+/**
+ * gps_track_is_recording()
+ *
+ * @brief Tell if a track is being recorded
+ * @return true if recording, false otherwise
+ **/
+
+bool gps_track_is_recording(void)
+{
+  return g_track.b_recording;
+}
+
+
+/**
+ * gps_track_add()
+ *
+ * @brief Add a fix to the current track. Invalid fixes and fixes sharing
+ *        the timestamp of the previous point are ignored.
+ * @param p_fix: pointer to a `gps_fix_t` structure
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if partition is full, an error
+ *         code otherwise.
+ **/
+
+esp_err_t gps_track_add(gps_fix_t *p_fix)
+{
+  gps_track_point_t point;
+  esp_err_t result = ESP_OK;
+
+  if (!g_track.b_recording)
+    return ESP_ERR_INVALID_STATE;
+
+  if (!p_fix->valid || !gps_track_timestamp(p_fix, &point.timestamp))
+    return ESP_OK;
+
+  point.lat = gps_track_to_fixed(&p_fix->lat);
+  point.lng = gps_track_to_fixed(&p_fix->lng);
+
+  xSemaphoreTake(g_track.lock, portMAX_DELAY);
+  point.b_new_segment = g_track.b_new_segment;
+  if (point.b_new_segment || (point.timestamp != g_track.last.timestamp))
+  {
+    result = gps_track_append(&point);
+    if (result == ESP_OK)
+      g_track.b_new_segment = false;
+    else if (result == ESP_ERR_NO_MEM)
+    {
+      ESP_LOGW(TAG, "track partition full, recording stopped");
+      g_track.b_recording = false;
+    }
+  }
+  xSemaphoreGive(g_track.lock);
+
+  return result;
+}
+
+
+/**
+ * gps_track_get_used()
+ *
+ * @brief Get the number of bytes used by recorded tracks
+ * @return used bytes
+ **/
+
+uint32_t gps_track_get_used(void)
+{
+  return g_track.offset + g_track.page_len;
+}
+
+
+/**
+ * gps_track_get_size()
+ *
+ * @brief Get the track partition size
+ * @return partition size in bytes, 0 if not available
+ **/
+
+uint32_t gps_track_get_size(void)
+{
+  return (g_track.p_partition != NULL) ? g_track.p_partition->size : 0;
+}
+
+
+/**
+ * gps_track_get_varint()
+ *
+ * @brief Decode an unsigned LEB128 varint from an iterator page
+ * @param p_iter: pointer to a `gps_track_iter_t` structure
+ * @param p_value: pointer to the decoded value
+ * @return true on success, false if varint is truncated
+ **/
+
+static bool gps_track_get_varint(gps_track_iter_t *p_iter, uint32_t *p_value)
+{
+  int shift = 0;
+  uint8_t byte;
+
+  *p_value = 0;
+  do
+  {
+    if ((p_iter->pos >= GPS_TRACK_PAGE_SIZE) || (shift > 28))
+      return false;
+    byte = p_iter->page[p_iter->pos++];
+    *p_value |= (uint32_t)(byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+
+  /* Success. */
+  return true;
+}
+
+
+/**
+ * gps_track_get_u32()
+ *
+ * @brief Decode a little-endian 32-bit value from an iterator page
+ * @param p_iter: pointer to a `gps_track_iter_t` structure
+ * @return decoded value
+ **/
+
+static uint32_t gps_track_get_u32(gps_track_iter_t *p_iter)
+{
+  uint8_t *p = &p_iter->page[p_iter->pos];
+
+  p_iter->pos += 4;
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+/**
+ * gps_track_iter_init()
+ *
+ * @brief Initialize an iterator over recorded points. Points still
+ *        buffered in RAM are only visible once written to flash.
+ * @param p_iter: pointer to a `gps_track_iter_t` structure
+ * @return ESP_OK on success, an error code otherwise.
+ **/
+
+esp_err_t gps_track_iter_init(gps_track_iter_t *p_iter)
+{
+  if (g_track.p_partition == NULL)
+    return ESP_ERR_INVALID_STATE;
+
+  memset(p_iter, 0, sizeof(gps_track_iter_t));
+  return esp_partition_read(g_track.p_partition, 0, p_iter->page, GPS_TRACK_PAGE_SIZE);
+}
+
+
+/**
+ * gps_track_iter_next()
+ *
+ * @brief Retrieve the next recorded point
+ * @param p_iter: pointer to a `gps_track_iter_t` structure
+ * @param p_point: pointer to a `gps_track_point_t` structure to fill
+ * @return true if a point has been retrieved, false at end of track data
+ **/
+
+bool gps_track_iter_next(gps_track_iter_t *p_iter, gps_track_point_t *p_point)
+{
+  uint32_t dlat, dlng, dt;
+  uint8_t tag;
+
+  for (;;)
+  {
+    /* Move to next page at end of data. */
+    if ((p_iter->pos >= GPS_TRACK_PAGE_SIZE) || (p_iter->page[p_iter->pos] == GPS_TRACK_TAG_ERASED))
+    {
+      p_iter->offset += GPS_TRACK_PAGE_SIZE;
+      p_iter->pos = 0;
+      if (p_iter->offset >= g_track.p_partition->size)
+        return false;
+      if (esp_partition_read(g_track.p_partition, p_iter->offset, p_iter->page, GPS_TRACK_PAGE_SIZE) != ESP_OK)
+        return false;
+      if (p_iter->page[0] == GPS_TRACK_TAG_ERASED)
+        return false;
+      continue;
+    }
+
+    tag = p_iter->page[p_iter->pos++];
+    switch (tag)
+    {
+      case GPS_TRACK_TAG_KEY:
+      case GPS_TRACK_TAG_SEGMENT:
+        {
+          if ((p_iter->pos + GPS_TRACK_KEY_LEN - 1) > GPS_TRACK_PAGE_SIZE)
+            break;
+          p_iter->last.lat = (int32_t)gps_track_get_u32(p_iter);
+          p_iter->last.lng = (int32_t)gps_track_get_u32(p_iter);
+          p_iter->last.timestamp = gps_track_get_u32(p_iter);
+          p_iter->last.b_new_segment = (tag == GPS_TRACK_TAG_SEGMENT);
+          *p_point = p_iter->last;
+          return true;
+        }
+
+      case GPS_TRACK_TAG_DELTA:
+        {
+          if (!gps_track_get_varint(p_iter, &dlat) || !gps_track_get_varint(p_iter, &dlng) || !gps_track_get_varint(p_iter, &dt))
+            break;
+          p_iter->last.lat += (int32_t)((dlat >> 1) ^ -(dlat & 1));
+          p_iter->last.lng += (int32_t)((dlng >> 1) ^ -(dlng & 1));
+          p_iter->last.timestamp += dt;
+          p_iter->last.b_new_segment = false;
+          *p_point = p_iter->last;
+          return true;
+        }
+
+      default:
+        break;
+    }
+
+    /* Corrupted record, skip the rest of this page. */
+    p_iter->pos = GPS_TRACK_PAGE_SIZE;
+  }
+}
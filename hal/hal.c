@@ -1,5 +1,7 @@
 #include "hal/hal.h"
 
+#define TAG "[hal]"
+
 /**
  * twatch_hal_init()
  * 
@@ -17,12 +19,18 @@ bool twatch_hal_init(void)
     return false;
   }
 
-  /* Initialize screen. */
+  /* Initialize screen first, it shows the last frame when resuming. */
   if (twatch_screen_init() != ESP_OK)
   {
     return false;
   }
 
+  /* Initialize battery fuel gauge (optional, PMU readings are used otherwise). */
+  if (twatch_gauge_init() != ESP_OK)
+  {
+    ESP_LOGW(TAG, "fuel gauge disabled, cannot initialize it");
+  }
+
   /* Initialize touch screen. */
   if (twatch_touch_init() != ESP_OK)
   {
@@ -43,6 +51,9 @@ bool twatch_hal_init(void)
     }
   #endif
 
+  /* Enable CPU frequency scaling and light sleep, if supported. */
+  twatch_power_init();
+
   /* Success ! */
   return true;
 }
\ No newline at end of file
@@ -1,33 +1,199 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "driver/gpio.h"
 #include "driver/rtc_io.h"
 #include "esp_sleep.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "hal/pmu.h"
+#include "hal/gauge.h"
 #include "hal/screen.h" // DEBUG ONLY
 
 #define AXP_CHECK(x) if(x != AXP_PASS) return ESP_FAIL
 
+/* IRQs handled by the PMU task. */
+#define PMU_IRQ_MASK ( \
+  (1ULL << AXP202_IRQ_POKSH) | (1ULL << AXP202_IRQ_POKLO) | \
+  (1ULL << AXP202_IRQ_USBIN) | (1ULL << AXP202_IRQ_USBRE) | \
+  (1ULL << AXP202_IRQ_CHAST) | (1ULL << AXP202_IRQ_CHAOV) | \
+  (1ULL << AXP202_IRQ_EXTLOWARN1) | (1ULL << AXP202_IRQ_EXTLOWARN2) | \
+  (1ULL << AXP202_IRQ_TEMOV) | (1ULL << AXP202_IRQ_ICTEMOV) \
+)
+
+/* IRQs allowed to wake the watch from deep sleep. */
+#define PMU_WAKE_IRQ_MASK ( \
+  (1ULL << AXP202_IRQ_POKSH) | (1ULL << AXP202_IRQ_POKLO) | \
+  (1ULL << AXP202_IRQ_USBIN) \
+)
+
+/**
+ * Max number of IRQ reads per wake-up, only reached if status registers
+ * cannot be cleared (I2C errors): the level-triggered IRQ is raised again
+ * as soon as it is unmasked.
+ **/
+
+#define PMU_IRQ_MAX_PASSES  16
+
+/* Written before entering deep sleep through twatch_pmu_deepsleep(). */
+#define PMU_SLEEP_MAGIC     0x534C5050
+
 /* User button handling. */
-volatile bool b_axpxx_irq_triggered = false;
 volatile int userbtn_int_count = 0;
 portMUX_TYPE userbtn_mux = portMUX_INITIALIZER_UNLOCKED;
 
 /* USB charge monitoring. */
 volatile bool b_usb_plugged = false;
 
+/* Power rails enabled through this module (PMU_RAIL_*), AXP202 keeps them in deep sleep. */
+RTC_DATA_ATTR static volatile uint32_t g_pmu_rails = 0;
+
+/* Deep sleep resume detection. */
+RTC_DATA_ATTR static uint32_t g_pmu_sleep_magic = 0;
+static bool g_pmu_resuming = false;
+
+/* PMU task and event subscribers. */
+static struct {
+  TaskHandle_t task;
+  SemaphoreHandle_t lock;
+  struct {
+    FPmuEventHandler pfn_handler;
+    void *p_user_data;
+  } subscribers[PMU_MAX_SUBSCRIBERS];
+} g_pmu;
+
 /**
  * _axpxx_interrupt_handler()
  *
- * Internal interrupt handler for AXP202 IRQ.
+ * Internal interrupt handler for AXP202 IRQ, wakes up the PMU task.
+ * IRQ is level-triggered and stays masked until the task has acked it.
  **/
 
 void IRAM_ATTR _axpxx_interrupt_handler(void *parameter)
 {
-  /* Mark AXP202 IRQ as triggered. */
-  b_axpxx_irq_triggered = true;
+  BaseType_t b_woken = pdFALSE;
+
+  gpio_intr_disable(PMU_IRQ_GPIO);
+  if (g_pmu.task != NULL)
+  {
+    vTaskNotifyGiveFromISR(g_pmu.task, &b_woken);
+    if (b_woken == pdTRUE)
+      portYIELD_FROM_ISR();
+  }
+}
+
+
+/**
+ * pmu_publish()
+ *
+ * @brief Send an event to every subscriber.
+ * @param type: event type
+ * @param timestamp_us: event timestamp in microseconds
+ **/
+
+static void pmu_publish(pmu_event_type_t type, int64_t timestamp_us)
+{
+  pmu_event_t event;
+  int i;
+
+  event.type = type;
+  event.timestamp_us = timestamp_us;
+
+  xSemaphoreTake(g_pmu.lock, portMAX_DELAY);
+  for (i=0; i<PMU_MAX_SUBSCRIBERS; i++)
+  {
+    if (g_pmu.subscribers[i].pfn_handler != NULL)
+      g_pmu.subscribers[i].pfn_handler(&event, g_pmu.subscribers[i].p_user_data);
+  }
+  xSemaphoreGive(g_pmu.lock);
+}
+
+
+/**
+ * pmu_process_irq()
+ *
+ * @brief Read all IRQ status registers in one I2C transaction, acknowledge
+ *        the bits that were set and publish the matching events.
+ * @return true if a status bit was set, false otherwise
+ **/
+
+static bool pmu_process_irq(void)
+{
+  pmu_event_type_t events[PMU_EVENT_OVER_TEMPERATURE + 1];
+  int nb_events = 0, i;
+  bool b_pending = false;
+  int64_t now;
+
+  if (axpxx_readIRQ() != AXP_PASS)
+    return false;
+  now = esp_timer_get_time();
+
+  for (i=0; i<sizeof(axpxx_irq); i++)
+    b_pending |= (axpxx_irq[i] != 0);
+  if (!b_pending)
+    return false;
+
+  if (axpxx_isPEKShortPressIRQ())
+  {
+    portENTER_CRITICAL(&userbtn_mux);
+    userbtn_int_count = 1;
+    portEXIT_CRITICAL(&userbtn_mux);
+    events[nb_events++] = PMU_EVENT_SHORT_PRESS;
+  }
+  if (axpxx_isPEKLongtPressIRQ())
+    events[nb_events++] = PMU_EVENT_LONG_PRESS;
+  if (axpxx_isVbusPlugInIRQ())
+  {
+    b_usb_plugged = true;
+    events[nb_events++] = PMU_EVENT_VBUS_IN;
+  }
+  if (axpxx_isVbusRemoveIRQ())
+  {
+    b_usb_plugged = false;
+    events[nb_events++] = PMU_EVENT_VBUS_OUT;
+  }
+  if (axpxx_isChargingIRQ())
+    events[nb_events++] = PMU_EVENT_CHARGE_START;
+  if (axpxx_isChargingDoneIRQ())
+    events[nb_events++] = PMU_EVENT_CHARGE_DONE;
+  if (axpxx_isApsLowVoltageLevel1IRQ() || axpxx_isApsLowVoltageLevel2IRQ())
+    events[nb_events++] = PMU_EVENT_BATTERY_LOW;
+  if (axpxx_isBattTempHighIRQ() || axpxx_isChipOverTemperatureIRQ())
+    events[nb_events++] = PMU_EVENT_OVER_TEMPERATURE;
+
+  /* Acknowledge before publishing, new IRQs will raise the line again. */
+  axpxx_ackIRQ();
+
+  for (i=0; i<nb_events; i++)
+    pmu_publish(events[i], now);
+
+  return true;
+}
+
+
+/**
+ * _twatch_pmu_task()
+ *
+ * @brief PMU task, processes AXP202 IRQs as soon as they are raised.
+ * @param parameter: not used
+ **/
+
+void _twatch_pmu_task(void *parameter)
+{
+  int passes;
+
+  while (1)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    /* IRQ line stays low as long as a status bit is set, drain them all. */
+    passes = 0;
+    while (pmu_process_irq() && (++passes < PMU_IRQ_MAX_PASSES));
+
+    /* Unmask IRQ, raised again right away if still asserted. */
+    gpio_intr_enable(PMU_IRQ_GPIO);
+  }
 }
 
 /**
@@ -41,10 +207,18 @@ esp_err_t twatch_pmu_init(void)
 {
   gpio_config_t irq_conf;
 
+  /* Create our subscribers lock, once. */
+  if (g_pmu.lock == NULL)
+  {
+    g_pmu.lock = xSemaphoreCreateMutex();
+    if (g_pmu.lock == NULL)
+      return ESP_FAIL;
+  }
+
   /* Initialize AXP202 IRQ pin as input pin. */
-  rtc_gpio_deinit(GPIO_NUM_35);
-  irq_conf.intr_type = GPIO_INTR_NEGEDGE;
-  irq_conf.pin_bit_mask = (1ULL << 35);
+  rtc_gpio_deinit(PMU_IRQ_GPIO);
+  irq_conf.intr_type = GPIO_INTR_LOW_LEVEL;
+  irq_conf.pin_bit_mask = (1ULL << PMU_IRQ_GPIO);
   irq_conf.mode = GPIO_MODE_INPUT;
   irq_conf.pull_down_en = 0;
   irq_conf.pull_up_en = 1;
@@ -54,21 +228,54 @@ esp_err_t twatch_pmu_init(void)
   /* Install our user button interrupt handler. */
   if (gpio_install_isr_service(0) != ESP_OK)
     printf("[pmu::isr] Error while installing service\r\n");
-  gpio_isr_handler_add(GPIO_NUM_35, _axpxx_interrupt_handler, NULL);
+  gpio_isr_handler_add(PMU_IRQ_GPIO, _axpxx_interrupt_handler, NULL);
 
   /* Initialize I2C master communication. */
   axpxx_i2c_init();
 
+  /**
+   * Waking up from twatch_pmu_deepsleep(): AXP202 stayed powered and kept
+   * its configuration, as did the BMA423 and the RTC.
+   **/
+
+  g_pmu_resuming = (g_pmu_sleep_magic == PMU_SLEEP_MAGIC) &&
+    (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_UNDEFINED);
+  g_pmu_sleep_magic = 0;
+
   /* Initialize AXP202. */
   if (axpxx_probe_chip() == AXP_PASS)
   {
-    /* Enable PEK short press IRQ. */
-    axpxx_enableIRQ((1 << AXP202_IRQ_POKSH) | (1 << AXP202_IRQ_USBIN) | (1 << AXP202_IRQ_USBRE), true);
+    /**
+     * Enable button, VBUS, charge, battery and temperature IRQs (only wake-up
+     * IRQs are left enabled by twatch_pmu_deepsleep()).
+     **/
+
+    axpxx_enableIRQ(PMU_IRQ_MASK, true);
     axpxx_clearIRQ();
 
     /* Determine if USB is connected. */
     b_usb_plugged = axpxx_isVBUSPlug();
 
+    /* Start our PMU task, once. */
+    if (g_pmu.task == NULL)
+    {
+      if (xTaskCreate(
+        _twatch_pmu_task,
+        "_pmu_task",
+        PMU_TASK_STACK,
+        NULL,
+        PMU_TASK_PRIORITY,
+        &g_pmu.task
+      ) != pdPASS)
+      {
+        g_pmu.task = NULL;
+        return ESP_FAIL;
+      }
+    }
+
+    /* Process any IRQ raised before the task was started, and unmask IRQ. */
+    xTaskNotifyGive(g_pmu.task);
+
     /* Success. */
     return ESP_OK;
   }
@@ -80,6 +287,37 @@ esp_err_t twatch_pmu_init(void)
 }
 
 
+/**
+ * pmu_set_rail()
+ *
+ * @brief Keep track of a power rail state.
+ * @param rail: rail (PMU_RAIL_*)
+ * @param enable: true if rail is powered
+ **/
+
+static void pmu_set_rail(uint32_t rail, bool enable)
+{
+  if (enable)
+    g_pmu_rails |= rail;
+  else
+    g_pmu_rails &= ~rail;
+}
+
+
+/**
+ * twatch_pmu_get_rails()
+ *
+ * @brief Get power rails enabled through this module, without any I2C
+ *        transaction.
+ * @return bitmask of PMU_RAIL_* values
+ **/
+
+uint32_t twatch_pmu_get_rails(void)
+{
+  return g_pmu_rails;
+}
+
+
 /**
  * twatch_pmu_audio_power()
  *
@@ -91,7 +329,10 @@ esp_err_t twatch_pmu_audio_power(bool enable)
   if (axpxx_setLDO3Mode(1) == AXP_PASS)
   {
     if (axpxx_setPowerOutPut(AXP202_LDO3, enable) == AXP_PASS)
+    {
+      pmu_set_rail(PMU_RAIL_AUDIO, enable);
       return ESP_OK;
+    }
     else
       return ESP_FAIL;
   }
@@ -120,6 +361,7 @@ esp_err_t twatch_pmu_screen_power(bool enable)
   {
     return ESP_FAIL;
   }
+  pmu_set_rail(PMU_RAIL_SCREEN, enable);
 
   #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
     /* Enable LDO2 */
@@ -153,7 +395,14 @@ esp_err_t twatch_pmu_screen_power(bool enable)
         return ESP_FAIL;
       }
 
-      twatch_pmu_reset_touchscreen();
+      /**
+       * Touch controller only needs a reset once powered again. Resetting
+       * it on power-down would also bring it out of hibernation right
+       * before deep sleep.
+       **/
+
+      if (enable)
+        twatch_pmu_reset_touchscreen();
     #endif
   #endif
 
@@ -200,6 +449,7 @@ esp_err_t twatch_pmu_power(bool enable)
     AXP_CHECK(axpxx_setPowerOutPut(AXP202_EXTEN, false));
     AXP_CHECK(axpxx_setChargeControlCur(300));
     AXP_CHECK(axpxx_setPowerOutPut(AXP202_LDO2, AXP202_ON));
+    pmu_set_rail(PMU_RAIL_SCREEN, true);
   }
   else
   {
@@ -209,6 +459,7 @@ esp_err_t twatch_pmu_power(bool enable)
     AXP_CHECK(axpxx_setPowerOutPut(AXP202_DCDC2, false));
     AXP_CHECK(axpxx_setPowerOutPut(AXP202_LDO3, false));
     AXP_CHECK(axpxx_setPowerOutPut(AXP202_LDO2, false));
+    g_pmu_rails = 0;
   }
 
   /* Success. */
@@ -216,63 +467,107 @@ esp_err_t twatch_pmu_power(bool enable)
 }
 
 /**
- * twatch_pmu_read_irq()
- * 
- * Fetch IRQ data from AXP202.
- * 
+ * twatch_pmu_subscribe()
+ *
+ * @brief Register a callback for PMU events.
+ * @param pfn_handler: callback called from the PMU task for each event
+ * @param p_user_data: pointer passed to callback
+ * @return ESP_OK on success, ESP_FAIL if there is no room left
  **/
 
-void twatch_pmu_read_irq(void)
+esp_err_t twatch_pmu_subscribe(FPmuEventHandler pfn_handler, void *p_user_data)
 {
-  if (b_axpxx_irq_triggered)
+  esp_err_t result = ESP_FAIL;
+  int i;
+
+  if ((pfn_handler == NULL) || (g_pmu.lock == NULL))
+    return ESP_FAIL;
+
+  xSemaphoreTake(g_pmu.lock, portMAX_DELAY);
+  for (i=0; i<PMU_MAX_SUBSCRIBERS; i++)
   {
-    /* Read IRQ. */
-    if (axpxx_readIRQ() == AXP_PASS)
+    if (g_pmu.subscribers[i].pfn_handler == NULL)
     {
-      /* Check if user button has been pressed. */
-      if (axpxx_isPEKShortPressIRQ())
-      {
-        userbtn_int_count = 1;
-      }
-      if (axpxx_isVbusPlugInIRQ())
-      {
-        b_usb_plugged = true;
-      }
-      if (axpxx_isVbusRemoveIRQ())
-      {
-        b_usb_plugged = false;
-      }
+      g_pmu.subscribers[i].pfn_handler = pfn_handler;
+      g_pmu.subscribers[i].p_user_data = p_user_data;
+      result = ESP_OK;
+      break;
     }
+  }
+  xSemaphoreGive(g_pmu.lock);
 
-    /* Clear IRQ. */
-    axpxx_clearIRQ();
-    b_axpxx_irq_triggered = false;
+  return result;
+}
+
+
+/**
+ * twatch_pmu_unsubscribe()
+ *
+ * @brief Unregister a callback previously registered for PMU events.
+ *        Must not be called from a PMU event callback.
+ * @param pfn_handler: callback
+ * @param p_user_data: pointer given at subscription
+ * @return ESP_OK on success, ESP_FAIL if callback was not registered
+ **/
+
+esp_err_t twatch_pmu_unsubscribe(FPmuEventHandler pfn_handler, void *p_user_data)
+{
+  esp_err_t result = ESP_FAIL;
+  int i;
+
+  if (g_pmu.lock == NULL)
+    return ESP_FAIL;
+
+  xSemaphoreTake(g_pmu.lock, portMAX_DELAY);
+  for (i=0; i<PMU_MAX_SUBSCRIBERS; i++)
+  {
+    if ((g_pmu.subscribers[i].pfn_handler == pfn_handler) &&
+        (g_pmu.subscribers[i].p_user_data == p_user_data))
+    {
+      g_pmu.subscribers[i].pfn_handler = NULL;
+      g_pmu.subscribers[i].p_user_data = NULL;
+      result = ESP_OK;
+      break;
+    }
   }
+  xSemaphoreGive(g_pmu.lock);
+
+  return result;
+}
+
+
+/**
+ * twatch_pmu_read_irq()
+ * 
+ * Ask the PMU task to fetch IRQ data from AXP202. IRQs are processed by
+ * the PMU task as soon as they are raised, this is only needed to force
+ * a status refresh.
+ * 
+ **/
+
+void twatch_pmu_read_irq(void)
+{
+  if (g_pmu.task != NULL)
+    xTaskNotifyGive(g_pmu.task);
 }
 
 /**
  * twatch_pmu_is_userbtn_pressed(void)
  *
- * Determines if the user button has been pressed.
+ * Determines if the user button has been pressed since last call.
  *
  * @return true if user button has been pressed, false otherwise.
  **/
 
 bool twatch_pmu_is_userbtn_pressed(void)
 {
-  bool result = false;
-
-  /* Fetch IRQ data if there is any. */
-  twatch_pmu_read_irq();
+  bool result;
 
-  /* If user button has been (short) pressed, return true. */
-  if (userbtn_int_count > 0)
-  {
-    result = true;
-    
-    /* Reset interrupt counter. */
-    userbtn_int_count = 0;    
-  }
+  /* Read and reset interrupt counter. */
+  portENTER_CRITICAL(&userbtn_mux);
+  result = (userbtn_int_count > 0);
+  userbtn_int_count = 0;
+  portEXIT_CRITICAL(&userbtn_mux);
 
   return result;
 }
@@ -287,7 +582,7 @@ bool twatch_pmu_is_userbtn_pressed(void)
 
 bool twatch_pmu_is_usb_plugged(bool b_query_irq)
 {
-  /* Read IRQ if required. */
+  /* Refresh IRQ status if required. */
   if (b_query_irq)
     twatch_pmu_read_irq();
 
@@ -312,38 +607,65 @@ void twatch_pmu_deepsleep(void)
   twatch_pmu_audio_power(false);
   #endif
 
+  /* Only button and VBUS insertion may wake us up, drop pending IRQs. */
+  axpxx_enableIRQ(PMU_IRQ_MASK & ~PMU_WAKE_IRQ_MASK, false);
+  axpxx_enableIRQ(PMU_WAKE_IRQ_MASK, true);
+  axpxx_clearIRQ();
+
   /* Set GPIO 35 as wakeup signal. */
-  esp_sleep_enable_ext0_wakeup(GPIO_NUM_35, 0);
+  esp_sleep_enable_ext0_wakeup(PMU_IRQ_GPIO, 0);
+
+  /* Peripherals state will survive, next boot can resume. */
+  g_pmu_sleep_magic = PMU_SLEEP_MAGIC;
 
   /* Go into deep sleep mode. */
   esp_deep_sleep_start();
 }
 
 
+/**
+ * twatch_pmu_is_resuming()
+ *
+ * @brief Determine if we are waking up from twatch_pmu_deepsleep(), in
+ *        which case PMU, accelerometer and RTC are still configured.
+ * @return true if resuming, false on cold boot
+ **/
+
+bool twatch_pmu_is_resuming(void)
+{
+  return g_pmu_resuming;
+}
+
+
 /**
  * twatch_pmu_get_battery_level()
  * 
- * Get battery percentage from AXP202.
- * @return: percentage (0-100)
+ * Get battery percentage from fuel gauge, or from AXP202 if the gauge
+ * is not available.
+ * @return: percentage (0-100), -1 on error
  **/
 
 int twatch_pmu_get_battery_level(void)
 {
-  float voltage;
-  int level=-1;
+  axp_batt_status_t status;
+  int level;
 
-  if (axpxx_isChargeing())
-  {
-    /* Read level, if level == 0x7f then percentage cannot be trusted. */
-    level = axpxx_getBattPercentage();
-    if (level == 0x7F)
-      level = -1;
-  }
+  /* Use fuel gauge if available. */
+  level = twatch_gauge_get_level();
+  if (level >= 0)
+    return level;
+
+  /* Read all battery registers at once. */
+  if (axpxx_getBattStatus(&status) != AXP_PASS)
+    return -1;
+
+  /* Gauge can only be trusted while charging. */
+  if (status.charging)
+    level = status.percentage;
 
   if (level < 0)
   {
-    voltage = axpxx_getBattVoltage();
-    level = ((voltage - 3200)*100)/1000;
+    level = ((status.voltage - 3200)*100)/1000;
     if (level < 0)
       level = 0;
     if (level > 100)
@@ -387,6 +709,7 @@ esp_err_t twatch_pmu_gps_power(bool enable)
     {
       AXP_CHECK(axpxx_setPowerOutPut(AXP202_LDO4, AXP202_ON));
     }
+    pmu_set_rail(PMU_RAIL_GPS, enable);
   #endif
 
   /* Success. */
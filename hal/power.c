@@ -0,0 +1,167 @@
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_log.h"
+#include "drivers/ft6236.h"
+#include "hal/pmu.h"
+#include "hal/power.h"
+
+#define TAG "[hal::power]"
+
+#ifdef CONFIG_PM_ENABLE
+
+static struct {
+  bool b_enabled;
+  bool b_light_sleep;
+
+  /* Boost: CPU at max frequency. */
+  esp_pm_lock_handle_t boost_lock;
+  bool b_boosted;
+
+  /* Awake: no automatic light sleep. */
+  esp_pm_lock_handle_t awake_lock;
+  bool b_awake;
+} g_power;
+
+#endif
+
+
+/**
+ * twatch_power_init()
+ *
+ * @brief Enable dynamic frequency scaling and automatic light sleep, with
+ *        touch, PMU and RTC alarm interrupts as wake-up sources. The system is
+ *        kept awake until twatch_power_keep_awake(false) is called.
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if power management is
+ *         not enabled, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_power_init(void)
+{
+  #ifdef CONFIG_PM_ENABLE
+    esp_pm_config_esp32_t pm_config;
+
+    if (g_power.b_enabled)
+      return ESP_OK;
+
+    /* Create our locks, stay awake until told otherwise. */
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "twatch_boost", &g_power.boost_lock) != ESP_OK)
+      return ESP_FAIL;
+    if (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "twatch_awake", &g_power.awake_lock) != ESP_OK)
+      return ESP_FAIL;
+    esp_pm_lock_acquire(g_power.awake_lock);
+    g_power.b_awake = true;
+    g_power.b_boosted = false;
+
+    /**
+     * Wake up from light sleep on touch and PMU interrupts. RTC interrupt
+     * is a wake-up source only while an alarm is armed and not yet
+     * acknowledged (see pcf8563_enable_alarm()).
+     **/
+
+    gpio_wakeup_enable(FT6236_IRQ_GPIO, GPIO_INTR_LOW_LEVEL);
+    gpio_wakeup_enable(PMU_IRQ_GPIO, GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+
+    pm_config.max_freq_mhz = POWER_MAX_CPU_FREQ_MHZ;
+    pm_config.min_freq_mhz = POWER_MIN_CPU_FREQ_MHZ;
+    #ifdef CONFIG_FREERTOS_USE_TICKLESS_IDLE
+      pm_config.light_sleep_enable = true;
+    #else
+      pm_config.light_sleep_enable = false;
+    #endif
+    if (esp_pm_configure(&pm_config) != ESP_OK)
+    {
+      ESP_LOGE(TAG, "cannot configure power management");
+      return ESP_FAIL;
+    }
+
+    g_power.b_light_sleep = pm_config.light_sleep_enable;
+    g_power.b_enabled = true;
+
+    /* Success. */
+    return ESP_OK;
+  #else
+    ESP_LOGW(TAG, "power management disabled (CONFIG_PM_ENABLE)");
+    return ESP_ERR_NOT_SUPPORTED;
+  #endif
+}
+
+
+/**
+ * twatch_power_is_enabled()
+ *
+ * @brief Determine if dynamic frequency scaling is enabled.
+ * @return true if enabled, false otherwise
+ **/
+
+bool twatch_power_is_enabled(void)
+{
+  #ifdef CONFIG_PM_ENABLE
+    return g_power.b_enabled;
+  #else
+    return false;
+  #endif
+}
+
+
+/**
+ * twatch_power_is_light_sleep_enabled()
+ *
+ * @brief Determine if automatic light sleep is enabled.
+ * @return true if enabled, false otherwise
+ **/
+
+bool twatch_power_is_light_sleep_enabled(void)
+{
+  #ifdef CONFIG_PM_ENABLE
+    return g_power.b_enabled && g_power.b_light_sleep;
+  #else
+    return false;
+  #endif
+}
+
+
+/**
+ * twatch_power_boost()
+ *
+ * @brief Run CPU at max frequency until boost is disabled.
+ * @param b_enable: true to boost, false to let CPU frequency scale down
+ **/
+
+void twatch_power_boost(bool b_enable)
+{
+  #ifdef CONFIG_PM_ENABLE
+    if (!g_power.b_enabled || (g_power.b_boosted == b_enable))
+      return;
+
+    if (b_enable)
+      esp_pm_lock_acquire(g_power.boost_lock);
+    else
+      esp_pm_lock_release(g_power.boost_lock);
+    g_power.b_boosted = b_enable;
+  #endif
+}
+
+
+/**
+ * twatch_power_keep_awake()
+ *
+ * @brief Prevent automatic light sleep until disabled.
+ * @param b_enable: true to stay awake, false to allow light sleep
+ **/
+
+void twatch_power_keep_awake(bool b_enable)
+{
+  #ifdef CONFIG_PM_ENABLE
+    if (!g_power.b_enabled || (g_power.b_awake == b_enable))
+      return;
+
+    if (b_enable)
+      esp_pm_lock_acquire(g_power.awake_lock);
+    else
+      esp_pm_lock_release(g_power.awake_lock);
+    g_power.b_awake = b_enable;
+  #endif
+}
@@ -0,0 +1,564 @@
+#include "hal/profiler.h"
+#include "hal/pmu.h"
+#include "hal/gauge.h"
+#include "hal/screen.h"
+#include "hal/touch.h"
+#include "esp_timer.h"
+#include "esp_private/esp_clk.h"
+
+#define TAG "[hal::profiler]"
+
+/* Recursive least-squares settings. */
+#define PROFILER_RLS_LAMBDA     0.999f    /* Forgetting factor (~1000 samples). */
+#define PROFILER_RLS_P0         10000.0f  /* Initial covariance. */
+#define PROFILER_RLS_P_MAX      1000000.0f
+
+static const char *g_profiler_subsys_names[PROFILER_NB_SUBSYS] = {
+  "base",
+  "backlight",
+  "screen",
+  "gps",
+  "audio",
+  "touch",
+  "cpu"
+};
+
+static struct {
+  SemaphoreHandle_t lock;
+  SemaphoreHandle_t done;
+  TaskHandle_t task;
+  volatile bool b_running;
+  twatch_profiler_config_t config;
+  int saved_adc_rate;
+  uint8_t saved_adc1;       /* ADCs enabled before profiling. */
+
+  /* Sample log. */
+  twatch_profiler_sample_t *p_log;
+  int log_size;
+  int log_head;
+  int log_count;
+  bool b_dumping;
+
+  /* Attribution. */
+  float weights[PROFILER_NB_SUBSYS];
+  float cov[PROFILER_NB_SUBSYS][PROFILER_NB_SUBSYS];
+  double feature_sum[PROFILER_NB_SUBSYS];
+  double load_sum;
+  uint32_t nb_samples;
+} g_profiler;
+
+
+/**
+ * profiler_rate_to_enum()
+ *
+ * @brief Convert an ADC rate in Hz into an AXP sampling rate setting.
+ * @param rate_hz: ADC rate in Hz (25, 50, 100 or 200)
+ * @return sampling rate setting
+ **/
+
+static axp_adc_sampling_rate_t profiler_rate_to_enum(int rate_hz)
+{
+  if (rate_hz >= 200)
+    return AXP_ADC_SAMPLING_RATE_200HZ;
+  else if (rate_hz >= 100)
+    return AXP_ADC_SAMPLING_RATE_100HZ;
+  else if (rate_hz >= 50)
+    return AXP_ADC_SAMPLING_RATE_50HZ;
+  else
+    return AXP_ADC_SAMPLING_RATE_25HZ;
+}
+
+
+/**
+ * profiler_reset_fit()
+ *
+ * @brief Reset attribution. Must be called with profiler locked.
+ **/
+
+static void profiler_reset_fit(void)
+{
+  int i;
+
+  memset(g_profiler.weights, 0, sizeof(g_profiler.weights));
+  memset(g_profiler.cov, 0, sizeof(g_profiler.cov));
+  memset(g_profiler.feature_sum, 0, sizeof(g_profiler.feature_sum));
+  for (i=0; i<PROFILER_NB_SUBSYS; i++)
+    g_profiler.cov[i][i] = PROFILER_RLS_P0;
+  g_profiler.load_sum = 0.0;
+  g_profiler.nb_samples = 0;
+}
+
+
+/**
+ * profiler_get_features()
+ *
+ * @brief Convert a sample into the subsystem features used by the fit.
+ * @param p_sample: pointer to a `twatch_profiler_sample_t` structure
+ * @param p_features: pointer to an array of PROFILER_NB_SUBSYS floats
+ **/
+
+static void profiler_get_features(twatch_profiler_sample_t *p_sample, float *p_features)
+{
+  p_features[PROFILER_SUBSYS_BASE] = 1.0f;
+  p_features[PROFILER_SUBSYS_BACKLIGHT] = (float)p_sample->backlight / SCREEN_MAX_BACKLIGHT;
+  p_features[PROFILER_SUBSYS_SCREEN] = (p_sample->flags & PROFILER_FLAG_SCREEN) ? 1.0f : 0.0f;
+  p_features[PROFILER_SUBSYS_GPS] = (p_sample->flags & PROFILER_FLAG_GPS) ? 1.0f : 0.0f;
+  p_features[PROFILER_SUBSYS_AUDIO] = (p_sample->flags & PROFILER_FLAG_AUDIO) ? 1.0f : 0.0f;
+  p_features[PROFILER_SUBSYS_TOUCH] = (p_sample->flags & PROFILER_FLAG_TOUCH_ACTIVE) ? 1.0f : 0.0f;
+  p_features[PROFILER_SUBSYS_CPU] = (p_sample->cpu_mhz > 80) ? (p_sample->cpu_mhz - 80) / 160.0f : 0.0f;
+}
+
+
+/**
+ * profiler_fit()
+ *
+ * @brief Update attribution with a new sample (recursive least squares).
+ *        Must be called with profiler locked.
+ * @param p_features: pointer to an array of PROFILER_NB_SUBSYS floats
+ * @param load_ma: measured load current
+ **/
+
+static void profiler_fit(float *p_features, float load_ma)
+{
+  float px[PROFILER_NB_SUBSYS], gain[PROFILER_NB_SUBSYS];
+  float denom, error, trace, lambda;
+  int i, j;
+
+  for (i=0; i<PROFILER_NB_SUBSYS; i++)
+  {
+    px[i] = 0.0f;
+    for (j=0; j<PROFILER_NB_SUBSYS; j++)
+      px[i] += g_profiler.cov[i][j] * p_features[j];
+  }
+
+  denom = PROFILER_RLS_LAMBDA;
+  error = load_ma;
+  for (i=0; i<PROFILER_NB_SUBSYS; i++)
+  {
+    denom += p_features[i] * px[i];
+    error -= g_profiler.weights[i] * p_features[i];
+  }
+
+  for (i=0; i<PROFILER_NB_SUBSYS; i++)
+  {
+    gain[i] = px[i] / denom;
+    g_profiler.weights[i] += gain[i] * error;
+  }
+
+  /* Stop forgetting if covariance grows too much (subsystem never toggled). */
+  trace = 0.0f;
+  for (i=0; i<PROFILER_NB_SUBSYS; i++)
+    trace += g_profiler.cov[i][i];
+  lambda = (trace > PROFILER_RLS_P_MAX) ? 1.0f : PROFILER_RLS_LAMBDA;
+
+  for (i=0; i<PROFILER_NB_SUBSYS; i++)
+    for (j=0; j<PROFILER_NB_SUBSYS; j++)
+      g_profiler.cov[i][j] = (g_profiler.cov[i][j] - gain[i] * px[j]) / lambda;
+
+  for (i=0; i<PROFILER_NB_SUBSYS; i++)
+    g_profiler.feature_sum[i] += p_features[i];
+  g_profiler.load_sum += load_ma;
+  g_profiler.nb_samples++;
+}
+
+
+/**
+ * profiler_sample()
+ *
+ * @brief Take a sample of currents and subsystems state.
+ * @param p_sample: pointer to a `twatch_profiler_sample_t` structure
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+static esp_err_t profiler_sample(twatch_profiler_sample_t *p_sample)
+{
+  float charge, discharge, vbus;
+  uint32_t rails;
+  int backlight;
+
+  if (axpxx_getCurrents(&charge, &discharge, &vbus) != AXP_PASS)
+    return ESP_FAIL;
+
+  p_sample->timestamp_ms = (uint32_t)(esp_timer_get_time() / 1000);
+  p_sample->batt_ma = (int16_t)(charge - discharge);
+  p_sample->vbus_ma = (int16_t)vbus;
+
+  backlight = twatch_screen_get_backlight();
+  p_sample->backlight = (backlight < 0) ? 0 : (uint16_t)backlight;
+  p_sample->cpu_mhz = (uint8_t)(esp_clk_cpu_freq() / 1000000);
+
+  rails = twatch_pmu_get_rails();
+  p_sample->flags = 0;
+  if (rails & PMU_RAIL_SCREEN)
+    p_sample->flags |= PROFILER_FLAG_SCREEN;
+  if (rails & PMU_RAIL_GPS)
+    p_sample->flags |= PROFILER_FLAG_GPS;
+  if (rails & PMU_RAIL_AUDIO)
+    p_sample->flags |= PROFILER_FLAG_AUDIO;
+  if (twatch_pmu_is_usb_plugged(false))
+    p_sample->flags |= PROFILER_FLAG_VBUS;
+
+  switch (twatch_touch_get_power_mode())
+  {
+    case TOUCH_MODE_ACTIVE:
+      p_sample->flags |= PROFILER_FLAG_TOUCH_ACTIVE;
+      break;
+
+    case TOUCH_MODE_MONITOR:
+      p_sample->flags |= PROFILER_FLAG_TOUCH_MONITOR;
+      break;
+
+    default:
+      break;
+  }
+
+  return ESP_OK;
+}
+
+
+/**
+ * _twatch_profiler_task()
+ *
+ * @brief Profiler task, samples at a fixed rate until stopped.
+ * @param parameter: not used
+ **/
+
+void _twatch_profiler_task(void *parameter)
+{
+  twatch_profiler_sample_t sample;
+  float features[PROFILER_NB_SUBSYS];
+  TickType_t last_wake, period;
+
+  period = g_profiler.config.period_ms / portTICK_PERIOD_MS;
+  if (period == 0)
+    period = 1;
+  last_wake = xTaskGetTickCount();
+
+  while (g_profiler.b_running)
+  {
+    vTaskDelayUntil(&last_wake, period);
+
+    if (profiler_sample(&sample) != ESP_OK)
+      continue;
+
+    xSemaphoreTake(g_profiler.lock, portMAX_DELAY);
+
+    /* Load is what the system draws, from battery and/or VBUS. */
+    profiler_get_features(&sample, features);
+    profiler_fit(features, (float)sample.vbus_ma - (float)sample.batt_ma);
+
+    /* Log sample, unless the log is being dumped. */
+    if ((g_profiler.p_log != NULL) && !g_profiler.b_dumping)
+    {
+      g_profiler.p_log[g_profiler.log_head] = sample;
+      g_profiler.log_head = (g_profiler.log_head + 1) % g_profiler.log_size;
+      if (g_profiler.log_count < g_profiler.log_size)
+        g_profiler.log_count++;
+    }
+
+    xSemaphoreGive(g_profiler.lock);
+  }
+
+  /* Notify twatch_profiler_stop() we are done. */
+  xSemaphoreGive(g_profiler.done);
+  vTaskDelete(NULL);
+}
+
+
+/**
+ * twatch_profiler_get_default_config()
+ *
+ * @brief Fill a configuration structure with default values.
+ * @param p_config: pointer to a `twatch_profiler_config_t` structure
+ **/
+
+void twatch_profiler_get_default_config(twatch_profiler_config_t *p_config)
+{
+  p_config->period_ms = PROFILER_DEFAULT_PERIOD_MS;
+  p_config->log_size = PROFILER_DEFAULT_LOG_SIZE;
+  p_config->adc_rate = PROFILER_DEFAULT_ADC_RATE;
+}
+
+
+/**
+ * twatch_profiler_start()
+ *
+ * @brief Start profiling. Attribution and log are reset.
+ * @param p_config: pointer to a `twatch_profiler_config_t` structure,
+ *                  NULL to use default configuration
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_profiler_start(twatch_profiler_config_t *p_config)
+{
+  int min_period_ms;
+
+  if (g_profiler.b_running)
+    return ESP_FAIL;
+
+  /* Create our semaphores, once. */
+  if (g_profiler.lock == NULL)
+  {
+    g_profiler.lock = xSemaphoreCreateMutex();
+    g_profiler.done = xSemaphoreCreateBinary();
+    if ((g_profiler.lock == NULL) || (g_profiler.done == NULL))
+      return ESP_FAIL;
+  }
+
+  if (p_config != NULL)
+    memcpy(&g_profiler.config, p_config, sizeof(twatch_profiler_config_t));
+  else
+    twatch_profiler_get_default_config(&g_profiler.config);
+
+  /* Sampling faster than the ADC only returns the same values. */
+  min_period_ms = 1000 / (25 << g_profiler.config.adc_rate);
+  if (g_profiler.config.period_ms < min_period_ms)
+    g_profiler.config.period_ms = min_period_ms;
+
+  /* (Re)allocate log. */
+  xSemaphoreTake(g_profiler.lock, portMAX_DELAY);
+  if ((g_profiler.p_log == NULL) || (g_profiler.log_size != g_profiler.config.log_size))
+  {
+    free(g_profiler.p_log);
+    g_profiler.p_log = NULL;
+    g_profiler.log_size = 0;
+    if (g_profiler.config.log_size > 0)
+    {
+      g_profiler.p_log = malloc(g_profiler.config.log_size * sizeof(twatch_profiler_sample_t));
+      if (g_profiler.p_log == NULL)
+      {
+        xSemaphoreGive(g_profiler.lock);
+        return ESP_FAIL;
+      }
+      g_profiler.log_size = g_profiler.config.log_size;
+    }
+  }
+  g_profiler.log_head = 0;
+  g_profiler.log_count = 0;
+  profiler_reset_fit();
+  xSemaphoreGive(g_profiler.lock);
+
+  /**
+   * Fuel gauge converts coulomb counts with the ADC rate, bring it up to
+   * date before changing rate.
+   **/
+
+  twatch_gauge_update();
+  g_profiler.saved_adc_rate = axpxx_getAdcSamplingRate();
+  g_profiler.saved_adc1 = axpxx_getAdc1Enable();
+  axpxx_setAdcSamplingRate(g_profiler.config.adc_rate);
+  axpxx_adc1Enable(AXP202_BATT_CUR_ADC1 | AXP202_VBUS_CUR_ADC1, true);
+
+  g_profiler.b_running = true;
+  if (xTaskCreate(
+    _twatch_profiler_task,
+    "_prof_task",
+    PROFILER_TASK_STACK,
+    NULL,
+    PROFILER_TASK_PRIORITY,
+    &g_profiler.task
+  ) != pdPASS)
+  {
+    g_profiler.b_running = false;
+    twatch_profiler_stop();
+    return ESP_FAIL;
+  }
+
+  /* Success. */
+  return ESP_OK;
+}
+
+
+/**
+ * twatch_profiler_stop()
+ *
+ * @brief Stop profiling and restore ADC settings. Attribution and log are
+ *        kept until next start.
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_profiler_stop(void)
+{
+  if (g_profiler.lock == NULL)
+    return ESP_FAIL;
+
+  /* Wait for the task to exit. */
+  if (g_profiler.b_running)
+  {
+    g_profiler.b_running = false;
+    xSemaphoreTake(g_profiler.done, portMAX_DELAY);
+    g_profiler.task = NULL;
+  }
+
+  /* Restore ADC settings, only turning off the ADCs we enabled. */
+  twatch_gauge_update();
+  axpxx_adc1Enable((AXP202_BATT_CUR_ADC1 | AXP202_VBUS_CUR_ADC1) & ~g_profiler.saved_adc1, false);
+  axpxx_setAdcSamplingRate(profiler_rate_to_enum(g_profiler.saved_adc_rate));
+
+  return ESP_OK;
+}
+
+
+/**
+ * twatch_profiler_is_running()
+ *
+ * @brief Determine if profiler is running.
+ * @return true if running, false otherwise
+ **/
+
+bool twatch_profiler_is_running(void)
+{
+  return g_profiler.b_running;
+}
+
+
+/**
+ * twatch_profiler_get_report()
+ *
+ * @brief Get current attribution.
+ * @param p_report: pointer to a `twatch_profiler_report_t` structure
+ * @return ESP_OK on success, ESP_FAIL if no sample has been taken
+ **/
+
+esp_err_t twatch_profiler_get_report(twatch_profiler_report_t *p_report)
+{
+  int i;
+
+  if (g_profiler.lock == NULL)
+    return ESP_FAIL;
+
+  xSemaphoreTake(g_profiler.lock, portMAX_DELAY);
+  if (g_profiler.nb_samples == 0)
+  {
+    xSemaphoreGive(g_profiler.lock);
+    return ESP_FAIL;
+  }
+
+  p_report->nb_samples = g_profiler.nb_samples;
+  p_report->load_ma = (float)(g_profiler.load_sum / g_profiler.nb_samples);
+  for (i=0; i<PROFILER_NB_SUBSYS; i++)
+  {
+    p_report->cost_ma[i] = g_profiler.weights[i];
+    p_report->share_ma[i] = g_profiler.weights[i] *
+      (float)(g_profiler.feature_sum[i] / g_profiler.nb_samples);
+  }
+  xSemaphoreGive(g_profiler.lock);
+
+  return ESP_OK;
+}
+
+
+/**
+ * twatch_profiler_reset()
+ *
+ * @brief Reset attribution and log.
+ **/
+
+void twatch_profiler_reset(void)
+{
+  if (g_profiler.lock == NULL)
+    return;
+
+  xSemaphoreTake(g_profiler.lock, portMAX_DELAY);
+  g_profiler.log_head = 0;
+  g_profiler.log_count = 0;
+  profiler_reset_fit();
+  xSemaphoreGive(g_profiler.lock);
+}
+
+
+/**
+ * twatch_profiler_read_log()
+ *
+ * @brief Copy logged samples, oldest first. Log is not consumed.
+ * @param p_samples: pointer to an array of `twatch_profiler_sample_t`
+ * @param max_samples: size of array
+ * @return number of samples copied
+ **/
+
+int twatch_profiler_read_log(twatch_profiler_sample_t *p_samples, int max_samples)
+{
+  int i, start, count;
+
+  if ((g_profiler.lock == NULL) || (g_profiler.p_log == NULL))
+    return 0;
+
+  xSemaphoreTake(g_profiler.lock, portMAX_DELAY);
+  count = (g_profiler.log_count < max_samples) ? g_profiler.log_count : max_samples;
+  start = (g_profiler.log_head - g_profiler.log_count + g_profiler.log_size) % g_profiler.log_size;
+  for (i=0; i<count; i++)
+    p_samples[i] = g_profiler.p_log[(start + i) % g_profiler.log_size];
+  xSemaphoreGive(g_profiler.lock);
+
+  return count;
+}
+
+
+/**
+ * twatch_profiler_dump()
+ *
+ * @brief Print log and attribution on the console, as CSV lines between
+ *        "#PROF-BEGIN" and "#PROF-END" markers. Sampling goes on but
+ *        samples are not logged while dumping.
+ **/
+
+void twatch_profiler_dump(void)
+{
+  twatch_profiler_sample_t sample;
+  twatch_profiler_report_t report;
+  int i, start, count;
+
+  if ((g_profiler.lock == NULL) || (g_profiler.p_log == NULL))
+    return;
+
+  xSemaphoreTake(g_profiler.lock, portMAX_DELAY);
+  g_profiler.b_dumping = true;
+  count = g_profiler.log_count;
+  start = (g_profiler.log_head - g_profiler.log_count + g_profiler.log_size) % g_profiler.log_size;
+  xSemaphoreGive(g_profiler.lock);
+
+  printf("#PROF-BEGIN period_ms=%d samples=%d\n", g_profiler.config.period_ms, count);
+  printf("t_ms,batt_ma,vbus_ma,backlight,flags,cpu_mhz\n");
+  for (i=0; i<count; i++)
+  {
+    /* Log is not written while dumping, no need to lock. */
+    sample = g_profiler.p_log[(start + i) % g_profiler.log_size];
+    printf(
+      "%" PRIu32 ",%d,%d,%u,%u,%u\n",
+      sample.timestamp_ms,
+      sample.batt_ma,
+      sample.vbus_ma,
+      sample.backlight,
+      sample.flags,
+      sample.cpu_mhz
+    );
+  }
+
+  if (twatch_profiler_get_report(&report) == ESP_OK)
+  {
+    printf("#PROF-LOAD %.1f\n", report.load_ma);
+    for (i=0; i<PROFILER_NB_SUBSYS; i++)
+      printf("#PROF-ATTR %s,%.1f,%.1f\n", g_profiler_subsys_names[i], report.cost_ma[i], report.share_ma[i]);
+  }
+  printf("#PROF-END\n");
+
+  xSemaphoreTake(g_profiler.lock, portMAX_DELAY);
+  g_profiler.b_dumping = false;
+  xSemaphoreGive(g_profiler.lock);
+}
+
+
+/**
+ * twatch_profiler_subsys_name()
+ *
+ * @brief Get subsystem name.
+ * @param subsys: subsystem
+ * @return subsystem name
+ **/
+
+const char *twatch_profiler_subsys_name(twatch_profiler_subsys_t subsys)
+{
+  if ((subsys < 0) || (subsys >= PROFILER_NB_SUBSYS))
+    return "unknown";
+  return g_profiler_subsys_names[subsys];
+}
@@ -1,10 +1,12 @@
 #include "hal/rtc.h"
+#include "hal/pmu.h"
 
 esp_err_t twatch_rtc_init(void)
 { 
   if (pcf8563_init() == ESP_OK)
   {
-    if (pcf8563_probe() == ESP_OK)
+    /* RTC kept running during deep sleep, no need to probe it again. */
+    if (twatch_pmu_is_resuming() || (pcf8563_probe() == ESP_OK))
     {
       return ESP_OK;
     }
@@ -33,7 +35,28 @@ esp_err_t twatch_rtc_get_alarm(rtc_alarm_t *p_alarm)
   return pcf8563_get_alarm((pcf8563_alarm_t *)p_alarm);
 }
 
+/**
+ * twatch_rtc_enable_alarm()
+ *
+ * @brief Enable or disable alarm. Must be called again once the alarm went
+ *        off to acknowledge it, as the RTC interrupt line stays asserted
+ *        until then.
+ * @param enable: true to enable alarm, false to disable it
+ **/
+
 void twatch_rtc_enable_alarm(bool enable)
 {
-  /* TODO ! */
+  pcf8563_enable_alarm(enable);
+}
+
+/**
+ * twatch_rtc_is_alarm_pending()
+ *
+ * @brief Determine if alarm went off and has not been acknowledged yet.
+ * @return true if alarm is pending, false otherwise
+ **/
+
+bool twatch_rtc_is_alarm_pending(void)
+{
+  return pcf8563_is_alarm_pending();
 }
\ No newline at end of file
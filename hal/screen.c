@@ -2,6 +2,10 @@
 
 RTC_DATA_ATTR static int g_default_backlight = SCREEN_DEFAULT_BACKLIGHT;
 
+/* Last frame before deep sleep, compressed (see st7789_compress_fb()). */
+RTC_DATA_ATTR static uint8_t g_snapshot[SCREEN_SNAPSHOT_SIZE];
+RTC_DATA_ATTR static int g_snapshot_size = 0;
+
 /**
  * screen_init()
  * 
@@ -26,12 +30,23 @@ esp_err_t twatch_screen_init(void)
 
   if (result == ESP_OK)
   {
-    /* Blank screen. */
-    st7789_blank();
-    st7789_commit_fb();
-
-    /* Power on backlight with default setting. */
-    st7789_backlight_set(SCREEN_DEFAULT_BACKLIGHT);
+    /* Show last frame when resuming from deep sleep, blank screen otherwise. */
+    if (twatch_pmu_is_resuming() && (g_snapshot_size > 0) &&
+        (st7789_decompress_fb(g_snapshot, g_snapshot_size) == ESP_OK))
+    {
+      st7789_commit_fb();
+      st7789_backlight_set(g_default_backlight);
+    }
+    else
+    {
+      /* Blank screen. */
+      st7789_blank();
+      st7789_commit_fb();
+
+      /* Power on backlight with default setting. */
+      st7789_backlight_set(SCREEN_DEFAULT_BACKLIGHT);
+    }
+    g_snapshot_size = 0;
   }
   else
     ESP_LOGE("[screen]", "Cannot initialize screen");
@@ -40,6 +55,26 @@ esp_err_t twatch_screen_init(void)
   return result;
 }
 
+/**
+ * twatch_screen_save_snapshot()
+ *
+ * @brief: Save current framebuffer in RTC memory, to be displayed by
+ *         twatch_screen_init() when resuming from deep sleep.
+ * @return: ESP_OK on success, ESP_FAIL if frame is too complex to fit.
+ **/
+esp_err_t twatch_screen_save_snapshot(void)
+{
+  g_snapshot_size = st7789_compress_fb(g_snapshot, SCREEN_SNAPSHOT_SIZE);
+  if (g_snapshot_size < 0)
+  {
+    g_snapshot_size = 0;
+    return ESP_FAIL;
+  }
+
+  /* Success. */
+  return ESP_OK;
+}
+
 /**
  * twatch_screen_set_backlight()
  *
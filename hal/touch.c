@@ -1,4 +1,5 @@
 #include "esp_log.h"
+#include "drivers/i2c.h"
 #include "hal/touch.h"
 #include "math.h"
 
@@ -16,6 +17,16 @@ RTC_DATA_ATTR static bool b_inverted=false;
 volatile bool b_touched = false;
 volatile ft6236_touch_t touch_data;
 
+/*
+ Touch report is read asynchronously (high priority) as soon as the IRQ
+ fires. b_touch_xfer_pending is set while the read is in flight, and
+ b_touch_report_ready once the report is available.
+*/
+static uint8_t touch_report[FT6X36_REPORT_SIZE];
+static i2c_xfer_t touch_xfer;
+volatile bool b_touch_xfer_pending = false;
+volatile bool b_touch_report_ready = false;
+
 /*
  b_swipe_sent: true if we already sent a swipe event.
 
@@ -26,6 +37,14 @@ volatile bool b_swipe_sent = false;
 
 QueueHandle_t _touch_queue;
 
+/* Semaphore given when touch activity is detected (see twatch_touch_set_wakeup()). */
+static SemaphoreHandle_t touch_wakeup = NULL;
+
+/* Touch controller power management. */
+volatile touch_power_mode_t touch_power_mode = TOUCH_MODE_ACTIVE;
+volatile int64_t touch_wake_ts = 0;
+touch_power_stats_t touch_power_stats;
+
 unsigned long IRAM_ATTR millis()
 {
     return (unsigned long) (esp_timer_get_time() / 1000ULL);
@@ -35,9 +54,90 @@ unsigned long IRAM_ATTR millis()
  * @brief IRQ handler ISR
  **/
 
-void _touch_irq_handler(void)
+void IRAM_ATTR _touch_irq_handler(void)
 {
+  BaseType_t task_woken = pdFALSE;
+
+  /* Record first IRQ timestamp while in monitor mode (wake latency). */
+  if ((touch_power_mode == TOUCH_MODE_MONITOR) && (touch_wake_ts == 0))
+    touch_wake_ts = esp_timer_get_time();
+
+  /* Start reading touch report, unless a read is already in flight. */
+  if (!b_touch_xfer_pending)
+  {
+    b_touch_xfer_pending = true;
+    if (twatch_i2c_submit_from_isr(I2C_SEC, &touch_xfer, &task_woken) == ESP_OK)
+    {
+      if (task_woken == pdTRUE)
+        portYIELD_FROM_ISR();
+      return;
+    }
+    b_touch_xfer_pending = false;
+  }
+
+  /* Report will be read synchronously. */
   b_touched = true;
+  if (touch_wakeup != NULL)
+  {
+    xSemaphoreGiveFromISR(touch_wakeup, &task_woken);
+    if (task_woken == pdTRUE)
+      portYIELD_FROM_ISR();
+  }
+}
+
+
+/**
+ * @brief Touch report read completion callback (I2C worker task)
+ * @param p_xfer: pointer to the completed `i2c_xfer_t` structure
+ **/
+
+void _touch_xfer_done(i2c_xfer_t *p_xfer)
+{
+  b_touch_report_ready = (p_xfer->result == ESP_OK);
+  b_touch_xfer_pending = false;
+
+  /* Wake up whoever waits for touch activity. */
+  if (b_touch_report_ready && (touch_wakeup != NULL))
+    xSemaphoreGive(touch_wakeup);
+}
+
+
+/**
+ * @brief Apply monitor mode settings to the touch controller.
+ * @retval ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t _touch_enable_monitor_mode(void)
+{
+  if (ft6x36_set_monitor_period(TOUCH_MONITOR_PERIOD) != ESP_OK)
+    return ESP_FAIL;
+
+  if (ft6x36_set_monitor_timeout(TOUCH_MONITOR_TIMEOUT) != ESP_OK)
+    return ESP_FAIL;
+
+  /* Controller switches to monitor mode when there is no touch. */
+  return ft6x36_enable_monitor_mode();
+}
+
+
+/**
+ * @brief Update wake latency statistics once a wake-up touch has been reported.
+ **/
+
+void _touch_update_wake_stats(void)
+{
+  uint32_t latency;
+
+  if (touch_wake_ts == 0)
+    return;
+
+  latency = (uint32_t)(esp_timer_get_time() - touch_wake_ts);
+  touch_power_stats.nb_wakeups++;
+  touch_power_stats.last_wake_latency_us = latency;
+  if (latency > touch_power_stats.max_wake_latency_us)
+    touch_power_stats.max_wake_latency_us = latency;
+
+  touch_wake_ts = 0;
 }
 
 
@@ -234,12 +334,32 @@ esp_err_t twatch_touch_init(void)
   /* Initialize touch state. */
   touch_state = TOUCH_STATE_CLEAR;
 
+  /* Prepare asynchronous touch report read. */
+  memset(&touch_xfer, 0, sizeof(i2c_xfer_t));
+  touch_xfer.type = I2C_XFER_READ;
+  touch_xfer.priority = I2C_XFER_PRIO_HIGH;
+  touch_xfer.addr = FT6236_I2C_SLAVE_ADDR;
+  touch_xfer.reg = FT6X36_DEV_MODE_REG;
+  touch_xfer.data = touch_report;
+  touch_xfer.len = FT6X36_REPORT_SIZE;
+  touch_xfer.ticks_to_wait = 1000 / portTICK_RATE_MS;
+  touch_xfer.pfn_callback = _touch_xfer_done;
+  b_touch_xfer_pending = false;
+  b_touch_report_ready = false;
+
   /* Initialize our FT6236. */
   ft6x36_init(FT6236_I2C_SLAVE_ADDR, (FT6X36_IRQ_HANDLER)_touch_irq_handler);
 
   first.x = 0xffff;
   first.y = 0xffff;
 
+  /* Controller starts in active mode, at full report rate. */
+  memset(&touch_power_stats, 0, sizeof(touch_power_stats_t));
+  touch_power_mode = TOUCH_MODE_ACTIVE;
+  touch_wake_ts = 0;
+  ft6x36_enable_active_mode();
+  ft6x36_set_active_period(TOUCH_ACTIVE_PERIOD);
+
   return ESP_OK;
 }
 
@@ -253,18 +373,41 @@ esp_err_t twatch_touch_init(void)
 
 esp_err_t twatch_get_touch_event(touch_event_t *event, TickType_t ticks_to_wait)
 {
-  /* Handle IRQ if any. */
-  if (b_touched)
+  bool b_processed = false;
+
+  /* Process report read asynchronously, if any. */
+  if (b_touch_report_ready)
   {
+    b_touch_report_ready = false;
+    ft6x36_parse_report(touch_report, (ft6236_touch_t *)&touch_data);
+    _process_touch_data((ft6236_touch_t *)&touch_data);
+    b_processed = true;
+  }
+
+  /* Handle IRQ that could not be served asynchronously. */
+  if (b_touched && !b_touch_xfer_pending)
+  {
+    /* Reset b_touched. */
+    b_touched = false;
+
     /* Read touch data. */
     ft6x36_read((ft6236_touch_t *)&touch_data);
 
     _process_touch_data((ft6236_touch_t *)&touch_data);
+    b_processed = true;
+  }
 
-    /* Reset b_touched. */
-    b_touched = false;
+  /* First touch while in monitor mode: go back to full report rate. */
+  if (b_processed && (touch_power_mode == TOUCH_MODE_MONITOR))
+  {
+    _touch_update_wake_stats();
+    twatch_touch_set_power_mode(TOUCH_MODE_ACTIVE);
   }
 
+  /* No report left to read, unmask touch IRQ. */
+  if (!b_touch_xfer_pending && !b_touch_report_ready && !b_touched)
+    ft6x36_ack_irq();
+
   /* Do we have some event to process ? */
   if (xQueueReceive(_touch_queue, event, ticks_to_wait))
   {
@@ -274,6 +417,18 @@ esp_err_t twatch_get_touch_event(touch_event_t *event, TickType_t ticks_to_wait)
     return ESP_FAIL;
 }
 
+/**
+ * @brief Set a semaphore to give when touch activity is detected, allows
+ *        to block until the next touch instead of polling.
+ * @param wakeup: binary semaphore, NULL to disable
+ **/
+
+void twatch_touch_set_wakeup(SemaphoreHandle_t wakeup)
+{
+  touch_wakeup = wakeup;
+}
+
+
 /**
  * @brief Set touch screen as inverted (or not).
  * @param inverted: true if touch screen is inverted, false otherwise
@@ -288,3 +443,96 @@ bool twatch_touch_is_inverted(void)
 {
   return b_inverted;
 }
+
+
+/**
+ * @brief Set touch controller power mode.
+ *
+ * Active mode reports touches at full rate, monitor mode lowers the scan
+ * rate until a touch is detected and hibernate mode stops the controller.
+ * Hibernate requires a hardware reset to wake up, only available on v2:
+ * other versions fall back to monitor mode.
+ *
+ * @param mode: power mode to apply
+ * @retval ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_touch_set_power_mode(touch_power_mode_t mode)
+{
+  esp_err_t result = ESP_FAIL;
+
+  /* Nothing to do if mode is already set. */
+  if (mode == touch_power_mode)
+    return ESP_OK;
+
+  switch (mode)
+  {
+    case TOUCH_MODE_ACTIVE:
+      {
+        #ifdef CONFIG_TWATCH_V2
+          /* Controller must be reset to leave hibernate mode. */
+          if (touch_power_mode == TOUCH_MODE_HIBERNATE)
+            twatch_pmu_reset_touchscreen();
+        #endif
+
+        result = ft6x36_enable_active_mode();
+        if (result == ESP_OK)
+          result = ft6x36_set_active_period(TOUCH_ACTIVE_PERIOD);
+      }
+      break;
+
+    case TOUCH_MODE_MONITOR:
+      {
+        touch_wake_ts = 0;
+        result = _touch_enable_monitor_mode();
+      }
+      break;
+
+    case TOUCH_MODE_HIBERNATE:
+      {
+        #ifdef CONFIG_TWATCH_V2
+          result = ft6x36_hibernate();
+        #else
+          /* No reset line, stick to monitor mode. */
+          touch_wake_ts = 0;
+          result = _touch_enable_monitor_mode();
+          mode = TOUCH_MODE_MONITOR;
+        #endif
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  if (result == ESP_OK)
+  {
+    touch_power_mode = mode;
+    ESP_LOGD(TOUCH_TAG, "power mode set to %d", mode);
+  }
+
+  return result;
+}
+
+
+/**
+ * @brief Get touch controller power mode.
+ * @retval current power mode
+ **/
+
+touch_power_mode_t twatch_touch_get_power_mode(void)
+{
+  return touch_power_mode;
+}
+
+
+/**
+ * @brief Get touch controller power statistics (mode and wake latency).
+ * @param p_stats: pointer to a `touch_power_stats_t` structure to fill
+ **/
+
+void twatch_touch_get_power_stats(touch_power_stats_t *p_stats)
+{
+  memcpy(p_stats, &touch_power_stats, sizeof(touch_power_stats_t));
+  p_stats->mode = touch_power_mode;
+}
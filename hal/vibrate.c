@@ -1,63 +1,576 @@
 #include "hal/vibrate.h"
+#include "freertos/semphr.h"
+#include "driver/ledc.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
 
 #define TAG "[hal::vibrate]"
 
-void _twatch_vibration_task(void *parameter)
+#if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+
+#define VIBRATE_MOTOR_GPIO      GPIO_NUM_4
+#define VIBRATE_PWM_TIMER       LEDC_TIMER_1
+#define VIBRATE_PWM_CHANNEL     LEDC_CHANNEL_1
+#define VIBRATE_PWM_FREQ        20000
+#define VIBRATE_PWM_RESOLUTION  LEDC_TIMER_10_BIT
+#if SOC_LEDC_SUPPORT_HS_MODE
+  #define VIBRATE_PWM_MODE      LEDC_HIGH_SPEED_MODE
+#else
+  #define VIBRATE_PWM_MODE      LEDC_LOW_SPEED_MODE
+#endif
+
+/**
+ * The motor is switched straight from the battery, full duty is used as
+ * overdrive only. Amplitudes are mapped between the duty needed to keep
+ * the motor spinning and the rated duty.
+ **/
+
+#define VIBRATE_DUTY_OVERDRIVE  1023
+#define VIBRATE_DUTY_RATED      819
+#define VIBRATE_DUTY_MIN        307
+#define VIBRATE_AMPLITUDE_MAX   255
+
+#define VIBRATE_MAX_SEGMENTS    24
+
+/* Segments not over within this margin are re-armed, not skipped. */
+#define VIBRATE_TIMER_SLACK_US  200
+
+/* Drive level held for some time, optionally reached through a fade. */
+typedef struct {
+  uint32_t duty;
+  int ramp_ms;
+  int64_t hold_us;
+} vibrate_segment_t;
+
+/* Amplitude envelope emulating a library effect. */
+typedef struct {
+  uint8_t effect;
+  uint8_t amplitude;
+  uint16_t attack_ms;
+  uint16_t sustain_ms;
+  uint16_t release_ms;
+  uint8_t repeat;
+  uint16_t gap_ms;
+} vibrate_envelope_t;
+
+static const vibrate_envelope_t g_vibrate_envelopes[] = {
+  {VIBRATE_EFFECT_STRONG_CLICK, 255, 0, 30, 0, 1, 0},
+  {VIBRATE_EFFECT_SHARP_CLICK,  255, 0, 15, 0, 1, 0},
+  {VIBRATE_EFFECT_SOFT_BUMP,    140, 20, 30, 20, 1, 0},
+  {VIBRATE_EFFECT_DOUBLE_CLICK, 255, 0, 30, 0, 2, 80},
+  {VIBRATE_EFFECT_TRIPLE_CLICK, 255, 0, 30, 0, 3, 80},
+  {VIBRATE_EFFECT_STRONG_BUZZ,  255, 0, 300, 0, 1, 0},
+  {VIBRATE_EFFECT_ALERT_750MS,  255, 0, 750, 0, 1, 0},
+  {VIBRATE_EFFECT_ALERT_1000MS, 255, 0, 1000, 0, 1, 0},
+  {VIBRATE_EFFECT_BUZZ,         200, 0, 200, 0, 1, 0},
+  {VIBRATE_EFFECT_PULSING,      255, 0, 60, 0, 4, 60},
+  {VIBRATE_EFFECT_RAMP_DOWN,    255, 0, 0, 500, 1, 0},
+  {VIBRATE_EFFECT_RAMP_UP,      255, 500, 0, 0, 1, 0},
+};
+
+#define VIBRATE_NB_ENVELOPES (sizeof(g_vibrate_envelopes)/sizeof(vibrate_envelope_t))
+
+/**
+ * Haptics engine state. Segments are stepped from an esp_timer callback
+ * and ramps are run by the LEDC fade engine, so timing does not depend
+ * on the load of application tasks.
+ **/
+
+static struct {
+  SemaphoreHandle_t lock;
+  esp_timer_handle_t timer;
+  bool b_fade;
+  int overdrive_ms;
+  int brake_ms;
+
+  /* Command being played. */
+  bool b_playing;
+  vibrate_parameter_t command;
+  int step;
+  int64_t step_end_us;
+
+  /* Segments of current step. */
+  vibrate_segment_t segments[VIBRATE_MAX_SEGMENTS];
+  int nb_segments;
+  int segment;
+  int64_t segment_end_us;
+  uint32_t last_duty;
+
+  #ifdef CONFIG_PM_ENABLE
+    /* LEDC runs from APB clock, no light sleep while motor is driven. */
+    esp_pm_lock_handle_t pm_lock;
+    bool b_pm_locked;
+  #endif
+} g_vibrate;
+
+
+/**
+ * vibrate_amplitude_to_duty()
+ *
+ * @brief Convert an amplitude into a PWM duty.
+ * @param amplitude: amplitude, 0 to VIBRATE_AMPLITUDE_MAX
+ * @return PWM duty
+ **/
+
+static uint32_t vibrate_amplitude_to_duty(int amplitude)
 {
-  vibrate_parameter_t *vibration_config = (vibrate_parameter_t *)parameter;
+  if (amplitude <= 0)
+    return 0;
+  if (amplitude > VIBRATE_AMPLITUDE_MAX)
+    amplitude = VIBRATE_AMPLITUDE_MAX;
+
+  return VIBRATE_DUTY_MIN + ((VIBRATE_DUTY_RATED - VIBRATE_DUTY_MIN) * amplitude) / VIBRATE_AMPLITUDE_MAX;
+}
+
+
+/**
+ * vibrate_set_duty()
+ *
+ * @brief Drive motor with the given duty, immediately or through a fade.
+ * @param duty: PWM duty
+ * @param ramp_ms: fade duration in milliseconds, 0 to apply immediately
+ **/
+
+static void vibrate_set_duty(uint32_t duty, int ramp_ms)
+{
+  #ifdef CONFIG_PM_ENABLE
+    bool b_driven = (duty > 0) || (ramp_ms > 0);
+
+    if ((g_vibrate.pm_lock != NULL) && (b_driven != g_vibrate.b_pm_locked))
+    {
+      if (b_driven)
+        esp_pm_lock_acquire(g_vibrate.pm_lock);
+      else
+        esp_pm_lock_release(g_vibrate.pm_lock);
+      g_vibrate.b_pm_locked = b_driven;
+    }
+  #endif
+
+  if ((ramp_ms > 0) && g_vibrate.b_fade)
+  {
+    ledc_set_fade_with_time(VIBRATE_PWM_MODE, VIBRATE_PWM_CHANNEL, duty, ramp_ms);
+    ledc_fade_start(VIBRATE_PWM_MODE, VIBRATE_PWM_CHANNEL, LEDC_FADE_NO_WAIT);
+  }
+  else
+  {
+    ledc_set_duty(VIBRATE_PWM_MODE, VIBRATE_PWM_CHANNEL, duty);
+    ledc_update_duty(VIBRATE_PWM_MODE, VIBRATE_PWM_CHANNEL);
+  }
+}
+
+
+/**
+ * vibrate_add_segment()
+ *
+ * @brief Append a segment to current step.
+ * @param duty: PWM duty to reach
+ * @param ramp_ms: fade duration in milliseconds, 0 to jump to duty
+ * @param hold_ms: segment duration in milliseconds, including ramp
+ **/
+
+static void vibrate_add_segment(uint32_t duty, int ramp_ms, int hold_ms)
+{
+  vibrate_segment_t *p_segment;
+
+  if (g_vibrate.nb_segments >= VIBRATE_MAX_SEGMENTS)
+    return;
+
+  p_segment = &g_vibrate.segments[g_vibrate.nb_segments++];
+  p_segment->duty = duty;
+  p_segment->ramp_ms = ramp_ms;
+  p_segment->hold_us = (hold_ms > 0) ? (int64_t)hold_ms * 1000 : 0;
+  g_vibrate.last_duty = duty;
+}
+
+
+/**
+ * vibrate_add_drive()
+ *
+ * @brief Append segments driving the motor with an envelope. Drives
+ *        starting from rest without a ramp begin with an overdrive kick
+ *        to spin the motor up faster.
+ * @param amplitude: peak amplitude
+ * @param attack_ms: ramp up duration in milliseconds
+ * @param sustain_ms: duration at peak amplitude in milliseconds
+ * @param release_ms: ramp down duration in milliseconds
+ **/
+
+static void vibrate_add_drive(int amplitude, int attack_ms, int sustain_ms, int release_ms)
+{
+  uint32_t duty = vibrate_amplitude_to_duty(amplitude);
+  int kick_ms;
+
+  if (attack_ms > 0)
+    vibrate_add_segment(duty, attack_ms, attack_ms);
+  else
+  {
+    if ((g_vibrate.last_duty == 0) && (sustain_ms > 0) && (g_vibrate.overdrive_ms > 0))
+    {
+      kick_ms = (g_vibrate.overdrive_ms < sustain_ms) ? g_vibrate.overdrive_ms : sustain_ms;
+      vibrate_add_segment(VIBRATE_DUTY_OVERDRIVE, 0, kick_ms);
+      sustain_ms -= kick_ms;
+    }
+    vibrate_add_segment(duty, 0, sustain_ms);
+  }
+
+  if ((attack_ms > 0) && (sustain_ms > 0))
+    vibrate_add_segment(duty, 0, sustain_ms);
+
+  if (release_ms > 0)
+    vibrate_add_segment(0, release_ms, release_ms);
+}
+
+
+/**
+ * vibrate_add_effect()
+ *
+ * @brief Append segments emulating a library effect. Each drive is
+ *        followed by a brake gap with the motor switched off, so that
+ *        consecutive effects are felt as distinct (this motor cannot be
+ *        driven in reverse).
+ * @param effect: effect number, unknown effects play a strong click
+ **/
+
+static void vibrate_add_effect(uint8_t effect)
+{
+  const vibrate_envelope_t *p_envelope = &g_vibrate_envelopes[0];
   int i;
 
-  ESP_LOGI(TAG, "Starting vibration task...");
+  for (i=0; i<VIBRATE_NB_ENVELOPES; i++)
+  {
+    if (g_vibrate_envelopes[i].effect == effect)
+    {
+      p_envelope = &g_vibrate_envelopes[i];
+      break;
+    }
+  }
 
-  /* Drive motor based on vibration_config. */
-  switch (vibration_config->mode)
+  for (i=0; i<p_envelope->repeat; i++)
   {
-    case VIBRATE_DURATION:
-      {
-        ESP_LOGI(TAG, "single vibration enabled");
+    if (i > 0)
+      vibrate_add_segment(0, 0, p_envelope->gap_ms);
+
+    vibrate_add_drive(
+      p_envelope->amplitude,
+      p_envelope->attack_ms,
+      p_envelope->sustain_ms,
+      p_envelope->release_ms
+    );
+  }
+
+  vibrate_add_segment(0, 0, g_vibrate.brake_ms);
+}
+
+
+/**
+ * vibrate_build_step()
+ *
+ * @brief Build segments for the next step of the command being played.
+ * @param now: current time in microseconds
+ * @return true if a step has been built, false at the end of command
+ **/
 
-        /* Enable motor. */
-        gpio_set_level(GPIO_NUM_4, 1);
+static bool vibrate_build_step(int64_t now)
+{
+  vibrate_pattern_t *p_step;
+  uint8_t slot;
+
+  g_vibrate.nb_segments = 0;
+  g_vibrate.segment = 0;
 
-        /* Wait for duration. */
-        vTaskDelay(vibration_config->duration/portTICK_RATE_MS);
+  switch (g_vibrate.command.mode)
+  {
+    case VIBRATE_DURATION:
+      {
+        if (g_vibrate.step > 0)
+          return false;
 
-        /* Stop motor. */
-        gpio_set_level(GPIO_NUM_4, 0);
+        g_vibrate.step_end_us = now + (int64_t)g_vibrate.command.duration * 1000;
+        vibrate_add_drive(VIBRATE_AMPLITUDE_MAX, 0, g_vibrate.command.duration, 0);
       }
       break;
 
     case VIBRATE_PATTERN:
       {
-        ESP_LOGI(TAG, "pattern vibration enabled");
-        for (i=0; i<vibration_config->pattern_length; i++)
-        {
-          if (vibration_config->pattern[i].level == 1)
-          {
-            /* Enable motor. */
-            gpio_set_level(GPIO_NUM_4, 1);
-
-            /* Wait for duration. */
-            vTaskDelay(vibration_config->pattern[i].duration/portTICK_RATE_MS);
-          }
-          else
-          {
-            /* Disable motor. */
-            gpio_set_level(GPIO_NUM_4, 0);
-
-            /* Wait for duration. */
-            vTaskDelay(vibration_config->pattern[i].duration/portTICK_RATE_MS);
-          }
-        }
+        if ((g_vibrate.command.pattern == NULL) || (g_vibrate.step >= g_vibrate.command.pattern_length))
+          return false;
+
+        p_step = &g_vibrate.command.pattern[g_vibrate.step];
+        if (p_step->level == VIBRATE_ON)
+          vibrate_add_drive(VIBRATE_AMPLITUDE_MAX, 0, p_step->duration, 0);
+        else
+          vibrate_add_segment(0, 0, p_step->duration);
       }
       break;
+
+    case VIBRATE_SEQUENCE:
+      {
+        if (g_vibrate.step >= g_vibrate.command.sequence_length)
+          return false;
+
+        slot = g_vibrate.command.sequence[g_vibrate.step];
+        if (slot == VIBRATE_SEQ_END)
+          return false;
+
+        if (VIBRATE_SEQ_IS_WAIT(slot))
+          vibrate_add_segment(0, 0, (slot & 0x7F) * 10);
+        else
+          vibrate_add_effect(slot);
+      }
+      break;
+
+    default:
+      return false;
   }
 
-  /* Free vibration_config. */
-  ESP_LOGI(TAG, "freeing memory ...");
-  free(vibration_config);
+  g_vibrate.step++;
+  return true;
+}
+
+
+/**
+ * vibrate_run()
+ *
+ * @brief Start every segment that is due and arm the timer for the end
+ *        of the current one. Must be called with the engine locked.
+ * @param now: current time in microseconds
+ **/
+
+static void vibrate_run(int64_t now)
+{
+  vibrate_segment_t *p_segment;
+
+  while (g_vibrate.b_playing)
+  {
+    /* Current segment still running. */
+    if (g_vibrate.segment_end_us - now > VIBRATE_TIMER_SLACK_US)
+    {
+      esp_timer_stop(g_vibrate.timer);
+      esp_timer_start_once(g_vibrate.timer, g_vibrate.segment_end_us - now);
+      return;
+    }
+
+    /* Move on to next step if all segments have been played. */
+    if (g_vibrate.segment >= g_vibrate.nb_segments)
+    {
+      if (!vibrate_build_step(now))
+      {
+        vibrate_set_duty(0, 0);
+        g_vibrate.b_playing = false;
+        return;
+      }
+      continue;
+    }
+
+    p_segment = &g_vibrate.segments[g_vibrate.segment++];
+    vibrate_set_duty(p_segment->duty, p_segment->ramp_ms);
+    g_vibrate.segment_end_us = now + p_segment->hold_us;
+  }
+}
+
+
+/**
+ * vibrate_timer_callback()
+ *
+ * @brief Segment timer callback, runs from the esp_timer task.
+ * @param arg: not used
+ **/
+
+static void vibrate_timer_callback(void *arg)
+{
+  xSemaphoreTake(g_vibrate.lock, portMAX_DELAY);
+  vibrate_run(esp_timer_get_time());
+  xSemaphoreGive(g_vibrate.lock);
+}
+
+
+/**
+ * vibrate_extend()
+ *
+ * @brief Extend the duration being played up to a new end time.
+ * @param end_us: new end time in microseconds
+ **/
+
+static void vibrate_extend(int64_t end_us)
+{
+  int64_t delta = end_us - g_vibrate.step_end_us;
+
+  if (delta <= 0)
+    return;
+
+  g_vibrate.step_end_us = end_us;
+  if (g_vibrate.segment < g_vibrate.nb_segments)
+    g_vibrate.segments[g_vibrate.nb_segments - 1].hold_us += delta;
+  else
+    g_vibrate.segment_end_us += delta;
+}
+
+
+/**
+ * vibrate_send()
+ *
+ * @brief Play a command. A duration received while another duration is
+ *        being played extends it (back-to-back taps merge into one
+ *        vibration), any other command preempts the current one.
+ * @param p_command: pointer to a `vibrate_parameter_t` structure
+ * @retval ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+static esp_err_t vibrate_send(vibrate_parameter_t *p_command)
+{
+  int64_t now;
+
+  if (g_vibrate.lock == NULL)
+    return ESP_FAIL;
+
+  xSemaphoreTake(g_vibrate.lock, portMAX_DELAY);
+  now = esp_timer_get_time();
+
+  if (g_vibrate.b_playing &&
+      (g_vibrate.command.mode == VIBRATE_DURATION) &&
+      (p_command->mode == VIBRATE_DURATION))
+  {
+    vibrate_extend(now + (int64_t)p_command->duration * 1000);
+  }
+  else
+  {
+    esp_timer_stop(g_vibrate.timer);
+    memcpy(&g_vibrate.command, p_command, sizeof(vibrate_parameter_t));
+    g_vibrate.step = 0;
+    g_vibrate.nb_segments = 0;
+    g_vibrate.segment = 0;
+    g_vibrate.segment_end_us = now;
+    g_vibrate.last_duty = 0;
+    g_vibrate.b_playing = (p_command->mode != VIBRATE_STOP);
+    if (!g_vibrate.b_playing)
+      vibrate_set_duty(0, 0);
+  }
+
+  vibrate_run(now);
+  xSemaphoreGive(g_vibrate.lock);
+
+  return ESP_OK;
+}
+
+#endif
+
+#ifdef CONFIG_TWATCH_V2
+
+/* Set while DRV2605L is in real-time playback mode. */
+static bool g_vibrate_rtp = false;
+
+
+/**
+ * vibrate_leave_realtime()
+ *
+ * @brief Switch DRV2605L back to internal trigger mode if needed.
+ * @retval ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+static esp_err_t vibrate_leave_realtime(void)
+{
+  if (!g_vibrate_rtp)
+    return ESP_OK;
+
+  if (drv2605_set_realtime_value(0) != ESP_OK)
+    return ESP_FAIL;
+  if (drv2605_set_mode(DRV2605_MODE_INTTRIG) != ESP_OK)
+    return ESP_FAIL;
+
+  g_vibrate_rtp = false;
+  return ESP_OK;
+}
+
+#endif
+
+
+/**
+ * vibrate_append_slot()
+ *
+ * @brief Append a slot to a haptic sequence.
+ * @param p_sequence: pointer to a sequence of VIBRATE_SEQ_SLOTS bytes
+ * @param p_count: pointer to the number of slots already used
+ * @param slot: slot value
+ * @retval true on success, false if sequence is full
+ **/
+
+static bool vibrate_append_slot(uint8_t *p_sequence, int *p_count, uint8_t slot)
+{
+  if (*p_count >= VIBRATE_SEQ_SLOTS)
+    return false;
+
+  p_sequence[(*p_count)++] = slot;
+  return true;
+}
+
+
+/**
+ * vibrate_append_on()
+ *
+ * @brief Append effects vibrating for about the given duration. Library
+ *        alerts last 750 ms and 1000 ms, shorter remainders are rounded
+ *        to a strong buzz or, below 100 ms, to a strong click.
+ * @param p_sequence: pointer to a sequence of VIBRATE_SEQ_SLOTS bytes
+ * @param p_count: pointer to the number of slots already used
+ * @param duration: duration in milliseconds
+ * @retval true on success, false if sequence is full
+ **/
 
-  vTaskDelete( NULL );
+static bool vibrate_append_on(uint8_t *p_sequence, int *p_count, int duration)
+{
+  uint8_t effect;
+
+  do
+  {
+    if (duration >= 1000)
+    {
+      effect = VIBRATE_EFFECT_ALERT_1000MS;
+      duration -= 1000;
+    }
+    else if (duration >= 750)
+    {
+      effect = VIBRATE_EFFECT_ALERT_750MS;
+      duration -= 750;
+    }
+    else
+    {
+      effect = (duration >= 100) ? VIBRATE_EFFECT_STRONG_BUZZ : VIBRATE_EFFECT_STRONG_CLICK;
+      duration = 0;
+    }
+
+    if (!vibrate_append_slot(p_sequence, p_count, effect))
+      return false;
+
+    /* Drop remainders too short to be felt. */
+  } while (duration >= 50);
+
+  return true;
+}
+
+
+/**
+ * vibrate_append_off()
+ *
+ * @brief Append wait slots for the given duration (10 ms resolution).
+ * @param p_sequence: pointer to a sequence of VIBRATE_SEQ_SLOTS bytes
+ * @param p_count: pointer to the number of slots already used
+ * @param duration: duration in milliseconds
+ * @retval true on success, false if sequence is full
+ **/
+
+static bool vibrate_append_off(uint8_t *p_sequence, int *p_count, int duration)
+{
+  int wait;
+
+  while (duration >= 10)
+  {
+    wait = (duration > VIBRATE_SEQ_WAIT_MAX) ? VIBRATE_SEQ_WAIT_MAX : duration;
+    if (!vibrate_append_slot(p_sequence, p_count, VIBRATE_SEQ_WAIT(wait)))
+      return false;
+    duration -= wait;
+  }
+
+  return true;
 }
 
 
@@ -69,12 +582,57 @@ void _twatch_vibration_task(void *parameter)
 esp_err_t twatch_vibrate_init(void)
 {
   #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
-    gpio_config_t motor;
+    ledc_timer_config_t pwm_timer;
+    ledc_channel_config_t pwm_channel;
+    esp_timer_create_args_t timer_args;
+    esp_err_t result;
+
+    /* Drive motor through PWM, on its own LEDC timer (backlight uses 0). */
+    memset(&pwm_timer, 0, sizeof(ledc_timer_config_t));
+    pwm_timer.speed_mode = VIBRATE_PWM_MODE;
+    pwm_timer.duty_resolution = VIBRATE_PWM_RESOLUTION;
+    pwm_timer.timer_num = VIBRATE_PWM_TIMER;
+    pwm_timer.freq_hz = VIBRATE_PWM_FREQ;
+    pwm_timer.clk_cfg = LEDC_AUTO_CLK;
+    if (ledc_timer_config(&pwm_timer) != ESP_OK)
+      return ESP_FAIL;
+
+    memset(&pwm_channel, 0, sizeof(ledc_channel_config_t));
+    pwm_channel.gpio_num = VIBRATE_MOTOR_GPIO;
+    pwm_channel.speed_mode = VIBRATE_PWM_MODE;
+    pwm_channel.channel = VIBRATE_PWM_CHANNEL;
+    pwm_channel.timer_sel = VIBRATE_PWM_TIMER;
+    pwm_channel.duty = 0;
+    pwm_channel.hpoint = 0;
+    if (ledc_channel_config(&pwm_channel) != ESP_OK)
+      return ESP_FAIL;
 
-    /* Configure GPIO. */
-    motor.mode = GPIO_MODE_OUTPUT;
-    motor.pin_bit_mask = (1ULL << GPIO_NUM_4);
-    gpio_config(&motor);
+    /* Ramps use the fade engine, that may already be installed. */
+    result = ledc_fade_func_install(0);
+    g_vibrate.b_fade = ((result == ESP_OK) || (result == ESP_ERR_INVALID_STATE));
+
+    /* Create our segment timer and lock, once. */
+    if (g_vibrate.lock == NULL)
+    {
+      g_vibrate.overdrive_ms = VIBRATE_DEFAULT_OVERDRIVE_MS;
+      g_vibrate.brake_ms = VIBRATE_DEFAULT_BRAKE_MS;
+
+      memset(&timer_args, 0, sizeof(esp_timer_create_args_t));
+      timer_args.callback = vibrate_timer_callback;
+      timer_args.dispatch_method = ESP_TIMER_TASK;
+      timer_args.name = "vibrate";
+      if (esp_timer_create(&timer_args, &g_vibrate.timer) != ESP_OK)
+        return ESP_FAIL;
+
+      #ifdef CONFIG_PM_ENABLE
+        if (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "vibrate", &g_vibrate.pm_lock) != ESP_OK)
+          g_vibrate.pm_lock = NULL;
+      #endif
+
+      g_vibrate.lock = xSemaphoreCreateMutex();
+      if (g_vibrate.lock == NULL)
+        return ESP_FAIL;
+    }
 
     /* Initialized. */
     return ESP_OK;
@@ -88,11 +646,11 @@ esp_err_t twatch_vibrate_init(void)
     if (drv2605_init() == ESP_FAIL)
       return ESP_FAIL;
     
-    /* Set our vibration pattern. */
-    drv2605_select_library(1);
+    /* Default to ERM library A, sequences triggered through GO. */
+    g_vibrate_rtp = false;
+    drv2605_select_library(VIBRATE_LIBRARY_ERM_A);
     drv2605_set_mode(DRV2605_MODE_INTTRIG);
-    drv2605_set_waveform(0, 1);
-    drv2605_set_waveform(1, 0);
+    drv2605_set_sequence(NULL, 0);
 
     /* Success. */
     return ESP_OK;
@@ -109,33 +667,28 @@ esp_err_t twatch_vibrate_init(void)
 esp_err_t twatch_vibrate_vibrate(int duration)
 {
   #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
-    vibrate_parameter_t *parameter = (vibrate_parameter_t *)malloc(sizeof(vibrate_parameter_t));
-    if (parameter != NULL)
-    {
-      parameter->mode = VIBRATE_DURATION;
-      parameter->duration = duration;
-
-      /* Start a vibration task. */
-      xTaskCreate(_twatch_vibration_task, "_vib_task", 10000, parameter, 1, NULL);
+    vibrate_parameter_t command;
 
-      /* Success. */
-      return ESP_OK;
-    }
-    else
-      /* Cannot allocate memory. */
-      return ESP_FAIL;
+    memset(&command, 0, sizeof(vibrate_parameter_t));
+    command.mode = VIBRATE_DURATION;
+    command.duration = duration;
+    return vibrate_send(&command);
   #endif
 
   #ifdef CONFIG_TWATCH_V2
-    drv2605_go();
-    return ESP_OK;
+    vibrate_pattern_t step;
+
+    step.duration = duration;
+    step.level = VIBRATE_ON;
+    return twatch_vibrate_pattern(&step, 1);
   #endif
 }
 
 
 /**
  * @brief Vibrate following a provided pattern
- * @param pattern: array of vibrate_pattern_t structures
+ * @param pattern: array of vibrate_pattern_t structures, must stay valid
+ *                 until the pattern has been played
  * @param length: number of vibrate_pattern_t structures in array
  * @retval ESP_OK on success, ESP_FAIL otherwise
  **/
@@ -143,25 +696,241 @@ esp_err_t twatch_vibrate_vibrate(int duration)
 esp_err_t twatch_vibrate_pattern(vibrate_pattern_t *pattern, int length)
 {
   #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
-    vibrate_parameter_t *parameter = (vibrate_parameter_t *)malloc(sizeof(vibrate_parameter_t));
-    if (parameter != NULL)
-    {
-      parameter->mode = VIBRATE_PATTERN;
-      parameter->pattern = pattern;
-      parameter->pattern_length = length;
+    vibrate_parameter_t command;
 
-      /* Start a vibration task. */
-      xTaskCreate(_twatch_vibration_task, "_vib_task", 10000, parameter, 1, NULL);
+    memset(&command, 0, sizeof(vibrate_parameter_t));
+    command.mode = VIBRATE_PATTERN;
+    command.pattern = pattern;
+    command.pattern_length = length;
+    return vibrate_send(&command);
+  #endif
+
+  #ifdef CONFIG_TWATCH_V2
+    uint8_t sequence[VIBRATE_SEQ_SLOTS];
+    int count;
 
-      /* Success. */
-      return ESP_OK;
+    /* Patterns are played by the chip sequencer, and must fit in it. */
+    count = twatch_vibrate_pattern_to_sequence(pattern, length, sequence);
+    if (count < 0)
+    {
+      ESP_LOGW(TAG, "pattern does not fit in %d sequencer slots", VIBRATE_SEQ_SLOTS);
+      return ESP_FAIL;
     }
+
+    return twatch_vibrate_play_sequence(sequence, count);
+  #endif
+}
+
+
+/**
+ * @brief Stop any vibration in progress
+ * @retval ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_vibrate_stop(void)
+{
+  #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+    vibrate_parameter_t command;
+
+    memset(&command, 0, sizeof(vibrate_parameter_t));
+    command.mode = VIBRATE_STOP;
+    return vibrate_send(&command);
+  #endif
+
+  #ifdef CONFIG_TWATCH_V2
+    if (vibrate_leave_realtime() != ESP_OK)
+      return ESP_FAIL;
+    return drv2605_stop();
+  #endif
+}
+
+
+/**
+ * @brief Translate a timed pattern into a haptic sequence. Off steps
+ *        become wait slots, on steps become library effects of about the
+ *        same duration.
+ * @param pattern: array of vibrate_pattern_t structures
+ * @param length: number of vibrate_pattern_t structures in array
+ * @param p_sequence: pointer to a sequence of VIBRATE_SEQ_SLOTS bytes
+ * @retval number of slots used, -1 if pattern does not fit
+ **/
+
+int twatch_vibrate_pattern_to_sequence(vibrate_pattern_t *pattern, int length, uint8_t *p_sequence)
+{
+  int i, count = 0;
+  bool b_fit;
+
+  for (i=0; i<length; i++)
+  {
+    if (pattern[i].level == VIBRATE_ON)
+      b_fit = vibrate_append_on(p_sequence, &count, pattern[i].duration);
     else
-      /* Cannot allocate memory. */
+      b_fit = vibrate_append_off(p_sequence, &count, pattern[i].duration);
+
+    if (!b_fit)
+      return -1;
+  }
+
+  /* Terminate sequence if there is room left. */
+  if (count < VIBRATE_SEQ_SLOTS)
+    p_sequence[count] = VIBRATE_SEQ_END;
+
+  return count;
+}
+
+
+/**
+ * @brief Select the effect library used by sequences.
+ * @param library: library number (VIBRATE_LIBRARY_*)
+ * @retval ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_vibrate_select_library(uint8_t library)
+{
+  #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+    /* Effect envelopes do not depend on the library. */
+    return (library > VIBRATE_LIBRARY_LRA) ? ESP_FAIL : ESP_OK;
+  #endif
+
+  #ifdef CONFIG_TWATCH_V2
+    if (library > VIBRATE_LIBRARY_LRA)
       return ESP_FAIL;
+    return drv2605_select_library(library);
+  #endif
+}
+
+
+/**
+ * @brief Play a haptic sequence, preempting any vibration in progress.
+ * @param p_sequence: pointer to slot values (effects, waits)
+ * @param length: number of slots (up to VIBRATE_SEQ_SLOTS), the sequence
+ *                also ends at the first VIBRATE_SEQ_END slot
+ * @retval ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_vibrate_play_sequence(const uint8_t *p_sequence, int length)
+{
+  #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+    vibrate_parameter_t command;
+
+    if ((length < 0) || (length > VIBRATE_SEQ_SLOTS))
+      return ESP_FAIL;
+
+    memset(&command, 0, sizeof(vibrate_parameter_t));
+    command.mode = VIBRATE_SEQUENCE;
+    if (length > 0)
+      memcpy(command.sequence, p_sequence, length);
+    command.sequence_length = length;
+    return vibrate_send(&command);
   #endif
 
   #ifdef CONFIG_TWATCH_V2
+    if ((length < 0) || (length > VIBRATE_SEQ_SLOTS))
+      return ESP_FAIL;
+
+    if (vibrate_leave_realtime() != ESP_OK)
+      return ESP_FAIL;
+
+    /* Stop current sequence, load the new one and start it. */
+    if (drv2605_stop() != ESP_OK)
+      return ESP_FAIL;
+    if (drv2605_set_sequence(p_sequence, length) != ESP_OK)
+      return ESP_FAIL;
+    return drv2605_go();
+  #endif
+}
+
+
+/**
+ * @brief Play a single library effect.
+ * @param effect: effect number (1-123)
+ * @retval ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_vibrate_play_effect(uint8_t effect)
+{
+  if ((effect == VIBRATE_SEQ_END) || VIBRATE_SEQ_IS_WAIT(effect))
+    return ESP_FAIL;
+
+  return twatch_vibrate_play_sequence(&effect, 1);
+}
+
+
+/**
+ * @brief Drive motor directly at a given amplitude (real-time playback),
+ *        until amplitude is set back to 0 or another vibration starts.
+ * @param amplitude: amplitude, 0 (stop) to VIBRATE_RTP_MAX
+ * @retval ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_vibrate_realtime(int amplitude)
+{
+  #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+    if (g_vibrate.lock == NULL)
+      return ESP_FAIL;
+
+    if (amplitude > VIBRATE_RTP_MAX)
+      amplitude = VIBRATE_RTP_MAX;
+
+    /* Preempt any command and drive motor directly. */
+    xSemaphoreTake(g_vibrate.lock, portMAX_DELAY);
+    esp_timer_stop(g_vibrate.timer);
+    g_vibrate.b_playing = false;
+    vibrate_set_duty(
+      vibrate_amplitude_to_duty((amplitude * VIBRATE_AMPLITUDE_MAX) / VIBRATE_RTP_MAX),
+      0
+    );
+    xSemaphoreGive(g_vibrate.lock);
+    return ESP_OK;
+  #endif
+
+  #ifdef CONFIG_TWATCH_V2
+    if (amplitude <= 0)
+      return vibrate_leave_realtime();
+
+    if (amplitude > VIBRATE_RTP_MAX)
+      amplitude = VIBRATE_RTP_MAX;
+
+    if (drv2605_set_realtime_value((uint8_t)amplitude) != ESP_OK)
+      return ESP_FAIL;
+
+    if (!g_vibrate_rtp)
+    {
+      if (drv2605_set_mode(DRV2605_MODE_REALTIME) != ESP_OK)
+        return ESP_FAIL;
+      g_vibrate_rtp = true;
+    }
+
+    return ESP_OK;
+  #endif
+}
+
+
+/**
+ * @brief Set kick-start and brake times used by the PWM drive. Effects
+ *        starting from rest begin at full duty for `overdrive_ms`, and
+ *        consecutive effects are separated by `brake_ms` with the motor
+ *        switched off.
+ * @param overdrive_ms: overdrive duration in milliseconds, 0 to disable
+ * @param brake_ms: brake duration in milliseconds, 0 to disable
+ * @retval ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t twatch_vibrate_set_drive(int overdrive_ms, int brake_ms)
+{
+  #if defined(CONFIG_TWATCH_V1) || defined(CONFIG_TWATCH_V3)
+    if ((g_vibrate.lock == NULL) || (overdrive_ms < 0) || (brake_ms < 0))
+      return ESP_FAIL;
+
+    xSemaphoreTake(g_vibrate.lock, portMAX_DELAY);
+    g_vibrate.overdrive_ms = overdrive_ms;
+    g_vibrate.brake_ms = brake_ms;
+    xSemaphoreGive(g_vibrate.lock);
     return ESP_OK;
   #endif
+
+  #ifdef CONFIG_TWATCH_V2
+    /* DRV2605L handles overdrive and braking of library effects. */
+    return ESP_ERR_NOT_SUPPORTED;
+  #endif
 }
@@ -586,6 +586,16 @@ typedef enum {
     AXP1XX_CHARGE_CUR_1320MA,
 } axp1xx_charge_current_t;
 
+  /* Battery status, as returned by axpxx_getBattStatus(). */
+  typedef struct {
+    bool charging;
+    bool connected;
+    int percentage;           /* -1 if gauge is not valid */
+    float voltage;            /* mV */
+    float charge_current;     /* mA */
+    float discharge_current;  /* mA */
+  } axp_batt_status_t;
+
   typedef uint8_t (*axp_com_fptr_t)(uint8_t dev_addr, uint8_t reg_addr, uint8_t *data, uint8_t len);
 
 
@@ -594,6 +604,8 @@ typedef enum {
 
     void axpxx_readByte(uint8_t reg, uint8_t nbytes, uint8_t *data);
     void axpxx_writeByte(uint8_t reg, uint8_t nbytes, uint8_t *data);
+    void axpxx_readBatch(i2c_read_op_t *p_ops, int nb_ops);
+    void axpxx_readBatchPrio(i2c_read_op_t *p_ops, int nb_ops, i2c_xfer_prio_t priority);
     // Power Output Control
     int axpxx_setPowerOutPut(uint8_t ch, bool en);
 
@@ -632,6 +644,9 @@ typedef enum {
 
     bool axpxx_isPEKShortPressIRQ();
     bool axpxx_isPEKLongtPressIRQ();
+    bool axpxx_isChipOverTemperatureIRQ();
+    bool axpxx_isApsLowVoltageLevel1IRQ();
+    bool axpxx_isApsLowVoltageLevel2IRQ();
     bool axpxx_isTimerTimeoutIRQ();
 
     //! Group4 ADC data
@@ -648,14 +663,18 @@ typedef enum {
     float axpxx_getBattChargeCurrent();
     float axpxx_getBattDischargeCurrent();
     float axpxx_getSysIPSOUTVoltage();
+    int axpxx_getBattStatus(axp_batt_status_t *p_status);
+    int axpxx_getCurrents(float *p_charge, float *p_discharge, float *p_vbus);
     uint32_t axpxx_getBattChargeCoulomb();
     uint32_t axpxx_getBattDischargeCoulomb();
+    int axpxx_getCoulombCounters(uint32_t *p_charge, uint32_t *p_discharge, int *p_rate);
     float axpxx_getSettingChargeCurrent();
 
     int axpxx_setChargingTargetVoltage(axp_chargeing_vol_t param);
     int axpxx_enableChargeing(bool en);
 
     int axpxx_adc1Enable(uint16_t params, bool en);
+    uint8_t axpxx_getAdc1Enable();
     int axpxx_adc2Enable(uint16_t params, bool en);
 
     int axpxx_setTScurrent(axp_ts_pin_current_t current);
@@ -691,6 +710,7 @@ typedef enum {
     int axpxx_enableIRQ(uint64_t params, bool en);
     int axpxx_readIRQ();
     void axpxx_clearIRQ();
+    void axpxx_ackIRQ();
 
     int axpxx_setDCDC1Voltage(uint16_t mv); //! Only AXP192 support and AXP173
     // return mv
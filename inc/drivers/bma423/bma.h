@@ -19,6 +19,7 @@ typedef struct bma4_accel Accel;
 typedef struct bma4_accel_config Acfg;
 
 esp_err_t bma_init(void);
+bool bma_is_configured(void);
 
 void bma_reset();
 uint8_t bma_direction();
@@ -0,0 +1,78 @@
+#ifndef __INC_DRIVERS_CASIC_H
+#define __INC_DRIVERS_CASIC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+/**
+ * CASIC binary protocol, as spoken by the L76K GPS module:
+ *
+ *   0xBA 0xCE | length (u16 LE) | class | id | payload | checksum (u32 LE)
+ *
+ * Checksum is (id << 24) + (class << 16) + length, plus the sum of the
+ * payload read as little-endian 32-bit words.
+ **/
+
+#define CASIC_SYNC1             0xBA
+#define CASIC_SYNC2             0xCE
+#define CASIC_HEADER_LEN        6
+#define CASIC_CHECKSUM_LEN      4
+#define CASIC_MAX_PAYLOAD       128
+
+/* Message classes and IDs. */
+#define CASIC_CLASS_NAV         0x01
+#define CASIC_CLASS_ACK         0x05
+#define CASIC_CLASS_CFG         0x06
+
+#define CASIC_ID_NAV_PV         0x03
+#define CASIC_ID_NAV_TIMEUTC    0x10
+#define CASIC_ID_ACK_NAK        0x00
+#define CASIC_ID_ACK_ACK        0x01
+#define CASIC_ID_CFG_MSG        0x01
+
+typedef enum {
+  CASIC_WAIT_SYNC1,
+  CASIC_WAIT_SYNC2,
+  CASIC_LEN_LO,
+  CASIC_LEN_HI,
+  CASIC_CLASS,
+  CASIC_ID,
+  CASIC_PAYLOAD,
+  CASIC_CHECKSUM
+} casic_state_t;
+
+typedef struct t_casic_parser casic_parser_t;
+
+typedef void (*FCasicFrameHandler)(casic_parser_t *p_parser, uint8_t msg_class, uint8_t msg_id, uint8_t *p_payload, int len);
+
+struct t_casic_parser {
+  /* Parser state, carried across calls. */
+  casic_state_t state;
+  uint16_t len;
+  uint8_t msg_class;
+  uint8_t msg_id;
+  uint8_t payload[CASIC_MAX_PAYLOAD];
+  int pos;
+  uint32_t checksum;
+
+  /* Callback. */
+  FCasicFrameHandler pfn_frame_handler;
+  void *p_user_data;
+
+  /* Statistics. */
+  uint32_t nb_frames;
+  uint32_t nb_checksum_errors;
+  uint32_t nb_framing_errors;
+};
+
+void casic_parser_init(casic_parser_t *p_parser, FCasicFrameHandler pfn_frame_handler, void *p_user_data);
+void casic_parser_reset(casic_parser_t *p_parser);
+bool casic_parser_busy(casic_parser_t *p_parser);
+void casic_parser_push(casic_parser_t *p_parser, uint8_t byte);
+uint32_t casic_checksum(uint8_t msg_class, uint8_t msg_id, uint8_t *p_payload, int len);
+int casic_build_frame(uint8_t *p_frame, int size, uint8_t msg_class, uint8_t msg_id, uint8_t *p_payload, int len);
+
+#endif /* __INC_DRIVERS_CASIC_H */
@@ -57,6 +57,10 @@
 #define DRV2605_REG_WAVESEQ7        0x0A ///< Waveform sequence register 7
 #define DRV2605_REG_WAVESEQ8        0x0B ///< Waveform sequence register 8
 
+#define DRV2605_WAVESEQ_SLOTS       8     ///< Number of waveform sequencer slots
+#define DRV2605_WAVESEQ_END         0x00  ///< Slot value ending a sequence
+#define DRV2605_WAVESEQ_WAIT        0x80  ///< Slot is a wait of (value & 0x7F) * 10 ms
+
 #define DRV2605_REG_GO              0x0C         ///< Go register
 #define DRV2605_REG_OVERDRIVE       0x0D  ///< Overdrive time offset register
 #define DRV2605_REG_SUSTAINPOS      0x0E ///< Sustain time offset, positive register
@@ -91,6 +95,7 @@
 
 esp_err_t drv2605_init(void);
 esp_err_t drv2605_set_waveform(uint8_t slot, uint8_t w);
+esp_err_t drv2605_set_sequence(const uint8_t *p_slots, int count);
 esp_err_t drv2605_select_library(uint8_t lib);
 esp_err_t drv2605_go(void);
 esp_err_t drv2605_stop(void);
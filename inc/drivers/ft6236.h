@@ -33,6 +33,7 @@
 #include <stdbool.h>
 
 #define FT6236_I2C_SLAVE_ADDR   0x38
+#define FT6236_IRQ_GPIO         GPIO_NUM_38
 #define FT6236_MAX_QUEUE_EVENTS (10)
 
 /* Maximum border values of the touchscreen pad that the chip can handle */
@@ -135,6 +136,8 @@
 #define FT6X36_CHIPSELECT_REG            0xA3       /* 0x36 for ft6236; 0x06 for ft6206 */
 
 #define FT6X36_POWER_MODE_REG            0xA5
+#define FT6X36_POWER_MODE_ACTIVE         0x00        /* Normal operation (active or monitor) */
+#define FT6X36_POWER_MODE_HIBERNATE      0x03        /* Deep sleep, only a hardware reset wakes the chip up */
 #define FT6X36_FIRMWARE_ID_REG           0xA6
 #define FT6X36_RELEASECODE_REG           0xAF
 #define FT6X36_PANEL_ID_REG              0xA8
@@ -169,7 +172,9 @@ typedef void (*FT6X36_IRQ_HANDLER)(void);
   * @retval None
   */
 void ft6x36_init(uint16_t dev_addr, FT6X36_IRQ_HANDLER pfn_handler);
+void ft6x36_ack_irq(void);
 bool ft6x36_read(ft6236_touch_t *touch);
+bool ft6x36_parse_report(uint8_t *report, ft6236_touch_t *touch);
 
 esp_err_t ft6x36_enable_active_mode(void);
 esp_err_t ft6x36_enable_monitor_mode(void);
@@ -184,6 +189,9 @@ esp_err_t ft6x36_set_min_distance_move_ud(uint8_t distance);
 esp_err_t ft6x36_get_min_distance_move_lr(uint8_t *distance);
 esp_err_t ft6x36_set_touch_threshold(uint8_t threshold);
 esp_err_t ft6x36_set_active_period(uint8_t period);
+esp_err_t ft6x36_set_monitor_period(uint8_t period);
+esp_err_t ft6x36_set_monitor_timeout(uint8_t seconds);
+esp_err_t ft6x36_hibernate(void);
 
 
 #endif /* __INC_DRIVER_FT6236_H */
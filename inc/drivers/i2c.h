@@ -1,6 +1,9 @@
 #ifndef __INC_DRIVERS_I2C_H
 #define __INC_DRIVERS_I2C_H
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
 #include "driver/gpio.h"
 #include "driver/i2c.h"
 
@@ -9,11 +12,129 @@
 #define I2C_SEC_SDA_PIN (23)
 #define I2C_SEC_SCL_PIN (32)
 
+/* Asynchronous transactions worker configuration. */
+#define I2C_XFER_QUEUE_SIZE     8
+#define I2C_XFER_TASK_STACK     3072
+#define I2C_XFER_TASK_PRIORITY  10
+
+/* Maximum number of register reads combined in a single batch. */
+#define I2C_BATCH_MAX_OPS       8
+
+/* Static command link buffer size (per bus), sized for a full batch. */
+#define I2C_LINK_BUFFER_SIZE    I2C_LINK_RECOMMENDED_SIZE(2*I2C_BATCH_MAX_OPS)
+
 typedef enum {
   I2C_PRI,
   I2C_SEC
 } i2c_bus_t;
 
+/**
+ * Bus telemetry (CONFIG_TWATCH_I2C_TELEMETRY).
+ *
+ * Latency histogram buckets (transaction duration, bus lock excluded):
+ * <50us, <100us, <200us, <500us, <1ms, <2ms, <5ms, >=5ms.
+ **/
+
+#define I2C_STATS_MAX_DEVICES       8
+#define I2C_STATS_LATENCY_BUCKETS   8
+#define I2C_STATS_ADDR_UNKNOWN      0xFF  /* Raw commands (twatch_i2c_master_cmd_begin) */
+
+typedef struct {
+  uint8_t addr;
+  uint32_t nb_xfers;
+  uint32_t nb_bytes;
+  uint32_t nb_errors;
+  uint32_t nb_timeouts;
+  uint32_t max_latency_us;
+  uint32_t latency_hist[I2C_STATS_LATENCY_BUCKETS];
+} i2c_dev_stats_t;
+
+typedef struct {
+  /* Bus totals. */
+  uint32_t nb_xfers;
+  uint32_t nb_bytes;
+  uint32_t nb_errors;
+  uint32_t nb_timeouts;
+
+  /* Occupancy: time spent in transactions since last reset. */
+  uint64_t busy_us;
+  uint64_t elapsed_us;
+  uint8_t busy_percent;
+
+  /* Bus mutex contention. */
+  uint64_t lock_wait_us;
+  uint32_t max_lock_wait_us;
+
+  /* Per-device statistics. */
+  int nb_devices;
+  i2c_dev_stats_t devices[I2C_STATS_MAX_DEVICES];
+} i2c_bus_stats_t;
+
+/**
+ * Asynchronous transaction priority. Touch, user button, PMU interrupt
+ * status and sensor reads should use I2C_XFER_PRIO_HIGH, device setup
+ * I2C_XFER_PRIO_NORMAL and periodic polling (battery ADC, coulomb counter)
+ * I2C_XFER_PRIO_LOW.
+ **/
+
+typedef enum {
+  I2C_XFER_PRIO_HIGH,
+  I2C_XFER_PRIO_NORMAL,
+  I2C_XFER_PRIO_LOW,
+  I2C_XFER_PRIO_MAX
+} i2c_xfer_prio_t;
+
+typedef enum {
+  I2C_XFER_READ,
+  I2C_XFER_WRITE,
+  I2C_XFER_READ_BATCH
+} i2c_xfer_type_t;
+
+/**
+ * Batched register read: `len` bytes are read from register `reg` into
+ * `data`. All operations of a batch target the same device and are sent
+ * as a single transaction (repeated START between operations).
+ **/
+
+typedef struct {
+  uint8_t reg;
+  uint8_t *data;
+  uint16_t len;
+} i2c_read_op_t;
+
+typedef struct t_i2c_xfer i2c_xfer_t;
+
+/* Completion callback, called from the bus worker task. */
+typedef void (*FI2CXferCallback)(i2c_xfer_t *p_xfer);
+
+/**
+ * Asynchronous transaction descriptor. Memory is owned by the caller and
+ * must remain valid until the transaction completes.
+ **/
+
+typedef struct t_i2c_xfer {
+  /* Transaction parameters. */
+  i2c_xfer_type_t type;
+  i2c_xfer_prio_t priority;
+  uint8_t addr;
+  uint8_t reg;
+  uint8_t *data;
+  uint16_t len;
+  TickType_t ticks_to_wait;
+
+  /* Batched read operations (I2C_XFER_READ_BATCH only). */
+  i2c_read_op_t *p_ops;
+  int nb_ops;
+
+  /* Completion: callback and/or task notification (may be NULL). */
+  FI2CXferCallback pfn_callback;
+  TaskHandle_t notify_task;
+  void *p_user_data;
+
+  /* Transaction result, set before completion is signaled. */
+  volatile esp_err_t result;
+} i2c_xfer_t;
+
 void twatch_i2c_init(void);
 esp_err_t twatch_i2c_master_cmd_begin(i2c_bus_t bus, i2c_cmd_handle_t cmd, TickType_t ticks_to_wait);
 
@@ -35,5 +156,51 @@ esp_err_t twatch_i2c_writeBytes(
   TickType_t ticks_to_wait
 );
 
+esp_err_t twatch_i2c_readBatch(
+  i2c_bus_t bus,
+  uint8_t addr,
+  i2c_read_op_t *p_ops,
+  int nb_ops,
+  TickType_t ticks_to_wait
+);
+
+/* Bus telemetry. */
+esp_err_t twatch_i2c_get_stats(i2c_bus_t bus, i2c_bus_stats_t *p_stats);
+void twatch_i2c_reset_stats(i2c_bus_t bus);
+
+/* Asynchronous transactions. */
+esp_err_t twatch_i2c_submit(i2c_bus_t bus, i2c_xfer_t *p_xfer, TickType_t ticks_to_wait);
+esp_err_t twatch_i2c_submit_from_isr(i2c_bus_t bus, i2c_xfer_t *p_xfer, BaseType_t *p_task_woken);
+esp_err_t twatch_i2c_transfer(i2c_bus_t bus, i2c_xfer_t *p_xfer, TickType_t ticks_to_wait);
+
+/* Blocking transactions scheduled through the bus priority queues. */
+esp_err_t twatch_i2c_readBytesPrio(
+  i2c_bus_t bus,
+  i2c_xfer_prio_t priority,
+  uint8_t addr,
+  uint8_t reg,
+  uint8_t *data,
+  uint16_t len,
+  TickType_t ticks_to_wait
+);
+
+esp_err_t twatch_i2c_writeBytesPrio(
+  i2c_bus_t bus,
+  i2c_xfer_prio_t priority,
+  uint8_t addr,
+  uint8_t reg,
+  uint8_t *data,
+  uint16_t len,
+  TickType_t ticks_to_wait
+);
+
+esp_err_t twatch_i2c_readBatchPrio(
+  i2c_bus_t bus,
+  i2c_xfer_prio_t priority,
+  uint8_t addr,
+  i2c_read_op_t *p_ops,
+  int nb_ops,
+  TickType_t ticks_to_wait
+);
 
 #endif /* __INC_DRIVERS_I2C_H */
@@ -0,0 +1,65 @@
+#ifndef __INC_DRIVERS_NMEA_H
+#define __INC_DRIVERS_NMEA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+/* NMEA 0183 limits a sentence to 82 characters, fields are much shorter. */
+#define NMEA_FIELD_MAXLEN     23
+#define NMEA_SENTENCE_MAXLEN  82
+
+typedef enum {
+  NMEA_WAIT_START,    /* Waiting for a '$' marker. */
+  NMEA_IN_SENTENCE,   /* Accumulating fields. */
+  NMEA_CHECKSUM_HI,   /* Expecting checksum high nibble. */
+  NMEA_CHECKSUM_LO    /* Expecting checksum low nibble. */
+} nmea_state_t;
+
+typedef struct t_nmea_parser nmea_parser_t;
+
+/**
+ * Field callback, called once for every field including the address field
+ * (index 0, e.g. "GNGGA"). Fields are delivered before the checksum is
+ * known, so values must be staged and only committed by the sentence
+ * callback.
+ **/
+
+typedef void (*FNmeaFieldHandler)(nmea_parser_t *p_parser, int field_index, char *psz_field, int len);
+
+/**
+ * Sentence callback, called once the checksum has been received with
+ * b_valid set to true if it matched.
+ **/
+
+typedef void (*FNmeaSentenceHandler)(nmea_parser_t *p_parser, bool b_valid);
+
+struct t_nmea_parser {
+  /* Parser state, carried across calls. */
+  nmea_state_t state;
+  uint8_t parity;
+  uint8_t checksum;
+  int field_index;
+  char field[NMEA_FIELD_MAXLEN + 1];
+  int field_len;
+  int sentence_len;
+
+  /* Callbacks. */
+  FNmeaFieldHandler pfn_field_handler;
+  FNmeaSentenceHandler pfn_sentence_handler;
+  void *p_user_data;
+
+  /* Statistics. */
+  uint32_t nb_sentences;
+  uint32_t nb_checksum_errors;
+  uint32_t nb_framing_errors;
+};
+
+void nmea_parser_init(nmea_parser_t *p_parser, FNmeaFieldHandler pfn_field_handler, FNmeaSentenceHandler pfn_sentence_handler, void *p_user_data);
+void nmea_parser_reset(nmea_parser_t *p_parser);
+void nmea_parser_push(nmea_parser_t *p_parser, uint8_t byte);
+void nmea_parser_feed(nmea_parser_t *p_parser, uint8_t *p_data, int len);
+
+#endif /* __INC_DRIVERS_NMEA_H */
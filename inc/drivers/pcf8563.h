@@ -14,6 +14,7 @@
 
 
 #define PCF8563_SLAVE_ADDRESS   (0x51) //7-bit I2C Address
+#define PCF8563_IRQ_GPIO        GPIO_NUM_37
 
 /**
  * Register map (addresses)
@@ -113,6 +114,7 @@ esp_err_t pcf8563_get_date_time(pcf8563_datetime_t *p_datetime_t);
 esp_err_t pcf8563_set_alarm(pcf8563_alarm_t *p_alarm);
 esp_err_t pcf8563_get_alarm(pcf8563_alarm_t *p_alarm);
 void pcf8563_enable_alarm(bool enable);
+bool pcf8563_is_alarm_pending(void);
 
 
 
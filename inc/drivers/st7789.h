@@ -88,6 +88,8 @@ void st7789_set_inverted(bool inverted);
 bool st7789_is_inverted(void);
 void st7789_blank(void);
 void st7789_commit_fb(void);
+int st7789_compress_fb(uint8_t *p_dst, int max_size);
+esp_err_t st7789_decompress_fb(const uint8_t *p_src, int size);
 void st7789_set_pixel(int x, int y, uint8_t pixel);
 uint8_t st7789_get_pixel(int x, int y);
 void st7789_fill_region(int x, int y, int width, int height, uint8_t color);
@@ -21,9 +21,43 @@
 #define BUF_SIZE         (1024)
 #define RD_BUF_SIZE      (BUF_SIZE)
 
+/**
+ * Line mode: the UART peripheral detects the end-of-line character and the
+ * driver reports a UART_PATTERN_DET event for each complete line. Lines
+ * are read straight into buffers taken from a small static pool and handed
+ * to the caller by pointer, the caller gives them back once processed.
+ **/
+
+#define TWATCH_UART_LINE_MAXLEN     128   /* Longest line kept, NMEA max is 82. */
+#define TWATCH_UART_LINE_POOL       4     /* Number of line buffers. */
+#define TWATCH_UART_PATTERN_QUEUE   16    /* Pending end-of-line positions. */
+
+/* RX interrupt tuning (thresholds in bytes, timeouts in character times).
+   In line mode the end-of-line interrupt delivers data, so the idle
+   timeout is stretched to avoid waking up on every inter-sentence gap. */
+#define TWATCH_UART_RX_FULL_THRESH  120
+#define TWATCH_UART_RX_TOUT_RAW     10
+#define TWATCH_UART_RX_TOUT_LINE    100
+
+typedef struct {
+  uint8_t data[TWATCH_UART_LINE_MAXLEN];
+  int len;              /* Number of bytes in data, including end-of-line. */
+  bool b_truncated;     /* Line was longer than TWATCH_UART_LINE_MAXLEN. */
+} twatch_uart_line_t;
+
 esp_err_t twatch_uart_init(int baudrate);
 esp_err_t twatch_uart_transmit(uint8_t *p_buffer, int len);
-esp_err_t twatch_uart_receive(uint8_t *p_buffer, int len);
-bool twatch_uart_wait_event(uart_event_t *p_uart_event);
+int twatch_uart_receive(uint8_t *p_buffer, int len, TickType_t ticks_to_wait);
+bool twatch_uart_wait_event(uart_event_t *p_uart_event, TickType_t ticks_to_wait);
+esp_err_t twatch_uart_flush(void);
+esp_err_t twatch_uart_set_baudrate(int baudrate);
+int twatch_uart_get_buffered_len(void);
+
+/* Line mode. */
+esp_err_t twatch_uart_enable_line_mode(char eol);
+esp_err_t twatch_uart_disable_line_mode(void);
+bool twatch_uart_is_line_mode(void);
+twatch_uart_line_t *twatch_uart_get_line(void);
+void twatch_uart_release_line(twatch_uart_line_t *p_line);
 
 #endif /* __INC_DRIVERS_UART_H */
\ No newline at end of file
@@ -11,12 +11,67 @@
 #define SOUND_DEFAULT_I2S_PORT  (0)
 #define SOUND_DEFAULT_SAMPLE_RATE (44100)
 
+/**
+ * Playback pipeline: producers write 16-bit stereo frames into a ring
+ * buffer (or hand over a whole buffer played in place), and a feeder task
+ * moves them into I2S DMA buffers one DMA buffer at a time. The DMA depth
+ * plus the ring buffer are what keep playback going while other tasks
+ * are busy.
+ **/
+
+#define AUDIO_FRAME_SIZE              (4)       /* 16-bit stereo. */
+#define AUDIO_DEFAULT_DMA_BUF_COUNT   (8)
+#define AUDIO_DEFAULT_DMA_BUF_LEN     (256)     /* Frames per DMA buffer. */
+#define AUDIO_DEFAULT_RING_SIZE       (16384)   /* Bytes, about 90ms at 44.1kHz. */
+#define AUDIO_DEFAULT_TASK_PRIORITY   (10)
+#define AUDIO_IDLE_MS                 (100)     /* Silence sent before stopping. */
+
+typedef struct {
+  int sample_rate;
+  int dma_buf_count;
+  int dma_buf_len;            /* Frames per DMA buffer, also the feeder block size. */
+  size_t ring_size;           /* Ring buffer size in bytes. */
+  UBaseType_t task_priority;  /* Feeder task priority, keep it above UI. */
+  BaseType_t task_core;       /* Feeder task core, or tskNO_AFFINITY. */
+} twatch_audio_config_t;
+
+/**
+ * Render callback of a source played by the feeder task: fill `p_block`
+ * with up to `frames` 16-bit stereo frames and return how many were
+ * written, less than `frames` meaning the source is exhausted.
+ **/
+
+typedef int (*FAudioRender)(void *p_source, int16_t *p_block, int frames);
+
+typedef struct {
+  uint32_t underruns;         /* Ring ran dry while a stream was playing. */
+  uint32_t frames_played;     /* Frames taken from producers. */
+  uint32_t frames_silence;    /* Silence frames inserted. */
+  size_t ring_min_free;       /* Lowest free space seen in ring buffer. */
+} twatch_audio_stats_t;
+
 /* Initialize 16-bit sound system. */
 esp_err_t twatch_audio_init(int sample_rate);
+void twatch_audio_get_default_config(twatch_audio_config_t *p_config, int sample_rate);
+esp_err_t twatch_audio_init_config(twatch_audio_config_t *p_config);
+int twatch_audio_get_sample_rate(void);
+void twatch_audio_wake(void);
 
 /* Send samples to sound system. */
 esp_err_t twatch_audio_send_samples(void *samples, size_t samples_size, size_t *p_bytes_written, TickType_t ticks_to_wait);
 
+/* Non-blocking playback. */
+size_t twatch_audio_queue(void *samples, size_t samples_size);
+esp_err_t twatch_audio_play_buffer(const void *samples, size_t samples_size);
+esp_err_t twatch_audio_play_source(FAudioRender pfn_render, void *p_source);
+esp_err_t twatch_audio_stop(void);
+bool twatch_audio_is_playing(void);
+size_t twatch_audio_get_free(void);
+
+/* Statistics. */
+void twatch_audio_get_stats(twatch_audio_stats_t *p_stats);
+void twatch_audio_reset_stats(void);
+
 /* Deinitialize 16-bit sound system. */
 esp_err_t twatch_audio_deinit(void);
 
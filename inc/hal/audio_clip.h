@@ -0,0 +1,66 @@
+#ifndef __INC_AUDIO_CLIP_H
+#define __INC_AUDIO_CLIP_H
+
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+#include "esp_err.h"
+#include "hal/audio.h"
+
+/**
+ * IMA ADPCM clips (see tools/adpcm_encode.py), 4 bits per sample:
+ *
+ *   header : magic "IMA4", sample rate (uint32 LE), number of frames
+ *            (uint32 LE), block size (uint16 LE), channels (uint8), 0
+ *   blocks : same layout as WAV IMA ADPCM, i.e. for each channel a first
+ *            sample (int16 LE) and step index (uint8, then 0), followed by
+ *            groups of 4 bytes per channel holding 8 samples each, low
+ *            nibble first.
+ *
+ * Clips are decoded on the fly from wherever they are mapped (usually a
+ * const array in flash), only the current group of 8 frames is kept in RAM.
+ * Mono clips are upmixed to stereo and clips are resampled to the output
+ * rate with linear interpolation.
+ **/
+
+#define AUDIO_CLIP_MAGIC        0x34414d49  /* "IMA4" */
+#define AUDIO_CLIP_HEADER_SIZE  16
+#define AUDIO_CLIP_GROUP_FRAMES 8
+
+typedef struct {
+  /* Clip description. */
+  const uint8_t *p_data;
+  size_t data_size;
+  uint32_t sample_rate;
+  uint32_t nb_frames;
+  int block_size;
+  int channels;
+  bool b_loop;
+
+  /* Decoder state. */
+  size_t block_offset;          /* Offset of next block in data. */
+  const uint8_t *p_read;        /* Next group in current block. */
+  const uint8_t *p_block_end;
+  int16_t predictor[2];
+  uint8_t index[2];
+  int16_t group[AUDIO_CLIP_GROUP_FRAMES][2];
+  int group_len;
+  int group_pos;
+  uint32_t frames_decoded;
+
+  /* Resampler state. */
+  uint32_t step;                /* Input frames per output frame, 16.16. */
+  uint32_t phase;
+  int16_t prev[2];
+  int16_t cur[2];
+  bool b_last_frame;            /* Input exhausted, last frame being played. */
+} twatch_audio_clip_t;
+
+esp_err_t twatch_audio_clip_open(twatch_audio_clip_t *p_clip, const void *p_data, size_t size);
+void twatch_audio_clip_rewind(twatch_audio_clip_t *p_clip);
+void twatch_audio_clip_set_loop(twatch_audio_clip_t *p_clip, bool b_loop);
+uint32_t twatch_audio_clip_get_duration_ms(twatch_audio_clip_t *p_clip);
+int twatch_audio_clip_render(void *p_clip, int16_t *p_block, int frames);
+esp_err_t twatch_audio_clip_play(twatch_audio_clip_t *p_clip);
+
+#endif /* __INC_AUDIO_CLIP_H */
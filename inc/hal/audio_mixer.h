@@ -0,0 +1,56 @@
+#ifndef __INC_AUDIO_MIXER_H
+#define __INC_AUDIO_MIXER_H
+
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+#include "esp_err.h"
+#include "hal/audio.h"
+#include "hal/audio_clip.h"
+
+/**
+ * Software mixer: up to AUDIO_MIXER_VOICES voices are rendered by the
+ * audio feeder task, scaled by their gain and pan, and summed with
+ * saturation on top of the streamed samples, one DMA-sized block at a
+ * time.
+ *
+ * Starting a voice returns a handle (>= 0). When all voices are busy, the
+ * oldest voice with the lowest priority not above the new one is stolen.
+ **/
+
+#define AUDIO_MIXER_VOICES      8
+#define AUDIO_MIXER_UNITY       256     /* Gain of 1.0. */
+#define AUDIO_MIXER_PAN_LEFT    (-128)
+#define AUDIO_MIXER_PAN_CENTER  0
+#define AUDIO_MIXER_PAN_RIGHT   128
+
+typedef int twatch_audio_voice_t;
+
+typedef struct {
+  uint32_t nb_blocks;         /* Blocks mixed with at least one voice. */
+  uint32_t last_block_us;     /* Mixing time of last block. */
+  uint32_t max_block_us;      /* Worst mixing time seen. */
+  uint32_t block_period_us;   /* Time budget of a block at output rate. */
+  uint32_t nb_stolen;         /* Voices stolen to start new ones. */
+  int max_voices;             /* Most voices mixed at once. */
+} twatch_audio_mixer_stats_t;
+
+/* Used by audio feeder. */
+esp_err_t audio_mixer_setup(int block_frames);
+void audio_mixer_teardown(void);
+int audio_mixer_mix(int16_t *p_block, int frames);
+
+/* Voices. */
+twatch_audio_voice_t twatch_audio_mixer_play_pcm(const int16_t *p_frames, size_t nb_frames, bool b_loop, int gain, int pan, int priority);
+twatch_audio_voice_t twatch_audio_mixer_play_clip(const void *p_clip, size_t size, bool b_loop, int gain, int pan, int priority);
+twatch_audio_voice_t twatch_audio_mixer_play_source(FAudioRender pfn_render, void *p_source, int gain, int pan, int priority);
+esp_err_t twatch_audio_mixer_stop(twatch_audio_voice_t voice);
+esp_err_t twatch_audio_mixer_stop_all(void);
+esp_err_t twatch_audio_mixer_set_gain(twatch_audio_voice_t voice, int gain, int pan);
+bool twatch_audio_mixer_is_playing(twatch_audio_voice_t voice);
+
+/* Statistics. */
+void twatch_audio_mixer_get_stats(twatch_audio_mixer_stats_t *p_stats);
+void twatch_audio_mixer_reset_stats(void);
+
+#endif /* __INC_AUDIO_MIXER_H */
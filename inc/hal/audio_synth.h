@@ -0,0 +1,111 @@
+#ifndef __INC_AUDIO_SYNTH_H
+#define __INC_AUDIO_SYNTH_H
+
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+#include "esp_err.h"
+#include "hal/audio.h"
+#include "hal/audio_mixer.h"
+
+/**
+ * Tone synthesizer: a wavetable oscillator shaped by an ADSR envelope,
+ * driven by a compact byte sequence. Sequences are made of:
+ *
+ *   SYNTH_NOTE(n, d)          : MIDI note n (0 is a rest) for d ticks
+ *   SYNTH_WAVE(w)             : select waveform
+ *   SYNTH_TICK(ms)            : set tick duration in milliseconds
+ *   SYNTH_VOLUME(v)           : set volume (0-255)
+ *   SYNTH_ENVELOPE(a,d,s,r)   : attack, decay and release in 10ms units,
+ *                               sustain level (0-255)
+ *   SYNTH_REPEAT(n)           : play sequence again n more times (0: forever)
+ *   SYNTH_END                 : end of sequence
+ *
+ * A note is released so that its release ends with its last tick. Samples
+ * are rendered on the fly into feeder blocks, nothing is allocated.
+ **/
+
+#define SYNTH_CMD_WAVE      0x80
+#define SYNTH_CMD_TICK      0x81
+#define SYNTH_CMD_VOLUME    0x82
+#define SYNTH_CMD_ENVELOPE  0x83
+#define SYNTH_CMD_REPEAT    0x84
+#define SYNTH_CMD_END       0xff
+
+#define SYNTH_NOTE(n, d)          (n), (d)
+#define SYNTH_WAVE(w)             SYNTH_CMD_WAVE, (w)
+#define SYNTH_TICK(ms)            SYNTH_CMD_TICK, (ms)
+#define SYNTH_VOLUME(v)           SYNTH_CMD_VOLUME, (v)
+#define SYNTH_ENVELOPE(a,d,s,r)   SYNTH_CMD_ENVELOPE, (a), (d), (s), (r)
+#define SYNTH_REPEAT(n)           SYNTH_CMD_REPEAT, (n)
+#define SYNTH_END                 SYNTH_CMD_END
+
+#define SYNTH_REST          0
+
+/* Handy MIDI notes. */
+#define SYNTH_C4            60
+#define SYNTH_E4            64
+#define SYNTH_G4            67
+#define SYNTH_A4            69
+#define SYNTH_C5            72
+#define SYNTH_E5            76
+#define SYNTH_G5            79
+#define SYNTH_C6            84
+
+typedef enum {
+  SYNTH_SINE,
+  SYNTH_SQUARE,
+  SYNTH_TRIANGLE
+} synth_wave_t;
+
+typedef enum {
+  SYNTH_ENV_IDLE,
+  SYNTH_ENV_ATTACK,
+  SYNTH_ENV_DECAY,
+  SYNTH_ENV_SUSTAIN,
+  SYNTH_ENV_RELEASE
+} synth_env_state_t;
+
+typedef struct {
+  /* Sequence. */
+  const uint8_t *p_sequence;
+  int pos;
+  int repeat;
+  bool b_repeat_set;
+
+  /* Settings. */
+  synth_wave_t wave;
+  uint32_t tick_ms;
+  int volume;
+  uint8_t attack;
+  uint8_t decay;
+  uint8_t sustain;
+  uint8_t release;
+
+  /* Oscillator, 32-bit phase accumulator. */
+  uint32_t phase;
+  uint32_t phase_inc;
+
+  /* Envelope, level in Q24. */
+  synth_env_state_t env_state;
+  int32_t level;
+  int32_t level_inc;
+  int32_t sustain_level;
+
+  /* Current note. */
+  uint32_t note_samples;    /* Samples left in note. */
+  uint32_t gate_samples;    /* Samples left before release. */
+  int rate;
+} twatch_audio_synth_t;
+
+/* Built-in sounds. */
+extern const uint8_t twatch_synth_beep[];
+extern const uint8_t twatch_synth_chime[];
+extern const uint8_t twatch_synth_alarm[];
+
+void twatch_audio_synth_init(twatch_audio_synth_t *p_synth);
+void twatch_audio_synth_start(twatch_audio_synth_t *p_synth, const uint8_t *p_sequence);
+int twatch_audio_synth_render(void *p_synth, int16_t *p_block, int frames);
+twatch_audio_voice_t twatch_audio_synth_play(twatch_audio_synth_t *p_synth, const uint8_t *p_sequence, int gain, int pan, int priority);
+
+#endif /* __INC_AUDIO_SYNTH_H */
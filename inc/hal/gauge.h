@@ -0,0 +1,50 @@
+#ifndef __INC_TWATCH_GAUGE_H
+#define __INC_TWATCH_GAUGE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include "drivers/axp20x.h"
+
+/**
+ * Battery fuel gauge. State of charge is tracked with the AXP202 coulomb
+ * counter, and slowly pulled toward the open-circuit voltage estimate
+ * (measured voltage compensated for the current load) to cancel counter
+ * drift. Gauge state is kept in RTC memory and survives deep sleep.
+ **/
+
+#if defined(CONFIG_TWATCH_V2)
+  #define GAUGE_DEFAULT_CAPACITY_MAH    470
+#else
+  #define GAUGE_DEFAULT_CAPACITY_MAH    380
+#endif
+#define GAUGE_DEFAULT_RESISTANCE_MOHM   250
+#define GAUGE_UPDATE_MIN_MS             2000
+
+typedef struct {
+  int level;                /* Reported level in percent (0-100). */
+  int soc_permille;         /* Filtered state of charge (0-1000). */
+  int remaining_mah;        /* Remaining charge. */
+  int capacity_mah;         /* Full charge capacity. */
+  int voltage_mv;           /* Measured battery voltage. */
+  int ocv_mv;               /* Load-compensated (open-circuit) voltage. */
+  int current_ma;           /* Battery current, negative when discharging. */
+  int avg_current_ma;       /* Averaged battery current. */
+  int time_to_empty_min;    /* -1 if battery is not discharging. */
+  bool b_charging;
+} twatch_gauge_status_t;
+
+esp_err_t twatch_gauge_init(void);
+esp_err_t twatch_gauge_update(void);
+int twatch_gauge_get_level(void);
+esp_err_t twatch_gauge_get_status(twatch_gauge_status_t *p_status);
+void twatch_gauge_set_capacity(int capacity_mah);
+void twatch_gauge_set_resistance(int resistance_mohm);
+
+#endif /* __INC_TWATCH_GAUGE_H */
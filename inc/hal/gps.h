@@ -11,6 +11,7 @@
 #include "hal/pmu.h"
 
 #define TWATCH_GPS_WAKEUP GPIO_NUM_33
+#define TWATCH_BMA423_INT GPIO_NUM_39
 
 #define TWATCH_GPS_ERROR      -1
 #define TWATCH_GPS_RX_FULL    -2
@@ -21,11 +22,140 @@ typedef struct t_gps_raw_degrees {
   bool negative;
 } gps_raw_degrees_t;
 
+/* Fix quality, as reported in GGA sentences. */
+typedef enum {
+  GPS_FIX_INVALID = 0,
+  GPS_FIX_GPS = 1,
+  GPS_FIX_DGPS = 2,
+  GPS_FIX_PPS = 3,
+  GPS_FIX_RTK = 4,
+  GPS_FIX_FLOAT_RTK = 5,
+  GPS_FIX_ESTIMATED = 6,
+  GPS_FIX_MANUAL = 7,
+  GPS_FIX_SIMULATION = 8
+} gps_fix_quality_t;
+
+/* Fix mode, as reported in GSA sentences. */
+typedef enum {
+  GPS_MODE_UNKNOWN = 0,
+  GPS_MODE_NO_FIX = 1,
+  GPS_MODE_2D = 2,
+  GPS_MODE_3D = 3
+} gps_fix_mode_t;
+
+/* Satellite systems. */
+typedef enum {
+  GPS_SYSTEM_UNKNOWN,
+  GPS_SYSTEM_GPS,
+  GPS_SYSTEM_GLONASS,
+  GPS_SYSTEM_GALILEO,
+  GPS_SYSTEM_BEIDOU,
+  GPS_SYSTEM_QZSS,
+  GPS_SYSTEM_MAX
+} gps_system_t;
+
+/**
+ * GPS fix snapshot. Fields are published together, so a snapshot never
+ * mixes values from two different fixes.
+ **/
+
+typedef struct t_gps_fix {
+  bool valid;                   /* Position is valid. */
+  gps_fix_quality_t quality;    /* Fix quality. */
+  gps_fix_mode_t mode;          /* 2D/3D fix mode. */
+  gps_raw_degrees_t lat;
+  gps_raw_degrees_t lng;
+  int nb_sat;                   /* Satellites used. */
+  int pdop;                     /* PDOP x 100. */
+  int hdop;                     /* HDOP x 100. */
+  int vdop;                     /* VDOP x 100. */
+  int alt;                      /* Altitude in meters x 100. */
+  int speed;                    /* Speed in knots x 100. */
+  int course;                   /* Course over ground in degrees x 100. */
+  int date;                     /* UTC date as DDMMYY. */
+  int time;                     /* UTC time as HHMMSSsss. */
+  int64_t timestamp_us;         /* Publication time (esp_timer). */
+  uint32_t seq;                 /* Publication counter. */
+} gps_fix_t;
+
+#define GPS_MAX_SATELLITES  48
+
+typedef struct t_gps_satellite {
+  gps_system_t system;
+  uint16_t prn;
+  int8_t elevation;             /* Elevation in degrees, -1 if unknown. */
+  int16_t azimuth;              /* Azimuth in degrees, -1 if unknown. */
+  int8_t snr;                   /* SNR in dB-Hz, -1 if not tracked. */
+  bool b_used;                  /* Used in fix. */
+} gps_satellite_t;
+
+/* Satellites in view, as reported in GSV/GSA sentences. */
+typedef struct t_gps_sky {
+  int nb_sats;
+  gps_satellite_t sats[GPS_MAX_SATELLITES];
+  int64_t timestamp_us;         /* Publication time (esp_timer). */
+} gps_sky_t;
+
+/* NMEA sentences output mask, see twatch_gps_set_sentences(). */
+#define GPS_NMEA_GGA      (1 << 0)
+#define GPS_NMEA_GLL      (1 << 1)
+#define GPS_NMEA_GSA      (1 << 2)
+#define GPS_NMEA_GSV      (1 << 3)
+#define GPS_NMEA_RMC      (1 << 4)
+#define GPS_NMEA_VTG      (1 << 5)
+#define GPS_NMEA_ZDA      (1 << 6)
+
+/* GPS power scheduling modes. */
+typedef enum {
+  GPS_SCHED_OFF,          /* GPS powered off. */
+  GPS_SCHED_CONTINUOUS,   /* GPS always on. */
+  GPS_SCHED_PERIODIC,     /* Wake up, get a fix, sleep. */
+  GPS_SCHED_MOTION        /* On while the accelerometer reports motion. */
+} gps_sched_mode_t;
+
+typedef struct t_gps_sched_config {
+  gps_sched_mode_t mode;
+  uint32_t period_s;        /* Periodic: delay between fixes when moving. */
+  uint32_t max_period_s;    /* Periodic: delay between fixes when stationary. */
+  uint32_t fix_timeout_s;   /* Periodic: maximum on-time to get a fix. */
+  uint32_t motion_hold_s;   /* Motion: on-time after the last motion event. */
+} gps_sched_config_t;
+
+typedef struct t_gps_sched_stats {
+  uint32_t nb_power_cycles;
+  uint32_t nb_fixes;        /* Periodic wake-ups that got a fix. */
+  uint32_t nb_timeouts;     /* Periodic wake-ups that timed out. */
+  uint32_t avg_ttff_ms;     /* Average time to fix after power-up. */
+  uint32_t on_time_s;       /* Cumulated on-time. */
+  uint32_t period_s;        /* Current (adapted) period. */
+} gps_sched_stats_t;
+
+/* GPS current estimates (mA), see twatch_gps_estimate_energy(). */
+typedef struct t_gps_energy {
+  float moving_current_ma;
+  float stationary_current_ma;
+  float avg_current_ma;
+} gps_energy_t;
+
 /* Exposed functions. */
 esp_err_t twatch_gps_init(void);
 esp_err_t twatch_gps_on(void);
 esp_err_t twatch_gps_off(void);
+esp_err_t twatch_gps_set_schedule(gps_sched_config_t *p_config);
+void twatch_gps_get_schedule(gps_sched_config_t *p_config);
+void twatch_gps_get_sched_stats(gps_sched_stats_t *p_stats);
+void twatch_gps_estimate_energy(gps_sched_config_t *p_config, int motion_percent, gps_energy_t *p_energy);
+void twatch_gps_notify_motion(void);
+esp_err_t twatch_gps_send_command(const char *psz_command);
+esp_err_t twatch_gps_send_binary(uint8_t msg_class, uint8_t msg_id, uint8_t *p_payload, int len);
+esp_err_t twatch_gps_set_baudrate(int baudrate);
+esp_err_t twatch_gps_set_rate(int interval_ms);
+esp_err_t twatch_gps_set_sentences(uint32_t mask);
+esp_err_t twatch_gps_set_binary_output(bool b_enable);
 
+void gps_get_fix(gps_fix_t *p_fix);
+esp_err_t gps_wait_fix(gps_fix_t *p_fix, TickType_t ticks_to_wait);
+void gps_get_sky(gps_sky_t *p_sky);
 void gps_get_lat_lng(gps_raw_degrees_t *p_lat, gps_raw_degrees_t *p_lng);
 int gps_get_day(void);
 int gps_get_month(void);
@@ -0,0 +1,67 @@
+#ifndef __INC_GPS_GEO_H
+#define __INC_GPS_GEO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal/gps.h"
+
+/**
+ * Geodesy helpers. Positions are 1e-7 degrees fixed-point values (about
+ * 1.1 cm at the equator), distances are in centimeters and bearings in
+ * hundredths of degree.
+ *
+ * Equirectangular functions only use integer math and a cos(lat) table,
+ * they are accurate to better than 0.1% below a few tens of kilometers
+ * and are meant for per-fix processing. Haversine functions use single
+ * precision float trigonometry and remain valid at any distance.
+ **/
+
+#define GEO_SPEED_WINDOW      8     /* Segments used for moving average speed. */
+#define GEO_DEFAULT_MIN_STEP  300   /* Default minimum step (cm) counted in track distance. */
+
+typedef struct t_geo_point {
+  int32_t lat;
+  int32_t lng;
+} geo_point_t;
+
+typedef struct t_geo_fence {
+  geo_point_t center;
+  uint32_t radius_cm;
+  int32_t cos_lat;          /* cos(center latitude), Q15. */
+} geo_fence_t;
+
+typedef struct t_geo_track_stats {
+  geo_point_t last;         /* Last point counted in distance. */
+  uint32_t last_time_ms;
+  bool b_has_last;
+  uint32_t min_step_cm;     /* Smaller steps are considered as GPS jitter. */
+  int32_t cos_lat;          /* Cached cos(latitude), Q15. */
+  int32_t cos_lat_ref;      /* Latitude cos_lat was computed for. */
+  uint64_t distance_cm;     /* Cumulative distance. */
+  uint32_t moving_time_ms;  /* Time spent moving. */
+
+  /* Moving average speed. */
+  uint32_t window_dist_cm[GEO_SPEED_WINDOW];
+  uint32_t window_time_ms[GEO_SPEED_WINDOW];
+  int window_pos;
+} geo_track_stats_t;
+
+void geo_point_from_raw(geo_point_t *p_point, gps_raw_degrees_t *p_lat, gps_raw_degrees_t *p_lng);
+void geo_point_from_fix(geo_point_t *p_point, gps_fix_t *p_fix);
+int32_t geo_cos_lat(int32_t lat);
+uint32_t geo_distance_cm(geo_point_t *p_from, geo_point_t *p_to);
+uint32_t geo_haversine_cm(geo_point_t *p_from, geo_point_t *p_to);
+uint16_t geo_bearing(geo_point_t *p_from, geo_point_t *p_to);
+
+void geo_fence_init(geo_fence_t *p_fence, geo_point_t *p_center, uint32_t radius_m);
+bool geo_fence_contains(geo_fence_t *p_fence, geo_point_t *p_point);
+
+void geo_track_stats_init(geo_track_stats_t *p_stats, uint32_t min_step_cm);
+void geo_track_stats_add(geo_track_stats_t *p_stats, geo_point_t *p_point, uint32_t time_ms);
+uint32_t geo_track_stats_distance_m(geo_track_stats_t *p_stats);
+uint32_t geo_track_stats_speed(geo_track_stats_t *p_stats);
+uint32_t geo_track_stats_moving_speed(geo_track_stats_t *p_stats);
+
+#endif /* __INC_GPS_GEO_H */
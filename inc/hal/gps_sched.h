@@ -0,0 +1,33 @@
+#ifndef __INC_GPS_SCHED_H
+#define __INC_GPS_SCHED_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal/gps.h"
+
+/**
+ * GPS power model used by the periodic scheduler (L76K datasheet figures).
+ *
+ * Between two periodic fixes, the receiver is either kept tracking or
+ * switched off and reacquired on next wake-up. Switching it off saves the
+ * tracking current during the off-time, but the next fix then costs a time
+ * to first fix at acquisition current instead of tracking current.
+ **/
+
+#define GPS_DEFAULT_TTFF_MS         30000
+#define GPS_STATIONARY_SPEED        100     /* knots x 100, about 2 km/h */
+#define GPS_CURRENT_ACQUISITION_MA  40.0
+#define GPS_CURRENT_TRACKING_MA     25.0
+
+/* Default periodic schedule. */
+#define GPS_SCHED_DEFAULT_PERIOD_S        60
+#define GPS_SCHED_DEFAULT_MAX_PERIOD_S    600
+#define GPS_SCHED_DEFAULT_FIX_TIMEOUT_S   120
+#define GPS_SCHED_DEFAULT_MOTION_HOLD_S   60
+
+bool gps_sched_keep_tracking(uint32_t period_s, uint32_t on_time_ms);
+uint32_t gps_sched_next_period(gps_sched_config_t *p_config, uint32_t period_s, int speed);
+float gps_sched_periodic_current(uint32_t period_s, uint32_t ttff_ms);
+
+#endif /* __INC_GPS_SCHED_H */
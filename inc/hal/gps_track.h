@@ -0,0 +1,67 @@
+#ifndef __INC_GPS_TRACK_H
+#define __INC_GPS_TRACK_H
+
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#include "hal/gps.h"
+
+/**
+ * Tracks are stored in a raw data partition labelled "track", e.g.:
+ *
+ *   track, data, 0x40, , 512K
+ *
+ * The partition is written in 256-byte pages. Each page starts with an
+ * absolute (key) record followed by delta records, and is padded with
+ * erased bytes (0xFF). Records:
+ *
+ *   KEY     : tag, lat (int32 LE), lng (int32 LE), timestamp (uint32 LE)
+ *   SEGMENT : same as KEY, starts a new recording session
+ *   DELTA   : tag, zigzag varint dlat, zigzag varint dlng, varint dt
+ *
+ * Latitude/longitude are in 1e-7 degrees, timestamps in seconds since
+ * 2000-01-01 UTC. A fix at 1 Hz takes about 6 bytes.
+ **/
+
+#define GPS_TRACK_PARTITION_LABEL   "track"
+#define GPS_TRACK_PARTITION_SUBTYPE 0x40
+#define GPS_TRACK_PAGE_SIZE         256
+
+#define GPS_TRACK_TAG_KEY           0x01
+#define GPS_TRACK_TAG_SEGMENT       0x02
+#define GPS_TRACK_TAG_DELTA         0x03
+#define GPS_TRACK_TAG_ERASED        0xFF
+
+typedef struct t_gps_track_point {
+  int32_t lat;          /* Latitude in 1e-7 degrees. */
+  int32_t lng;          /* Longitude in 1e-7 degrees. */
+  uint32_t timestamp;   /* Seconds since 2000-01-01 UTC. */
+  bool b_new_segment;   /* First point of a recording session. */
+} gps_track_point_t;
+
+typedef struct t_gps_track_iter {
+  uint32_t offset;      /* Offset of the current page in partition. */
+  int pos;              /* Read position in current page. */
+  gps_track_point_t last;
+  uint8_t page[GPS_TRACK_PAGE_SIZE];
+} gps_track_iter_t;
+
+/* Exposed functions. */
+esp_err_t gps_track_init(void);
+esp_err_t gps_track_erase(void);
+esp_err_t gps_track_start(void);
+esp_err_t gps_track_stop(void);
+bool gps_track_is_recording(void);
+esp_err_t gps_track_add(gps_fix_t *p_fix);
+uint32_t gps_track_get_used(void);
+uint32_t gps_track_get_size(void);
+
+esp_err_t gps_track_iter_init(gps_track_iter_t *p_iter);
+bool gps_track_iter_next(gps_track_iter_t *p_iter, gps_track_point_t *p_point);
+
+#endif /* __INC_GPS_TRACK_H */
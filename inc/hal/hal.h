@@ -4,6 +4,8 @@
 #include "drivers/i2c.h"
 
 #include "hal/pmu.h"
+#include "hal/power.h"
+#include "hal/gauge.h"
 #include "hal/screen.h"
 #include "hal/rtc.h"
 #include "hal/touch.h"
@@ -3,6 +3,44 @@
 
 #include "drivers/axp20x.h"
 
+#define PMU_IRQ_GPIO            GPIO_NUM_35
+#define PMU_MAX_SUBSCRIBERS     8
+#define PMU_TASK_STACK          3072
+#define PMU_TASK_PRIORITY       10
+
+/* Power rails, as reported by twatch_pmu_get_rails(). */
+#define PMU_RAIL_SCREEN         (1 << 0)
+#define PMU_RAIL_AUDIO          (1 << 1)
+#define PMU_RAIL_GPS            (1 << 2)
+
+/**
+ * PMU events, published by the PMU task as soon as the AXP202 raises
+ * its IRQ line.
+ **/
+
+typedef enum {
+  PMU_EVENT_SHORT_PRESS,
+  PMU_EVENT_LONG_PRESS,
+  PMU_EVENT_VBUS_IN,
+  PMU_EVENT_VBUS_OUT,
+  PMU_EVENT_CHARGE_START,
+  PMU_EVENT_CHARGE_DONE,
+  PMU_EVENT_BATTERY_LOW,
+  PMU_EVENT_OVER_TEMPERATURE
+} pmu_event_type_t;
+
+typedef struct {
+  pmu_event_type_t type;
+  int64_t timestamp_us;   /* Time the IRQ has been handled. */
+} pmu_event_t;
+
+/**
+ * Event callback, called from the PMU task. Callbacks must not block,
+ * heavy work should be deferred to the subscriber's own task.
+ **/
+
+typedef void (*FPmuEventHandler)(pmu_event_t *p_event, void *p_user_data);
+
 /* Global power management functions. */
 esp_err_t twatch_pmu_init(void);
 esp_err_t twatch_pmu_power(bool enable);
@@ -11,6 +49,7 @@ esp_err_t twatch_pmu_power(bool enable);
 void twatch_pmu_reset_touchscreen(void);
 
 /* Peripheral power management functions. */
+uint32_t twatch_pmu_get_rails(void);
 esp_err_t twatch_pmu_audio_power(bool enable);
 esp_err_t twatch_pmu_screen_power(bool enable);
 
@@ -20,12 +59,17 @@ esp_err_t twatch_pmu_vibration(bool enable);
 /* GPS */
 esp_err_t twatch_pmu_gps_power(bool enable);
 
+/* Events. */
+esp_err_t twatch_pmu_subscribe(FPmuEventHandler pfn_handler, void *p_user_data);
+esp_err_t twatch_pmu_unsubscribe(FPmuEventHandler pfn_handler, void *p_user_data);
+
 /* User button. */
 void twatch_pmu_read_irq(void);
 bool twatch_pmu_is_userbtn_pressed(void);
 
 /* Deep sleep */
 void twatch_pmu_deepsleep(void);
+bool twatch_pmu_is_resuming(void);
 
 /* Battery. */
 int twatch_pmu_get_battery_level(void);
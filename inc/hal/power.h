@@ -0,0 +1,29 @@
+#ifndef __INC_TWATCH_POWER_H
+#define __INC_TWATCH_POWER_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+/**
+ * CPU power management. When ESP-IDF power management is enabled
+ * (CONFIG_PM_ENABLE), the CPU runs at POWER_MIN_CPU_FREQ_MHZ unless a boost
+ * is requested, and automatic light sleep (CONFIG_FREERTOS_USE_TICKLESS_IDLE)
+ * is allowed unless the system is kept awake.
+ *
+ * Touch, PMU and RTC interrupt lines wake the chip from light sleep, the
+ * latter only while an alarm is armed. GPIO wake-up requires level-triggered
+ * interrupts, their handlers mask their interrupt until it is serviced.
+ *
+ * Without power management, every function is a no-op.
+ **/
+
+#define POWER_MAX_CPU_FREQ_MHZ      240
+#define POWER_MIN_CPU_FREQ_MHZ      80
+
+esp_err_t twatch_power_init(void);
+bool twatch_power_is_enabled(void);
+bool twatch_power_is_light_sleep_enabled(void);
+void twatch_power_boost(bool b_enable);
+void twatch_power_keep_awake(bool b_enable);
+
+#endif /* __INC_TWATCH_POWER_H */
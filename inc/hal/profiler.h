@@ -0,0 +1,84 @@
+#ifndef __INC_TWATCH_PROFILER_H
+#define __INC_TWATCH_PROFILER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include "drivers/axp20x.h"
+
+/**
+ * Power profiler. Samples battery and VBUS currents from the AXP202
+ * along with the state of every power-hungry subsystem, and attributes
+ * the load current to subsystems with a recursive least-squares fit. A
+ * subsystem can only be attributed once it has been seen both on and off.
+ *
+ * Samples are also kept in a ring buffer, printed on the console by
+ * twatch_profiler_dump() between "#PROF-BEGIN" and "#PROF-END" markers
+ * (see tools/power_dump.py).
+ **/
+
+#define PROFILER_DEFAULT_PERIOD_MS    100
+#define PROFILER_DEFAULT_LOG_SIZE     512
+#define PROFILER_DEFAULT_ADC_RATE     AXP_ADC_SAMPLING_RATE_100HZ
+#define PROFILER_TASK_STACK           3072
+#define PROFILER_TASK_PRIORITY        4
+
+/* Sample flags. */
+#define PROFILER_FLAG_SCREEN          (1 << 0)
+#define PROFILER_FLAG_GPS             (1 << 1)
+#define PROFILER_FLAG_AUDIO           (1 << 2)
+#define PROFILER_FLAG_TOUCH_ACTIVE    (1 << 3)
+#define PROFILER_FLAG_TOUCH_MONITOR   (1 << 4)
+#define PROFILER_FLAG_VBUS            (1 << 5)
+
+typedef enum {
+  PROFILER_SUBSYS_BASE,         /* Everything else (idle CPU, RTC, leakage). */
+  PROFILER_SUBSYS_BACKLIGHT,    /* Cost at full backlight. */
+  PROFILER_SUBSYS_SCREEN,
+  PROFILER_SUBSYS_GPS,
+  PROFILER_SUBSYS_AUDIO,
+  PROFILER_SUBSYS_TOUCH,        /* Touch controller in active mode. */
+  PROFILER_SUBSYS_CPU,          /* Cost of 240 MHz over 80 MHz. */
+  PROFILER_NB_SUBSYS
+} twatch_profiler_subsys_t;
+
+typedef struct {
+  int period_ms;                    /* Sampling period. */
+  int log_size;                     /* Ring buffer size, in samples. */
+  axp_adc_sampling_rate_t adc_rate; /* AXP202 ADC rate while profiling. */
+} twatch_profiler_config_t;
+
+typedef struct {
+  uint32_t timestamp_ms;
+  int16_t batt_ma;          /* Battery current, negative when discharging. */
+  int16_t vbus_ma;          /* VBUS input current. */
+  uint16_t backlight;       /* Backlight PWM duty. */
+  uint8_t flags;            /* PROFILER_FLAG_* */
+  uint8_t cpu_mhz;
+} twatch_profiler_sample_t;
+
+typedef struct {
+  uint32_t nb_samples;
+  float load_ma;                          /* Average load current. */
+  float cost_ma[PROFILER_NB_SUBSYS];      /* Current drawn when fully on. */
+  float share_ma[PROFILER_NB_SUBSYS];     /* Contribution to average load. */
+} twatch_profiler_report_t;
+
+void twatch_profiler_get_default_config(twatch_profiler_config_t *p_config);
+esp_err_t twatch_profiler_start(twatch_profiler_config_t *p_config);
+esp_err_t twatch_profiler_stop(void);
+bool twatch_profiler_is_running(void);
+esp_err_t twatch_profiler_get_report(twatch_profiler_report_t *p_report);
+void twatch_profiler_reset(void);
+int twatch_profiler_read_log(twatch_profiler_sample_t *p_samples, int max_samples);
+void twatch_profiler_dump(void);
+const char *twatch_profiler_subsys_name(twatch_profiler_subsys_t subsys);
+
+#endif /* __INC_TWATCH_PROFILER_H */
@@ -17,6 +17,7 @@ esp_err_t twatch_rtc_get_date_time(rtc_datetime_t *p_datetime_t);
 esp_err_t twatch_rtc_set_alarm(rtc_alarm_t *p_alarm);
 esp_err_t twatch_rtc_get_alarm(rtc_alarm_t *p_alarm);
 void twatch_rtc_enable_alarm(bool enable);
+bool twatch_rtc_is_alarm_pending(void);
 
 
 #endif /* __INC_TWATCH_RTC_H */
\ No newline at end of file
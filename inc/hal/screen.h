@@ -5,8 +5,11 @@
 #include "hal/pmu.h"
 
 #define   SCREEN_DEFAULT_BACKLIGHT    1000
+#define   SCREEN_MAX_BACKLIGHT        8191  /* 13-bit PWM duty. */
+#define   SCREEN_SNAPSHOT_SIZE        4096  /* RTC memory for last frame. */
 
 esp_err_t twatch_screen_init(void);
+esp_err_t twatch_screen_save_snapshot(void);
 void twatch_screen_set_backlight(int level);
 int  twatch_screen_get_backlight();
 void twatch_screen_set_default_backlight(int level);
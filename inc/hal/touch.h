@@ -20,9 +20,17 @@
 #define TOUCH_MAX_X 240
 #define TOUCH_MAX_Y 240
 
+/* Controller report periods (FT6236 units, lower is faster). */
+#define TOUCH_ACTIVE_PERIOD       0x06
+#define TOUCH_MONITOR_PERIOD      0x28
+
+/* Delay without touch (seconds) before the controller enters monitor mode. */
+#define TOUCH_MONITOR_TIMEOUT     1
+
 #include "drivers/ft6236.h"
 #include "hal/pmu.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 typedef enum {
   TOUCH_STATE_CLEAR,
@@ -40,6 +48,12 @@ typedef enum {
   TOUCH_EVENT_SWIPE_DOWN
 } touch_event_type_t;
 
+typedef enum {
+  TOUCH_MODE_ACTIVE,
+  TOUCH_MODE_MONITOR,
+  TOUCH_MODE_HIBERNATE
+} touch_power_mode_t;
+
 
 /**
  * Touch event coordinates (used for taps)
@@ -65,6 +79,22 @@ typedef struct {
   float velocity;
 } touch_event_t;
 
+/**
+ * Touch power statistics.
+ **/
+
+typedef struct {
+  /* Current controller power mode. */
+  touch_power_mode_t mode;
+
+  /* Number of wake-ups from monitor mode. */
+  uint32_t nb_wakeups;
+
+  /* Wake latency (IRQ to first reported event) in microseconds. */
+  uint32_t last_wake_latency_us;
+  uint32_t max_wake_latency_us;
+} touch_power_stats_t;
+
 /* Initialize Touch HAL. */
 esp_err_t twatch_touch_init(void);
 
@@ -77,5 +107,13 @@ bool twatch_touch_is_inverted(void);
 /* Retrieve Touch event (if any). */
 esp_err_t twatch_get_touch_event(touch_event_t *event, TickType_t ticks_to_wait);
 
+/* Notify touch activity through a semaphore. */
+void twatch_touch_set_wakeup(SemaphoreHandle_t wakeup);
+
+/* Touch controller power management. */
+esp_err_t twatch_touch_set_power_mode(touch_power_mode_t mode);
+touch_power_mode_t twatch_touch_get_power_mode(void);
+void twatch_touch_get_power_stats(touch_power_stats_t *p_stats);
+
 
 #endif /* __INC_TWATCH_TOUCH_H */
@@ -17,9 +17,56 @@
 #define VIBRATE_ON  1
 #define VIBRATE_OFF 0
 
+/**
+ * Haptic sequences follow the DRV2605 waveform sequencer format: up to
+ * VIBRATE_SEQ_SLOTS bytes, each one being either an effect of the selected
+ * library (1-123), a wait of 10 ms steps (VIBRATE_SEQ_WAIT(), up to
+ * 1270 ms) or VIBRATE_SEQ_END. On T-Watch 2020 v2 a sequence is loaded
+ * into the chip and played without any CPU or I2C activity.
+ **/
+
+#define VIBRATE_SEQ_SLOTS           DRV2605_WAVESEQ_SLOTS
+#define VIBRATE_SEQ_END             DRV2605_WAVESEQ_END
+#define VIBRATE_SEQ_WAIT_MAX        1270
+#define VIBRATE_SEQ_WAIT(ms)        ((uint8_t)(DRV2605_WAVESEQ_WAIT | \
+                                     ((((ms) / 10) > 0x7F) ? 0x7F : ((ms) / 10))))
+#define VIBRATE_SEQ_IS_WAIT(slot)   (((slot) & DRV2605_WAVESEQ_WAIT) != 0)
+
+/* Effect libraries. */
+#define VIBRATE_LIBRARY_EMPTY       0
+#define VIBRATE_LIBRARY_ERM_A       1
+#define VIBRATE_LIBRARY_ERM_B       2
+#define VIBRATE_LIBRARY_ERM_C       3
+#define VIBRATE_LIBRARY_ERM_D       4
+#define VIBRATE_LIBRARY_ERM_E       5
+#define VIBRATE_LIBRARY_LRA         6
+
+/* A few effects common to all libraries. */
+#define VIBRATE_EFFECT_STRONG_CLICK 1
+#define VIBRATE_EFFECT_SHARP_CLICK  4
+#define VIBRATE_EFFECT_SOFT_BUMP    7
+#define VIBRATE_EFFECT_DOUBLE_CLICK 10
+#define VIBRATE_EFFECT_TRIPLE_CLICK 12
+#define VIBRATE_EFFECT_STRONG_BUZZ  14
+#define VIBRATE_EFFECT_ALERT_750MS  15
+#define VIBRATE_EFFECT_ALERT_1000MS 16
+#define VIBRATE_EFFECT_BUZZ         47
+#define VIBRATE_EFFECT_PULSING      52
+#define VIBRATE_EFFECT_RAMP_DOWN    70
+#define VIBRATE_EFFECT_RAMP_UP      82
+
+/* Real-time playback amplitude range. */
+#define VIBRATE_RTP_MAX             127
+
+/* Default kick-start and brake times (T-Watch 2020 v1/v3 PWM drive). */
+#define VIBRATE_DEFAULT_OVERDRIVE_MS  20
+#define VIBRATE_DEFAULT_BRAKE_MS      30
+
 typedef enum {
   VIBRATE_DURATION,
-  VIBRATE_PATTERN
+  VIBRATE_PATTERN,
+  VIBRATE_SEQUENCE,
+  VIBRATE_STOP
 } vibrate_mode_t;
 
 typedef struct {
@@ -27,15 +74,27 @@ typedef struct {
   int level;
 } vibrate_pattern_t;
 
+/* Command played by the haptics engine. */
 typedef struct {
   vibrate_mode_t mode;
   int duration;
   vibrate_pattern_t *pattern;
   int pattern_length;
+  uint8_t sequence[VIBRATE_SEQ_SLOTS];
+  int sequence_length;
 } vibrate_parameter_t;
 
 esp_err_t twatch_vibrate_init(void);
 esp_err_t twatch_vibrate_vibrate(int duration);
 esp_err_t twatch_vibrate_pattern(vibrate_pattern_t *pattern, int length);
+esp_err_t twatch_vibrate_stop(void);
+
+/* Haptic sequences and effects. */
+int twatch_vibrate_pattern_to_sequence(vibrate_pattern_t *pattern, int length, uint8_t *p_sequence);
+esp_err_t twatch_vibrate_select_library(uint8_t library);
+esp_err_t twatch_vibrate_play_sequence(const uint8_t *p_sequence, int length);
+esp_err_t twatch_vibrate_play_effect(uint8_t effect);
+esp_err_t twatch_vibrate_realtime(int amplitude);
+esp_err_t twatch_vibrate_set_drive(int overdrive_ms, int brake_ms);
 
 #endif /* __INC_TWATCH_VIBRATE_H */
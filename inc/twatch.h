@@ -8,6 +8,12 @@
 /* Include power management HAL. */
 #include "hal/pmu.h"
 
+/* Include CPU power management HAL. */
+#include "hal/power.h"
+
+/* Include battery fuel gauge HAL. */
+#include "hal/gauge.h"
+
 /* Include sound HAL. */
 #include "hal/audio.h"
 
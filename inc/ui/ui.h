@@ -2,11 +2,12 @@
 #define __INC_TWATCH_UI_H
 
 #include <stdint.h>
-#include "driver/timer.h"
+#include "esp_timer.h"
 #include "drivers/st7789.h"
 
 #include "hal/touch.h"
 #include "hal/pmu.h"
+#include "hal/power.h"
 #include "hal/screen.h"
 
 #include "img.h"
@@ -17,6 +18,15 @@
 #define SCREEN_HEIGHT 240
 #define UI_ANIM_DELTA 40
 
+/**
+ * Idle tier: once nothing happened for UI_IDLE_DELAY_MS, the UI only
+ * refreshes every UI_IDLE_REFRESH_MS or on touch/PMU activity, letting
+ * the CPU scale down and enter light sleep in between.
+ **/
+
+#define UI_IDLE_DELAY_MS    1000
+#define UI_IDLE_REFRESH_MS  1000
+
 #define TE_ERROR      (1)
 #define TE_PROCESSED  (0)
 
@@ -126,15 +136,21 @@ typedef struct {
   /* Pointer to a modal box. */
   modal_t *p_modal;
 
-  /* Eco mode timer. */
+  /* Eco mode timer (deadlines in microseconds, 0 if not armed). */
   bool b_eco_mode_enabled;
   screen_mode_t screen_mode;
-  timer_config_t eco_timer;
+  int64_t eco_deadline_us;
   int eco_max_inactivity;
   int eco_max_inactivity_to_deepsleep;
-  bool b_inactivity_detected;
   bool b_usb_plugged;
 
+  /* Idle tier. */
+  bool b_idle;
+  int idle_delay_ms;
+  int idle_refresh_ms;
+  int64_t last_activity_us;
+  SemaphoreHandle_t wakeup;
+
   /* Mutex */
   SemaphoreHandle_t mutex;
 
@@ -171,6 +187,10 @@ bool is_ecomode_set(void);
 void enable_ecomode(void);
 void disable_ecomode(void);
 void ui_wakeup(void);
+void ui_set_idle_timing(int delay_ms, int refresh_ms);
+
+/* Deep sleep resume. */
+bool ui_resume(void);
 
 /* Tiles */
 void tile_init(tile_t *p_tile, void *p_user_data);
@@ -0,0 +1,100 @@
+#include "sim.h"
+
+/**
+ * FreeRTOS stubs.
+ *
+ * The simulator runs the UI in a single thread, semaphores only track
+ * ownership and catch recursive takes of non-recursive mutexes (which
+ * would deadlock on target).
+ **/
+
+typedef struct {
+  bool b_recursive;
+  int count;
+} sim_sem_t;
+
+
+static SemaphoreHandle_t sim_sem_create(bool b_recursive, int count)
+{
+  sim_sem_t *p_sem = calloc(1, sizeof(sim_sem_t));
+
+  if (p_sem != NULL)
+  {
+    p_sem->b_recursive = b_recursive;
+    p_sem->count = count;
+  }
+  return (SemaphoreHandle_t)p_sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+  return sim_sem_create(false, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+  return sim_sem_create(true, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+  /* Binary semaphores are created empty. */
+  return sim_sem_create(false, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait)
+{
+  sim_sem_t *p_sem = (sim_sem_t *)sem;
+
+  /* Single thread: an already taken mutex would never be released. */
+  if (!p_sem->b_recursive && (p_sem->count > 0))
+  {
+    assert(ticks_to_wait != portMAX_DELAY);
+    return pdFALSE;
+  }
+
+  p_sem->count++;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+  sim_sem_t *p_sem = (sim_sem_t *)sem;
+
+  if (p_sem->count == 0)
+    return pdFALSE;
+
+  p_sem->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks_to_wait)
+{
+  return xSemaphoreTake(sem, ticks_to_wait);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem)
+{
+  return xSemaphoreGive(sem);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+  free(sem);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+  return (TickType_t)(sim_time_get_us() / (1000 * portTICK_PERIOD_MS));
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  sim_time_advance(ticks * portTICK_PERIOD_MS * 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+  /* Single task. */
+  return (TaskHandle_t)1;
+}
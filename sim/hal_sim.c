@@ -0,0 +1,408 @@
+#include <ctype.h>
+#include "sim.h"
+#include "hal/pmu.h"
+#include "hal/power.h"
+#include "hal/touch.h"
+#include "hal/vibrate.h"
+
+#define TAG "[sim::hal]"
+
+/* Pending touch events (ring buffer). */
+#define SIM_TOUCH_QUEUE_SIZE    32
+
+/* Maximum number of scripted actions. */
+#define SIM_SCRIPT_MAX_ACTIONS  256
+#define SIM_SCRIPT_MAX_LINE     256
+
+typedef enum {
+  SIM_ACTION_TOUCH,
+  SIM_ACTION_BUTTON,
+  SIM_ACTION_USB,
+  SIM_ACTION_DUMP
+} sim_action_type_t;
+
+typedef struct {
+  int frame;
+  sim_action_type_t type;
+  touch_event_t touch;
+  bool b_usb_plugged;
+  char sz_path[64];
+} sim_action_t;
+
+static touch_event_t g_touch_queue[SIM_TOUCH_QUEUE_SIZE];
+static int g_touch_head = 0;
+static int g_touch_count = 0;
+static touch_power_mode_t g_touch_mode = TOUCH_MODE_ACTIVE;
+
+static bool g_userbtn_pressed = false;
+static bool g_usb_plugged = false;
+static bool g_deepsleep = false;
+
+static sim_action_t g_script[SIM_SCRIPT_MAX_ACTIONS];
+static int g_script_size = 0;
+
+
+/**********************************************************************
+ * Input injection
+ **********************************************************************/
+
+/**
+ * sim_touch_inject()
+ *
+ * @brief Queue a touch event, returned by twatch_get_touch_event().
+ * @param type: touch event type
+ * @param x: X coordinate
+ * @param y: Y coordinate
+ * @param velocity: swipe velocity
+ **/
+
+void sim_touch_inject(touch_event_type_t type, int x, int y, float velocity)
+{
+  touch_event_t *p_event;
+
+  if (g_touch_count >= SIM_TOUCH_QUEUE_SIZE)
+  {
+    ESP_LOGW(TAG, "touch queue full, event dropped");
+    return;
+  }
+
+  p_event = &g_touch_queue[(g_touch_head + g_touch_count) % SIM_TOUCH_QUEUE_SIZE];
+  p_event->type = type;
+  p_event->coords.x = x;
+  p_event->coords.y = y;
+  p_event->velocity = velocity;
+  g_touch_count++;
+}
+
+void sim_userbtn_press(void)
+{
+  g_userbtn_pressed = true;
+}
+
+void sim_usb_plug(bool plugged)
+{
+  g_usb_plugged = plugged;
+}
+
+bool sim_deepsleep_requested(void)
+{
+  return g_deepsleep;
+}
+
+
+/**********************************************************************
+ * HAL stubs (touch, PMU, vibrator)
+ **********************************************************************/
+
+esp_err_t twatch_touch_init(void)
+{
+  g_touch_head = 0;
+  g_touch_count = 0;
+  return ESP_OK;
+}
+
+esp_err_t twatch_get_touch_event(touch_event_t *event, TickType_t ticks_to_wait)
+{
+  if (g_touch_count == 0)
+    return ESP_FAIL;
+
+  memcpy(event, &g_touch_queue[g_touch_head], sizeof(touch_event_t));
+  g_touch_head = (g_touch_head + 1) % SIM_TOUCH_QUEUE_SIZE;
+  g_touch_count--;
+  return ESP_OK;
+}
+
+esp_err_t twatch_touch_set_power_mode(touch_power_mode_t mode)
+{
+  g_touch_mode = mode;
+  return ESP_OK;
+}
+
+touch_power_mode_t twatch_touch_get_power_mode(void)
+{
+  return g_touch_mode;
+}
+
+void twatch_touch_set_wakeup(SemaphoreHandle_t wakeup)
+{
+}
+
+void twatch_power_boost(bool b_enable)
+{
+}
+
+void twatch_power_keep_awake(bool b_enable)
+{
+}
+
+bool twatch_pmu_is_userbtn_pressed(void)
+{
+  bool pressed = g_userbtn_pressed;
+
+  g_userbtn_pressed = false;
+  return pressed;
+}
+
+bool twatch_pmu_is_usb_plugged(bool b_query_irq)
+{
+  return g_usb_plugged;
+}
+
+esp_err_t twatch_pmu_subscribe(FPmuEventHandler pfn_handler, void *p_user_data)
+{
+  return ESP_OK;
+}
+
+bool twatch_pmu_is_resuming(void)
+{
+  return false;
+}
+
+void twatch_pmu_deepsleep(void)
+{
+  ESP_LOGI(TAG, "deep sleep requested");
+  g_deepsleep = true;
+}
+
+esp_err_t twatch_pmu_screen_power(bool enable)
+{
+  return ESP_OK;
+}
+
+esp_err_t twatch_vibrate_vibrate(int duration)
+{
+  return ESP_OK;
+}
+
+
+/**********************************************************************
+ * Scripted scenarios
+ *
+ * One action per line, `#` starts a comment:
+ *
+ *   <frame> tap|press|release <x> <y>
+ *   <frame> swipe left|right|up|down [velocity]
+ *   <frame> button
+ *   <frame> usb on|off
+ *   <frame> dump <file.ppm>
+ *
+ * Input actions are injected before the given frame is rendered, dumps
+ * are taken once it has been rendered.
+ **********************************************************************/
+
+/**
+ * sim_script_parse()
+ *
+ * @brief Parse a script line.
+ * @param psz_line: line to parse
+ * @param p_action: pointer to a `sim_action_t` structure
+ * @return ESP_OK if an action was parsed, ESP_ERR_NOT_FOUND for empty lines,
+ *         ESP_FAIL on syntax error
+ **/
+
+static esp_err_t sim_script_parse(char *psz_line, sim_action_t *p_action)
+{
+  char sz_cmd[16], sz_arg[64];
+  int x, y, nb_fields;
+  float velocity = TOUCH_SWIPE_MIN_VELOCITY;
+
+  /* Strip comments. */
+  if (strchr(psz_line, '#') != NULL)
+    *strchr(psz_line, '#') = '\0';
+
+  memset(p_action, 0, sizeof(sim_action_t));
+  nb_fields = sscanf(psz_line, "%d %15s %63s", &p_action->frame, sz_cmd, sz_arg);
+  if (nb_fields <= 0)
+    return ESP_ERR_NOT_FOUND;
+  if (nb_fields < 2)
+    return ESP_FAIL;
+
+  if (!strcmp(sz_cmd, "tap") || !strcmp(sz_cmd, "press") || !strcmp(sz_cmd, "release"))
+  {
+    if (sscanf(psz_line, "%*d %*s %d %d", &x, &y) != 2)
+      return ESP_FAIL;
+    p_action->type = SIM_ACTION_TOUCH;
+    p_action->touch.type = (sz_cmd[0] == 't')?TOUCH_EVENT_TAP:
+      ((sz_cmd[0] == 'p')?TOUCH_EVENT_PRESS:TOUCH_EVENT_RELEASE);
+    p_action->touch.coords.x = x;
+    p_action->touch.coords.y = y;
+  }
+  else if (!strcmp(sz_cmd, "swipe") && (nb_fields == 3))
+  {
+    sscanf(psz_line, "%*d %*s %*s %f", &velocity);
+    p_action->type = SIM_ACTION_TOUCH;
+    p_action->touch.coords.x = TOUCH_MAX_X/2;
+    p_action->touch.coords.y = TOUCH_MAX_Y/2;
+    p_action->touch.velocity = velocity;
+    if (!strcmp(sz_arg, "left"))
+      p_action->touch.type = TOUCH_EVENT_SWIPE_LEFT;
+    else if (!strcmp(sz_arg, "right"))
+      p_action->touch.type = TOUCH_EVENT_SWIPE_RIGHT;
+    else if (!strcmp(sz_arg, "up"))
+      p_action->touch.type = TOUCH_EVENT_SWIPE_UP;
+    else if (!strcmp(sz_arg, "down"))
+      p_action->touch.type = TOUCH_EVENT_SWIPE_DOWN;
+    else
+      return ESP_FAIL;
+  }
+  else if (!strcmp(sz_cmd, "button"))
+    p_action->type = SIM_ACTION_BUTTON;
+  else if (!strcmp(sz_cmd, "usb") && (nb_fields == 3))
+  {
+    p_action->type = SIM_ACTION_USB;
+    p_action->b_usb_plugged = !strcmp(sz_arg, "on");
+  }
+  else if (!strcmp(sz_cmd, "dump") && (nb_fields == 3))
+  {
+    p_action->type = SIM_ACTION_DUMP;
+    strncpy(p_action->sz_path, sz_arg, sizeof(p_action->sz_path) - 1);
+  }
+  else
+    return ESP_FAIL;
+
+  /* Success. */
+  return ESP_OK;
+}
+
+
+/**
+ * sim_script_load()
+ *
+ * @brief Load a scenario from a text file.
+ * @param psz_path: path to the script
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t sim_script_load(const char *psz_path)
+{
+  FILE *f_script;
+  char sz_line[SIM_SCRIPT_MAX_LINE];
+  int line = 0;
+  esp_err_t result = ESP_OK;
+
+  f_script = fopen(psz_path, "r");
+  if (f_script == NULL)
+  {
+    ESP_LOGE(TAG, "cannot open script %s", psz_path);
+    return ESP_FAIL;
+  }
+
+  g_script_size = 0;
+  while (fgets(sz_line, sizeof(sz_line), f_script) != NULL)
+  {
+    line++;
+    switch (sim_script_parse(sz_line, &g_script[g_script_size]))
+    {
+      case ESP_OK:
+        if (++g_script_size >= SIM_SCRIPT_MAX_ACTIONS)
+        {
+          ESP_LOGE(TAG, "%s: too many actions", psz_path);
+          result = ESP_FAIL;
+        }
+        break;
+
+      case ESP_ERR_NOT_FOUND:
+        break;
+
+      default:
+        ESP_LOGE(TAG, "%s:%d: syntax error", psz_path, line);
+        result = ESP_FAIL;
+        break;
+    }
+
+    if (result != ESP_OK)
+      break;
+  }
+
+  fclose(f_script);
+  return result;
+}
+
+
+/**
+ * sim_script_inputs()
+ *
+ * @brief Inject input actions scheduled for a given frame.
+ * @param frame: frame number
+ **/
+
+void sim_script_inputs(int frame)
+{
+  int i;
+  sim_action_t *p_action;
+
+  for (i=0; i<g_script_size; i++)
+  {
+    p_action = &g_script[i];
+    if (p_action->frame != frame)
+      continue;
+
+    switch (p_action->type)
+    {
+      case SIM_ACTION_TOUCH:
+        sim_touch_inject(
+          p_action->touch.type,
+          p_action->touch.coords.x,
+          p_action->touch.coords.y,
+          p_action->touch.velocity
+        );
+        break;
+
+      case SIM_ACTION_BUTTON:
+        sim_userbtn_press();
+        break;
+
+      case SIM_ACTION_USB:
+        sim_usb_plug(p_action->b_usb_plugged);
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+
+/**
+ * sim_script_outputs()
+ *
+ * @brief Take the screenshots scheduled for a given frame.
+ * @param frame: frame number
+ * @param psz_outdir: output directory
+ **/
+
+void sim_script_outputs(int frame, const char *psz_outdir)
+{
+  int i;
+  char sz_path[256];
+
+  for (i=0; i<g_script_size; i++)
+  {
+    if ((g_script[i].frame == frame) && (g_script[i].type == SIM_ACTION_DUMP))
+    {
+      snprintf(sz_path, sizeof(sz_path), "%s/%s", psz_outdir, g_script[i].sz_path);
+      if (sim_panel_dump_ppm(sz_path) != ESP_OK)
+        ESP_LOGE(TAG, "cannot write %s", sz_path);
+    }
+  }
+}
+
+
+/**
+ * sim_script_last_frame()
+ *
+ * @brief Get the last frame referenced by the loaded script.
+ * @return frame number, -1 if no script loaded
+ **/
+
+int sim_script_last_frame(void)
+{
+  int i, last = -1;
+
+  for (i=0; i<g_script_size; i++)
+  {
+    if (g_script[i].frame > last)
+      last = g_script[i].frame;
+  }
+  return last;
+}
@@ -0,0 +1,2 @@
+/* Forwarding header, see sim_idf.h. */
+#include "sim_idf.h"
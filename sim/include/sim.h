@@ -0,0 +1,43 @@
+#ifndef __INC_SIM_H
+#define __INC_SIM_H
+
+/*******************************************************************************
+ * T-Watch library host simulator
+ ******************************************************************************/
+
+#include "sim_idf.h"
+#include "hal/touch.h"
+
+/* Panel statistics. */
+typedef struct {
+  /* Number of frames written to panel memory (RAMWR commands). */
+  uint32_t nb_frames;
+
+  /* Bytes sent over the (simulated) SPI bus, commands included. */
+  uint64_t nb_bytes;
+
+  /* Current backlight level. */
+  int backlight;
+} sim_panel_stats_t;
+
+/* Simulated clock. */
+int64_t sim_time_get_us(void);
+void sim_time_advance(uint32_t us);
+
+/* Panel model. */
+void sim_panel_get_stats(sim_panel_stats_t *p_stats);
+esp_err_t sim_panel_dump_ppm(const char *psz_path);
+
+/* Input injection. */
+void sim_touch_inject(touch_event_type_t type, int x, int y, float velocity);
+void sim_userbtn_press(void);
+void sim_usb_plug(bool plugged);
+bool sim_deepsleep_requested(void);
+
+/* Scripted scenarios. */
+esp_err_t sim_script_load(const char *psz_path);
+void sim_script_inputs(int frame);
+void sim_script_outputs(int frame, const char *psz_outdir);
+int sim_script_last_frame(void);
+
+#endif /* __INC_SIM_H */
@@ -0,0 +1,242 @@
+#ifndef __INC_SIM_IDF_H
+#define __INC_SIM_IDF_H
+
+/*******************************************************************************
+ * T-Watch library host simulator - ESP-IDF/FreeRTOS subset
+ *
+ * Only declares what the library headers and the UI/drawing code need to
+ * compile on a workstation. Functions actually called by the simulated code
+ * are implemented in the sim sources, everything else is declaration only.
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Error codes. */
+typedef int esp_err_t;
+#define ESP_OK                    0
+#define ESP_FAIL                  -1
+#define ESP_ERR_NO_MEM            0x101
+#define ESP_ERR_INVALID_ARG       0x102
+#define ESP_ERR_INVALID_STATE     0x103
+#define ESP_ERR_INVALID_SIZE      0x104
+#define ESP_ERR_NOT_FOUND         0x105
+#define ESP_ERR_NOT_SUPPORTED     0x106
+#define ESP_ERR_TIMEOUT           0x107
+
+/* Logging. */
+#define ESP_LOGE(tag, fmt, ...)   fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)   fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)   fprintf(stderr, "I %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...)   do {} while (0)
+#define ESP_LOGV(tag, fmt, ...)   do {} while (0)
+
+/* Memory placement attributes. */
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define ESP_INTR_FLAG_IRAM        (1<<10)
+#define BIT(n)                    (1UL<<(n))
+
+/* FreeRTOS. */
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void *SemaphoreHandle_t;
+typedef void *QueueHandle_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdTRUE                    1
+#define pdFALSE                   0
+#define pdPASS                    pdTRUE
+#define pdFAIL                    pdFALSE
+#define portMAX_DELAY             ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ        100
+#define portTICK_PERIOD_MS        (1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS          portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)         ((TickType_t)((ms) / portTICK_PERIOD_MS))
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks_to_wait);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+
+typedef struct {
+  int count;
+} StaticSemaphore_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *p_buffer);
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *p_item, TickType_t ticks_to_wait);
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *p_item, BaseType_t *p_task_woken);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *p_item, TickType_t ticks_to_wait);
+
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskCreate(TaskFunction_t pfn_task, const char *psz_name, uint32_t stack_depth, void *p_param,
+                       UBaseType_t priority, TaskHandle_t *p_task);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *p_task_woken);
+uint32_t ulTaskNotifyTake(BaseType_t b_clear, TickType_t ticks_to_wait);
+
+/* GPIO. */
+typedef int gpio_num_t;
+#define GPIO_NUM_NC               -1
+#define GPIO_NUM_0                0
+#define GPIO_NUM_4                4
+#define GPIO_NUM_5                5
+#define GPIO_NUM_12               12
+#define GPIO_NUM_13               13
+#define GPIO_NUM_14               14
+#define GPIO_NUM_15               15
+#define GPIO_NUM_18               18
+#define GPIO_NUM_19               19
+#define GPIO_NUM_21               21
+#define GPIO_NUM_22               22
+#define GPIO_NUM_23               23
+#define GPIO_NUM_25               25
+#define GPIO_NUM_26               26
+#define GPIO_NUM_27               27
+#define GPIO_NUM_32               32
+#define GPIO_NUM_33               33
+#define GPIO_NUM_35               35
+#define GPIO_NUM_38               38
+#define GPIO_NUM_39               39
+
+typedef enum {
+  GPIO_PULLUP_DISABLE,
+  GPIO_PULLUP_ENABLE
+} gpio_pullup_t;
+
+/* I2C master (the simulator has no I2C bus, only host tests implement it). */
+typedef void *i2c_cmd_handle_t;
+typedef int i2c_port_t;
+#define I2C_LINK_RECOMMENDED_SIZE(n)  (2*24 + 24*(5*(n)))
+#define I2C_NUM_0                 0
+#define I2C_NUM_1                 1
+
+typedef enum {
+  I2C_MODE_SLAVE,
+  I2C_MODE_MASTER
+} i2c_mode_t;
+
+typedef enum {
+  I2C_MASTER_WRITE,
+  I2C_MASTER_READ
+} i2c_rw_t;
+
+typedef enum {
+  I2C_MASTER_ACK,
+  I2C_MASTER_NACK,
+  I2C_MASTER_LAST_NACK
+} i2c_ack_type_t;
+
+typedef struct {
+  i2c_mode_t mode;
+  int sda_io_num;
+  int scl_io_num;
+  bool sda_pullup_en;
+  bool scl_pullup_en;
+  struct {
+    uint32_t clk_speed;
+  } master;
+} i2c_config_t;
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *p_config);
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len,
+                             int intr_alloc_flags);
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *p_buffer, uint32_t size);
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en);
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, const uint8_t *p_data, size_t len, bool ack_en);
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t *p_data, i2c_ack_type_t ack);
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd, uint8_t *p_data, size_t len, i2c_ack_type_t ack);
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks_to_wait);
+
+/* General purpose timers. */
+typedef enum {
+  TIMER_GROUP_0,
+  TIMER_GROUP_1,
+  TIMER_GROUP_MAX
+} timer_group_t;
+
+typedef enum {
+  TIMER_0,
+  TIMER_1,
+  TIMER_MAX
+} timer_idx_t;
+
+typedef enum {
+  TIMER_COUNT_DOWN,
+  TIMER_COUNT_UP
+} timer_count_dir_t;
+
+typedef enum {
+  TIMER_PAUSE,
+  TIMER_START
+} timer_start_t;
+
+typedef enum {
+  TIMER_ALARM_DIS,
+  TIMER_ALARM_EN
+} timer_alarm_t;
+
+typedef enum {
+  TIMER_AUTORELOAD_DIS,
+  TIMER_AUTORELOAD_EN
+} timer_autoreload_t;
+
+typedef struct {
+  timer_alarm_t alarm_en;
+  timer_start_t counter_en;
+  timer_count_dir_t counter_dir;
+  timer_autoreload_t auto_reload;
+  uint32_t divider;
+} timer_config_t;
+
+typedef bool (*timer_isr_t)(void *);
+
+#define TIMER_BASE_CLK            80000000
+
+esp_err_t timer_init(timer_group_t group, timer_idx_t num, const timer_config_t *config);
+esp_err_t timer_set_counter_value(timer_group_t group, timer_idx_t num, uint64_t value);
+esp_err_t timer_set_alarm_value(timer_group_t group, timer_idx_t num, uint64_t value);
+esp_err_t timer_enable_intr(timer_group_t group, timer_idx_t num);
+esp_err_t timer_isr_callback_add(timer_group_t group, timer_idx_t num, timer_isr_t isr_handler, void *arg, int intr_alloc_flags);
+esp_err_t timer_start(timer_group_t group, timer_idx_t num);
+esp_err_t timer_pause(timer_group_t group, timer_idx_t num);
+uint64_t timer_group_get_counter_value_in_isr(timer_group_t group, timer_idx_t num);
+void timer_group_set_alarm_value_in_isr(timer_group_t group, timer_idx_t num, uint64_t value);
+
+/* UART (types only, the simulator has no GPS). */
+typedef int uart_port_t;
+#define UART_NUM_1                1
+
+typedef struct {
+  int type;
+  size_t size;
+} uart_event_t;
+
+/* SPI master (types only). */
+typedef void *spi_device_handle_t;
+#define SPI_MASTER_FREQ_80M       80000000
+
+/* Time since simulator start, in microseconds. */
+int64_t esp_timer_get_time(void);
+
+#endif /* __INC_SIM_IDF_H */
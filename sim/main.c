@@ -0,0 +1,177 @@
+#include <time.h>
+#include <unistd.h>
+#include "sim.h"
+#include "twatch.h"
+#include "ui/switch.h"
+#include "ui/slider.h"
+
+#define TAG "[sim]"
+
+/* Default simulated frame period (ms). */
+#define SIM_DEFAULT_FRAME_MS  20
+#define SIM_DEFAULT_FRAMES    100
+
+/* ST7789 SPI clock, used to estimate transfer time. */
+#define SIM_SPI_CLOCK_HZ      80000000
+
+/**
+ * Demo user interface: a main tile with a button and a progress bar,
+ * a list tile on its right and a settings tile below it.
+ **/
+
+static tile_t g_main_tile, g_list_tile, g_settings_tile;
+static widget_label_t g_title;
+static widget_button_t g_button;
+static widget_progress_t g_progress;
+static widget_listbox_t g_listbox;
+static widget_label_t g_items[12];
+static char g_items_text[12][16];
+static widget_switch_t g_switch;
+static widget_slider_t g_slider;
+
+
+static int sim_demo_button_tapped(widget_t *p_widget)
+{
+  widget_progress_set_value(&g_progress, (widget_progress_get_value(&g_progress) + 10) % 110);
+  return WE_PROCESSED;
+}
+
+static void sim_demo_init(void)
+{
+  int i;
+
+  /* Main tile. */
+  tile_init(&g_main_tile, NULL);
+  widget_label_init(&g_title, &g_main_tile, 10, 10, 220, 40, "T-Watch sim");
+  widget_button_init(&g_button, &g_main_tile, 40, 80, 160, 50, "Tap me");
+  widget_button_set_handler(&g_button, sim_demo_button_tapped);
+  widget_progress_init(&g_progress, &g_main_tile, 20, 170, 200, 20);
+  widget_progress_configure(&g_progress, 0, 100, 30);
+
+  /* List tile. */
+  tile_init(&g_list_tile, NULL);
+  widget_listbox_init(&g_listbox, &g_list_tile, 10, 10, 220, 220);
+  for (i=0; i<12; i++)
+  {
+    snprintf(g_items_text[i], sizeof(g_items_text[i]), "Item %d", i + 1);
+    widget_label_init(&g_items[i], &g_list_tile, 0, 0, 200, 40, g_items_text[i]);
+    widget_listbox_add(&g_listbox, (widget_t *)&g_items[i]);
+  }
+  tile_link_right(&g_main_tile, &g_list_tile);
+
+  /* Settings tile. */
+  tile_init(&g_settings_tile, NULL);
+  widget_switch_init(&g_switch, &g_settings_tile, 80, 40, 80, 40);
+  widget_slider_init(&g_slider, &g_settings_tile, 20, 140, 200, 40);
+  widget_slider_configure(&g_slider, 0, 100, 50, 10);
+  tile_link_bottom(&g_main_tile, &g_settings_tile);
+
+  ui_select_tile(&g_main_tile);
+}
+
+
+/**
+ * sim_now_us()
+ *
+ * @brief Get host monotonic time.
+ * @return time in microseconds
+ **/
+
+static uint64_t sim_now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+static void sim_usage(const char *psz_prog)
+{
+  fprintf(
+    stderr,
+    "usage: %s [-s script] [-n frames] [-f frame_ms] [-o outdir]\n"
+    "  -s script    scripted touch/button scenario\n"
+    "  -n frames    number of frames to render (default: %d, or script length)\n"
+    "  -f frame_ms  simulated time between two frames (default: %d)\n"
+    "  -o outdir    screenshots output directory (default: .)\n",
+    psz_prog,
+    SIM_DEFAULT_FRAMES,
+    SIM_DEFAULT_FRAME_MS
+  );
+}
+
+
+int main(int argc, char **argv)
+{
+  int opt, frame, nb_frames = -1, frame_ms = SIM_DEFAULT_FRAME_MS;
+  const char *psz_script = NULL, *psz_outdir = ".";
+  uint64_t start, elapsed, total = 0, max = 0, min = UINT64_MAX;
+  sim_panel_stats_t stats;
+
+  while ((opt = getopt(argc, argv, "s:n:f:o:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 's': psz_script = optarg; break;
+      case 'n': nb_frames = atoi(optarg); break;
+      case 'f': frame_ms = atoi(optarg); break;
+      case 'o': psz_outdir = optarg; break;
+      default:
+        sim_usage(argv[0]);
+        return (opt == 'h')?0:1;
+    }
+  }
+
+  if ((psz_script != NULL) && (sim_script_load(psz_script) != ESP_OK))
+    return 1;
+
+  /* Run at least until the end of the script. */
+  if (nb_frames < 0)
+  {
+    nb_frames = sim_script_last_frame() + 1;
+    if (nb_frames <= 0)
+      nb_frames = SIM_DEFAULT_FRAMES;
+  }
+
+  twatch_screen_init();
+  ui_init();
+  sim_demo_init();
+
+  for (frame=0; (frame<nb_frames) && !sim_deepsleep_requested(); frame++)
+  {
+    sim_script_inputs(frame);
+
+    start = sim_now_us();
+    ui_process_events();
+    elapsed = sim_now_us() - start;
+
+    total += elapsed;
+    if (elapsed > max)
+      max = elapsed;
+    if (elapsed < min)
+      min = elapsed;
+
+    sim_script_outputs(frame, psz_outdir);
+    sim_time_advance(frame_ms * 1000);
+  }
+
+  /* Report rendering statistics. */
+  sim_panel_get_stats(&stats);
+  if (frame > 0)
+  {
+    printf("frames:        %d\n", frame);
+    printf("render (host): min %llu us, avg %llu us, max %llu us\n",
+      (unsigned long long)min,
+      (unsigned long long)(total / frame),
+      (unsigned long long)max
+    );
+    printf("spi traffic:   %llu bytes/frame (%llu us/frame at %d MHz)\n",
+      (unsigned long long)(stats.nb_bytes / stats.nb_frames),
+      (unsigned long long)((stats.nb_bytes / stats.nb_frames) * 8 * 1000000ULL / SIM_SPI_CLOCK_HZ),
+      SIM_SPI_CLOCK_HZ / 1000000
+    );
+  }
+
+  return 0;
+}
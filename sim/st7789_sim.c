@@ -0,0 +1,256 @@
+#include "sim.h"
+#include "drivers/st7789.h"
+
+#define TAG "[sim::st7789]"
+
+/**
+ * ST7789 panel model.
+ *
+ * Replaces the SPI/backlight half of drivers/st7789.c. Commands and pixel
+ * data sent by st7789_commit_fb() are decoded as the controller would do
+ * (CASET/RASET window, RAMWR stream of big-endian RGB565 pixels) into a
+ * headless panel memory that can be dumped as a PPM image.
+ *
+ * The panel is mounted upside down in the watch (hence the default X/Y
+ * inversion in the driver), dumps are rotated by 180 degrees to show what
+ * the wearer sees.
+ **/
+
+#define PANEL_WIDTH     240
+#define PANEL_HEIGHT    240
+
+typedef struct {
+  /* Current command and its parameters. */
+  uint8_t cmd;
+  uint8_t params[4];
+  int nb_params;
+
+  /* Write window and cursor. */
+  int x0, x1, y0, y1;
+  int x, y;
+
+  /* Pixel assembly (two bytes per pixel). */
+  uint8_t pix_msb;
+  bool b_pix_half;
+
+  /* Panel memory. */
+  uint16_t gram[PANEL_HEIGHT][PANEL_WIDTH];
+} sim_panel_t;
+
+static sim_panel_t g_panel = {
+  .x1 = PANEL_WIDTH - 1,
+  .y1 = PANEL_HEIGHT - 1
+};
+static sim_panel_stats_t g_panel_stats;
+
+
+/**
+ * sim_panel_clamp()
+ *
+ * @brief Clamp a window address to the panel size, as the controller
+ *        ignores addresses beyond its memory.
+ **/
+
+static int sim_panel_clamp(int value, int max)
+{
+  return (value > (max - 1))?(max - 1):value;
+}
+
+
+/**
+ * sim_panel_write_pixel()
+ *
+ * @brief Write a pixel at cursor position and advance cursor in window.
+ * @param pixel: RGB565 pixel
+ **/
+
+static void sim_panel_write_pixel(uint16_t pixel)
+{
+  g_panel.gram[g_panel.y][g_panel.x] = pixel;
+
+  if (++g_panel.x > g_panel.x1)
+  {
+    g_panel.x = g_panel.x0;
+    if (++g_panel.y > g_panel.y1)
+      g_panel.y = g_panel.y0;
+  }
+}
+
+
+/**
+ * sim_panel_param()
+ *
+ * @brief Process a command parameter byte.
+ * @param byte: parameter
+ **/
+
+static void sim_panel_param(uint8_t byte)
+{
+  if (g_panel.nb_params < (int)sizeof(g_panel.params))
+    g_panel.params[g_panel.nb_params++] = byte;
+
+  if (g_panel.nb_params != 4)
+    return;
+
+  switch (g_panel.cmd)
+  {
+    case ST7789_CMD_CASET:
+      g_panel.x0 = sim_panel_clamp((g_panel.params[0] << 8) | g_panel.params[1], PANEL_WIDTH);
+      g_panel.x1 = sim_panel_clamp((g_panel.params[2] << 8) | g_panel.params[3], PANEL_WIDTH);
+      break;
+
+    case ST7789_CMD_RASET:
+      g_panel.y0 = sim_panel_clamp((g_panel.params[0] << 8) | g_panel.params[1], PANEL_HEIGHT);
+      g_panel.y1 = sim_panel_clamp((g_panel.params[2] << 8) | g_panel.params[3], PANEL_HEIGHT);
+      break;
+
+    default:
+      break;
+  }
+}
+
+
+/**********************************************************************
+ * Hardware interface replacement
+ **********************************************************************/
+
+void st7789_wait(int milliseconds)
+{
+  sim_time_advance(milliseconds * 1000);
+}
+
+esp_err_t st7789_send_cmd(const uint8_t cmd)
+{
+  g_panel_stats.nb_bytes++;
+  g_panel.cmd = cmd;
+  g_panel.nb_params = 0;
+
+  if (cmd == ST7789_CMD_RAMWR)
+  {
+    /* Memory write starts at window origin. */
+    g_panel.x = g_panel.x0;
+    g_panel.y = g_panel.y0;
+    g_panel.b_pix_half = false;
+    g_panel_stats.nb_frames++;
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t st7789_send_data(const uint8_t *data, int len)
+{
+  int i;
+
+  if (len == 0)
+    return ESP_FAIL;
+
+  g_panel_stats.nb_bytes += len;
+  for (i=0; i<len; i++)
+  {
+    if (g_panel.cmd == ST7789_CMD_RAMWR)
+    {
+      /* RGB565, most significant byte first. */
+      if (g_panel.b_pix_half)
+        sim_panel_write_pixel((g_panel.pix_msb << 8) | data[i]);
+      else
+        g_panel.pix_msb = data[i];
+      g_panel.b_pix_half = !g_panel.b_pix_half;
+    }
+    else
+      sim_panel_param(data[i]);
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t st7789_send_data_byte(const uint8_t byte)
+{
+  return st7789_send_data(&byte, 1);
+}
+
+esp_err_t st7789_init_backlight(void)
+{
+  g_panel_stats.backlight = 0;
+  return ESP_OK;
+}
+
+esp_err_t st7789_init(void)
+{
+  memset(g_panel.gram, 0, sizeof(g_panel.gram));
+  g_panel.x0 = 0;
+  g_panel.y0 = 0;
+  g_panel.x1 = PANEL_WIDTH - 1;
+  g_panel.y1 = PANEL_HEIGHT - 1;
+  return ESP_OK;
+}
+
+void st7789_backlight_on(void)
+{
+  g_panel_stats.backlight = 5000;
+}
+
+void st7789_backlight_set(int backlight_level)
+{
+  g_panel_stats.backlight = backlight_level;
+}
+
+int st7789_backlight_get()
+{
+  return g_panel_stats.backlight;
+}
+
+
+/**********************************************************************
+ * Simulator API
+ **********************************************************************/
+
+/**
+ * sim_panel_get_stats()
+ *
+ * @brief Get panel statistics.
+ * @param p_stats: pointer to a `sim_panel_stats_t` structure
+ **/
+
+void sim_panel_get_stats(sim_panel_stats_t *p_stats)
+{
+  memcpy(p_stats, &g_panel_stats, sizeof(sim_panel_stats_t));
+}
+
+
+/**
+ * sim_panel_dump_ppm()
+ *
+ * @brief Save panel memory as a binary PPM (P6) image.
+ * @param psz_path: output file path
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ **/
+
+esp_err_t sim_panel_dump_ppm(const char *psz_path)
+{
+  FILE *f_out;
+  int x, y;
+  uint16_t pixel;
+  uint8_t rgb[3];
+
+  f_out = fopen(psz_path, "wb");
+  if (f_out == NULL)
+    return ESP_FAIL;
+
+  fprintf(f_out, "P6\n%d %d\n255\n", PANEL_WIDTH, PANEL_HEIGHT);
+  for (y=0; y<PANEL_HEIGHT; y++)
+  {
+    for (x=0; x<PANEL_WIDTH; x++)
+    {
+      /* Expand RGB565 to RGB888. */
+      pixel = g_panel.gram[PANEL_HEIGHT - y - 1][PANEL_WIDTH - x - 1];
+      rgb[0] = (((pixel >> 11) & 0x1F) * 255) / 31;
+      rgb[1] = (((pixel >> 5) & 0x3F) * 255) / 63;
+      rgb[2] = ((pixel & 0x1F) * 255) / 31;
+      fwrite(rgb, 1, sizeof(rgb), f_out);
+    }
+  }
+
+  fclose(f_out);
+  ESP_LOGI(TAG, "screenshot saved to %s", psz_path);
+  return ESP_OK;
+}
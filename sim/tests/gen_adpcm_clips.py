@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""
+Generate IMA ADPCM test clips for test_audio_clip.c.
+
+  gen_adpcm_clips.py path/to/adpcm_encode.py output_dir
+
+Test signals are written as WAV files and encoded with the clip encoder
+itself. The expected PCM is what the encoder predicted while encoding,
+i.e. what the decoder must output bit for bit. Everything ends up in
+output_dir/adpcm_clips.h.
+"""
+
+import os
+import sys
+import math
+import wave
+import struct
+import subprocess
+import importlib.util
+
+RATE = 8000
+
+
+def sine(nb_frames, freq, amplitude):
+    return [int(round(amplitude * math.sin(2 * math.pi * freq * i / RATE))) for i in range(nb_frames)]
+
+
+def clamp_edges():
+    """Drive the step index to 88 and the predictor to both rails, then
+    back down to index 0 with silence and 1-LSB steps."""
+    samples = []
+    for i in range(24):
+        samples += [32767 if i % 2 else -32768] * 12
+    samples += [0] * 200
+    samples += [1, -1, 0, 0] * 25
+    return samples
+
+
+def write_wav(path, channels_samples):
+    with wave.open(path, 'wb') as wav:
+        wav.setnchannels(len(channels_samples))
+        wav.setsampwidth(2)
+        wav.setframerate(RATE)
+        frames = [s for frame in zip(*channels_samples) for s in frame]
+        wav.writeframes(struct.pack('<%dh' % len(frames), *frames))
+
+
+def decode(encoder, clip):
+    """Decode a clip with the encoder's own channel model."""
+    _, _, nb_frames, block_size, channels, _ = struct.unpack('<4sIIHBB', clip[:16])
+    data = clip[16:]
+    states = [encoder.Channel() for _ in range(channels)]
+    frames = []
+
+    for offset in range(0, len(data), block_size):
+        block = data[offset:offset + block_size]
+        for c, state in enumerate(states):
+            state.predictor, state.index = struct.unpack('<hB', block[4*c:4*c + 3])
+        frames.append([state.predictor for state in states])
+
+        for group in range(4 * channels, len(block), 4 * channels):
+            samples = []
+            for c, state in enumerate(states):
+                nibbles = []
+                for byte in block[group + 4*c:group + 4*c + 4]:
+                    nibbles += [byte & 0x0f, byte >> 4]
+                samples.append([state.decode(n) for n in nibbles])
+            frames += [list(frame) for frame in zip(*samples)]
+
+    return frames[:nb_frames]
+
+
+def main():
+    encoder_path, out_dir = sys.argv[1:3]
+    spec = importlib.util.spec_from_file_location('adpcm_encode', encoder_path)
+    encoder = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(encoder)
+
+    # name, per-channel samples, encoder block size per channel.
+    cases = [
+        ('clip_sine', [sine(1001, 440, 12000)], 64),
+        ('clip_clamp', [clamp_edges()], 256),
+        ('clip_stereo', [sine(517, 1000, 20000), clamp_edges()[:517]], 32),
+    ]
+
+    with open(os.path.join(out_dir, 'adpcm_clips.h'), 'w') as out:
+        out.write('/* Generated by sim/tests/gen_adpcm_clips.py, do not edit. */\n')
+        for name, samples, block_size in cases:
+            wav_path = os.path.join(out_dir, name + '.wav')
+            bin_path = os.path.join(out_dir, name + '.bin')
+            write_wav(wav_path, samples)
+            subprocess.check_call([sys.executable, encoder_path, '--block-size', str(block_size),
+                                   wav_path, bin_path], stderr=subprocess.DEVNULL)
+            with open(bin_path, 'rb') as f:
+                clip = f.read()
+            encoder.write_c_array(os.path.join(out_dir, name + '.h'), clip)
+            frames = decode(encoder, clip)
+
+            out.write('#include "%s.h"\n' % name)
+            out.write('static const int16_t %s_pcm[%d][2] = {\n' % (name, len(frames)))
+            for frame in frames:
+                out.write('  { %d, %d },\n' % (frame[0], frame[-1]))
+            out.write('};\n\n')
+
+        out.write('static const adpcm_case_t g_cases[] = {\n')
+        for name, samples, _ in cases:
+            out.write('  { "%s", %s, sizeof(%s), %d, %d, %s_pcm },\n' % (
+                name, name, name, len(samples), len(samples[0]), name))
+        out.write('};\n')
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,38 @@
+#ifndef __INC_SIM_TEST_H
+#define __INC_SIM_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Minimal host test helpers. Each test program counts failed checks and
+ * returns a non-zero status if any failed, as expected by ctest.
+ **/
+
+static int g_test_failures = 0;
+
+#define TEST_CHECK(cond) do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      g_test_failures++; \
+    } \
+  } while (0)
+
+#define TEST_CHECK_INT(value, expected) do { \
+    long long _v = (long long)(value), _e = (long long)(expected); \
+    if (_v != _e) { \
+      fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #value, _v, _e); \
+      g_test_failures++; \
+    } \
+  } while (0)
+
+#define TEST_RUN(test) do { \
+    int _failures = g_test_failures; \
+    test(); \
+    printf("%s %s\n", (g_test_failures == _failures) ? "PASS" : "FAIL", #test); \
+  } while (0)
+
+#define TEST_EXIT() ((g_test_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE)
+
+#endif /* __INC_SIM_TEST_H */
@@ -0,0 +1,190 @@
+#include "test.h"
+#include "hal/audio_clip.h"
+
+/**
+ * IMA ADPCM clip decoder tests. Clips are produced by tools/adpcm_encode.py
+ * at build time (see gen_adpcm_clips.py) and decoded frames must match the
+ * encoder's own prediction bit for bit.
+ **/
+
+typedef struct {
+  const char *psz_name;
+  const uint8_t *p_clip;
+  size_t size;
+  int channels;
+  uint32_t nb_frames;
+  const int16_t (*p_pcm)[2];
+} adpcm_case_t;
+
+#include "adpcm_clips.h"
+
+#define NB_CASES (sizeof(g_cases)/sizeof(adpcm_case_t))
+
+static int g_output_rate;
+
+
+/* Audio HAL stubs, the clip decoder only needs the output rate. */
+
+int twatch_audio_get_sample_rate(void)
+{
+  return g_output_rate;
+}
+
+esp_err_t twatch_audio_play_source(FAudioRender pfn_render, void *p_source)
+{
+  return ESP_FAIL;
+}
+
+
+/**
+ * decode_and_compare()
+ *
+ * @brief Render a whole clip one frame at a time at its own rate (no
+ *        resampling) and compare it against reference frames.
+ * @param p_clip: pointer to an opened clip
+ * @param p_pcm: reference frames, mono is expected on both channels
+ * @param nb_frames: number of reference frames
+ * @param p_min_index: pointer to lowest step index seen
+ * @param p_max_index: pointer to highest step index seen
+ * @return number of mismatching frames
+ **/
+
+static int decode_and_compare(twatch_audio_clip_t *p_clip, const int16_t (*p_pcm)[2], uint32_t nb_frames,
+                              int *p_min_index, int *p_max_index)
+{
+  int16_t frame[2];
+  uint32_t i;
+  int c, nb_errors = 0;
+
+  *p_min_index = 88;
+  *p_max_index = 0;
+
+  for (i=0; i<nb_frames; i++)
+  {
+    if (twatch_audio_clip_render(p_clip, frame, 1) != 1)
+    {
+      fprintf(stderr, "clip ended at frame %u\n", i);
+      return nb_errors + 1;
+    }
+
+    if ((frame[0] != p_pcm[i][0]) || (frame[1] != p_pcm[i][1]))
+    {
+      if (nb_errors++ < 8)
+        fprintf(stderr, "frame %u is (%d, %d), expected (%d, %d)\n",
+                i, frame[0], frame[1], p_pcm[i][0], p_pcm[i][1]);
+    }
+
+    for (c=0; c<p_clip->channels; c++)
+    {
+      if (p_clip->index[c] < *p_min_index)
+        *p_min_index = p_clip->index[c];
+      if (p_clip->index[c] > *p_max_index)
+        *p_max_index = p_clip->index[c];
+    }
+  }
+
+  /* Nothing past the last frame. */
+  if (twatch_audio_clip_render(p_clip, frame, 1) != 0)
+    nb_errors++;
+
+  return nb_errors;
+}
+
+
+static void test_encoder_clips(void)
+{
+  twatch_audio_clip_t clip;
+  int i, min_index, max_index;
+
+  for (i=0; i<NB_CASES; i++)
+  {
+    g_output_rate = 8000;
+    TEST_CHECK_INT(twatch_audio_clip_open(&clip, g_cases[i].p_clip, g_cases[i].size), ESP_OK);
+    TEST_CHECK_INT(clip.sample_rate, 8000);
+    TEST_CHECK_INT(clip.channels, g_cases[i].channels);
+    TEST_CHECK_INT(clip.nb_frames, g_cases[i].nb_frames);
+
+    if (decode_and_compare(&clip, g_cases[i].p_pcm, g_cases[i].nb_frames, &min_index, &max_index) != 0)
+    {
+      fprintf(stderr, "%s: decoded clip differs from encoder\n", g_cases[i].psz_name);
+      g_test_failures++;
+    }
+
+    /* Clamp edges clip must reach both ends of the step table. */
+    if (strcmp(g_cases[i].psz_name, "clip_clamp") == 0)
+    {
+      TEST_CHECK_INT(min_index, 0);
+      TEST_CHECK_INT(max_index, 88);
+    }
+  }
+}
+
+
+static void test_rewind(void)
+{
+  twatch_audio_clip_t clip;
+  int16_t frame[2];
+  int min_index, max_index;
+
+  /* Second pass must be identical, block state is restored from headers. */
+  g_output_rate = 8000;
+  TEST_CHECK_INT(twatch_audio_clip_open(&clip, g_cases[0].p_clip, g_cases[0].size), ESP_OK);
+  TEST_CHECK_INT(twatch_audio_clip_render(&clip, frame, 1), 1);
+  twatch_audio_clip_rewind(&clip);
+  TEST_CHECK_INT(decode_and_compare(&clip, g_cases[0].p_pcm, g_cases[0].nb_frames, &min_index, &max_index), 0);
+}
+
+
+static void test_header_index_clamp(void)
+{
+  static const uint8_t clip_data[] = {
+    'I', 'M', 'A', '4',
+    0x40, 0x1f, 0x00, 0x00,         /* 8000 Hz. */
+    0x09, 0x00, 0x00, 0x00,         /* 9 frames. */
+    0x08, 0x00,                     /* 8-byte blocks. */
+    0x01, 0x00,                     /* Mono. */
+    0x00, 0x00, 200, 0x00,          /* Out of range step index. */
+    0x77, 0xff, 0x00, 0x88
+  };
+  static const int16_t pcm[9][2] = {
+    { 0, 0 }, { 32767, 32767 }, { 32767, 32767 }, { -28669, -28669 }, { -32768, -32768 },
+    { -28673, -28673 }, { -24949, -24949 }, { -28334, -28334 }, { -31411, -31411 }
+  };
+  twatch_audio_clip_t clip;
+  int min_index, max_index;
+
+  /* Header index is clamped to 88, then the predictor to both rails. */
+  g_output_rate = 8000;
+  TEST_CHECK_INT(twatch_audio_clip_open(&clip, clip_data, sizeof(clip_data)), ESP_OK);
+  TEST_CHECK_INT(decode_and_compare(&clip, pcm, 9, &min_index, &max_index), 0);
+  TEST_CHECK_INT(clip.index[0], 84);
+}
+
+
+static void test_invalid_clips(void)
+{
+  twatch_audio_clip_t clip;
+  uint8_t header[AUDIO_CLIP_HEADER_SIZE];
+
+  TEST_CHECK_INT(twatch_audio_clip_open(&clip, NULL, 0), ESP_ERR_INVALID_ARG);
+  TEST_CHECK_INT(twatch_audio_clip_open(&clip, g_cases[0].p_clip, AUDIO_CLIP_HEADER_SIZE - 1), ESP_ERR_INVALID_ARG);
+
+  /* Bad magic, then block size not a multiple of 4 bytes per channel. */
+  memcpy(header, g_cases[0].p_clip, sizeof(header));
+  header[0] = 'X';
+  TEST_CHECK_INT(twatch_audio_clip_open(&clip, header, sizeof(header)), ESP_ERR_INVALID_ARG);
+  memcpy(header, g_cases[2].p_clip, sizeof(header));
+  header[12] = 36;
+  TEST_CHECK_INT(twatch_audio_clip_open(&clip, header, sizeof(header)), ESP_ERR_INVALID_ARG);
+}
+
+
+int main(void)
+{
+  TEST_RUN(test_encoder_clips);
+  TEST_RUN(test_rewind);
+  TEST_RUN(test_header_index_clamp);
+  TEST_RUN(test_invalid_clips);
+
+  return TEST_EXIT();
+}
@@ -0,0 +1,171 @@
+#include <math.h>
+#include "test.h"
+#include "hal/gps_geo.h"
+
+/**
+ * Geodesy helpers tests. Reference distances and bearings were computed in
+ * double precision with the same mean Earth radius (6371008.8 m).
+ **/
+
+typedef struct {
+  double lat1, lng1;
+  double lat2, lng2;
+  uint32_t distance_cm;
+  int bearing;            /* Hundredths of degree, -1 if undefined. */
+} geo_ref_t;
+
+static const geo_ref_t g_refs[] = {
+  /* Paris to London. */
+  { 48.8566, 2.3522, 51.5074, -0.1278, 34355653, 33002 },
+
+  /* Short hops, north then east. */
+  { 45.0, 7.0, 45.009, 7.0, 100076, 0 },
+  { 45.0, 7.0, 45.0, 7.0127, 99856, 9000 },
+
+  /* Across the antimeridian, both ways. */
+  { 0.0, 179.9, 0.0, -179.9, 2223902, 9000 },
+  { 0.0, -179.9, 0.0, 179.9, 2223902, 27000 },
+
+  /* Antipodes, bearing is undefined. */
+  { 10.0, 20.0, -10.0, -160.0, 2001511425, -1 },
+  { 90.0, 0.0, -90.0, 0.0, 2001511444, -1 },
+
+  /* Poles. */
+  { 0.0, 0.0, 90.0, 0.0, 1000755722, 0 },
+  { 0.0, 0.0, -90.0, 0.0, 1000755722, 18000 },
+  { 90.0, 0.0, 89.0, 45.0, 11119508, -1 },
+  { 89.99, 0.0, 89.99, 180.0, 222390, 0 },
+};
+
+#define NB_REFS (sizeof(g_refs)/sizeof(geo_ref_t))
+
+
+static geo_point_t point(double lat, double lng)
+{
+  geo_point_t p;
+
+  p.lat = (int32_t)lround(lat * 1e7);
+  p.lng = (int32_t)lround(lng * 1e7);
+  return p;
+}
+
+
+static void check_distance(uint32_t distance_cm, uint32_t expected_cm, double max_error)
+{
+  double error = fabs((double)distance_cm - expected_cm);
+
+  if (error > max_error * expected_cm + 2.0)
+  {
+    fprintf(stderr, "distance is %u cm, expected %u cm\n", distance_cm, expected_cm);
+    g_test_failures++;
+  }
+}
+
+
+static void test_haversine(void)
+{
+  geo_point_t from, to;
+  int i;
+
+  /* Single precision, 0.001% at any distance. */
+  for (i=0; i<NB_REFS; i++)
+  {
+    from = point(g_refs[i].lat1, g_refs[i].lng1);
+    to = point(g_refs[i].lat2, g_refs[i].lng2);
+    check_distance(geo_haversine_cm(&from, &to), g_refs[i].distance_cm, 0.00001);
+    check_distance(geo_haversine_cm(&to, &from), g_refs[i].distance_cm, 0.00001);
+  }
+}
+
+
+static void test_equirectangular(void)
+{
+  geo_point_t from, to;
+  int i;
+
+  /* Documented accuracy (0.1%) only holds for short distances. */
+  for (i=0; i<NB_REFS; i++)
+  {
+    if (g_refs[i].distance_cm > 5000000)
+      continue;
+
+    /* Not meant to cross the poles either. */
+    if ((fabs(g_refs[i].lat1) > 85.0) || (fabs(g_refs[i].lat2) > 85.0))
+      continue;
+
+    from = point(g_refs[i].lat1, g_refs[i].lng1);
+    to = point(g_refs[i].lat2, g_refs[i].lng2);
+    check_distance(geo_distance_cm(&from, &to), g_refs[i].distance_cm, 0.001);
+    check_distance(geo_distance_cm(&to, &from), g_refs[i].distance_cm, 0.001);
+  }
+
+  /* Paris to London is 343 km, still within 0.1%. */
+  from = point(48.8566, 2.3522);
+  to = point(51.5074, -0.1278);
+  check_distance(geo_distance_cm(&from, &to), 34355653, 0.001);
+}
+
+
+static void test_bearing(void)
+{
+  geo_point_t from, to;
+  int i, bearing, error;
+
+  for (i=0; i<NB_REFS; i++)
+  {
+    if (g_refs[i].bearing < 0)
+      continue;
+
+    from = point(g_refs[i].lat1, g_refs[i].lng1);
+    to = point(g_refs[i].lat2, g_refs[i].lng2);
+    bearing = geo_bearing(&from, &to);
+    TEST_CHECK((bearing >= 0) && (bearing < 36000));
+
+    /* 0.01 degree, either side of north. */
+    error = abs(bearing - g_refs[i].bearing);
+    if (error > 18000)
+      error = 36000 - error;
+    if (error > 1)
+    {
+      fprintf(stderr, "ref #%d: bearing is %d, expected %d\n", i, bearing, g_refs[i].bearing);
+      g_test_failures++;
+    }
+  }
+}
+
+
+static void test_zero_distance(void)
+{
+  geo_point_t points[] = {
+    point(0.0, 0.0),
+    point(48.8566, 2.3522),
+    point(-33.8688, 151.2093),
+    point(0.0, 180.0),
+    point(90.0, 0.0),
+    point(-90.0, 0.0)
+  };
+  int i;
+
+  for (i=0; i<(sizeof(points)/sizeof(geo_point_t)); i++)
+  {
+    TEST_CHECK_INT(geo_haversine_cm(&points[i], &points[i]), 0);
+    TEST_CHECK_INT(geo_distance_cm(&points[i], &points[i]), 0);
+  }
+
+  /* Same place, on each side of the antimeridian. */
+  points[0] = point(0.0, 180.0);
+  points[1] = point(0.0, -180.0);
+  TEST_CHECK_INT(geo_haversine_cm(&points[0], &points[1]), 0);
+  TEST_CHECK_INT(geo_distance_cm(&points[0], &points[1]), 0);
+}
+
+
+int main(void)
+{
+  TEST_RUN(test_haversine);
+  TEST_RUN(test_equirectangular);
+  TEST_RUN(test_bearing);
+  TEST_RUN(test_zero_distance);
+
+  return TEST_EXIT();
+}
@@ -0,0 +1,99 @@
+#include "test.h"
+#include "hal/gps_sched.h"
+
+/**
+ * GPS periodic scheduler tests. Fix cycles are simulated with the power
+ * model from gps_sched.h: receiver on until it gets a fix, then either kept
+ * tracking or switched off until the next period.
+ **/
+
+static gps_sched_config_t g_config = {
+  .mode = GPS_SCHED_PERIODIC,
+  .period_s = GPS_SCHED_DEFAULT_PERIOD_S,
+  .max_period_s = GPS_SCHED_DEFAULT_MAX_PERIOD_S,
+  .fix_timeout_s = GPS_SCHED_DEFAULT_FIX_TIMEOUT_S,
+  .motion_hold_s = GPS_SCHED_DEFAULT_MOTION_HOLD_S
+};
+
+
+/**
+ * simulate_off_time()
+ *
+ * @brief Run a number of stationary fix cycles and sum the time spent with
+ *        the receiver switched off.
+ * @param ttff_ms: time to fix after each power-up in milliseconds
+ * @param nb_cycles: number of fix cycles
+ * @param p_period_s: pointer to the period reached after the last cycle
+ * @return off-time in seconds
+ **/
+
+static uint32_t simulate_off_time(uint32_t ttff_ms, int nb_cycles, uint32_t *p_period_s)
+{
+  uint32_t period_s = g_config.period_s;
+  uint32_t off_time_s = 0;
+  int i;
+
+  for (i=0; i<nb_cycles; i++)
+  {
+    if (!gps_sched_keep_tracking(period_s, ttff_ms))
+    {
+      off_time_s += period_s - ttff_ms/1000;
+      period_s = gps_sched_next_period(&g_config, period_s, 0);
+    }
+  }
+
+  *p_period_s = period_s;
+  return off_time_s;
+}
+
+
+static void test_default_periodic_cycles(void)
+{
+  uint32_t period_s, off_time_s;
+
+  /* Default period with a cold TTFF must switch the receiver off. */
+  TEST_CHECK(!gps_sched_keep_tracking(GPS_SCHED_DEFAULT_PERIOD_S, GPS_DEFAULT_TTFF_MS));
+
+  /* 60 + 120 + 240 + 480 + 600 s periods, 30 s on for each of them. */
+  off_time_s = simulate_off_time(GPS_DEFAULT_TTFF_MS, 5, &period_s);
+  TEST_CHECK_INT(off_time_s, 1350);
+  TEST_CHECK_INT(period_s, GPS_SCHED_DEFAULT_MAX_PERIOD_S);
+
+  TEST_CHECK(gps_sched_periodic_current(GPS_SCHED_DEFAULT_PERIOD_S, GPS_DEFAULT_TTFF_MS) < GPS_CURRENT_TRACKING_MA);
+}
+
+
+static void test_keep_tracking(void)
+{
+  /* Next fix due before this one is acquired. */
+  TEST_CHECK(gps_sched_keep_tracking(10, GPS_DEFAULT_TTFF_MS));
+  TEST_CHECK(gps_sched_keep_tracking(30, GPS_DEFAULT_TTFF_MS));
+  TEST_CHECK(gps_sched_periodic_current(10, GPS_DEFAULT_TTFF_MS) == GPS_CURRENT_TRACKING_MA);
+
+  /* Off-time too short to pay for reacquisition at 30 s TTFF (break-even at 48 s). */
+  TEST_CHECK(gps_sched_keep_tracking(45, GPS_DEFAULT_TTFF_MS));
+  TEST_CHECK(!gps_sched_keep_tracking(50, GPS_DEFAULT_TTFF_MS));
+
+  /* Hot starts make short periods worth cycling. */
+  TEST_CHECK(!gps_sched_keep_tracking(10, 2000));
+}
+
+
+static void test_next_period(void)
+{
+  /* Moving resets to the base period, stationary doubles up to max. */
+  TEST_CHECK_INT(gps_sched_next_period(&g_config, 480, GPS_STATIONARY_SPEED), GPS_SCHED_DEFAULT_PERIOD_S);
+  TEST_CHECK_INT(gps_sched_next_period(&g_config, 60, 0), 120);
+  TEST_CHECK_INT(gps_sched_next_period(&g_config, 480, 0), GPS_SCHED_DEFAULT_MAX_PERIOD_S);
+  TEST_CHECK_INT(gps_sched_next_period(&g_config, 600, 0), GPS_SCHED_DEFAULT_MAX_PERIOD_S);
+}
+
+
+int main(void)
+{
+  TEST_RUN(test_default_periodic_cycles);
+  TEST_RUN(test_keep_tracking);
+  TEST_RUN(test_next_period);
+
+  return TEST_EXIT();
+}
@@ -0,0 +1,347 @@
+#include <setjmp.h>
+#include "test.h"
+#include "drivers/i2c.h"
+
+/**
+ * I2C transaction scheduling tests. Bus workers are not started as real
+ * tasks: xTaskCreate() only records them and they are run on demand until
+ * their queues are drained. The I2C master stubs log the register of each
+ * transaction, in execution order.
+ **/
+
+#define TEST_QUEUE_MAX_ITEMS  16
+#define TEST_LOG_MAX          32
+
+typedef struct {
+  void *items[TEST_QUEUE_MAX_ITEMS];
+  int head;
+  int count;
+  int length;
+} test_queue_t;
+
+typedef struct {
+  int count;
+  bool b_recursive;
+} test_sem_t;
+
+static TaskFunction_t g_workers[2];
+static void *g_worker_params[2];
+static TaskHandle_t g_current_task = (TaskHandle_t)0x100;
+static jmp_buf g_worker_exit;
+
+/* Register written by the command being built, and execution log. */
+static int g_cmd_nb_bytes;
+static uint8_t g_cmd_reg;
+static uint8_t g_log[TEST_LOG_MAX];
+static int g_log_size;
+
+
+/* FreeRTOS stubs. */
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+  test_sem_t *p_sem = calloc(1, sizeof(test_sem_t));
+
+  p_sem->b_recursive = true;
+  return (SemaphoreHandle_t)p_sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *p_buffer)
+{
+  p_buffer->count = 0;
+  return (SemaphoreHandle_t)p_buffer;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks_to_wait)
+{
+  ((test_sem_t *)sem)->count++;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem)
+{
+  ((test_sem_t *)sem)->count--;
+  return pdTRUE;
+}
+
+static void run_worker(i2c_bus_t bus);
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait)
+{
+  StaticSemaphore_t *p_sem = (StaticSemaphore_t *)sem;
+
+  /* Caller blocks, let the bus worker run (only binary semaphores here). */
+  if (p_sem->count == 0)
+    run_worker(I2C_PRI);
+  if (p_sem->count == 0)
+    return pdFALSE;
+
+  p_sem->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+  ((StaticSemaphore_t *)sem)->count = 1;
+  return pdTRUE;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+  test_queue_t *p_queue = calloc(1, sizeof(test_queue_t));
+
+  assert(item_size == sizeof(void *));
+  assert(length <= TEST_QUEUE_MAX_ITEMS);
+  p_queue->length = length;
+  return (QueueHandle_t)p_queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *p_item, TickType_t ticks_to_wait)
+{
+  test_queue_t *p_queue = (test_queue_t *)queue;
+
+  if (p_queue->count == p_queue->length)
+    return pdFALSE;
+
+  memcpy(&p_queue->items[(p_queue->head + p_queue->count) % p_queue->length], p_item, sizeof(void *));
+  p_queue->count++;
+  return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *p_item, BaseType_t *p_task_woken)
+{
+  return xQueueSend(queue, p_item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *p_item, TickType_t ticks_to_wait)
+{
+  test_queue_t *p_queue = (test_queue_t *)queue;
+
+  if (p_queue->count == 0)
+    return pdFALSE;
+
+  memcpy(p_item, &p_queue->items[p_queue->head], sizeof(void *));
+  p_queue->head = (p_queue->head + 1) % p_queue->length;
+  p_queue->count--;
+  return pdTRUE;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pfn_task, const char *psz_name, uint32_t stack_depth, void *p_param,
+                       UBaseType_t priority, TaskHandle_t *p_task)
+{
+  int bus = (int)(intptr_t)p_param;
+
+  g_workers[bus] = pfn_task;
+  g_worker_params[bus] = p_param;
+  *p_task = (TaskHandle_t)(intptr_t)(0x200 + bus);
+  return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *p_task_woken)
+{
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t b_clear, TickType_t ticks_to_wait)
+{
+  /* Only bus workers wait here, once their queues are empty. */
+  longjmp(g_worker_exit, 1);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+  return g_current_task;
+}
+
+int64_t esp_timer_get_time(void)
+{
+  return 0;
+}
+
+
+/* I2C master stubs. */
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *p_config)
+{
+  return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len,
+                             int intr_alloc_flags)
+{
+  return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *p_buffer, uint32_t size)
+{
+  g_cmd_nb_bytes = 0;
+  return (i2c_cmd_handle_t)p_buffer;
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd)
+{
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd)
+{
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd)
+{
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en)
+{
+  /* Address byte first, then register. */
+  if (g_cmd_nb_bytes++ == 1)
+    g_cmd_reg = data;
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, const uint8_t *p_data, size_t len, bool ack_en)
+{
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t *p_data, i2c_ack_type_t ack)
+{
+  *p_data = g_cmd_reg;
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd, uint8_t *p_data, size_t len, i2c_ack_type_t ack)
+{
+  memset(p_data, g_cmd_reg, len);
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks_to_wait)
+{
+  if (g_log_size < TEST_LOG_MAX)
+    g_log[g_log_size++] = g_cmd_reg;
+  return ESP_OK;
+}
+
+
+/**
+ * run_worker()
+ *
+ * @brief Run a bus worker until it has no pending transaction left.
+ * @param bus: I2C bus
+ **/
+
+static void run_worker(i2c_bus_t bus)
+{
+  TaskHandle_t caller = g_current_task;
+
+  g_current_task = (TaskHandle_t)(intptr_t)(0x200 + bus);
+  if (setjmp(g_worker_exit) == 0)
+    g_workers[bus](g_worker_params[bus]);
+  g_current_task = caller;
+}
+
+
+static void queue_read(i2c_xfer_t *p_xfer, i2c_xfer_prio_t priority, uint8_t reg, uint8_t *p_data)
+{
+  memset(p_xfer, 0, sizeof(i2c_xfer_t));
+  p_xfer->type = I2C_XFER_READ;
+  p_xfer->priority = priority;
+  p_xfer->addr = 0x35;
+  p_xfer->reg = reg;
+  p_xfer->data = p_data;
+  p_xfer->len = 1;
+  TEST_CHECK_INT(twatch_i2c_submit(I2C_PRI, p_xfer, 0), ESP_OK);
+}
+
+
+static void test_priority_order(void)
+{
+  i2c_xfer_t xfers[5];
+  uint8_t data[5];
+  int i;
+
+  /* Low priority polling queued first, then a setup read and an IRQ read. */
+  g_log_size = 0;
+  queue_read(&xfers[0], I2C_XFER_PRIO_LOW, 0x78, &data[0]);
+  queue_read(&xfers[1], I2C_XFER_PRIO_LOW, 0xB0, &data[1]);
+  queue_read(&xfers[2], I2C_XFER_PRIO_NORMAL, 0x12, &data[2]);
+  queue_read(&xfers[3], I2C_XFER_PRIO_LOW, 0xB4, &data[3]);
+  queue_read(&xfers[4], I2C_XFER_PRIO_HIGH, 0x48, &data[4]);
+  for (i=0; i<5; i++)
+    TEST_CHECK_INT(xfers[i].result, ESP_ERR_INVALID_STATE);
+
+  run_worker(I2C_PRI);
+
+  /* Highest priority first, submission order within a priority level. */
+  TEST_CHECK_INT(g_log_size, 5);
+  TEST_CHECK_INT(g_log[0], 0x48);
+  TEST_CHECK_INT(g_log[1], 0x12);
+  TEST_CHECK_INT(g_log[2], 0x78);
+  TEST_CHECK_INT(g_log[3], 0xB0);
+  TEST_CHECK_INT(g_log[4], 0xB4);
+  for (i=0; i<5; i++)
+  {
+    TEST_CHECK_INT(xfers[i].result, ESP_OK);
+    TEST_CHECK_INT(data[i], xfers[i].reg);
+  }
+}
+
+
+static void test_blocking_high_overtakes_low(void)
+{
+  i2c_xfer_t xfers[3];
+  uint8_t data[3], irq_status[5];
+  i2c_read_op_t ops[] = {
+    {.reg = 0x48, .data = &irq_status[0], .len = 4},
+    {.reg = 0x4C, .data = &irq_status[4], .len = 1}
+  };
+
+  /* Blocking IRQ status read while battery polling is still queued. */
+  g_log_size = 0;
+  queue_read(&xfers[0], I2C_XFER_PRIO_LOW, 0x78, &data[0]);
+  queue_read(&xfers[1], I2C_XFER_PRIO_LOW, 0x7A, &data[1]);
+  queue_read(&xfers[2], I2C_XFER_PRIO_LOW, 0xB0, &data[2]);
+  TEST_CHECK_INT(twatch_i2c_readBatchPrio(I2C_PRI, I2C_XFER_PRIO_HIGH, 0x35, ops, 2, 10), ESP_OK);
+
+  /* Caller is released once the worker drained the queues. */
+  TEST_CHECK_INT(g_log_size, 4);
+  TEST_CHECK_INT(g_log[0], 0x48);
+  TEST_CHECK_INT(g_log[1], 0x78);
+  TEST_CHECK_INT(g_log[2], 0x7A);
+  TEST_CHECK_INT(g_log[3], 0xB0);
+  TEST_CHECK_INT(irq_status[0], 0x48);
+  TEST_CHECK_INT(xfers[2].result, ESP_OK);
+}
+
+
+static void test_blocking_from_worker(void)
+{
+  uint8_t data = 0;
+
+  /* Calls issued by the worker itself (callbacks) cannot be queued. */
+  g_log_size = 0;
+  g_current_task = (TaskHandle_t)(intptr_t)(0x200 + I2C_PRI);
+  TEST_CHECK_INT(twatch_i2c_readBytesPrio(I2C_PRI, I2C_XFER_PRIO_LOW, 0x19, 0x1D, &data, 1, 10), ESP_OK);
+  g_current_task = (TaskHandle_t)0x100;
+
+  TEST_CHECK_INT(g_log_size, 1);
+  TEST_CHECK_INT(data, 0x1D);
+}
+
+
+int main(void)
+{
+  twatch_i2c_init();
+
+  TEST_RUN(test_priority_order);
+  TEST_RUN(test_blocking_high_overtakes_low);
+  TEST_RUN(test_blocking_from_worker);
+
+  return TEST_EXIT();
+}
@@ -0,0 +1,214 @@
+#include "test.h"
+#include "drivers/nmea.h"
+
+/**
+ * NMEA parser tests, run against reference sentences and damaged copies
+ * of them (bad checksums, truncated sentences, empty and overlong fields).
+ **/
+
+#define MAX_FIELDS  32
+
+typedef struct {
+  int nb_fields;
+  char fields[MAX_FIELDS][NMEA_FIELD_MAXLEN + 1];
+  int nb_valid;
+  int nb_invalid;
+} capture_t;
+
+static capture_t g_capture;
+static nmea_parser_t g_parser;
+
+
+static void on_field(nmea_parser_t *p_parser, int field_index, char *psz_field, int len)
+{
+  capture_t *p_capture = (capture_t *)p_parser->p_user_data;
+
+  /* Keep fields of the last sentence only. */
+  if (field_index == 0)
+    p_capture->nb_fields = 0;
+
+  TEST_CHECK_INT(field_index, p_capture->nb_fields);
+  TEST_CHECK_INT(len, strlen(psz_field));
+  if (p_capture->nb_fields < MAX_FIELDS)
+    strcpy(p_capture->fields[p_capture->nb_fields++], psz_field);
+}
+
+
+static void on_sentence(nmea_parser_t *p_parser, bool b_valid)
+{
+  capture_t *p_capture = (capture_t *)p_parser->p_user_data;
+
+  if (b_valid)
+    p_capture->nb_valid++;
+  else
+    p_capture->nb_invalid++;
+}
+
+
+static void setup(void)
+{
+  memset(&g_capture, 0, sizeof(g_capture));
+  nmea_parser_init(&g_parser, on_field, on_sentence, &g_capture);
+}
+
+
+static void feed(const char *psz_data)
+{
+  nmea_parser_feed(&g_parser, (uint8_t *)psz_data, strlen(psz_data));
+}
+
+
+static void test_valid_sentence(void)
+{
+  setup();
+  feed("$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\r\n");
+
+  TEST_CHECK_INT(g_capture.nb_valid, 1);
+  TEST_CHECK_INT(g_capture.nb_invalid, 0);
+  TEST_CHECK_INT(g_capture.nb_fields, 15);
+  TEST_CHECK(strcmp(g_capture.fields[0], "GPGGA") == 0);
+  TEST_CHECK(strcmp(g_capture.fields[2], "4807.038") == 0);
+  TEST_CHECK(strcmp(g_capture.fields[5], "E") == 0);
+  TEST_CHECK(strcmp(g_capture.fields[9], "545.4") == 0);
+  TEST_CHECK(strcmp(g_capture.fields[14], "") == 0);
+  TEST_CHECK_INT(g_parser.nb_sentences, 1);
+  TEST_CHECK_INT(g_parser.nb_checksum_errors, 0);
+  TEST_CHECK_INT(g_parser.nb_framing_errors, 0);
+}
+
+
+static void test_split_sentence(void)
+{
+  const char *psz_sentence = "$GPGLL,4916.45,N,12311.12,W,225444,A*31\r\n";
+  int i;
+
+  /* Byte by byte, as received from the UART ring buffer. */
+  setup();
+  for (i=0; psz_sentence[i] != '\0'; i++)
+    nmea_parser_push(&g_parser, psz_sentence[i]);
+
+  TEST_CHECK_INT(g_capture.nb_valid, 1);
+  TEST_CHECK_INT(g_capture.nb_fields, 7);
+  TEST_CHECK(strcmp(g_capture.fields[6], "A") == 0);
+}
+
+
+static void test_lowercase_checksum(void)
+{
+  setup();
+  feed("$GPGSV,1,1,01,07,79,048,42*4B\r\n");
+  feed("$GPGSV,1,1,01,07,79,048,42*4b\r\n");
+
+  TEST_CHECK_INT(g_capture.nb_valid, 2);
+  TEST_CHECK_INT(g_capture.nb_invalid, 0);
+}
+
+
+static void test_empty_fields(void)
+{
+  int i;
+
+  setup();
+  feed("$GPRMC,,V,,,,,,,,,,N*53\r\n");
+
+  TEST_CHECK_INT(g_capture.nb_valid, 1);
+  TEST_CHECK_INT(g_capture.nb_fields, 13);
+  TEST_CHECK(strcmp(g_capture.fields[2], "V") == 0);
+  TEST_CHECK(strcmp(g_capture.fields[12], "N") == 0);
+  for (i=3; i<12; i++)
+    TEST_CHECK(g_capture.fields[i][0] == '\0');
+}
+
+
+static void test_checksum_failure(void)
+{
+  setup();
+
+  /* Corrupted payload, then corrupted checksum. */
+  feed("$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.5,M,46.9,M,,*47\r\n");
+  feed("$GPGLL,4916.45,N,12311.12,W,225444,A*32\r\n");
+
+  TEST_CHECK_INT(g_capture.nb_valid, 0);
+  TEST_CHECK_INT(g_capture.nb_invalid, 2);
+  TEST_CHECK_INT(g_parser.nb_sentences, 0);
+  TEST_CHECK_INT(g_parser.nb_checksum_errors, 2);
+
+  /* Non-hexadecimal checksum is a framing error, no sentence reported. */
+  setup();
+  feed("$GPGLL,4916.45,N,12311.12,W,225444,A*3G\r\n");
+  TEST_CHECK_INT(g_capture.nb_valid + g_capture.nb_invalid, 0);
+  TEST_CHECK_INT(g_parser.nb_framing_errors, 1);
+}
+
+
+static void test_truncated_sentence(void)
+{
+  setup();
+
+  /* Cut by the next sentence. */
+  feed("$GPGGA,123519,4807.0");
+  feed("$GPGLL,4916.45,N,12311.12,W,225444,A*31\r\n");
+  TEST_CHECK_INT(g_capture.nb_valid, 1);
+  TEST_CHECK_INT(g_capture.nb_invalid, 0);
+  TEST_CHECK_INT(g_parser.nb_framing_errors, 1);
+
+  /* Cut by end of line, missing checksum. */
+  setup();
+  feed("$GPGLL,4916.45,N,12311.12,W\r\n");
+  feed("$GPGLL,4916.45,N,12311.12,W,225444,A*31\r\n");
+  TEST_CHECK_INT(g_capture.nb_valid, 1);
+  TEST_CHECK_INT(g_capture.nb_invalid, 0);
+  TEST_CHECK_INT(g_parser.nb_framing_errors, 1);
+
+  /* Cut in the middle of the checksum. */
+  setup();
+  feed("$GPGLL,4916.45,N,12311.12,W,225444,A*3\r\n");
+  TEST_CHECK_INT(g_capture.nb_valid + g_capture.nb_invalid, 0);
+  TEST_CHECK_INT(g_parser.nb_framing_errors, 1);
+
+  /* Garbage before the first sentence is ignored. */
+  setup();
+  feed("4,A*31\r\n$GPGLL,4916.45,N,12311.12,W,225444,A*31\r\n");
+  TEST_CHECK_INT(g_capture.nb_valid, 1);
+  TEST_CHECK_INT(g_parser.nb_framing_errors, 0);
+}
+
+
+static void test_overlong_input(void)
+{
+  char sentence[128];
+
+  /* Field longer than NMEA_FIELD_MAXLEN. */
+  setup();
+  feed("$GPTXT,0123456789012345678901234567890*00\r\n");
+  TEST_CHECK_INT(g_capture.nb_valid + g_capture.nb_invalid, 0);
+  TEST_CHECK_INT(g_parser.nb_framing_errors, 1);
+
+  /* Sentence longer than NMEA_SENTENCE_MAXLEN, made of short fields. */
+  setup();
+  strcpy(sentence, "$GPTXT");
+  while (strlen(sentence) < NMEA_SENTENCE_MAXLEN + 8)
+    strcat(sentence, ",12345");
+  strcat(sentence, "*00\r\n");
+  feed(sentence);
+  TEST_CHECK_INT(g_capture.nb_valid + g_capture.nb_invalid, 0);
+  TEST_CHECK_INT(g_parser.nb_framing_errors, 1);
+
+  /* Parser recovers on next sentence. */
+  feed("$GPGLL,4916.45,N,12311.12,W,225444,A*31\r\n");
+  TEST_CHECK_INT(g_capture.nb_valid, 1);
+}
+
+
+int main(void)
+{
+  TEST_RUN(test_valid_sentence);
+  TEST_RUN(test_split_sentence);
+  TEST_RUN(test_lowercase_checksum);
+  TEST_RUN(test_empty_fields);
+  TEST_RUN(test_checksum_failure);
+  TEST_RUN(test_truncated_sentence);
+  TEST_RUN(test_overlong_input);
+
+  return TEST_EXIT();
+}
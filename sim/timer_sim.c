@@ -0,0 +1,199 @@
+#include "sim.h"
+
+/**
+ * Simulated clock and general purpose timers.
+ *
+ * Time only moves forward when the runner calls sim_time_advance(), which
+ * makes rendering benchmarks and screenshots reproducible. Running timers
+ * count at TIMER_BASE_CLK/divider and call their ISR callback when their
+ * alarm is reached, as the ESP-IDF timer driver does.
+ **/
+
+typedef struct {
+  bool b_configured;
+  bool b_running;
+  bool b_alarm_en;
+  uint32_t divider;
+  uint64_t counter;
+  uint64_t alarm;
+  uint64_t remainder;
+  timer_isr_t pfn_isr;
+  void *p_isr_arg;
+} sim_timer_t;
+
+static int64_t g_sim_time_us = 0;
+static sim_timer_t g_timers[TIMER_GROUP_MAX][TIMER_MAX];
+
+
+/**
+ * sim_timer_get()
+ *
+ * @brief Get a timer descriptor.
+ * @param group: timer group
+ * @param num: timer index
+ * @return pointer to a `sim_timer_t` structure, NULL if invalid
+ **/
+
+static sim_timer_t *sim_timer_get(timer_group_t group, timer_idx_t num)
+{
+  if ((group >= TIMER_GROUP_MAX) || (num >= TIMER_MAX))
+    return NULL;
+  return &g_timers[group][num];
+}
+
+
+/**
+ * sim_timer_advance()
+ *
+ * @brief Advance a running timer, trigger its alarm if required.
+ * @param p_timer: pointer to a `sim_timer_t` structure
+ * @param us: elapsed time in microseconds
+ **/
+
+static void sim_timer_advance(sim_timer_t *p_timer, uint32_t us)
+{
+  uint64_t ticks;
+
+  if (!p_timer->b_configured || !p_timer->b_running)
+    return;
+
+  /* Convert elapsed time to timer ticks, keep track of remainder. */
+  ticks = (uint64_t)us * (TIMER_BASE_CLK / 1000000) + p_timer->remainder;
+  p_timer->remainder = ticks % p_timer->divider;
+  p_timer->counter += ticks / p_timer->divider;
+
+  if (p_timer->b_alarm_en && (p_timer->counter >= p_timer->alarm))
+  {
+    /* Alarm is disabled when triggered, re-enabled after the callback. */
+    p_timer->b_alarm_en = false;
+    if (p_timer->pfn_isr != NULL)
+      p_timer->pfn_isr(p_timer->p_isr_arg);
+    if (p_timer->alarm > p_timer->counter)
+      p_timer->b_alarm_en = true;
+  }
+}
+
+
+/**
+ * sim_time_get_us()
+ *
+ * @brief Get simulated time.
+ * @return time since simulator start, in microseconds
+ **/
+
+int64_t sim_time_get_us(void)
+{
+  return g_sim_time_us;
+}
+
+
+/**
+ * sim_time_advance()
+ *
+ * @brief Advance simulated time and all running timers.
+ * @param us: number of microseconds
+ **/
+
+void sim_time_advance(uint32_t us)
+{
+  int group, num;
+
+  g_sim_time_us += us;
+  for (group=0; group<TIMER_GROUP_MAX; group++)
+    for (num=0; num<TIMER_MAX; num++)
+      sim_timer_advance(&g_timers[group][num], us);
+}
+
+
+int64_t esp_timer_get_time(void)
+{
+  return g_sim_time_us;
+}
+
+esp_err_t timer_init(timer_group_t group, timer_idx_t num, const timer_config_t *config)
+{
+  sim_timer_t *p_timer = sim_timer_get(group, num);
+
+  if ((p_timer == NULL) || (config->divider < 2))
+    return ESP_ERR_INVALID_ARG;
+
+  memset(p_timer, 0, sizeof(sim_timer_t));
+  p_timer->b_configured = true;
+  p_timer->b_running = (config->counter_en == TIMER_START);
+  p_timer->b_alarm_en = (config->alarm_en == TIMER_ALARM_EN);
+  p_timer->divider = config->divider;
+  return ESP_OK;
+}
+
+esp_err_t timer_set_counter_value(timer_group_t group, timer_idx_t num, uint64_t value)
+{
+  sim_timer_t *p_timer = sim_timer_get(group, num);
+
+  if (p_timer == NULL)
+    return ESP_ERR_INVALID_ARG;
+  p_timer->counter = value;
+  p_timer->remainder = 0;
+  return ESP_OK;
+}
+
+esp_err_t timer_set_alarm_value(timer_group_t group, timer_idx_t num, uint64_t value)
+{
+  sim_timer_t *p_timer = sim_timer_get(group, num);
+
+  if (p_timer == NULL)
+    return ESP_ERR_INVALID_ARG;
+  p_timer->alarm = value;
+  p_timer->b_alarm_en = true;
+  return ESP_OK;
+}
+
+esp_err_t timer_enable_intr(timer_group_t group, timer_idx_t num)
+{
+  return (sim_timer_get(group, num) != NULL)?ESP_OK:ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t timer_isr_callback_add(timer_group_t group, timer_idx_t num, timer_isr_t isr_handler, void *arg, int intr_alloc_flags)
+{
+  sim_timer_t *p_timer = sim_timer_get(group, num);
+
+  if (p_timer == NULL)
+    return ESP_ERR_INVALID_ARG;
+  p_timer->pfn_isr = isr_handler;
+  p_timer->p_isr_arg = arg;
+  return ESP_OK;
+}
+
+esp_err_t timer_start(timer_group_t group, timer_idx_t num)
+{
+  sim_timer_t *p_timer = sim_timer_get(group, num);
+
+  if (p_timer == NULL)
+    return ESP_ERR_INVALID_ARG;
+  p_timer->b_running = true;
+  return ESP_OK;
+}
+
+esp_err_t timer_pause(timer_group_t group, timer_idx_t num)
+{
+  sim_timer_t *p_timer = sim_timer_get(group, num);
+
+  if (p_timer == NULL)
+    return ESP_ERR_INVALID_ARG;
+  p_timer->b_running = false;
+  return ESP_OK;
+}
+
+uint64_t timer_group_get_counter_value_in_isr(timer_group_t group, timer_idx_t num)
+{
+  sim_timer_t *p_timer = sim_timer_get(group, num);
+
+  return (p_timer != NULL)?p_timer->counter:0;
+}
+
+void timer_group_set_alarm_value_in_isr(timer_group_t group, timer_idx_t num, uint64_t value)
+{
+  sim_timer_t *p_timer = sim_timer_get(group, num);
+
+  if (p_timer != NULL)
+    p_timer->alarm = value;
+}
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""
+Encode a 16-bit PCM WAV file into an IMA ADPCM clip for hal/audio_clip.c.
+
+  adpcm_encode.py [--mono] [--block-size N] input.wav output.bin
+  adpcm_encode.py input.wav output.h
+
+With a .h output, the clip is written as a const C array (kept in flash)
+named after the output file, ready for twatch_audio_clip_open().
+
+See inc/hal/audio_clip.h for the clip format.
+"""
+
+import os
+import sys
+import wave
+import struct
+import argparse
+from array import array
+
+MAGIC = b'IMA4'
+
+STEPS = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+]
+
+INDEX_ADJUST = [-1, -1, -1, -1, 2, 4, 6, 8] * 2
+
+
+class Channel:
+    """Encoder state of a channel, updated exactly like the decoder."""
+
+    def __init__(self):
+        self.predictor = 0
+        self.index = 0
+
+    def decode(self, nibble):
+        step = STEPS[self.index]
+        diff = step >> 3
+        if nibble & 1:
+            diff += step >> 2
+        if nibble & 2:
+            diff += step >> 1
+        if nibble & 4:
+            diff += step
+        if nibble & 8:
+            diff = -diff
+        self.predictor = max(-32768, min(32767, self.predictor + diff))
+        self.index = max(0, min(88, self.index + INDEX_ADJUST[nibble]))
+        return self.predictor
+
+    def encode(self, sample):
+        step = STEPS[self.index]
+        diff = sample - self.predictor
+        nibble = 0
+        if diff < 0:
+            nibble = 8
+            diff = -diff
+        for bit in (4, 2, 1):
+            if diff >= step:
+                nibble |= bit
+                diff -= step
+            step >>= 1
+        self.decode(nibble)
+        return nibble
+
+
+def encode(channels_samples, block_size):
+    """Encode per-channel sample lists, return clip data without header."""
+    channels = len(channels_samples)
+    nb_frames = len(channels_samples[0])
+    groups_per_block = block_size // (4 * channels) - 1
+    frames_per_block = 1 + 8 * groups_per_block
+    states = [Channel() for _ in range(channels)]
+    out = bytearray()
+
+    for start in range(0, nb_frames, frames_per_block):
+        # Block header holds the first frame.
+        for c, state in enumerate(states):
+            state.predictor = channels_samples[c][start]
+            out += struct.pack('<hBB', state.predictor, state.index, 0)
+
+        # Whole groups of 8 frames, the last one padded with silence.
+        end = min(start + frames_per_block, nb_frames)
+        for group in range(start + 1, end, 8):
+            for c, state in enumerate(states):
+                samples = channels_samples[c][group:group + 8]
+                samples += [0] * (8 - len(samples))
+                nibbles = [state.encode(s) for s in samples]
+                out += bytes(nibbles[i] | (nibbles[i + 1] << 4) for i in range(0, 8, 2))
+
+    return bytes(out)
+
+
+def read_wav(path, mono):
+    with wave.open(path, 'rb') as wav:
+        if wav.getsampwidth() != 2:
+            raise ValueError('%s: only 16-bit PCM is supported' % path)
+        channels = wav.getnchannels()
+        rate = wav.getframerate()
+        pcm = array('h', wav.readframes(wav.getnframes()))
+    if sys.byteorder == 'big':
+        pcm.byteswap()
+    samples = [list(pcm[c::channels]) for c in range(channels)]
+    if channels > 2 or (mono and channels == 2):
+        samples = [[sum(frame) // channels for frame in zip(*samples)]]
+    return rate, samples
+
+
+def write_c_array(path, data):
+    name = os.path.splitext(os.path.basename(path))[0].replace('-', '_')
+    with open(path, 'w') as out:
+        out.write('/* Generated by tools/adpcm_encode.py, do not edit. */\n')
+        out.write('static const uint8_t %s[%d] = {\n' % (name, len(data)))
+        for offset in range(0, len(data), 16):
+            out.write('  ' + ', '.join('0x%02x' % b for b in data[offset:offset + 16]) + ',\n')
+        out.write('};\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Encode a WAV file into an IMA ADPCM clip.')
+    parser.add_argument('--mono', action='store_true', help='downmix stereo input (half the size)')
+    parser.add_argument('--block-size', type=int, default=256,
+                        help='block size per channel in bytes, multiple of 4 (default: 256)')
+    parser.add_argument('input', help='16-bit PCM WAV file')
+    parser.add_argument('output', help='clip file (.bin) or C header (.h)')
+    args = parser.parse_args()
+
+    if args.block_size < 8 or args.block_size % 4:
+        parser.error('block size must be a multiple of 4, at least 8')
+
+    rate, samples = read_wav(args.input, args.mono)
+    channels = len(samples)
+    block_size = args.block_size * channels
+    data = encode(samples, block_size)
+    clip = MAGIC + struct.pack('<IIHBB', rate, len(samples[0]), block_size, channels, 0) + data
+
+    if args.output.endswith('.h'):
+        write_c_array(args.output, clip)
+    else:
+        with open(args.output, 'wb') as out:
+            out.write(clip)
+
+    sys.stderr.write('%d frames, %d channel(s) at %d Hz: %d bytes\n' % (
+        len(samples[0]), channels, rate, len(clip)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
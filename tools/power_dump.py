@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""
+Extract a power profiler dump from the serial console.
+
+Call twatch_profiler_dump() on the watch, then capture it:
+
+  power_dump.py /dev/ttyUSB0 power.csv
+
+or extract it from a saved console log ('-' reads stdin):
+
+  power_dump.py console.log power.csv
+
+Samples are written as CSV and the per-subsystem attribution is printed.
+See inc/hal/profiler.h for the dump format.
+"""
+
+import os
+import sys
+
+FLAG_SCREEN = 1 << 0
+FLAG_GPS = 1 << 1
+FLAG_AUDIO = 1 << 2
+FLAG_TOUCH_ACTIVE = 1 << 3
+FLAG_TOUCH_MONITOR = 1 << 4
+FLAG_VBUS = 1 << 5
+
+
+def read_lines(source):
+    if source == '-':
+        for line in sys.stdin:
+            yield line
+    elif os.path.exists(source) and not os.path.isfile(source):
+        import serial
+        with serial.Serial(source, 115200, timeout=None) as port:
+            while True:
+                yield port.readline().decode('ascii', 'replace')
+    else:
+        with open(source, 'r', errors='replace') as f:
+            for line in f:
+                yield line
+
+
+def parse(lines):
+    """Return (samples, load, attribution) of the first complete dump."""
+    samples = []
+    attribution = []
+    load = None
+    in_dump = False
+    for line in lines:
+        line = line.strip()
+        if line.startswith('#PROF-BEGIN'):
+            samples, attribution, load = [], [], None
+            in_dump = True
+        elif not in_dump:
+            continue
+        elif line.startswith('#PROF-END'):
+            return samples, load, attribution
+        elif line.startswith('#PROF-LOAD'):
+            load = float(line.split()[1])
+        elif line.startswith('#PROF-ATTR'):
+            name, cost, share = line.split(None, 1)[1].split(',')
+            attribution.append((name, float(cost), float(share)))
+        elif line and line[0].isdigit():
+            t_ms, batt_ma, vbus_ma, backlight, flags, cpu_mhz = (int(v) for v in line.split(','))
+            samples.append((t_ms, batt_ma, vbus_ma, backlight, flags, cpu_mhz))
+    raise ValueError('no complete dump found')
+
+
+def to_csv(samples, out):
+    out.write('t_ms,batt_ma,vbus_ma,load_ma,backlight,screen,gps,audio,touch,vbus,cpu_mhz\n')
+    for t_ms, batt_ma, vbus_ma, backlight, flags, cpu_mhz in samples:
+        if flags & FLAG_TOUCH_ACTIVE:
+            touch = 'active'
+        elif flags & FLAG_TOUCH_MONITOR:
+            touch = 'monitor'
+        else:
+            touch = 'hibernate'
+        out.write('%d,%d,%d,%d,%d,%d,%d,%d,%s,%d,%d\n' % (
+            t_ms, batt_ma, vbus_ma, vbus_ma - batt_ma, backlight,
+            bool(flags & FLAG_SCREEN), bool(flags & FLAG_GPS), bool(flags & FLAG_AUDIO),
+            touch, bool(flags & FLAG_VBUS), cpu_mhz))
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.stderr.write('usage: %s <port|log|-> [power.csv]\n' % sys.argv[0])
+        return 1
+    samples, load, attribution = parse(read_lines(sys.argv[1]))
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], 'w') as out:
+            to_csv(samples, out)
+    sys.stderr.write('%d samples\n' % len(samples))
+    if load is not None:
+        sys.stderr.write('average load: %.1f mA\n' % load)
+        sys.stderr.write('%-10s %10s %10s\n' % ('subsystem', 'cost mA', 'share mA'))
+        for name, cost, share in attribution:
+            sys.stderr.write('%-10s %10.1f %10.1f\n' % (name, cost, share))
+    if len(sys.argv) == 2:
+        to_csv(samples, sys.stdout)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""
+Convert a dump of the GPS track partition into a GPX file.
+
+Dump the partition with:
+
+  parttool.py read_partition --partition-name=track --output=track.bin
+
+then convert it:
+
+  track2gpx.py track.bin track.gpx
+
+See inc/hal/gps_track.h for the record format.
+"""
+
+import sys
+import struct
+from datetime import datetime, timedelta, timezone
+
+PAGE_SIZE = 256
+
+TAG_KEY = 0x01
+TAG_SEGMENT = 0x02
+TAG_DELTA = 0x03
+TAG_ERASED = 0xFF
+
+EPOCH = datetime(2000, 1, 1, tzinfo=timezone.utc)
+
+
+def read_varint(page, pos):
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(page) or shift > 28:
+            raise ValueError('truncated varint')
+        byte = page[pos]
+        pos += 1
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode(data):
+    """Yield (lat, lng, timestamp, new_segment) tuples, lat/lng in 1e-7 degrees."""
+    lat = lng = timestamp = 0
+    for offset in range(0, len(data) - PAGE_SIZE + 1, PAGE_SIZE):
+        page = data[offset:offset + PAGE_SIZE]
+        if page[0] == TAG_ERASED:
+            return
+        pos = 0
+        try:
+            while pos < PAGE_SIZE and page[pos] != TAG_ERASED:
+                tag = page[pos]
+                pos += 1
+                if tag in (TAG_KEY, TAG_SEGMENT):
+                    lat, lng, timestamp = struct.unpack_from('<iiI', page, pos)
+                    pos += 12
+                    yield lat, lng, timestamp, tag == TAG_SEGMENT
+                elif tag == TAG_DELTA:
+                    dlat, pos = read_varint(page, pos)
+                    dlng, pos = read_varint(page, pos)
+                    dt, pos = read_varint(page, pos)
+                    lat += unzigzag(dlat)
+                    lng += unzigzag(dlng)
+                    timestamp += dt
+                    yield lat, lng, timestamp, False
+                else:
+                    raise ValueError('unknown tag 0x%02x' % tag)
+        except (ValueError, struct.error) as err:
+            sys.stderr.write('page at 0x%x: %s, skipped\n' % (offset, err))
+
+
+def to_gpx(points, out):
+    out.write('<?xml version="1.0" encoding="UTF-8"?>\n')
+    out.write('<gpx version="1.1" creator="twatch-lib" xmlns="http://www.topografix.com/GPX/1/1">\n')
+    out.write('<trk>\n')
+    in_segment = False
+    for lat, lng, timestamp, new_segment in points:
+        if new_segment or not in_segment:
+            if in_segment:
+                out.write('</trkseg>\n')
+            out.write('<trkseg>\n')
+            in_segment = True
+        time = (EPOCH + timedelta(seconds=timestamp)).strftime('%Y-%m-%dT%H:%M:%SZ')
+        out.write('<trkpt lat="%.7f" lon="%.7f"><time>%s</time></trkpt>\n' % (lat / 1e7, lng / 1e7, time))
+    if in_segment:
+        out.write('</trkseg>\n')
+    out.write('</trk>\n')
+    out.write('</gpx>\n')
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.stderr.write('usage: %s <track.bin> [track.gpx]\n' % sys.argv[0])
+        return 1
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], 'w') as out:
+            to_gpx(decode(data), out)
+    else:
+        to_gpx(decode(data), sys.stdout)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
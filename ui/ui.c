@@ -2,9 +2,6 @@
 #include "ui/widget.h"
 #include "hal/vibrate.h"
 
-#define TIMER_DIVIDER         (16)  //  Hardware timer clock divider
-#define TIMER_SCALE           (TIMER_BASE_CLK / TIMER_DIVIDER)  // convert counter value to seconds
-
 int ui_forward_event_to_widget(touch_event_type_t state, int x, int y, int velocity);
 
 /**
@@ -15,26 +12,55 @@ ui_t g_ui;
 
 
 /**
- * ui_inactivity_timer_cb()
- * 
- * @brief: This callback is called after X seconds of inactivity.
- * @param args: callback argument, shall be NULL.
- * @return: true if we need to yield at the end of ISR, false otherwise.
+ * UI state kept in RTC memory during deep sleep (see ui_resume()). The
+ * current tile is saved as the moves leading to it from the default tile.
+ **/
+
+#define UI_RESUME_MAGIC       0x55495253
+#define UI_RESUME_MAX_DEPTH   8
+#define UI_RESUME_MAX_TILES   32
+
+typedef struct {
+  uint32_t magic;
+  bool b_eco_mode_enabled;
+  int idle_delay_ms;
+  int idle_refresh_ms;
+  int path_len;
+  uint8_t path[UI_RESUME_MAX_DEPTH];
+} ui_resume_state_t;
+
+RTC_DATA_ATTR static ui_resume_state_t g_ui_resume;
+
+
+/**
+ * ui_eco_arm()
+ *
+ * @brief: Arm eco mode timer. Deadlines are checked against esp_timer,
+ *         that keeps counting in light sleep (timer groups do not).
+ * @param delay_s: delay in seconds, 0 to disarm.
  **/
 
-static bool IRAM_ATTR ui_inactivity_timer_cb(void *args)
+static void ui_eco_arm(int delay_s)
 {
-    BaseType_t high_task_awoken = pdFALSE;
- 
-    uint64_t timer_counter_value = timer_group_get_counter_value_in_isr(TIMER_GROUP_1, TIMER_1);
+  if (delay_s > 0)
+    g_ui.eco_deadline_us = esp_timer_get_time() + (int64_t)delay_s * 1000000;
+  else
+    g_ui.eco_deadline_us = 0;
+}
 
-    /* Inactivity detected. */
-    g_ui.b_inactivity_detected = true;
 
-    timer_counter_value += 5 * TIMER_SCALE;
-    timer_group_set_alarm_value_in_isr(TIMER_GROUP_1, TIMER_1, timer_counter_value);
+/**
+ * ui_pmu_event_handler()
+ *
+ * @brief: Wake up UI on PMU events (user button, USB plugged).
+ * @param p_event: pointer to a `pmu_event_t` structure
+ * @param p_user_data: not used
+ **/
 
-    return high_task_awoken == pdTRUE; // return whether we need to yield at the end of ISR
+static void ui_pmu_event_handler(pmu_event_t *p_event, void *p_user_data)
+{
+  if ((p_event->type == PMU_EVENT_SHORT_PRESS) || (p_event->type == PMU_EVENT_VBUS_IN))
+    xSemaphoreGive(g_ui.wakeup);
 }
 
 /**
@@ -46,8 +72,9 @@ void ui_init(void)
   /* Initialize the touch screen. */
   twatch_touch_init();
 
-  /* Create our mutex. */
+  /* Create our mutex and wake-up semaphore. */
   g_ui.mutex = xSemaphoreCreateMutex();
+  g_ui.wakeup = xSemaphoreCreateBinary();
 
   /* Set current and default tiles as none. */
   g_ui.p_current_tile = NULL;
@@ -67,24 +94,18 @@ void ui_init(void)
   /* Initialize our eco timer. */
   g_ui.b_usb_plugged = twatch_pmu_is_usb_plugged(true);
   g_ui.b_eco_mode_enabled = false;
-  g_ui.b_inactivity_detected = false;
+  g_ui.eco_deadline_us = 0;
   g_ui.eco_max_inactivity = 15; /* Inactivity set to 15 sec by default. */
   g_ui.eco_max_inactivity_to_deepsleep = 60; /* Second inactivity set to 60 by default */ 
-  g_ui.eco_timer.divider = TIMER_DIVIDER;
-  g_ui.eco_timer.counter_dir = TIMER_COUNT_UP;
-  g_ui.eco_timer.counter_en = TIMER_PAUSE;
-  g_ui.eco_timer.alarm_en = TIMER_ALARM_EN;
-  g_ui.eco_timer.auto_reload = false;
-  timer_init(TIMER_GROUP_1, TIMER_1, &g_ui.eco_timer);
-
-  /* Timer's counter will initially start from value below.
-      Also, if auto_reload is set, this value will be automatically reload on alarm */
-  timer_set_counter_value(TIMER_GROUP_1, TIMER_1, 0);
-
-  /* Configure the alarm value and the interrupt on alarm. */
-  timer_set_alarm_value(TIMER_GROUP_1, TIMER_1, g_ui.eco_max_inactivity * TIMER_SCALE);
-  timer_enable_intr(TIMER_GROUP_1, TIMER_1);
-  timer_isr_callback_add(TIMER_GROUP_1, TIMER_1, ui_inactivity_timer_cb, NULL, ESP_INTR_FLAG_IRAM);
+
+  /* Stay awake until idle, wake up on touch and PMU activity. */
+  g_ui.b_idle = false;
+  g_ui.idle_delay_ms = UI_IDLE_DELAY_MS;
+  g_ui.idle_refresh_ms = UI_IDLE_REFRESH_MS;
+  g_ui.last_activity_us = esp_timer_get_time();
+  twatch_power_keep_awake(true);
+  twatch_touch_set_wakeup(g_ui.wakeup);
+  twatch_pmu_subscribe(ui_pmu_event_handler, NULL);
 }
 
 
@@ -249,6 +270,100 @@ void ui_go_down(void)
   ui_swipe_up();
 }
 
+/**
+ * ui_tile_link()
+ *
+ * @brief: Get the tile linked to a tile in a given direction.
+ * @param p_tile: pointer to a `tile_t` structure
+ * @param direction: link direction
+ * @return: pointer to linked tile, NULL if none
+ **/
+
+static tile_t *ui_tile_link(tile_t *p_tile, ui_move_dir direction)
+{
+  switch (direction)
+  {
+    case MOVE_LEFT:
+      return p_tile->p_left;
+
+    case MOVE_RIGHT:
+      return p_tile->p_right;
+
+    case MOVE_UP:
+      return p_tile->p_top;
+
+    case MOVE_DOWN:
+      return p_tile->p_bottom;
+  }
+
+  return NULL;
+}
+
+
+/**
+ * ui_find_tile_path()
+ *
+ * @brief: Find the shortest path of moves from the default tile to a tile.
+ * @param p_tile: pointer to the `tile_t` structure to reach
+ * @param p_path: pointer to an array of UI_RESUME_MAX_DEPTH moves
+ * @return: number of moves, -1 if tile cannot be reached
+ **/
+
+static int ui_find_tile_path(tile_t *p_tile, uint8_t *p_path)
+{
+  tile_t *tiles[UI_RESUME_MAX_TILES];
+  int parents[UI_RESUME_MAX_TILES];
+  uint8_t moves[UI_RESUME_MAX_TILES];
+  int nb_tiles, nb_moves, i, j, depth;
+  ui_move_dir direction;
+  tile_t *p_next;
+
+  if (g_ui.p_default_tile == NULL)
+    return -1;
+
+  /* Breadth-first search from default tile. */
+  tiles[0] = g_ui.p_default_tile;
+  parents[0] = -1;
+  nb_tiles = 1;
+  for (i=0; i<nb_tiles; i++)
+  {
+    if (tiles[i] == p_tile)
+    {
+      depth = 0;
+      for (j=i; parents[j] >= 0; j=parents[j])
+        depth++;
+      if (depth > UI_RESUME_MAX_DEPTH)
+        return -1;
+
+      /* Store moves, last one first. */
+      nb_moves = depth;
+      for (j=i; parents[j] >= 0; j=parents[j])
+        p_path[--depth] = moves[j];
+      return nb_moves;
+    }
+
+    for (direction=MOVE_LEFT; direction<=MOVE_DOWN; direction++)
+    {
+      p_next = ui_tile_link(tiles[i], direction);
+      if (p_next == NULL)
+        continue;
+
+      for (j=0; (j<nb_tiles) && (tiles[j] != p_next); j++);
+      if ((j == nb_tiles) && (nb_tiles < UI_RESUME_MAX_TILES))
+      {
+        tiles[nb_tiles] = p_next;
+        parents[nb_tiles] = i;
+        moves[nb_tiles] = direction;
+        nb_tiles++;
+      }
+    }
+  }
+
+  /* Not found. */
+  return -1;
+}
+
+
 /**
  * __ui_deepsleep_activate()
  * 
@@ -257,8 +372,25 @@ void ui_go_down(void)
 void __ui_deepsleep_activate()
 {
   printf("[userbtn] Sleep mode enabled\r\n");
+
+  /* Save UI state and last frame, to resume where we left. */
+  g_ui_resume.b_eco_mode_enabled = g_ui.b_eco_mode_enabled;
+  g_ui_resume.idle_delay_ms = g_ui.idle_delay_ms;
+  g_ui_resume.idle_refresh_ms = g_ui.idle_refresh_ms;
+  g_ui_resume.path_len = ui_find_tile_path(g_ui.p_current_tile, g_ui_resume.path);
+  g_ui_resume.magic = UI_RESUME_MAGIC;
+  twatch_screen_save_snapshot();
+
   st7789_blank();
   st7789_commit_fb();
+
+  /**
+   * Hibernate touch controller while I2C is still usable. Screen power-down
+   * in twatch_pmu_deepsleep() does not reset it, it stays in hibernation
+   * until the reset that follows screen power-up on wake.
+   **/
+
+  twatch_touch_set_power_mode(TOUCH_MODE_HIBERNATE);
   twatch_pmu_deepsleep();
 }
 
@@ -272,14 +404,14 @@ void __ui_deepsleep_activate()
 void reset_inactivity_timer(void)
 {
   /* Reset inactivity timer. */
-  g_ui.b_inactivity_detected = false;
   g_ui.screen_mode = SCREEN_MODE_NORMAL;
-  timer_set_counter_value(TIMER_GROUP_1, TIMER_1, 0);
-  timer_set_alarm_value(TIMER_GROUP_1, TIMER_1, g_ui.eco_max_inactivity * TIMER_SCALE);
-  timer_start(TIMER_GROUP_1, TIMER_1);
+  ui_eco_arm(g_ui.eco_max_inactivity);
 
   /* Make sure backlight is correctly set. */
   twatch_screen_set_backlight(twatch_screen_get_default_backlight());
+
+  /* Touch controller back to full report rate. */
+  twatch_touch_set_power_mode(TOUCH_MODE_ACTIVE);
 }
 
 
@@ -292,14 +424,18 @@ void reset_inactivity_timer(void)
 void ui_process_events(void)
 {
   touch_event_t touch;
+  int64_t now, wait_us;
 
   ui_enter_critical_section();
+  now = esp_timer_get_time();
 
   /* Process touch events if we are not in an animation. */
   if (g_ui.state == UI_STATE_IDLE)
   {
-    if (twatch_get_touch_event(&touch, 1) == ESP_OK)
+    if (twatch_get_touch_event(&touch, g_ui.b_idle ? 0 : 1) == ESP_OK)
     {
+      g_ui.last_activity_us = now;
+
       if (g_ui.b_eco_mode_enabled)
       {
         reset_inactivity_timer();
@@ -380,9 +516,9 @@ void ui_process_events(void)
     else
     {
       /* Handle inactivity. */
-      if (g_ui.b_inactivity_detected && g_ui.b_eco_mode_enabled)
+      if (g_ui.b_eco_mode_enabled && (g_ui.eco_deadline_us != 0) && (now >= g_ui.eco_deadline_us))
       {     
-        g_ui.b_inactivity_detected = false;
+        g_ui.eco_deadline_us = 0;
 
         switch (g_ui.screen_mode)
         {
@@ -391,6 +527,9 @@ void ui_process_events(void)
             twatch_screen_set_backlight(100);
             g_ui.screen_mode = SCREEN_MODE_DIMMED;
 
+            /* Lower touch report rate until next touch. */
+            twatch_touch_set_power_mode(TOUCH_MODE_MONITOR);
+
             /* If not on a secondary tile, move to default tile. */
             if (g_ui.p_current_tile->t_type != TILE_SECONDARY)
             {
@@ -398,21 +537,11 @@ void ui_process_events(void)
             }
 
             /* Activate second alarm for switch in deepsleep mode if necessary */
-            if (g_ui.eco_max_inactivity_to_deepsleep != 0)
-            {
-              timer_set_counter_value(TIMER_GROUP_1, TIMER_1, 0);
-              timer_set_alarm_value(TIMER_GROUP_1, TIMER_1, g_ui.eco_max_inactivity_to_deepsleep * TIMER_SCALE);
-              timer_start(TIMER_GROUP_1, TIMER_1);
-            }
-            else
-            {
-              timer_pause(TIMER_GROUP_1, TIMER_1);
-            }
+            ui_eco_arm(g_ui.eco_max_inactivity_to_deepsleep);
             break;
 
           /* Switch screen to deepsleep */  
           case SCREEN_MODE_DIMMED:
-            timer_pause(TIMER_GROUP_1, TIMER_1);
             __ui_deepsleep_activate();
             break;
         }
@@ -424,6 +553,7 @@ void ui_process_events(void)
   if (twatch_pmu_is_userbtn_pressed())
   {
     /* Reset inactivity timer as user pressed the button. */
+    g_ui.last_activity_us = now;
     reset_inactivity_timer();
 
     /* Do we have a modal tile displayed ? */
@@ -470,12 +600,14 @@ void ui_process_events(void)
   if (twatch_pmu_is_usb_plugged(false) && !g_ui.b_usb_plugged)
   {
     g_ui.b_usb_plugged = true;
+    g_ui.last_activity_us = now;
     ui_wakeup();
   }
   else
     g_ui.b_usb_plugged = false;
 
-  /* Refresh screen. */
+  /* Refresh screen at full speed. */
+  twatch_power_boost(true);
   st7789_blank();
   switch(g_ui.state)
   {
@@ -646,7 +778,38 @@ void ui_process_events(void)
   }
   st7789_commit_fb();
 
+  /* Keep boosting while animating, animations count as activity. */
+  if (g_ui.state != UI_STATE_IDLE)
+    g_ui.last_activity_us = now;
+  else
+    twatch_power_boost(false);
+
+  /* Enter or leave idle tier. */
+  if ((now - g_ui.last_activity_us) >= ((int64_t)g_ui.idle_delay_ms * 1000))
+  {
+    if (!g_ui.b_idle)
+    {
+      g_ui.b_idle = true;
+      xSemaphoreTake(g_ui.wakeup, 0);
+      twatch_power_keep_awake(false);
+    }
+  }
+  else if (g_ui.b_idle)
+  {
+    g_ui.b_idle = false;
+    twatch_power_keep_awake(true);
+  }
+
   ui_leave_critical_section();
+
+  /* Idle: wait for activity, next refresh or eco deadline. */
+  if (g_ui.b_idle)
+  {
+    wait_us = (int64_t)g_ui.idle_refresh_ms * 1000;
+    if (g_ui.b_eco_mode_enabled && (g_ui.eco_deadline_us != 0) && ((g_ui.eco_deadline_us - now) < wait_us))
+      wait_us = (g_ui.eco_deadline_us > now) ? (g_ui.eco_deadline_us - now) : 0;
+    xSemaphoreTake(g_ui.wakeup, (TickType_t)(wait_us / 1000 / portTICK_PERIOD_MS));
+  }
 }
 
 /**
@@ -809,11 +972,7 @@ void enable_ecomode(void)
 {
   /* Start our timer. */
   g_ui.b_eco_mode_enabled = true;
-
-  /* Reset counter value and alarm value. */
-  timer_set_counter_value(TIMER_GROUP_1, TIMER_1, 0);
-  timer_set_alarm_value(TIMER_GROUP_1, TIMER_1, g_ui.eco_max_inactivity * TIMER_SCALE);
-  timer_start(TIMER_GROUP_1, TIMER_1);
+  ui_eco_arm(g_ui.eco_max_inactivity);
 }
 
 /**
@@ -826,7 +985,7 @@ void disable_ecomode(void)
 {
   /* Stop our timer. */
   g_ui.b_eco_mode_enabled = false;
-  timer_pause(TIMER_GROUP_1, TIMER_1);
+  ui_eco_arm(0);
 }
 
 
@@ -841,10 +1000,69 @@ void ui_wakeup(void)
   /* Set default backlight. */
   twatch_screen_set_backlight(twatch_screen_get_default_backlight());
 
-  /* Reset counter value and alarm value. */
-  timer_set_counter_value(TIMER_GROUP_1, TIMER_1, 0);
-  timer_set_alarm_value(TIMER_GROUP_1, TIMER_1, g_ui.eco_max_inactivity * TIMER_SCALE);
-  timer_start(TIMER_GROUP_1, TIMER_1);
+  /* Touch controller back to full report rate. */
+  twatch_touch_set_power_mode(TOUCH_MODE_ACTIVE);
+
+  /* Reset eco timer, leave idle tier right away. */
+  ui_eco_arm(g_ui.eco_max_inactivity);
+  g_ui.last_activity_us = esp_timer_get_time();
+  xSemaphoreGive(g_ui.wakeup);
+}
+
+
+/**
+ * ui_set_idle_timing()
+ *
+ * @brief: Set idle tier timing.
+ * @param delay_ms: inactivity delay before entering idle tier.
+ * @param refresh_ms: screen refresh period while idle.
+ **/
+
+void ui_set_idle_timing(int delay_ms, int refresh_ms)
+{
+  g_ui.idle_delay_ms = delay_ms;
+  g_ui.idle_refresh_ms = refresh_ms;
+}
+
+
+/**
+ * ui_resume()
+ *
+ * @brief: Restore UI state saved before deep sleep: eco mode, idle timing
+ *         and current tile. Must be called once tiles are created and
+ *         linked, and the default tile selected.
+ * @return: true if UI state has been restored, false on cold boot.
+ **/
+
+bool ui_resume(void)
+{
+  tile_t *p_tile;
+  int i;
+
+  if (!twatch_pmu_is_resuming() || (g_ui_resume.magic != UI_RESUME_MAGIC))
+    return false;
+  g_ui_resume.magic = 0;
+
+  /* Restore eco mode and idle tier settings. */
+  ui_set_idle_timing(g_ui_resume.idle_delay_ms, g_ui_resume.idle_refresh_ms);
+  if (g_ui_resume.b_eco_mode_enabled)
+    enable_ecomode();
+  else
+    disable_ecomode();
+
+  /* Walk from default tile to the tile displayed before deep sleep. */
+  if ((g_ui.p_default_tile != NULL) && (g_ui_resume.path_len >= 0))
+  {
+    p_tile = g_ui.p_default_tile;
+    for (i=0; (i<g_ui_resume.path_len) && (p_tile != NULL); i++)
+      p_tile = ui_tile_link(p_tile, g_ui_resume.path[i]);
+
+    if ((p_tile != NULL) && (p_tile != g_ui.p_current_tile))
+      ui_select_tile(p_tile);
+  }
+
+  /* Success. */
+  return true;
 }
 
 